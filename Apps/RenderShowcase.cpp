@@ -1,8 +1,13 @@
 #include "RenderShowcase.h"
 #include "RenderManager.h"
 #include "RenderPipeline.h"
+#include "GPUCullingPipeline.h"
 #include "ShaderUtil.h"
 #include "BasicMeshUtil.h"
+#include "TextureCache.h"
+#include "ProgramCache.h"
+#include "TextureResidency.h"
+#include "ChannelPacker.h"
 
 using namespace Graphics;
 
@@ -20,7 +25,12 @@ namespace Application
         if (WindowApplication::Initialize() != 0)
             return -1;
 
-        auto rp = std::make_shared<RenderPipeline>();
+        // static meshes are culled and drawn indirectly when the driver can
+        RenderPipeline::SP rp;
+        if (GPUCullingPipeline::IsSupported())
+            rp = std::make_shared<GPUCullingPipeline>();
+        else
+            rp = std::make_shared<RenderPipeline>();
         RenderManager::Instance()->SetCurrentPipeline(rp);
 
         mArrowMesh = GenArrowMesh(0.02f, 0.04f, 1, false);
@@ -28,37 +38,33 @@ namespace Application
         mSphereMesh = GenSphereMesh(0.2f, 50);
         // mSphereMesh = GenCubeMesh(Eigen::Vector3f(0.2, 0.2, 0.2));
 
-        mAlbedo = RenderManager::Instance()->AllocTexture(TextureType_2D, TextureFormat_R8G8B8, true);
-        mAlbedo->SetFilter(TextureFilter_LinearMipmapLinear, TextureFilter_Linear);
-        mAlbedo->SetWrapMode(TextureWrapMode_Repeat, TextureWrapMode_Repeat);
-        mAlbedo->LoadFromFile("Resources/copper/dull-copper_albedo.png");
-
-        mNormal = RenderManager::Instance()->AllocTexture(TextureType_2D, TextureFormat_R8G8B8A8, true);
-        mNormal->SetFilter(TextureFilter_LinearMipmapLinear, TextureFilter_Linear);
-        mNormal->SetWrapMode(TextureWrapMode_Repeat, TextureWrapMode_Repeat);
-        mNormal->LoadFromFile("Resources/copper/dull-copper_normal-dx.png");
-
-        mMetallic = RenderManager::Instance()->AllocTexture(TextureType_2D, TextureFormat_R8G8B8, true);
-        mMetallic->SetFilter(TextureFilter_LinearMipmapLinear, TextureFilter_Linear);
-        mMetallic->SetWrapMode(TextureWrapMode_Repeat, TextureWrapMode_Repeat);
-        mMetallic->LoadFromFile("Resources/copper/dull-copper_metallic.png");
-
-        mAo = RenderManager::Instance()->AllocTexture(TextureType_2D, TextureFormat_R8G8B8A8, true);
-        mAo->SetFilter(TextureFilter_LinearMipmapLinear, TextureFilter_Linear);
-        mAo->SetWrapMode(TextureWrapMode_Repeat, TextureWrapMode_Repeat);
-        mAo->LoadFromFile("Resources/copper/dull-copper_ao.png");
-
-        mRoughness = RenderManager::Instance()->AllocTexture(TextureType_2D, TextureFormat_R8G8B8, true);
-        mRoughness->SetFilter(TextureFilter_LinearMipmapLinear, TextureFilter_Linear);
-        mRoughness->SetWrapMode(TextureWrapMode_Repeat, TextureWrapMode_Repeat);
-        mRoughness->LoadFromFile("Resources/copper/dull-copper_roughness.png");
-
-        mShaderProgram = ShaderUtil::LoadProgramFromTinySL("Graphics/shaders/basic_pbr.tinysl");
-        mMaterialCopper = std::make_shared<BasicPBRMaterial>(mShaderProgram);
-        mMaterialBlock = std::make_shared<BasicPBRMaterial>(mShaderProgram);
-        mMaterialBlackWhite = std::make_shared<BasicPBRMaterial>(mShaderProgram);
-
-        mMaterialBlock->SetValue("mainColor", Eigen::Vector4f(1, 1, 1, 1));
+        const int waveGrid = 32;
+        mWaveSource = std::make_shared<DynamicVertexDataSource>(LayoutName_Position | LayoutName_Normal | LayoutName_UV0 | LayoutName_Tangent | LayoutName_Bitangent,
+                                                                (waveGrid + 1) * (waveGrid + 1), waveGrid * waveGrid * 6);
+
+        // ao, roughness and metallic are packed into one texture once, later runs reuse the imported file.
+        // Imported files are build products and stay out of Resources
+        const char *copperOrmPath = "ImportCache/copper/dull-copper_orm.png";
+        ChannelPacker::ImportORM("Resources/copper/dull-copper_ao.png", "Resources/copper/dull-copper_roughness.png",
+                                 "Resources/copper/dull-copper_metallic.png", copperOrmPath);
+
+        // bundles of "shader_bundles" target skip parsing, sources are parsed when there is none
+        ShaderUtil::SetShaderBundleDirectory("ShaderBundles/");
+        // all programs are compiled by the driver together, meshes are drawn with the fallback until theirs are ready
+        RenderManager::Instance()->SetFallbackProgram(ShaderUtil::LoadProgramFromTinySL("Graphics/shaders/fallback.tinysl"));
+        mPbrVariants = ShaderUtil::LoadVariantsFromTinySL("Graphics/shaders/basic_pbr.tinysl");
+        mOrmShaderProgram = ShaderUtil::LoadProgramFromTinySL("Graphics/shaders/basic_pbr_orm.tinysl");
+        mArrayShaderProgram = ShaderUtil::LoadProgramFromTinySL("Graphics/shaders/basic_pbr_array.tinysl");
+
+        // 4 lights are collected, black white tiles have no roughness map
+        auto blockKeywords = mPbrVariants->GetKeywordMask({"METALLIC_MAP", "ROUGHNESS_MAP", "AO_MAP", "NORMAL_MAP", "LIGHT_COUNT_4"});
+        auto blackWhiteKeywords = mPbrVariants->GetKeywordMask({"METALLIC_MAP", "AO_MAP", "NORMAL_MAP", "LIGHT_COUNT_4"});
+        mMaterialCopper = std::make_shared<BasicPBRMaterial>(mOrmShaderProgram);
+        mMaterialBlock = std::make_shared<BasicPBRMaterial>(mPbrVariants, blockKeywords);
+        mMaterialBlackWhite = std::make_shared<BasicPBRMaterial>(mPbrVariants, blackWhiteKeywords);
+        RenderManager::Instance()->BuildShaderProgramsAsync();
+
+        mMaterialBlock->SetValue(GFX_PROPERTY("mainColor"), Eigen::Vector4f(1, 1, 1, 1));
         const char *texs[5] = {"Resources/cobble/dusty-cobble_albedo.png",
                                "Resources/cobble/dusty-cobble_metallic.png",
                                "Resources/cobble/dusty-cobble_roughness.png",
@@ -73,14 +79,19 @@ namespace Application
         };
         mMaterialBlock->LoadTextures(texs, formats);
 
-        mMaterialCopper->SetValue("mainColor", Eigen::Vector4f(1, 1, 1, 1));
-        mMaterialCopper->SetTexture("roughnessTex", mRoughness);
-        mMaterialCopper->SetTexture("metallicTex", mMetallic);
-        mMaterialCopper->SetTexture("albedoTex", mAlbedo);
-        mMaterialCopper->SetTexture("aoTex", mAo);
-        mMaterialCopper->SetTexture("normalTex", mNormal);
+        // without S3TC a BC1 texture would stay incomplete and sample black
+        TextureFormat albedoFormat = RenderManager::Instance()->IsFormatSupported(TextureFormat_BC1) ? TextureFormat_BC1 : TextureFormat_R8G8B8A8;
 
-        mMaterialBlackWhite->SetValue("mainColor", Eigen::Vector4f(1, 1, 1, 1));
+        // decoded and block compressed on worker threads, uploaded over next frames, materials show placeholders meanwhile
+        mMaterialCopper->SetValue(GFX_PROPERTY("mainColor"), Eigen::Vector4f(1, 1, 1, 1));
+        const char *copperTexs[3] = {"Resources/copper/dull-copper_albedo.png", copperOrmPath, "Resources/copper/dull-copper_normal-dx.png"};
+        TextureFormat copperFormats[3] = {
+            albedoFormat,
+            RenderManager::Instance()->IsFormatSupported(TextureFormat_BC7) ? TextureFormat_BC7 : TextureFormat_R8G8B8,
+            TextureFormat_BC5};
+        mMaterialCopper->LoadTexturesORM(copperTexs, copperFormats);
+
+        mMaterialBlackWhite->SetValue(GFX_PROPERTY("mainColor"), Eigen::Vector4f(1, 1, 1, 1));
         const char *blackWhiteTexs[5] = {
             "Resources/black_white/black-white-tile_albedo.png",
             "Resources/black_white/black-white-tile_metallic.png",
@@ -95,6 +106,56 @@ namespace Application
             TextureFormat_R8G8B8,
             TextureFormat_R8G8B8};
         mMaterialBlackWhite->LoadTextures(blackWhiteTexs, blackWhiteFormats);
+
+        // same size and formats, so both land in layers of one texture set and share a material
+        TextureFormat setFormats[5] = {albedoFormat, TextureFormat_BC4, TextureFormat_BC4, TextureFormat_BC4, TextureFormat_BC5};
+        const char *copperSetTexs[5] = {
+            "Resources/copper/dull-copper_albedo.png",
+            "Resources/copper/dull-copper_metallic.png",
+            "Resources/copper/dull-copper_roughness.png",
+            "Resources/copper/dull-copper_ao.png",
+            "Resources/copper/dull-copper_normal-dx.png"};
+        auto setManager = TextureSetManager::Instance();
+        setManager->Load(copperSetTexs, setFormats, 5, mCopperSlice);
+        setManager->Load(blackWhiteTexs, setFormats, 5, mBlackWhiteSlice);
+
+        mMaterialArray = std::make_shared<BasicPBRMaterial>(mArrayShaderProgram);
+        mMaterialArray->SetValue(GFX_PROPERTY("mainColor"), Eigen::Vector4f(1, 1, 1, 1));
+        if (mCopperSlice.IsValid())
+            mMaterialArray->SetTextureSet(mCopperSlice.set);
+
+        // everything but the wave stays where it is, so it is kept in the scene instead of drawn every frame
+        mScene = std::make_shared<RenderScene>();
+        Light l;
+        l.lightColor = Eigen::Vector3f(1, 1, 1);
+        l.lightType = 0;
+        l.lightPos = Eigen::Vector3f(1, 1, 1);
+        l.intensity = 1;
+        mScene->AddLight(l);
+        l.lightPos = Eigen::Vector3f(-1, 1, 1);
+        mScene->AddLight(l);
+        l.lightPos = Eigen::Vector3f(1, -1, 1);
+        mScene->AddLight(l);
+        l.lightPos = Eigen::Vector3f(1, 1, -1);
+        mScene->AddLight(l);
+
+        AddAxis(Eigen::Matrix4f::Identity());
+        Eigen::Affine3f transform;
+        transform.setIdentity();
+        mScene->AddObject(mCubeMesh, mMaterialBlackWhite, transform.matrix());
+
+        transform.translation() = Eigen::Vector3f(0, 0, 0.5);
+        mScene->AddObject(mSphereMesh, mMaterialBlackWhite, transform.matrix());
+
+        // different materials, no texture rebinds between them
+        if (mCopperSlice.IsValid() && mBlackWhiteSlice.IsValid())
+        {
+            transform.translation() = Eigen::Vector3f(0.5f, 0, 0.5f);
+            mScene->AddObject(mSphereMesh, mMaterialArray, transform.matrix(), mCopperSlice.layer);
+            transform.translation() = Eigen::Vector3f(-0.5f, 0, 0.5f);
+            mScene->AddObject(mSphereMesh, mMaterialArray, transform.matrix(), mBlackWhiteSlice.layer);
+        }
+        RenderManager::Instance()->SetScene(mScene);
         return 0;
     }
 
@@ -116,28 +177,8 @@ namespace Application
         rm->SetProjectionMatrix(mProjectionMat);
         rm->SetCameraPos(m_Camera->GetEye().cast<float>());
 
-        Light l;
-        l.lightColor = Eigen::Vector3f(1, 1, 1);
-        l.lightType = 0;
-        l.lightPos = Eigen::Vector3f(1, 1, 1);
-        l.intensity = 1;
-        rm->CollectLight(l);
-        l.lightPos = Eigen::Vector3f(-1, 1, 1);
-        rm->CollectLight(l);
-        l.lightPos = Eigen::Vector3f(1, -1, 1);
-        rm->CollectLight(l);
-        l.lightPos = Eigen::Vector3f(1, 1, -1);
-        rm->CollectLight(l);
-
-        DrawAxis(Eigen::Matrix4f::Identity());
-        Eigen::Affine3f transform;
-        transform.setIdentity();
-        // transform.translation() = Eigen::Vector3f(0, 1, 0);
-        rm->DrawMesh(mCubeMesh, mMaterialBlackWhite, transform.matrix());
-
-        transform.setIdentity();
-        transform.translation() = Eigen::Vector3f(0, 0, 0.5);
-        rm->DrawMesh(mSphereMesh, mMaterialBlackWhite, transform.matrix());
+        DrawWave((float)glfwGetTime());
+        DrawSwarm((float)glfwGetTime());
         // rm->EnableWireFrame(true);
         rm->EndFrame();
     }
@@ -151,6 +192,7 @@ namespace Application
             mMaterialBlock->SetMetallicScale(mMetallicScale);
             mMaterialCopper->SetMetallicScale(mMetallicScale);
             mMaterialBlackWhite->SetMetallicScale(mMetallicScale);
+            mMaterialArray->SetMetallicScale(mMetallicScale);
             break;
 
         case GLFW_KEY_S:
@@ -158,40 +200,164 @@ namespace Application
             mMaterialBlock->SetMetallicScale(mMetallicScale);
             mMaterialCopper->SetMetallicScale(mMetallicScale);
             mMaterialBlackWhite->SetMetallicScale(mMetallicScale);
+            mMaterialArray->SetMetallicScale(mMetallicScale);
             break;
         case GLFW_KEY_A:
             mRoughnessScale -= 0.05f;
             mMaterialBlock->SetRoughnessScale(mRoughnessScale);
             mMaterialCopper->SetRoughnessScale(mRoughnessScale);
             mMaterialBlackWhite->SetRoughnessScale(mRoughnessScale);
+            mMaterialArray->SetRoughnessScale(mRoughnessScale);
             break;
         case GLFW_KEY_D:
             mRoughnessScale += 0.05f;
             mMaterialBlock->SetRoughnessScale(mRoughnessScale);
             mMaterialCopper->SetRoughnessScale(mRoughnessScale);
             mMaterialBlackWhite->SetRoughnessScale(mRoughnessScale);
+            mMaterialArray->SetRoughnessScale(mRoughnessScale);
+            break;
+        case GLFW_KEY_M:
+            if (action == GLFW_PRESS)
+            {
+                RenderManager::Instance()->PrintMemoryReport();
+                TextureCache::Instance()->PrintStats();
+                ProgramCache::Instance()->PrintStats();
+            }
+            break;
+        case GLFW_KEY_B:
+            // toggle a small texture budget to watch top mips being released and streamed back
+            if (action == GLFW_PRESS)
+            {
+                auto residency = TextureResidency::Instance();
+                residency->SetBudget(residency->GetBudget() == SIZE_MAX ? 16 * 1024 * 1024 : SIZE_MAX);
+            }
             break;
         }
     }
 
-    void RenderShowcase::DrawAxis(const Eigen::Matrix4f &transform)
+    void RenderShowcase::AddAxis(const Eigen::Matrix4f &transform)
     {
-        auto rm = RenderManager::Instance();
         Eigen::AngleAxisf rotation(PI_2_F, Eigen::Vector3f(0, 0, -1));
         Eigen::Affine3f local;
         local.setIdentity();
         local.linear() = rotation.toRotationMatrix();
 
-        rm->DrawMesh(mArrowMesh, mMaterialCopper, transform * local.matrix());
-        rm->DrawMesh(mArrowMesh, mMaterialCopper, transform);
+        mScene->AddObject(mArrowMesh, mMaterialCopper, transform * local.matrix());
+        mScene->AddObject(mArrowMesh, mMaterialCopper, transform);
 
         rotation.axis() = Eigen::Vector3f(1, 0, 0);
         local.linear() = rotation.toRotationMatrix();
-        rm->DrawMesh(mArrowMesh, mMaterialCopper, transform * local.matrix());
+        mScene->AddObject(mArrowMesh, mMaterialCopper, transform * local.matrix());
+    }
+
+    void RenderShowcase::DrawWave(float time)
+    {
+        // rewritten every frame straight into mapped memory, layout: position, normal, uv0, tangent, bitangent
+        const int grid = 32;
+        const float size = 2.f;
+        const float amplitude = 0.05f;
+        const float frequency = 6.f;
+
+        float *v = mWaveSource->MapVertices((grid + 1) * (grid + 1));
+        for (int j = 0; j <= grid; ++j)
+        {
+            for (int i = 0; i <= grid; ++i)
+            {
+                float s = (float)i / grid;
+                float t = (float)j / grid;
+                float x = (s - 0.5f) * size;
+                float z = (t - 0.5f) * size;
+                float phase = frequency * (x + z) + time * 2;
+                float y = amplitude * sinf(phase);
+                float slope = amplitude * frequency * cosf(phase);
+
+                Eigen::Vector3f tangent(1, slope, 0);
+                Eigen::Vector3f bitangent(0, slope, 1);
+                Eigen::Vector3f normal = bitangent.cross(tangent).normalized();
+
+                float vertex[15] = {x, y, z,
+                                    normal.x(), normal.y(), normal.z(),
+                                    s, t, 0,
+                                    tangent.x(), tangent.y(), tangent.z(),
+                                    bitangent.x(), bitangent.y(), bitangent.z()};
+                memcpy(v, vertex, sizeof(vertex));
+                v += 15;
+            }
+        }
+
+        uint32_t *idx = mWaveSource->MapIndices(grid * grid * 6);
+        for (int j = 0; j < grid; ++j)
+        {
+            for (int i = 0; i < grid; ++i)
+            {
+                uint32_t a = j * (grid + 1) + i;
+                uint32_t b = a + grid + 1;
+                *idx++ = a;
+                *idx++ = b;
+                *idx++ = a + 1;
+                *idx++ = a + 1;
+                *idx++ = b;
+                *idx++ = b + 1;
+            }
+        }
+
+        Eigen::Affine3f transform;
+        transform.setIdentity();
+        transform.translation() = Eigen::Vector3f(0, -0.5f, 0);
+        RenderManager::Instance()->DrawMesh(mWaveSource, mMaterialCopper, transform.matrix());
+    }
+
+    void RenderShowcase::DrawSwarm(float time)
+    {
+        // small cubes circling above the wave, composed by the batch transform kernels into one instanced draw
+        const int count = 4096;
+        const float radius = 1.2f;
+        for (auto &stream : mSwarmStreams)
+            stream.resize(count);
+
+        for (int i = 0; i < count; ++i)
+        {
+            float t = (float)i / count;
+            float angle = t * 2 * PI_F * 8 + time * 0.3f;
+            float r = radius * (0.6f + 0.4f * t);
+            mSwarmStreams[0][i] = r * cosf(angle);
+            mSwarmStreams[1][i] = 0.3f + 0.2f * sinf(angle * 3 + time);
+            mSwarmStreams[2][i] = r * sinf(angle);
+
+            Eigen::Quaternionf q(Eigen::AngleAxisf(angle + time, Eigen::Vector3f(0, 1, 0)));
+            mSwarmStreams[3][i] = q.x();
+            mSwarmStreams[4][i] = q.y();
+            mSwarmStreams[5][i] = q.z();
+            mSwarmStreams[6][i] = q.w();
+            for (int s = 7; s < 10; ++s)
+                mSwarmStreams[s][i] = 0.1f;
+        }
+
+        TransformSoA transforms;
+        for (int s = 0; s < 3; ++s)
+        {
+            transforms.position[s] = mSwarmStreams[s].data();
+            transforms.scale[s] = mSwarmStreams[7 + s].data();
+        }
+        for (int s = 0; s < 4; ++s)
+            transforms.rotation[s] = mSwarmStreams[3 + s].data();
+        RenderManager::Instance()->DrawInstances(mCubeMesh, mMaterialBlock, Eigen::Matrix4f::Identity(), transforms, count);
     }
 
     void RenderShowcase::MouseButton(int button, int action, int mods, int x, int y)
     {
+        if (action == GLFW_PRESS && button == GLFW_MOUSE_BUTTON_LEFT && (mods & GLFW_MOD_CONTROL))
+        {
+            PickResult result;
+            if (RenderManager::Instance()->Pick(m_Camera->GetPickRay(x, y), result))
+            {
+                printf("Picked object %u, triangle %u, barycentric (%f, %f), position (%f, %f, %f)\n",
+                       result.objectIndex, result.hit.triangle, result.hit.u, result.hit.v,
+                       result.worldPosition.x(), result.worldPosition.y(), result.worldPosition.z());
+            }
+            return;
+        }
+
         if (action == GLFW_PRESS)
         {
             m_IsDrag = true;
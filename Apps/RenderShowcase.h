@@ -3,9 +3,11 @@
 
 #include "Common/WindowApplication.h"
 #include "StaticMesh.h"
+#include "DynamicVertexDataSource.h"
 #include "ShaderProgram.h"
 #include "Material.h"
 #include "Camera.h"
+#include "RenderScene.h"
 
 namespace Application
 {
@@ -23,23 +25,29 @@ namespace Application
         virtual void MouseButton(int button, int action, int mods, int x, int y) override;
 
     private:
-        void DrawAxis(const Eigen::Matrix4f &transform);
+        void AddAxis(const Eigen::Matrix4f &transform);
+        void DrawWave(float time);
+        void DrawSwarm(float time);
 
         Graphics::StaticMesh::SP mArrowMesh;
         Graphics::StaticMesh::SP mCubeMesh;
         Graphics::StaticMesh::SP mSphereMesh;
+        Graphics::DynamicVertexDataSource::SP mWaveSource;
+        Graphics::RenderScene::SP mScene;
+        // position xyz, rotation xyzw, scale xyz of each swarm cube, kept until EndFrame reads them
+        std::vector<float> mSwarmStreams[10];
 
         Graphics::BasicPBRMaterial::SP mMaterialCopper;
         Graphics::BasicPBRMaterial::SP mMaterialBlock;
         Graphics::BasicPBRMaterial::SP mMaterialBlackWhite;
-
-        Graphics::Texture::SP mAlbedo;
-        Graphics::Texture::SP mNormal;
-        Graphics::Texture::SP mMetallic;
-        Graphics::Texture::SP mAo;
-        Graphics::Texture::SP mRoughness;
-
-        Graphics::ShaderProgram::SP mShaderProgram;
+        // one material for every slice of the texture set
+        Graphics::BasicPBRMaterial::SP mMaterialArray;
+        Graphics::TextureSetSlice mCopperSlice;
+        Graphics::TextureSetSlice mBlackWhiteSlice;
+
+        Graphics::ShaderVariants::SP mPbrVariants;
+        Graphics::ShaderProgram::SP mArrayShaderProgram;
+        Graphics::ShaderProgram::SP mOrmShaderProgram;
 
         Eigen::Matrix4f mViewMat;
         Eigen::Matrix4f mProjectionMat;
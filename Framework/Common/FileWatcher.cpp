@@ -0,0 +1,133 @@
+#include "FileWatcher.h"
+#include <stdio.h>
+#include <vector>
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+
+namespace Application
+{
+    std::string FileWatcher::normalize(const std::string &path)
+    {
+        std::error_code error;
+        auto absolute = std::filesystem::absolute(path, error);
+        if (error)
+            absolute = path;
+        return absolute.lexically_normal().generic_string();
+    }
+
+#ifdef __linux__
+    FileWatcher::FileWatcher()
+    {
+        m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_fd < 0)
+            printf("inotify is not available, files are not watched\n");
+    }
+
+    FileWatcher::~FileWatcher()
+    {
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+
+    void FileWatcher::Watch(const std::string &path)
+    {
+        auto normalized = normalize(path);
+        if (m_fd < 0 || m_files.count(normalized))
+            return;
+        m_files[normalized] = path;
+
+        auto dir = std::filesystem::path(normalized).parent_path().generic_string();
+        if (m_watchedDirs.count(dir))
+            return;
+
+        int wd = inotify_add_watch(m_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0)
+        {
+            printf("Can't watch directory %s\n", dir.c_str());
+            return;
+        }
+        m_dirs[wd] = dir;
+        m_watchedDirs.insert(dir);
+    }
+
+    void FileWatcher::Poll()
+    {
+        if (m_fd < 0)
+            return;
+
+        // events of one save often come in several reads, gather them before reporting
+        std::vector<std::string> changed;
+        alignas(inotify_event) char buffer[4096];
+        for (;;)
+        {
+            auto length = read(m_fd, buffer, sizeof(buffer));
+            if (length <= 0)
+                break;
+
+            for (char *ptr = buffer; ptr < buffer + length;)
+            {
+                auto event = (const inotify_event *)ptr;
+                ptr += sizeof(inotify_event) + event->len;
+
+                auto dir = m_dirs.find(event->wd);
+                if (dir == m_dirs.end() || event->len == 0)
+                    continue;
+
+                auto file = m_files.find(dir->second + "/" + event->name);
+                if (file == m_files.end())
+                    continue;
+
+                bool reported = false;
+                for (auto &path : changed)
+                    reported |= path == file->second;
+                if (!reported)
+                    changed.push_back(file->second);
+            }
+        }
+
+        if (m_callback)
+        {
+            for (auto &path : changed)
+                m_callback(path);
+        }
+    }
+#else
+    FileWatcher::FileWatcher()
+    {
+    }
+
+    FileWatcher::~FileWatcher()
+    {
+    }
+
+    void FileWatcher::Watch(const std::string &path)
+    {
+        auto normalized = normalize(path);
+        if (m_files.count(normalized))
+            return;
+        m_files[normalized] = path;
+
+        std::error_code error;
+        m_times[normalized] = std::filesystem::last_write_time(normalized, error);
+    }
+
+    void FileWatcher::Poll()
+    {
+        for (auto &pair : m_times)
+        {
+            std::error_code error;
+            auto time = std::filesystem::last_write_time(pair.first, error);
+            // a file being replaced may be missing for a moment, it is seen on a later poll
+            if (error || time == pair.second)
+                continue;
+
+            pair.second = time;
+            if (m_callback)
+                m_callback(m_files[pair.first]);
+        }
+    }
+#endif
+}
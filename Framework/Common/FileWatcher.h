@@ -0,0 +1,52 @@
+/**
+ * @file FileWatcher.h
+ * @author wangyudong
+ * @brief Reports modified files once per poll, inotify on linux and modification time polling elsewhere.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <filesystem>
+
+namespace Application
+{
+    /**
+     * @brief Files are watched through their directories, so editors that save by writing a temporary file and
+     * renaming it over the original are seen as well. Several events of one file within a poll are reported once.
+     * Poll never blocks, it is called from the main loop.
+     */
+    class FileWatcher
+    {
+    public:
+        typedef std::function<void(const std::string &path)> Callback;
+
+        FileWatcher();
+        ~FileWatcher();
+
+        void SetCallback(Callback callback) { m_callback = callback; }
+        // path is reported back as given here, watching a file twice is harmless
+        void Watch(const std::string &path);
+        void Poll();
+
+    private:
+        static std::string normalize(const std::string &path);
+
+        Callback m_callback;
+        // normalized path -> path given to Watch
+        std::unordered_map<std::string, std::string> m_files;
+#ifdef __linux__
+        int m_fd = -1;
+        // watch descriptor -> normalized directory
+        std::unordered_map<int, std::string> m_dirs;
+        std::unordered_set<std::string> m_watchedDirs;
+#else
+        std::unordered_map<std::string, std::filesystem::file_time_type> m_times;
+#endif
+    };
+}
@@ -1,4 +1,5 @@
 #include "WindowApplication.h"
+#include "HotReload.h"
 
 namespace Application
 {
@@ -24,16 +25,24 @@ namespace Application
         glfwSetMouseButtonCallback(m_window, &WindowApplication::mouseButtonCallBack);
 
         glewInit();
+
+        auto hotReload = Graphics::HotReload::Instance();
+        m_fileWatcher.SetCallback([hotReload](const std::string &path) { hotReload->OnFileChanged(path); });
+        hotReload->SetWatchCallback([this](const std::string &path) { m_fileWatcher.Watch(path); });
         return 0;
     }
     void WindowApplication::Finalize()
     {
+        Graphics::HotReload::Instance()->SetWatchCallback(nullptr);
         glfwDestroyWindow(m_window);
         glfwTerminate();
     }
 
     void WindowApplication::Tick()
     {
+        // reloaded before drawing, so a frame never mixes old and new programs
+        m_fileWatcher.Poll();
+        Graphics::HotReload::Instance()->Update();
         Render();
         glfwSwapBuffers(m_window);
         glfwPollEvents();
@@ -4,6 +4,7 @@
 #include "Interface/IApplication.h"
 #include "GL/glew.h"
 #include "GLFW/glfw3.h"
+#include "FileWatcher.h"
 
 namespace Application
 {
@@ -44,5 +45,8 @@ namespace Application
         int m_MouseType = -1;
         int m_PrevX, m_PrevY;
         int m_DisplayTimeout;
+
+        // TinySL files and streamed images registered by HotReload are watched and rebuilt when saved
+        FileWatcher m_fileWatcher;
     };
 } // namespace Application
\ No newline at end of file
@@ -0,0 +1,443 @@
+#include "BVH.h"
+#include <math.h>
+#include <algorithm>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define BVH_USE_SSE
+#endif
+
+namespace Graphics
+{
+    namespace
+    {
+        const int MaxDepth = 64;
+
+        inline float HalfArea(const Eigen::AlignedBox3f &box)
+        {
+            if (box.isEmpty())
+                return 0;
+            Eigen::Vector3f e = box.sizes();
+            return e.x() * e.y() + e.y() * e.z() + e.z() * e.x();
+        }
+
+        // ray with reciprocal direction, laid out for slab tests
+        struct PreparedRay
+        {
+#ifdef BVH_USE_SSE
+            __m128 origin;
+            __m128 invDir;
+#else
+            float origin[3];
+            float invDir[3];
+#endif
+        };
+
+        inline PreparedRay PrepareRay(const Ray &ray)
+        {
+            PreparedRay ret;
+            // divide by zero gives inf, slab test handles it
+#ifdef BVH_USE_SSE
+            ret.origin = _mm_set_ps(0, ray.origin.z(), ray.origin.y(), ray.origin.x());
+            ret.invDir = _mm_set_ps(0, 1.f / ray.direction.z(), 1.f / ray.direction.y(), 1.f / ray.direction.x());
+#else
+            for (int i = 0; i < 3; ++i)
+            {
+                ret.origin[i] = ray.origin[i];
+                ret.invDir[i] = 1.f / ray.direction[i];
+            }
+#endif
+            return ret;
+        }
+
+        // returns entry distance, or FLT_MAX if the box is missed or farther than tMax
+        inline float IntersectNode(const BVHNode &node, const PreparedRay &ray, float tMax)
+        {
+#ifdef BVH_USE_SSE
+            // w lanes hold leftFirst/count bits, they are masked out and replaced by the [0, tMax] interval
+            const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+            __m128 bmin = _mm_loadu_ps(node.boundsMin);
+            __m128 bmax = _mm_loadu_ps(node.boundsMax);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(bmin, ray.origin), ray.invDir);
+            __m128 t2 = _mm_mul_ps(_mm_sub_ps(bmax, ray.origin), ray.invDir);
+
+            __m128 tNear = _mm_and_ps(_mm_min_ps(t1, t2), xyzMask);
+            __m128 tFar = _mm_or_ps(_mm_and_ps(_mm_max_ps(t1, t2), xyzMask), _mm_andnot_ps(xyzMask, _mm_set1_ps(tMax)));
+
+            tNear = _mm_max_ps(tNear, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(1, 0, 3, 2)));
+            tNear = _mm_max_ps(tNear, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(2, 3, 0, 1)));
+            tFar = _mm_min_ps(tFar, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(1, 0, 3, 2)));
+            tFar = _mm_min_ps(tFar, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(2, 3, 0, 1)));
+
+            float entry = _mm_cvtss_f32(tNear);
+            float exit = _mm_cvtss_f32(tFar);
+#else
+            float entry = 0;
+            float exit = tMax;
+            for (int i = 0; i < 3; ++i)
+            {
+                float t1 = (node.boundsMin[i] - ray.origin[i]) * ray.invDir[i];
+                float t2 = (node.boundsMax[i] - ray.origin[i]) * ray.invDir[i];
+                entry = std::max(entry, std::min(t1, t2));
+                exit = std::min(exit, std::max(t1, t2));
+            }
+#endif
+            return entry <= exit ? entry : FLT_MAX;
+        }
+
+        // Nearest child first, leafFunc(first, count) tests primitives of a leaf and returns true on a closer hit.
+        template <typename LeafFunc>
+        bool TraverseBVH(const std::vector<BVHNode> &nodes, const Ray &ray, RayHit &hit, LeafFunc leafFunc)
+        {
+            if (nodes.empty())
+                return false;
+
+            PreparedRay prepared = PrepareRay(ray);
+            if (IntersectNode(nodes[0], prepared, hit.t) == FLT_MAX)
+                return false;
+
+            // builder limits depth, one far child is pushed per level at most
+            uint32_t nodeStack[MaxDepth];
+            float distStack[MaxDepth];
+            int stackSize = 0;
+            uint32_t current = 0;
+            bool found = false;
+
+            while (true)
+            {
+                const BVHNode &node = nodes[current];
+                if (node.IsLeaf())
+                {
+                    found |= leafFunc(node.leftFirst, node.count);
+                }
+                else
+                {
+                    uint32_t nearChild = node.leftFirst;
+                    uint32_t farChild = node.leftFirst + 1;
+                    float nearDist = IntersectNode(nodes[nearChild], prepared, hit.t);
+                    float farDist = IntersectNode(nodes[farChild], prepared, hit.t);
+                    if (farDist < nearDist)
+                    {
+                        std::swap(nearChild, farChild);
+                        std::swap(nearDist, farDist);
+                    }
+
+                    if (nearDist != FLT_MAX)
+                    {
+                        if (farDist != FLT_MAX)
+                        {
+                            nodeStack[stackSize] = farChild;
+                            distStack[stackSize] = farDist;
+                            ++stackSize;
+                        }
+                        current = nearChild;
+                        continue;
+                    }
+                }
+
+                // pop, skipping nodes behind the closest hit so far
+                bool popped = false;
+                while (stackSize > 0)
+                {
+                    --stackSize;
+                    if (distStack[stackSize] < hit.t)
+                    {
+                        current = nodeStack[stackSize];
+                        popped = true;
+                        break;
+                    }
+                }
+                if (!popped)
+                    break;
+            }
+            return found;
+        }
+
+        inline void SetNodeBounds(BVHNode &node, const Eigen::AlignedBox3f &box)
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                node.boundsMin[i] = box.min()[i];
+                node.boundsMax[i] = box.max()[i];
+            }
+        }
+    }
+
+    void BVHBuilder::Build(const std::vector<Eigen::AlignedBox3f> &primBounds, std::vector<BVHNode> &nodes, std::vector<uint32_t> &primIndices)
+    {
+        nodes.clear();
+        primIndices.resize(primBounds.size());
+        std::iota(primIndices.begin(), primIndices.end(), 0);
+        if (primBounds.empty())
+            return;
+
+        std::vector<Eigen::Vector3f> centroids(primBounds.size());
+        for (size_t i = 0; i < primBounds.size(); ++i)
+            centroids[i] = primBounds[i].center();
+
+        nodes.reserve(primBounds.size() * 2);
+        BVHNode root;
+        root.leftFirst = 0;
+        root.count = (uint32_t)primBounds.size();
+        nodes.push_back(root);
+
+        struct Task
+        {
+            uint32_t node;
+            int depth;
+        };
+        std::vector<Task> tasks;
+        tasks.push_back({0, 1});
+
+        struct Bin
+        {
+            Eigen::AlignedBox3f bounds;
+            uint32_t count = 0;
+        };
+
+        while (!tasks.empty())
+        {
+            Task task = tasks.back();
+            tasks.pop_back();
+
+            uint32_t first = nodes[task.node].leftFirst;
+            uint32_t count = nodes[task.node].count;
+
+            Eigen::AlignedBox3f bounds;
+            Eigen::AlignedBox3f centroidBounds;
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                bounds.extend(primBounds[primIndices[i]]);
+                centroidBounds.extend(centroids[primIndices[i]]);
+            }
+            SetNodeBounds(nodes[task.node], bounds);
+
+            if (count <= MaxLeafSize || task.depth >= MaxDepth)
+                continue;
+
+            // find the cheapest split plane between bins over all axes
+            float bestCost = FLT_MAX;
+            int bestAxis = -1;
+            int bestSplit = 0;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                float axisMin = centroidBounds.min()[axis];
+                float extent = centroidBounds.max()[axis] - axisMin;
+                if (extent <= 0)
+                    continue;
+
+                Bin bins[BinCount];
+                float scale = BinCount / extent;
+                for (uint32_t i = first; i < first + count; ++i)
+                {
+                    int b = std::min(BinCount - 1, (int)((centroids[primIndices[i]][axis] - axisMin) * scale));
+                    bins[b].count++;
+                    bins[b].bounds.extend(primBounds[primIndices[i]]);
+                }
+
+                // sweep from both sides, split k puts bins [0, k) on the left
+                float leftArea[BinCount - 1], rightArea[BinCount - 1];
+                uint32_t leftCount[BinCount - 1], rightCount[BinCount - 1];
+                Eigen::AlignedBox3f leftBox, rightBox;
+                uint32_t leftSum = 0, rightSum = 0;
+                for (int k = 0; k < BinCount - 1; ++k)
+                {
+                    leftSum += bins[k].count;
+                    leftBox.extend(bins[k].bounds);
+                    leftCount[k] = leftSum;
+                    leftArea[k] = HalfArea(leftBox);
+
+                    rightSum += bins[BinCount - 1 - k].count;
+                    rightBox.extend(bins[BinCount - 1 - k].bounds);
+                    rightCount[BinCount - 2 - k] = rightSum;
+                    rightArea[BinCount - 2 - k] = HalfArea(rightBox);
+                }
+
+                for (int k = 0; k < BinCount - 1; ++k)
+                {
+                    float cost = leftCount[k] * leftArea[k] + rightCount[k] * rightArea[k];
+                    if (leftCount[k] > 0 && rightCount[k] > 0 && cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = k + 1;
+                    }
+                }
+            }
+
+            // all centroids coincide, or splitting costs more than testing every primitive
+            if (bestAxis < 0 || bestCost >= count * HalfArea(bounds))
+                continue;
+
+            float axisMin = centroidBounds.min()[bestAxis];
+            float scale = BinCount / (centroidBounds.max()[bestAxis] - axisMin);
+            auto middle = std::partition(primIndices.begin() + first, primIndices.begin() + first + count, [&](uint32_t prim)
+            {
+                int b = std::min(BinCount - 1, (int)((centroids[prim][bestAxis] - axisMin) * scale));
+                return b < bestSplit;
+            });
+            uint32_t leftCount = (uint32_t)(middle - primIndices.begin()) - first;
+
+            BVHNode left, right;
+            left.leftFirst = first;
+            left.count = leftCount;
+            right.leftFirst = first + leftCount;
+            right.count = count - leftCount;
+
+            uint32_t leftIndex = (uint32_t)nodes.size();
+            nodes.push_back(left);
+            nodes.push_back(right);
+            nodes[task.node].leftFirst = leftIndex;
+            nodes[task.node].count = 0;
+
+            tasks.push_back({leftIndex, task.depth + 1});
+            tasks.push_back({leftIndex + 1, task.depth + 1});
+        }
+    }
+
+    void MeshBVH::Build(const std::vector<Eigen::Vector3f> &positions, const std::vector<uint32_t> &indices)
+    {
+        size_t triangleCount = indices.empty() ? positions.size() / 3 : indices.size() / 3;
+        auto vertexIndex = [&](size_t i) { return indices.empty() ? (uint32_t)i : indices[i]; };
+
+        std::vector<Eigen::AlignedBox3f> primBounds(triangleCount);
+        for (size_t i = 0; i < triangleCount; ++i)
+        {
+            primBounds[i].extend(positions[vertexIndex(i * 3)]);
+            primBounds[i].extend(positions[vertexIndex(i * 3 + 1)]);
+            primBounds[i].extend(positions[vertexIndex(i * 3 + 2)]);
+        }
+
+        std::vector<uint32_t> primIndices;
+        BVHBuilder::Build(primBounds, mNodes, primIndices);
+
+        // store triangles in leaf order so a leaf reads contiguous memory
+        mTriangles.resize(triangleCount);
+        for (size_t i = 0; i < triangleCount; ++i)
+        {
+            uint32_t prim = primIndices[i];
+            auto &v0 = positions[vertexIndex(prim * 3)];
+            auto &tri = mTriangles[i];
+            tri.v0 = v0;
+            tri.e1 = positions[vertexIndex(prim * 3 + 1)] - v0;
+            tri.e2 = positions[vertexIndex(prim * 3 + 2)] - v0;
+            tri.index = prim;
+        }
+    }
+
+    bool MeshBVH::Intersect(const Ray &ray, RayHit &hit) const
+    {
+        return TraverseBVH(mNodes, ray, hit, [&](uint32_t first, uint32_t count)
+        {
+            bool found = false;
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                // Moller-Trumbore
+                auto &tri = mTriangles[i];
+                Eigen::Vector3f p = ray.direction.cross(tri.e2);
+                float det = tri.e1.dot(p);
+                if (fabsf(det) < 1e-12f)
+                    continue;
+
+                float invDet = 1.f / det;
+                Eigen::Vector3f s = ray.origin - tri.v0;
+                float u = s.dot(p) * invDet;
+                if (u < 0 || u > 1)
+                    continue;
+
+                Eigen::Vector3f q = s.cross(tri.e1);
+                float v = ray.direction.dot(q) * invDet;
+                if (v < 0 || u + v > 1)
+                    continue;
+
+                float t = tri.e2.dot(q) * invDet;
+                if (t > 0 && t < hit.t)
+                {
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    hit.triangle = tri.index;
+                    found = true;
+                }
+            }
+            return found;
+        });
+    }
+
+    Eigen::AlignedBox3f MeshBVH::GetBounds() const
+    {
+        Eigen::AlignedBox3f ret;
+        if (mNodes.empty())
+            return ret;
+        ret.min() = Eigen::Vector3f(mNodes[0].boundsMin[0], mNodes[0].boundsMin[1], mNodes[0].boundsMin[2]);
+        ret.max() = Eigen::Vector3f(mNodes[0].boundsMax[0], mNodes[0].boundsMax[1], mNodes[0].boundsMax[2]);
+        return ret;
+    }
+
+    void SceneBVH::Build(const std::vector<Instance> &instances)
+    {
+        Clear();
+
+        std::vector<Eigen::AlignedBox3f> primBounds;
+        std::vector<uint32_t> sourceIndices;
+        for (size_t i = 0; i < instances.size(); ++i)
+        {
+            auto &instance = instances[i];
+            if (instance.bvh == nullptr || instance.bvh->GetTriangleCount() == 0)
+                continue;
+
+            // world bounds of the transformed object bounds
+            Eigen::AlignedBox3f local = instance.bvh->GetBounds();
+            Eigen::AlignedBox3f world;
+            for (int c = 0; c < 8; ++c)
+            {
+                Eigen::Vector3f corner = local.corner((Eigen::AlignedBox3f::CornerType)c);
+                world.extend((instance.modelMat * corner.homogeneous()).hnormalized());
+            }
+            primBounds.push_back(world);
+            sourceIndices.push_back((uint32_t)i);
+
+            InstanceData data;
+            data.bvh = instance.bvh;
+            data.worldToObject = instance.modelMat.inverse();
+            mInstances.push_back(data);
+        }
+
+        BVHBuilder::Build(primBounds, mNodes, mInstanceIndices);
+        mSourceIndices.swap(sourceIndices);
+    }
+
+    void SceneBVH::Clear()
+    {
+        mNodes.clear();
+        mInstanceIndices.clear();
+        mInstances.clear();
+        mSourceIndices.clear();
+    }
+
+    bool SceneBVH::Intersect(const Ray &ray, RayHit &hit) const
+    {
+        return TraverseBVH(mNodes, ray, hit, [&](uint32_t first, uint32_t count)
+        {
+            bool found = false;
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                uint32_t instanceIndex = mInstanceIndices[i];
+                auto &data = mInstances[instanceIndex];
+
+                // direction is not normalized after transform, so t stays comparable between instances
+                Ray localRay;
+                localRay.origin = (data.worldToObject * ray.origin.homogeneous()).hnormalized();
+                localRay.direction = data.worldToObject.block<3, 3>(0, 0) * ray.direction;
+
+                if (data.bvh->Intersect(localRay, hit))
+                {
+                    hit.instance = mSourceIndices[instanceIndex];
+                    found = true;
+                }
+            }
+            return found;
+        });
+    }
+}
@@ -0,0 +1,120 @@
+/**
+ * @file BVH.h
+ * @author wangyudong
+ * @brief Bounding volume hierarchies for CPU ray queries (picking), one per mesh and one over scene instances.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <float.h>
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+#include "Constants.h"
+
+namespace Graphics
+{
+    struct Ray
+    {
+        Eigen::Vector3f origin;
+        Eigen::Vector3f direction; // need not be normalized, hit distance is in units of direction length
+    };
+
+    struct RayHit
+    {
+        float t = FLT_MAX;
+        // barycentrics of v1 and v2, weight of v0 is 1 - u - v
+        float u = 0;
+        float v = 0;
+        uint32_t triangle = INVALID_ID;  // triangle index in the mesh, as in index buffer order
+        uint32_t instance = INVALID_ID;  // instance index of SceneBVH
+
+        bool IsValid() const { return triangle != INVALID_ID; }
+    };
+
+    // 32 bytes, bounds min/max are 16 bytes aligned together with the child/primitive fields for SIMD loads.
+    struct BVHNode
+    {
+        float boundsMin[3];
+        uint32_t leftFirst; // left child index for inner node (right is leftFirst + 1), first primitive for leaf
+        float boundsMax[3];
+        uint32_t count;     // primitive count, 0 for inner node
+
+        bool IsLeaf() const { return count > 0; }
+    };
+
+    /**
+     * @brief Binned SAH builder shared by mesh and scene hierarchies, works on primitive bounds only.
+     * Output primitive indices are ordered so that each leaf references a contiguous range.
+     */
+    class BVHBuilder
+    {
+    public:
+        static void Build(const std::vector<Eigen::AlignedBox3f> &primBounds, std::vector<BVHNode> &nodes, std::vector<uint32_t> &primIndices);
+
+        static const int BinCount = 12;
+        static const uint32_t MaxLeafSize = 4;
+    };
+
+    // Triangle hierarchy in object space, triangles are stored in leaf order.
+    class MeshBVH
+    {
+    public:
+        typedef std::shared_ptr<MeshBVH> SP;
+
+        // non-indexed positions are treated as triangle list when indices is empty
+        void Build(const std::vector<Eigen::Vector3f> &positions, const std::vector<uint32_t> &indices);
+
+        // only updates hit when a closer triangle than hit.t is found
+        bool Intersect(const Ray &ray, RayHit &hit) const;
+
+        Eigen::AlignedBox3f GetBounds() const;
+        size_t GetTriangleCount() const { return mTriangles.size(); }
+        size_t GetMemoryBytes() const { return mNodes.capacity() * sizeof(BVHNode) + mTriangles.capacity() * sizeof(Triangle); }
+
+    private:
+        struct Triangle
+        {
+            Eigen::Vector3f v0;
+            Eigen::Vector3f e1; // v1 - v0
+            Eigen::Vector3f e2; // v2 - v0
+            uint32_t index;
+        };
+
+        std::vector<BVHNode> mNodes;
+        std::vector<Triangle> mTriangles;
+    };
+
+    // Top level hierarchy over mesh instances, rays are transformed into object space of each instance.
+    class SceneBVH
+    {
+    public:
+        struct Instance
+        {
+            MeshBVH::SP bvh;
+            Eigen::Matrix4f modelMat;
+        };
+
+        void Build(const std::vector<Instance> &instances);
+        void Clear();
+
+        // hit.instance is the index into instances passed to Build
+        bool Intersect(const Ray &ray, RayHit &hit) const;
+        bool IsEmpty() const { return mNodes.empty(); }
+
+    private:
+        struct InstanceData
+        {
+            MeshBVH::SP bvh;
+            Eigen::Matrix4f worldToObject;
+        };
+
+        std::vector<BVHNode> mNodes;
+        std::vector<uint32_t> mInstanceIndices;
+        std::vector<InstanceData> mInstances;
+        std::vector<uint32_t> mSourceIndices; // mInstances index -> index passed to Build, empty instances are skipped
+    };
+}
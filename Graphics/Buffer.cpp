@@ -7,31 +7,98 @@
 
 namespace Graphics
 {
+    // Data is specified through copy write target, binding index buffer to its own target would change
+    // the element buffer of currently bound VAO.
     void Buffer::BufferData(void *data, size_t size, BufferUsage usage)
     {
-        auto nativeType = GetNativeBufferType(mBufferType);
-        glBindBuffer(nativeType, mBufferHandle);
-        glBufferData(nativeType, size, data, GetNativeBufferUsage(usage));
-        glBindBuffer(nativeType, 0);
-        CopyData(size, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mBufferHandle);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, data, GetNativeBufferUsage(usage));
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        mSize = size;
+
+        // storage specified without data is filled later by BufferSubData, the copy starts zeroed
+        if (mRetentionPolicy == RetentionPolicy_KeepForReadback)
+            CopyData(size, data);
+        else
+            FreeData();
     }
 
     void Buffer::BufferSubData(void *data, size_t offset, size_t size)
     {
-        auto nativeType = GetNativeBufferType(mBufferType);
-        glBindBuffer(nativeType, mBufferHandle);
-        glBufferSubData(nativeType, offset, size, data);
-        glBindBuffer(nativeType, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mBufferHandle);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+        // keep readback copy coherent
+        if (mRetentionPolicy == RetentionPolicy_KeepForReadback && mData != nullptr && offset <= mDataSize &&
+            size <= mDataSize - offset)
+            memcpy((char *)mData + offset, data, size);
+    }
+
+    bool Buffer::BufferStorage(void *data, size_t size, uint32_t flags)
+    {
+        if (!RenderManager::Instance()->GetSystemInfo().bufferStorage)
+            return false;
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mBufferHandle);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, size, data, GetNativeStorageFlags(flags));
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glCheckError();
+        mSize = size;
+
+        if (mRetentionPolicy == RetentionPolicy_KeepForReadback)
+            CopyData(size, data);
+        return true;
+    }
+
+    void *Buffer::MapRange(size_t offset, size_t size, uint32_t flags)
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mBufferHandle);
+        void *ptr = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size, GetNativeMapFlags(flags));
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        if (ptr == nullptr)
+        {
+            GFX_LOG_ERROR_FMT("Map buffer %u failed, offset %zu size %zu", mBufferHandle, offset, size);
+        }
+        return ptr;
+    }
+
+    void Buffer::Unmap()
+    {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, mBufferHandle);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+
+    void Buffer::SetRetentionPolicy(RetentionPolicy policy)
+    {
+        mRetentionPolicy = policy;
+        if (policy != RetentionPolicy_KeepForReadback)
+            FreeData();
     }
 
     void Buffer::CopyData(size_t size, void *data)
     {
         free(mData);
-        mData = malloc(size);
-        memcpy(mData, data, size);
+        if (data == nullptr)
+        {
+            mData = calloc(1, size);
+        }
+        else
+        {
+            mData = malloc(size);
+            memcpy(mData, data, size);
+        }
         mDataSize = size;
     }
 
+    void Buffer::FreeData()
+    {
+        free(mData);
+        mData = nullptr;
+        mDataSize = 0;
+    }
+
     void Buffer::Bind() const
     {
         glBindBuffer(GetNativeBufferType(mBufferType), mBufferHandle);
@@ -10,9 +10,13 @@
 
 #include<memory>
 #include "Constants.h"
+#include "HandlePool.h"
 
 namespace Graphics
 {
+    class Buffer;
+    typedef PoolHandle<Buffer> BufferHandle;
+
     class Buffer
     {
     public:
@@ -23,21 +27,43 @@ namespace Graphics
         inline BufferType GetBufferType() const { return mBufferType; }
         inline uint32_t GetBufferHandle() const { return mBufferHandle; }
         inline void Reset() { mBufferHandle = 0; }
+        // slot in the buffer pool of RenderManager, valid from AllocBuffer until destruction
+        inline BufferHandle GetPoolHandle() const { return mPoolHandle; }
+        inline void SetPoolHandle(BufferHandle handle) { mPoolHandle = handle; }
+
+        // Buffers discard their cpu copy by default, KeepForReadback keeps a copy of uploaded data.
+        // KeepSource has nothing to keep for a buffer and behaves like Discard.
+        void SetRetentionPolicy(RetentionPolicy policy);
+        inline RetentionPolicy GetRetentionPolicy() const { return mRetentionPolicy; }
+        // cpu copy of uploaded data, nullptr if not retained
+        inline const void *GetData() const { return mData; }
+        inline size_t GetRetainedBytes() const { return mData == nullptr ? 0 : mDataSize; }
 
         void BufferData(void *data, size_t size, BufferUsage usage);
         void BufferSubData(void *data, size_t offset, size_t size);
 
+        // Immutable storage, flags are combination of BufferAccessFlag. Returns false if glBufferStorage is not supported.
+        bool BufferStorage(void *data, size_t size, uint32_t flags);
+        void *MapRange(size_t offset, size_t size, uint32_t flags);
+        void Unmap();
+        inline size_t GetSize() const { return mSize; }
+
         void Bind() const;
         void BindRange() const;
 
     private:
 
+        // zeroed when data is nullptr
         void CopyData(size_t size, void* data);
+        void FreeData();
 
         uint32_t mBufferHandle = INVALID_ID;
+        BufferHandle mPoolHandle;
         BufferType mBufferType;
+        RetentionPolicy mRetentionPolicy = RetentionPolicy_Discard;
+        size_t mSize = 0;
 
         void* mData;
-        size_t mDataSize;
+        size_t mDataSize = 0;
     };
 }
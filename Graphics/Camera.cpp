@@ -143,30 +143,24 @@ namespace Graphics
 		return vec.z() * n + vec.x() * v + vec.y() * u;
 	}
 
-	Eigen::Vector3d Camera::GetWorldPosition(int x, int y)
+	Ray Camera::GetPickRay(int x, int y)
 	{
-		GLdouble wx, wy, wz;
-		GLint w = m_width;
-		GLint h = m_height;
-		double aspect_ratio_inv = (double)h / (double)w;
-
-		Eigen::Vector2d screen_pos((double)x / (double)w - 0.5, (1.0 - (double)y / (double)h - 0.5) * aspect_ratio_inv);
-		Eigen::Vector2d mouse_position = 8 * screen_pos + Eigen::Vector2d(0, 0);
-
-		GLdouble projection[16];
-		GLdouble modelView[16];
-		GLint viewPort[4];
-		glGetDoublev(GL_PROJECTION_MATRIX, projection);
-		glGetDoublev(GL_MODELVIEW_MATRIX, modelView);
-		glGetIntegerv(GL_VIEWPORT, viewPort);
-
-		GLfloat zCursor, winX, winY;
-		winX = (float)x;
-		winY = -(float)y;
-		glReadPixels((int)winX, (int)winY, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &zCursor);
-		gluUnProject(winX, winY, zCursor, modelView, projection, viewPort, &wx, &wy, &wz);
-		Eigen::Vector3d world_position((double)wx, (double)wy, (double)wz);
-		return world_position;
+		Eigen::Matrix4f view, projection;
+		GetViewMatrix(view);
+		GetProjectionMatrix(projection);
+		Eigen::Matrix4f invViewProj = (projection * view).inverse();
+
+		// window y goes down, ndc y goes up
+		float ndcX = 2.f * ((float)x + 0.5f) / (float)m_width - 1.f;
+		float ndcY = 1.f - 2.f * ((float)y + 0.5f) / (float)m_height;
+
+		Eigen::Vector3f nearPoint = (invViewProj * Eigen::Vector4f(ndcX, ndcY, -1, 1)).hnormalized();
+		Eigen::Vector3f farPoint = (invViewProj * Eigen::Vector4f(ndcX, ndcY, 1, 1)).hnormalized();
+
+		Ray ray;
+		ray.origin = nearPoint;
+		ray.direction = (farPoint - nearPoint).normalized();
+		return ray;
 	}
 
 	void Camera::GetProjectionMatrix(Eigen::Matrix4f &out)
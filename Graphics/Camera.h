@@ -5,6 +5,7 @@
 #include <Eigen/Sparse>
 #include <Eigen/Geometry>
 #include <iostream>
+#include "BVH.h"
 
 namespace Graphics
 {
@@ -25,7 +26,8 @@ namespace Graphics
 		void SetFocusAt(Eigen::Vector3d lookAt);
 		void SetFovy(double fovy);
 
-		Eigen::Vector3d GetWorldPosition(int x, int y);
+		// world space ray through window pixel (x, y), origin on near plane
+		Ray GetPickRay(int x, int y);
 		Eigen::Vector3d GetEye() { return eye; };
 
 		void GetProjectionMatrix(Eigen::Matrix4f &out);
@@ -0,0 +1,105 @@
+#include "ChannelPacker.h"
+#include <sys/stat.h>
+#include <filesystem>
+#include "stb/stb_image.h"
+#include "stb/stb_image_write.h"
+#include "Constants.h"
+
+namespace Graphics
+{
+    namespace
+    {
+        // 0 if the file does not exist
+        long long ModifyTime(const char *path)
+        {
+            struct stat st;
+            if (path == nullptr || stat(path, &st) != 0)
+                return 0;
+            return (long long)st.st_mtime;
+        }
+    }
+
+    bool ChannelPacker::Pack(const char *const *paths, const uint8_t *defaults, int channelCount,
+                             int &width, int &height, std::vector<uint8_t> &pixels)
+    {
+        width = height = 0;
+        std::vector<unsigned char *> sources(channelCount, nullptr);
+        bool ok = true;
+        for (int c = 0; c < channelCount && ok; ++c)
+        {
+            if (paths[c] == nullptr)
+                continue;
+
+            int w, h, nchannel;
+            sources[c] = stbi_load(paths[c], &w, &h, &nchannel, 1);
+            if (sources[c] == nullptr)
+            {
+                GFX_LOG_ERROR_FMT("load image %s failed!", paths[c]);
+                ok = false;
+            }
+            else if (width == 0)
+            {
+                width = w;
+                height = h;
+            }
+            else if (w != width || h != height)
+            {
+                GFX_LOG_ERROR_FMT("packed maps must have the same size, %s is %dx%d, expect %dx%d", paths[c], w, h, width, height);
+                ok = false;
+            }
+        }
+
+        if (ok && width == 0)
+        {
+            GFX_LOG_ERROR("nothing to pack, all maps are missing!");
+            ok = false;
+        }
+
+        if (ok)
+        {
+            size_t pixelCount = (size_t)width * height;
+            pixels.resize(pixelCount * channelCount);
+            for (int c = 0; c < channelCount; ++c)
+            {
+                for (size_t i = 0; i < pixelCount; ++i)
+                    pixels[i * channelCount + c] = sources[c] != nullptr ? sources[c][i] : defaults[c];
+            }
+        }
+
+        for (auto source : sources)
+            stbi_image_free(source);
+        return ok;
+    }
+
+    bool ChannelPacker::PackORM(const char *aoPath, const char *roughnessPath, const char *metallicPath,
+                                int &width, int &height, std::vector<uint8_t> &pixels)
+    {
+        const char *paths[3] = {aoPath, roughnessPath, metallicPath};
+        const uint8_t defaults[3] = {255, 255, 0};
+        return Pack(paths, defaults, 3, width, height, pixels);
+    }
+
+    bool ChannelPacker::ImportORM(const char *aoPath, const char *roughnessPath, const char *metallicPath, const char *outPath)
+    {
+        long long outTime = ModifyTime(outPath);
+        if (outTime != 0 && outTime >= ModifyTime(aoPath) && outTime >= ModifyTime(roughnessPath) && outTime >= ModifyTime(metallicPath))
+            return true;
+
+        int width, height;
+        std::vector<uint8_t> pixels;
+        if (!PackORM(aoPath, roughnessPath, metallicPath, width, height, pixels))
+            return false;
+
+        std::error_code error;
+        auto outDir = std::filesystem::path(outPath).parent_path();
+        if (!outDir.empty())
+            std::filesystem::create_directories(outDir, error);
+        if (stbi_write_png(outPath, width, height, 3, pixels.data(), width * 3) == 0)
+        {
+            GFX_LOG_ERROR_FMT("write %s failed!", outPath);
+            return false;
+        }
+        GFX_LOG_OK_FMT("Imported ORM texture %s", outPath);
+        return true;
+    }
+}
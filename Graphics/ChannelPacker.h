@@ -0,0 +1,38 @@
+/**
+ * @file ChannelPacker.h
+ * @author wangyudong
+ * @brief Pack single channel material maps into channels of one image, e.g. AO, roughness and metallic into an ORM texture.
+ * No GL dependency, used at import time and by texcook.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace Graphics
+{
+    class ChannelPacker
+    {
+    public:
+        /**
+         * @brief Channel i of output is the first channel of paths[i] (gray maps converted to luminance).
+         * nullptr path fills the channel with defaults[i], all given maps must have the same size.
+         */
+        static bool Pack(const char *const *paths, const uint8_t *defaults, int channelCount,
+                         int &width, int &height, std::vector<uint8_t> &pixels);
+
+        // r: ao (default 1), g: roughness (default 1), b: metallic (default 0)
+        static bool PackORM(const char *aoPath, const char *roughnessPath, const char *metallicPath,
+                            int &width, int &height, std::vector<uint8_t> &pixels);
+
+        /**
+         * @brief Write packed ORM png to outPath, skipped if it is newer than all sources. Missing directories of outPath
+         * are created.
+         * Returns false if nothing could be written.
+         */
+        static bool ImportORM(const char *aoPath, const char *roughnessPath, const char *metallicPath, const char *outPath);
+    };
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <stdio.h>
 
 namespace Graphics
 {
@@ -15,6 +16,19 @@ namespace Graphics
         BufferUsage_Max
     };
 
+    // Used for both immutable storage creation and buffer mapping, flags not meaningful to one of them are ignored.
+    enum BufferAccessFlag
+    {
+        BufferAccessFlag_None = 0,
+        BufferAccessFlag_Read = 1,
+        BufferAccessFlag_Write = 1 << 1,
+        BufferAccessFlag_Persistent = 1 << 2,
+        BufferAccessFlag_Coherent = 1 << 3,
+        BufferAccessFlag_DynamicStorage = 1 << 4,  // storage only
+        BufferAccessFlag_InvalidateRange = 1 << 5, // map only
+        BufferAccessFlag_Unsynchronized = 1 << 6,  // map only
+    };
+
     enum BufferType
     {
         BufferType_VertexBuffer = 0,
@@ -22,6 +36,10 @@ namespace Graphics
         BufferType_UniformBuffer,
         BufferType_ShaderStorageBuffer,
         BufferType_AtomicCounter,
+        BufferType_PixelUnpackBuffer,
+        BufferType_DrawIndirectBuffer,      // arguments of indirect draws
+        BufferType_DispatchIndirectBuffer,  // arguments of indirect compute dispatches
+        BufferType_ParameterBuffer,         // draw counts of indirect count draws
         BufferType_Max
     };
 
@@ -59,7 +77,8 @@ namespace Graphics
         ShaderFlag_TesselationControl = 1 << 2,
         ShaderFlag_TesselationEval = 1 << 3,
         ShaderFlag_Fragment = 1 << 4,
-        ShaderFlag_Max = ShaderFlag_Fragment + 1
+        ShaderFlag_Compute = 1 << 5,    // alone in its program
+        ShaderFlag_Max = ShaderFlag_Compute + 1
     };
 
     enum ProgramDataType
@@ -76,6 +95,7 @@ namespace Graphics
         ProgramDataType_Sampler2D,
         ProgramDataType_Sampler3D,
         ProgramDataType_SamplerCube,
+        ProgramDataType_Sampler2DArray,
         ProgramDataType_Sampler1DShadow,
         ProgramDataType_Sampler2DShadow,
         ProgramDataType_SamplerEnd = ProgramDataType_Sampler2DShadow
@@ -154,7 +174,9 @@ namespace Graphics
     {
         TextureType_2D = 0,
         TextureType_3D,
-        TextureType_Cube
+        TextureType_Cube,
+        TextureType_2DArray,    // layers of same size and format, one layer is selected in shader
+        TextureType_Max
     };
 
     enum TextureFormat
@@ -162,6 +184,21 @@ namespace Graphics
         TextureFormat_R8G8B8A8 = 0,
         TextureFormat_R8G8B8,
         TextureFormat_R8G8,
+        // block compressed, 4x4 texels per block
+        TextureFormat_BC1,          // rgb, 8 bytes per block
+        TextureFormat_BC4,          // r, 8 bytes per block
+        TextureFormat_BC5,          // rg, 16 bytes per block, for normal maps
+        TextureFormat_BC7,          // rgba, 16 bytes per block
+        TextureFormat_ETC2_RGB8,    // upload only, 8 bytes per block
+        TextureFormat_ETC2_RGBA8,   // upload only, 16 bytes per block
+        TextureFormat_Max
+    };
+
+    enum TextureStatus
+    {
+        TextureStatus_Resident = 0, // image data is on GPU and usable
+        TextureStatus_Loading,      // streaming in, placeholder is bound instead
+        TextureStatus_Failed        // loading failed, error placeholder is bound instead
     };
 
     enum TextureFilter
@@ -184,6 +221,40 @@ namespace Graphics
         TextureWrapMode_Max
     };
 
+    // which writes of shaders must be visible to the following commands, see RenderManager::Barrier
+    enum BarrierFlag
+    {
+        BarrierFlag_None = 0,
+        BarrierFlag_VertexAttribArray = 1,
+        BarrierFlag_ElementArray = 1 << 1,
+        BarrierFlag_Uniform = 1 << 2,
+        BarrierFlag_TextureFetch = 1 << 3,
+        BarrierFlag_ShaderImageAccess = 1 << 4,
+        BarrierFlag_Command = 1 << 5,           // indirect draw and dispatch arguments
+        BarrierFlag_BufferUpdate = 1 << 6,      // buffer reads and writes by the cpu side API
+        BarrierFlag_TextureUpdate = 1 << 7,
+        BarrierFlag_ShaderStorage = 1 << 8,
+        BarrierFlag_AtomicCounter = 1 << 9,
+        BarrierFlag_All = (1 << 10) - 1
+    };
+
+    enum ImageAccess
+    {
+        ImageAccess_ReadOnly = 0,
+        ImageAccess_WriteOnly,
+        ImageAccess_ReadWrite,
+        ImageAccess_Max
+    };
+
+    // How much cpu side data a resource keeps after it has been uploaded to GPU.
+    enum RetentionPolicy
+    {
+        RetentionPolicy_Discard = 0,        // free cpu data right after upload
+        RetentionPolicy_KeepSource,         // keep source data only (e.g. mesh attributes), drop assembled copies
+        RetentionPolicy_KeepForReadback,    // keep a full copy of uploaded data
+        RetentionPolicy_Max
+    };
+
     /***********************************************
      * shader constants
      ***********************************************/
@@ -194,11 +265,20 @@ namespace Graphics
 
     #define GlobalUBOBindPoint 0
     #define PerMaterialUBOBindPoint 1
+    // chunk of the per object array without SSBO support, PER_OBJECT_CHUNK in common.tinysl
     #define PerObjectUBOBindPoint 2
+    #define PerObjectChunkSize 192
+    // SSBO view of pooled PerMaterial blocks, see MaterialBufferPool
+    #define PerMaterialSSBOBindPoint 1
+    // per object data array indexed by objectIndex
+    #define PerObjectSSBOBindPoint 2
+    // uint attribute holding the object index, instanced from base instance or a constant per draw
+    #define ObjectIndexAttribLocation 10
 
     #define GlobalUBOName "Globals"
     #define PerMaterialUBOName "PerMaterial"
     #define PerObjectUBOName "PerObject"
+    #define PerObjectSSBOName "PerObjects"
     #define INVALID_ID 0xffffffff
 
     /***********************************************
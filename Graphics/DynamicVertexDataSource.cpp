@@ -0,0 +1,174 @@
+#include "DynamicVertexDataSource.h"
+#include "RenderManager.h"
+#include "GL/glew.h"
+#include "InternalFunctions.h"
+
+namespace Graphics
+{
+    DynamicVertexDataSource::DynamicVertexDataSource(uint32_t layoutFlag, size_t maxVertexCount, size_t maxIndexCount)
+        : mLayoutFlag(layoutFlag), mMaxVertexCount(maxVertexCount), mMaxIndexCount(maxIndexCount)
+    {
+        for (int flag = 1; flag < LayoutName_Max; flag <<= 1)
+        {
+            if (mLayoutFlag & flag)
+                mVertexStride += mAttributeStride;
+        }
+
+        auto rm = RenderManager::Instance();
+        const uint32_t storageFlags = BufferAccessFlag_Write | BufferAccessFlag_Persistent | BufferAccessFlag_Coherent;
+        size_t vertexBufferSize = mVertexStride * mMaxVertexCount * SliceCount;
+        size_t indexBufferSize = sizeof(uint32_t) * mMaxIndexCount * SliceCount;
+
+        mVertexBuffer = rm->AllocBuffer(BufferType_VertexBuffer);
+        mPersistent = mVertexBuffer->BufferStorage(nullptr, vertexBufferSize, storageFlags);
+        if (mPersistent)
+            mVertexPtr = (char *)mVertexBuffer->MapRange(0, vertexBufferSize, storageFlags);
+        else
+            mVertexBuffer->BufferData(nullptr, vertexBufferSize, BufferUsage_StreamDraw);
+
+        mHasIndex = mMaxIndexCount > 0;
+        if (mHasIndex)
+        {
+            mIndexBuffer = rm->AllocBuffer(BufferType_IndexBuffer);
+            if (mPersistent)
+            {
+                mIndexBuffer->BufferStorage(nullptr, indexBufferSize, storageFlags);
+                mIndexPtr = (char *)mIndexBuffer->MapRange(0, indexBufferSize, storageFlags);
+            }
+            else
+                mIndexBuffer->BufferData(nullptr, indexBufferSize, BufferUsage_StreamDraw);
+        }
+
+        glGenVertexArrays(1, &mVAOHandle);
+        rm->BindVertexArray(mVAOHandle);
+
+        mVertexBuffer->Bind();
+        if (mHasIndex)
+            mIndexBuffer->Bind();
+
+        int count = 0;
+        for (int i = 0, flag = 1; flag < LayoutName_Max; i++, flag <<= 1)
+        {
+            if (mLayoutFlag & flag)
+            {
+                glEnableVertexAttribArray(i);
+                glVertexAttribPointer(i, 3, GL_FLOAT, GL_FALSE, (GLsizei)mVertexStride, (void *)(count * mAttributeStride));
+                ++count;
+            }
+        }
+
+        rm->SetupObjectIndexAttribute();
+        rm->BindVertexArray(0);
+        glCheckError();
+    }
+
+    DynamicVertexDataSource::~DynamicVertexDataSource()
+    {
+        for (int i = 0; i < SliceCount; ++i)
+        {
+            if (mFences[i] != nullptr)
+                glDeleteSync((GLsync)mFences[i]);
+        }
+
+        // deleting buffer unmaps it implicitly.
+        RenderManager::Instance()->ReleaseVertexArray(mVAOHandle);
+    }
+
+    void DynamicVertexDataSource::WaitSlice(int slice)
+    {
+        auto fence = (GLsync)mFences[slice];
+        if (fence == nullptr)
+            return;
+
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        while (result == GL_TIMEOUT_EXPIRED)
+        {
+            // GPU is SliceCount frames behind, flush and wait in 1ms steps.
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+
+        if (result == GL_WAIT_FAILED)
+        {
+            GFX_LOG_ERROR("Wait dynamic vertex slice fence failed!");
+        }
+
+        glDeleteSync(fence);
+        mFences[slice] = nullptr;
+    }
+
+    float *DynamicVertexDataSource::MapVertices(size_t vertexCount)
+    {
+        if (vertexCount > mMaxVertexCount)
+        {
+            GFX_LOG_ERROR_FMT("Too many dynamic vertices: %zu, max %zu", vertexCount, mMaxVertexCount);
+            vertexCount = mMaxVertexCount;
+        }
+
+        // previous slice has been submitted, fence it before moving on.
+        Prepare();
+        if (mCurrentSlice >= 0 && mFences[mCurrentSlice] == nullptr)
+            mFences[mCurrentSlice] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        mCurrentSlice = (mCurrentSlice + 1) % SliceCount;
+        WaitSlice(mCurrentSlice);
+
+        mVertexCount = vertexCount;
+        mBaseVertex = mCurrentSlice * mMaxVertexCount;
+        mIndexCount = 0;
+        mFirstIndex = mCurrentSlice * mMaxIndexCount;
+
+        size_t offset = mBaseVertex * mVertexStride;
+        if (mPersistent)
+            return (float *)(mVertexPtr + offset);
+
+        // slice is fenced, no need to let driver synchronize.
+        mVertexMapped = true;
+        return (float *)mVertexBuffer->MapRange(offset, vertexCount * mVertexStride,
+                                                BufferAccessFlag_Write | BufferAccessFlag_InvalidateRange | BufferAccessFlag_Unsynchronized);
+    }
+
+    uint32_t *DynamicVertexDataSource::MapIndices(size_t indexCount)
+    {
+        if (!mHasIndex || mCurrentSlice < 0)
+        {
+            GFX_LOG_ERROR("Map indices of a dynamic vertex source without index storage or before MapVertices!");
+            return nullptr;
+        }
+
+        if (indexCount > mMaxIndexCount)
+        {
+            GFX_LOG_ERROR_FMT("Too many dynamic indices: %zu, max %zu", indexCount, mMaxIndexCount);
+            indexCount = mMaxIndexCount;
+        }
+
+        mIndexCount = indexCount;
+        size_t offset = mFirstIndex * sizeof(uint32_t);
+        if (mPersistent)
+            return (uint32_t *)(mIndexPtr + offset);
+
+        mIndexMapped = true;
+        return (uint32_t *)mIndexBuffer->MapRange(offset, indexCount * sizeof(uint32_t),
+                                                  BufferAccessFlag_Write | BufferAccessFlag_InvalidateRange | BufferAccessFlag_Unsynchronized);
+    }
+
+    void DynamicVertexDataSource::Prepare()
+    {
+        // coherent persistent mapping needs nothing, fallback path must be unmapped before drawing.
+        if (mVertexMapped)
+        {
+            mVertexBuffer->Unmap();
+            mVertexMapped = false;
+        }
+
+        if (mIndexMapped)
+        {
+            mIndexBuffer->Unmap();
+            mIndexMapped = false;
+        }
+    }
+
+    void DynamicVertexDataSource::Bind()
+    {
+        RenderManager::Instance()->BindVertexArray(mVAOHandle);
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * @file DynamicVertexDataSource.h
+ * @author wangyudong
+ * @brief Vertex data rewritten every frame (debug lines, particles, deformation), streamed through a persistently mapped ring of buffers.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <memory>
+#include "Buffer.h"
+#include "Constants.h"
+#include "VertexDataSource.h"
+
+namespace Graphics
+{
+    /**
+     * @brief Storage is split into SliceCount slices, each frame writes to the next slice while GPU may still read
+     * the previous ones. A fence is placed after a slice is consumed, writing waits only if GPU is SliceCount frames behind.
+     * Vertex layout follows StaticMesh: interleaved 3 floats per attribute, in LayoutName order.
+     *
+     * Usage, once per frame:
+     *      float *vertices = source->MapVertices(n);     // write n * VertexStride() bytes
+     *      uint32_t *indices = source->MapIndices(m);    // optional, indices are relative to this frame's vertices
+     *      rm->DrawMesh(source, material, modelMat);
+     */
+    class DynamicVertexDataSource : public VertexDataSource
+    {
+    public:
+        typedef std::shared_ptr<DynamicVertexDataSource> SP;
+        static const int SliceCount = 3;
+
+        DynamicVertexDataSource(uint32_t layoutFlag, size_t maxVertexCount, size_t maxIndexCount = 0);
+        ~DynamicVertexDataSource();
+
+        // Advance to next slice and return its vertex memory, call once per frame before drawing.
+        float *MapVertices(size_t vertexCount);
+        // Index memory of current slice, only valid when created with maxIndexCount > 0.
+        uint32_t *MapIndices(size_t indexCount);
+
+        inline size_t VertexStride() const { return mVertexStride; }
+        inline size_t MaxVertexCount() const { return mMaxVertexCount; }
+        inline size_t MaxIndexCount() const { return mMaxIndexCount; }
+
+        void Prepare() override;
+        void Bind() override;
+        uint32_t VertexArrayHandle() override { return mVAOHandle; }
+
+    private:
+        void WaitSlice(int slice);
+
+        uint32_t mLayoutFlag;
+        size_t mVertexStride = 0;
+        size_t mMaxVertexCount;
+        size_t mMaxIndexCount;
+
+        Buffer::SP mVertexBuffer;
+        Buffer::SP mIndexBuffer;
+        uint32_t mVAOHandle = INVALID_ID;
+
+        // persistent mapping when glBufferStorage is available, otherwise map unsynchronized every frame.
+        bool mPersistent = false;
+        char *mVertexPtr = nullptr;
+        char *mIndexPtr = nullptr;
+        bool mVertexMapped = false;
+        bool mIndexMapped = false;
+
+        int mCurrentSlice = -1;
+        void *mFences[SliceCount] = {nullptr, nullptr, nullptr};
+
+        const size_t mAttributeStride = sizeof(float) * 3;
+    };
+}
@@ -0,0 +1,425 @@
+#include "GPUCullingPipeline.h"
+#include <algorithm>
+#include <string.h>
+#include "RenderManager.h"
+#include "ShaderUtil.h"
+#include "InternalFunctions.h"
+
+namespace Graphics
+{
+    // DrawElementsIndirectCommand
+    static const size_t DrawCommandSize = sizeof(uint32_t) * 5;
+    static const uint32_t CullObjectsBindPoint = 3;
+    static const uint32_t DrawCommandsBindPoint = 4;
+    static const uint32_t DrawCountsBindPoint = 5;
+
+    GPUCullingPipeline::GPUCullingPipeline(const std::string &shaderDirectory)
+    {
+        mPyramidViewProj.setIdentity();
+        if (!IsSupported())
+        {
+            GFX_LOG_ERROR("GPU culling is not supported, objects are drawn like RenderPipeline does");
+            return;
+        }
+
+        mCullProgram = ShaderUtil::LoadProgramFromTinySL(shaderDirectory + "gpu_cull.tinysl");
+        auto hizVariants = ShaderUtil::LoadVariantsFromTinySL(shaderDirectory + "hiz_build.tinysl");
+        if (hizVariants != nullptr)
+        {
+            mHiZCopyProgram = hizVariants->GetVariant(std::vector<std::string>{"COPY_DEPTH"});
+            mHiZReduceProgram = hizVariants->GetVariant(0);
+        }
+
+        auto rm = RenderManager::Instance();
+        mPerObjectBuffer = rm->AllocBuffer(BufferType_ShaderStorageBuffer);
+        for (auto pass : {&mFramePass, &mScenePass})
+        {
+            pass->cullObjectBuffer = rm->AllocBuffer(BufferType_ShaderStorageBuffer);
+            pass->commandBuffer = rm->AllocBuffer(BufferType_DrawIndirectBuffer);
+            pass->countBuffer = rm->AllocBuffer(BufferType_ParameterBuffer);
+        }
+    }
+
+    GPUCullingPipeline::~GPUCullingPipeline()
+    {
+        releaseDepthPyramid();
+    }
+
+    bool GPUCullingPipeline::IsSupported()
+    {
+        auto &info = RenderManager::Instance()->GetSystemInfo();
+        return info.computeShader && info.shaderStorageBuffer && info.multiDrawIndirect && info.indirectParameters &&
+               info.shaderImageLoadStore && info.baseInstance;
+    }
+
+    void GPUCullingPipeline::Submit()
+    {
+        // shaders of the pipeline are still compiling or failed
+        if (mCullProgram == nullptr || !mCullProgram->IsReady())
+        {
+            RenderPipeline::Submit();
+            return;
+        }
+        ensureCullUniforms();
+
+        uploadGlobals();
+        prepareObjects();
+
+        mCPUObjects.clear();
+        mGPUObjects.clear();
+        for (size_t i = 0; i < mRenderObjects.size(); ++i)
+        {
+            auto &ro = mRenderObjects[i];
+            if (isGPUObject(ro.vertexSource, ro.material))
+                mGPUObjects.push_back({static_cast<StaticMesh *>(ro.vertexSource), ro.material, &ro.objectData});
+            else
+                mCPUObjects.push_back((uint32_t)i);
+        }
+        uploadFrameObjects();
+
+        // dirty scene objects are uploaded first, the cull pass reads them
+        prepareScene();
+        if (mScene != nullptr && sceneLayoutChanged())
+            buildSceneLayout();
+        mGPUObjectCount = mGPUObjects.size() + (mScene == nullptr ? 0 : mScenePass.cullObjects.size());
+
+        drawObjects(mCPUObjects);
+        drawInstances();
+        drawScene(&mSceneCPUObjects);
+        if (!mGPUObjects.empty())
+            cullAndDraw(mFramePass, mPerObjectBuffer, (uint32_t)mGPUObjects.size());
+        if (mScene != nullptr)
+            cullAndDraw(mScenePass, mSceneObjectBuffer, (uint32_t)mScene->GetObjectCount());
+        buildDepthPyramid();
+
+        finishFrame();
+    }
+
+    bool GPUCullingPipeline::isGPUObject(VertexDataSource *source, Material *material)
+    {
+        // a program still compiling means the fallback program, which may index the array differently
+        auto mesh = dynamic_cast<StaticMesh *>(source);
+        auto shader = material->GetShader();
+        return mesh != nullptr && mesh->GetGeometryPool() != nullptr && mesh->HasIndex() && shader != nullptr && shader->IsReady() &&
+               shader->UsesPerObjectBuffer();
+    }
+
+    template<typename T>
+    void GPUCullingPipeline::uploadArray(Buffer::SP buffer, const std::vector<T> &data)
+    {
+        size_t size = sizeof(T) * data.size();
+        if (buffer->GetSize() < size)
+            buffer->BufferData((void *)data.data(), size, BufferUsage_DynamicDraw);
+        else
+            buffer->BufferSubData((void *)data.data(), 0, size);
+    }
+
+    GPUCullingPipeline::SceneMaterial GPUCullingPipeline::getSceneMaterial(Material *material)
+    {
+        auto shader = material->GetShader();
+        if (shader == nullptr)
+            return {material, nullptr, 0, false};
+        return {material, shader.get(), shader->GetGeneration(), shader->IsReady() && shader->UsesPerObjectBuffer()};
+    }
+
+    void GPUCullingPipeline::fillCullObject(CullObject &cullObject, StaticMesh *mesh, uint32_t batch, uint32_t commandBase,
+                                            uint32_t objectIndex)
+    {
+        auto &bounds = mesh->GetBounds();
+        Eigen::Vector3f center = bounds.center();
+        Eigen::Vector3f extent = bounds.sizes() * 0.5f;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            cullObject.boundsCenter[axis] = center[axis];
+            cullObject.boundsExtent[axis] = extent[axis];
+        }
+        cullObject.boundsCenter[3] = cullObject.boundsExtent[3] = 0.f;
+        cullObject.indexCount = (uint32_t)mesh->IndexCount();
+        cullObject.firstIndex = (uint32_t)mesh->FirstIndex();
+        cullObject.baseVertex = (int32_t)mesh->BaseVertex();
+        cullObject.batch = batch;
+        cullObject.commandBase = commandBase;
+        cullObject.objectIndex = objectIndex;
+        cullObject.padding[0] = cullObject.padding[1] = 0;
+    }
+
+    void GPUCullingPipeline::ensureCullUniforms()
+    {
+        if (mCullProgramGeneration == mCullProgram->GetGeneration())
+            return;
+        auto program = mCullProgram->GetProgramHandle();
+        mCullUniforms.objectCount = glGetUniformLocation(program, "objectCount");
+        mCullUniforms.viewProjection = glGetUniformLocation(program, "viewProjection");
+        mCullUniforms.pyramidViewProjection = glGetUniformLocation(program, "pyramidViewProjection");
+        mCullUniforms.occlusionEnabled = glGetUniformLocation(program, "occlusionEnabled");
+        mCullUniforms.pyramidLevels = glGetUniformLocation(program, "pyramidLevels");
+        mCullProgramGeneration = mCullProgram->GetGeneration();
+    }
+
+    bool GPUCullingPipeline::layoutChanged() const
+    {
+        if (mLayoutObjects.size() != mGPUObjects.size())
+            return true;
+        for (size_t i = 0; i < mGPUObjects.size(); ++i)
+        {
+            if (mGPUObjects[i].mesh != mLayoutObjects[i].mesh || mGPUObjects[i].material != mLayoutObjects[i].material)
+                return true;
+        }
+        // a mesh freed and another one made at the same address lives elsewhere in the pools
+        auto &cullObjects = mFramePass.cullObjects;
+        for (size_t i = 0; i < cullObjects.size(); ++i)
+        {
+            auto mesh = mGPUObjects[mLayoutOrder[i]].mesh;
+            auto &cullObject = cullObjects[i];
+            if (mesh->GetGeometryPool().get() != mFramePass.batches[cullObject.batch].pool || cullObject.firstIndex != (uint32_t)mesh->FirstIndex() ||
+                cullObject.baseVertex != (int32_t)mesh->BaseVertex() || cullObject.indexCount != (uint32_t)mesh->IndexCount())
+                return true;
+        }
+        return false;
+    }
+
+    void GPUCullingPipeline::buildLayout()
+    {
+        size_t objectCount = mGPUObjects.size();
+        mLayoutObjects = mGPUObjects;
+        mLayoutOrder.resize(objectCount);
+        for (size_t i = 0; i < objectCount; ++i)
+            mLayoutOrder[i] = (uint32_t)i;
+
+        // batches are contiguous once sorted, every batch is one indirect draw call
+        std::sort(mLayoutOrder.begin(), mLayoutOrder.end(), [this](uint32_t a, uint32_t b)
+        {
+            auto &objectA = mGPUObjects[a];
+            auto &objectB = mGPUObjects[b];
+            if (objectA.material != objectB.material)
+                return objectA.material < objectB.material;
+            return objectA.mesh->GetGeometryPool() < objectB.mesh->GetGeometryPool();
+        });
+
+        auto &batches = mFramePass.batches;
+        batches.clear();
+        mFramePass.cullObjects.resize(objectCount);
+        for (size_t i = 0; i < objectCount; ++i)
+        {
+            auto &object = mGPUObjects[mLayoutOrder[i]];
+            auto pool = object.mesh->GetGeometryPool().get();
+            if (batches.empty() || batches.back().material != object.material || batches.back().pool != pool)
+                batches.push_back({object.material, pool, (uint32_t)i, 0});
+            ++batches.back().objectCount;
+            // per object data is written in draw order
+            fillCullObject(mFramePass.cullObjects[i], object.mesh, (uint32_t)(batches.size() - 1), batches.back().firstObject, (uint32_t)i);
+        }
+        uploadArray(mFramePass.cullObjectBuffer, mFramePass.cullObjects);
+    }
+
+    void GPUCullingPipeline::uploadFrameObjects()
+    {
+        if (mGPUObjects.empty())
+            return;
+
+        size_t objectCount = mGPUObjects.size();
+        if (layoutChanged())
+        {
+            buildLayout();
+            mPerObjectData.resize(objectCount);
+            for (size_t i = 0; i < objectCount; ++i)
+                mPerObjectData[i] = *mGPUObjects[mLayoutOrder[i]].data;
+            uploadArray(mPerObjectBuffer, mPerObjectData);
+            return;
+        }
+
+        // collected objects come again every frame, only the range that differs from last frame is written
+        size_t first = objectCount, last = 0;
+        for (size_t i = 0; i < objectCount; ++i)
+        {
+            auto &data = *mGPUObjects[mLayoutOrder[i]].data;
+            if (memcmp(&mPerObjectData[i], &data, sizeof(data)) == 0)
+                continue;
+            mPerObjectData[i] = data;
+            first = std::min(first, i);
+            last = i;
+        }
+        if (first <= last)
+            mPerObjectBuffer->BufferSubData(&mPerObjectData[first], first * sizeof(RenderObject::PerObjectData),
+                                            (last - first + 1) * sizeof(RenderObject::PerObjectData));
+    }
+
+    bool GPUCullingPipeline::sceneLayoutChanged()
+    {
+        if (mSceneLayoutSortCount != mSceneSortCount)
+            return true;
+        for (auto &state : mSceneMaterials)
+        {
+            auto current = getSceneMaterial(state.material);
+            if (current.shader != state.shader || current.generation != state.generation || current.usable != state.usable)
+                return true;
+        }
+        return false;
+    }
+
+    void GPUCullingPipeline::buildSceneLayout()
+    {
+        mSceneLayoutSortCount = mSceneSortCount;
+        mSceneCPUObjects.clear();
+        mSceneMaterials.clear();
+        auto &batches = mScenePass.batches;
+        auto &cullObjects = mScenePass.cullObjects;
+        batches.clear();
+        cullObjects.clear();
+
+        // scene order is by material then VAO, one VAO per pool, so batches are contiguous already
+        for (auto index : mSceneDrawOrder)
+        {
+            auto material = mScene->GetMaterial(index);
+            if (mSceneMaterials.empty() || mSceneMaterials.back().material != material)
+                mSceneMaterials.push_back(getSceneMaterial(material));
+
+            auto mesh = mScene->GetMesh(index);
+            if (!isGPUObject(mesh, material))
+            {
+                mSceneCPUObjects.push_back(index);
+                continue;
+            }
+            auto staticMesh = static_cast<StaticMesh *>(mesh);
+            auto pool = staticMesh->GetGeometryPool().get();
+            if (batches.empty() || batches.back().material != material || batches.back().pool != pool)
+                batches.push_back({material, pool, (uint32_t)cullObjects.size(), 0});
+            ++batches.back().objectCount;
+            cullObjects.emplace_back();
+            fillCullObject(cullObjects.back(), staticMesh, (uint32_t)(batches.size() - 1), batches.back().firstObject, index);
+        }
+        if (!cullObjects.empty())
+            uploadArray(mScenePass.cullObjectBuffer, cullObjects);
+    }
+
+    void GPUCullingPipeline::cullAndDraw(CullPass &pass, Buffer::SP perObjectBuffer, uint32_t objectIndexCount)
+    {
+        if (pass.cullObjects.empty())
+            return;
+
+        size_t objectCount = pass.cullObjects.size();
+        // counts start from zero every frame, the cull pass appends to them
+        mZeroCounts.assign(pass.batches.size(), 0);
+        uploadArray(pass.countBuffer, mZeroCounts);
+        if (pass.commandBuffer->GetSize() < objectCount * DrawCommandSize)
+            pass.commandBuffer->BufferData(nullptr, objectCount * DrawCommandSize, BufferUsage_DynamicDraw);
+        auto rm = RenderManager::Instance();
+        rm->ReserveObjectIndices(objectIndexCount);
+        rm->BindStorageBuffer(perObjectBuffer, PerObjectSSBOBindPoint);
+        rm->BindStorageBuffer(pass.cullObjectBuffer, CullObjectsBindPoint);
+        rm->BindStorageBuffer(pass.commandBuffer, DrawCommandsBindPoint);
+        rm->BindStorageBuffer(pass.countBuffer, DrawCountsBindPoint);
+
+        bool occlusion = mOcclusionCulling && mPyramidValid;
+        mCullProgram->UseProgram();
+        glUniform1ui(mCullUniforms.objectCount, (GLuint)objectCount);
+        glUniformMatrix4fv(mCullUniforms.viewProjection, 1, GL_FALSE, mGlobalData.vpMat.data());
+        glUniformMatrix4fv(mCullUniforms.pyramidViewProjection, 1, GL_FALSE, mPyramidViewProj.data());
+        glUniform1i(mCullUniforms.occlusionEnabled, occlusion ? 1 : 0);
+        glUniform1i(mCullUniforms.pyramidLevels, mPyramidLevels);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, occlusion ? mDepthPyramid : 0);
+        glBindSampler(0, 0);
+
+        auto groupSize = mCullProgram->GetWorkGroupSize()[0];
+        rm->Dispatch(mCullProgram, (uint32_t)((objectCount + groupSize - 1) / groupSize));
+        rm->Barrier(BarrierFlag_Command | BarrierFlag_ShaderStorage);
+
+        for (size_t batchIndex = 0; batchIndex < pass.batches.size(); ++batchIndex)
+        {
+            auto &batch = pass.batches[batchIndex];
+            if (!batch.material->Use())
+                continue;
+            batch.material->SetStates();
+            batch.pool->Bind();
+            rm->MultiDrawElementsIndirectCount(DrawType_Triangles, pass.commandBuffer, batch.firstObject * DrawCommandSize, pass.countBuffer,
+                                               batchIndex * sizeof(uint32_t), batch.objectCount);
+        }
+    }
+
+    void GPUCullingPipeline::buildDepthPyramid()
+    {
+        if (!mOcclusionCulling || mHiZCopyProgram == nullptr || mHiZReduceProgram == nullptr || !mHiZCopyProgram->IsReady() ||
+            !mHiZReduceProgram->IsReady())
+        {
+            mPyramidValid = false;
+            return;
+        }
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        if (viewport[2] <= 0 || viewport[3] <= 0)
+            return;
+        if (viewport[2] != mPyramidWidth || viewport[3] != mPyramidHeight)
+            resizeDepthPyramid(viewport[2], viewport[3]);
+
+        // depth of the frame just drawn, from the read framebuffer
+        glActiveTexture(GL_TEXTURE0);
+        glBindSampler(0, 0);
+        glBindTexture(GL_TEXTURE_2D, mDepthTexture);
+        glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1], mPyramidWidth, mPyramidHeight);
+
+        auto rm = RenderManager::Instance();
+        auto dispatch = [rm](ShaderProgram::SP program, int width, int height)
+        {
+            auto groupSize = program->GetWorkGroupSize();
+            rm->Dispatch(program, (uint32_t)((width + groupSize[0] - 1) / groupSize[0]), (uint32_t)((height + groupSize[1] - 1) / groupSize[1]));
+        };
+
+        glBindImageTexture(0, mDepthPyramid, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        dispatch(mHiZCopyProgram, mPyramidWidth, mPyramidHeight);
+
+        int width = mPyramidWidth;
+        int height = mPyramidHeight;
+        for (int level = 1; level < mPyramidLevels; ++level)
+        {
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+            rm->Barrier(BarrierFlag_ShaderImageAccess);
+            glBindImageTexture(1, mDepthPyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glBindImageTexture(0, mDepthPyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            dispatch(mHiZReduceProgram, width, height);
+        }
+        rm->Barrier(BarrierFlag_TextureFetch);
+        glCheckError();
+
+        mPyramidViewProj = mGlobalData.vpMat;
+        mPyramidValid = true;
+    }
+
+    void GPUCullingPipeline::resizeDepthPyramid(int width, int height)
+    {
+        releaseDepthPyramid();
+
+        mPyramidWidth = width;
+        mPyramidHeight = height;
+        mPyramidLevels = 1;
+        while ((std::max(width, height) >> mPyramidLevels) > 0)
+            ++mPyramidLevels;
+
+        glGenTextures(1, &mDepthTexture);
+        glBindTexture(GL_TEXTURE_2D, mDepthTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glGenTextures(1, &mDepthPyramid);
+        glBindTexture(GL_TEXTURE_2D, mDepthPyramid);
+        glTexStorage2D(GL_TEXTURE_2D, mPyramidLevels, GL_R32F, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glCheckError();
+    }
+
+    void GPUCullingPipeline::releaseDepthPyramid()
+    {
+        if (mDepthTexture != 0)
+            glDeleteTextures(1, &mDepthTexture);
+        if (mDepthPyramid != 0)
+            glDeleteTextures(1, &mDepthPyramid);
+        mDepthTexture = mDepthPyramid = 0;
+        mPyramidWidth = mPyramidHeight = mPyramidLevels = 0;
+        mPyramidValid = false;
+    }
+}
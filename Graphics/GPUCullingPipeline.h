@@ -0,0 +1,169 @@
+/**
+ * @file GPUCullingPipeline.h
+ * @author wangyudong
+ * @brief Pipeline culling static meshes on GPU: a compute pass tests frustum and Hi-Z occlusion and writes compacted
+ * indirect draws, which are drawn with one MultiDrawElementsIndirectCount per material and geometry pool.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include "RenderPipeline.h"
+#include "ShaderVariants.h"
+
+namespace Graphics
+{
+    /**
+     * @brief Collected and scene objects go through the GPU path when their vertex source is a pooled StaticMesh and the
+     * material shader is built and reads the PerObjects storage buffer, everything else is drawn like RenderPipeline does.
+     *
+     * Per object data of collected objects is uploaded in one write, their bounds and draw arguments only when the meshes
+     * and materials collected change. Scene objects are batched once per scene change and read the per object data
+     * RenderPipeline keeps for the scene, where only dirty objects are written. A compute pass per set tests every object
+     * against the frustum and the depth pyramid of the previous frame, reprojected with its view projection matrix, then
+     * appends a draw command to its batch with an atomic counter. The command's base instance is the object index, which
+     * reaches the vertex shader through the objectIndex attribute like other draws, so no per draw work is left on CPU side.
+     * After drawing, depth is copied and reduced into the pyramid for the next frame. An object uncovered this frame shows
+     * one frame late at worst, the usual trade of previous frame occlusion.
+     *
+     * Needs compute shaders, storage buffers, base instance, multi draw indirect and indirect parameters (see IsSupported),
+     * Submit draws everything like RenderPipeline without them.
+     */
+    class GPUCullingPipeline : public RenderPipeline
+    {
+    public:
+        typedef std::shared_ptr<GPUCullingPipeline> SP;
+
+        // gpu_cull.tinysl and hiz_build.tinysl are loaded from shaderDirectory
+        GPUCullingPipeline(const std::string &shaderDirectory = "Graphics/shaders/");
+        ~GPUCullingPipeline();
+
+        static bool IsSupported();
+
+        void Submit() override;
+
+        // frustum culling stays on when occlusion culling is off
+        void EnableOcclusionCulling(bool enabled) { mOcclusionCulling = enabled; }
+        // objects that went through the GPU path in last frame, drawn or culled
+        inline size_t GetGPUObjectCount() const { return mGPUObjectCount; }
+
+    private:
+        // matches CullObject of gpu_cull.tinysl, std430
+        struct CullObject
+        {
+            float boundsCenter[4];  // object space, w unused
+            float boundsExtent[4];  // half size
+            uint32_t indexCount;
+            uint32_t firstIndex;
+            int32_t baseVertex;
+            uint32_t batch;         // index of draw count
+            uint32_t commandBase;   // first command of the batch
+            uint32_t objectIndex;   // of per object data, base instance of the command
+            uint32_t padding[2];
+        };
+
+        // collected object on the GPU path
+        struct GPUObject
+        {
+            StaticMesh *mesh;
+            Material *material;
+            const RenderObject::PerObjectData *data;
+        };
+
+        struct Batch
+        {
+            Material *material;
+            GeometryPool *pool;
+            uint32_t firstObject;   // in draw order
+            uint32_t objectCount;
+        };
+
+        // objects culled by one dispatch against one per object buffer, their batches and draws
+        struct CullPass
+        {
+            std::vector<Batch> batches;
+            std::vector<CullObject> cullObjects;
+            Buffer::SP cullObjectBuffer;
+            Buffer::SP commandBuffer;
+            Buffer::SP countBuffer;
+        };
+
+        // shader state deciding whether objects of a scene material go through the GPU path
+        struct SceneMaterial
+        {
+            Material *material;
+            ShaderProgram *shader;
+            uint32_t generation;
+            bool usable;
+        };
+
+        // uniforms of gpu_cull.tinysl, looked up again when the program is rebuilt
+        struct CullUniforms
+        {
+            int objectCount = -1;
+            int viewProjection = -1;
+            int pyramidViewProjection = -1;
+            int occlusionEnabled = -1;
+            int pyramidLevels = -1;
+        };
+
+        static bool isGPUObject(VertexDataSource *source, Material *material);
+        static SceneMaterial getSceneMaterial(Material *material);
+        static void fillCullObject(CullObject &cullObject, StaticMesh *mesh, uint32_t batch, uint32_t commandBase, uint32_t objectIndex);
+        void ensureCullUniforms();
+        // sort order, batches and cull records are kept while objects come with the same meshes and materials
+        bool layoutChanged() const;
+        void buildLayout();
+        // cull records of collected objects and their per object data in draw order
+        void uploadFrameObjects();
+        // scene batches follow the scene order, they are built again when it is sorted again or shaders of its materials change
+        bool sceneLayoutChanged();
+        void buildSceneLayout();
+        // objectIndexCount is one past the largest object index of the pass
+        void cullAndDraw(CullPass &pass, Buffer::SP perObjectBuffer, uint32_t objectIndexCount);
+        // copy depth of the frame drawn and reduce it into the pyramid
+        void buildDepthPyramid();
+        void resizeDepthPyramid(int width, int height);
+        void releaseDepthPyramid();
+        template<typename T>
+        static void uploadArray(Buffer::SP buffer, const std::vector<T> &data);
+
+        ShaderProgram::SP mCullProgram;
+        CullUniforms mCullUniforms;
+        uint32_t mCullProgramGeneration = UINT32_MAX;
+        ShaderProgram::SP mHiZCopyProgram;
+        ShaderProgram::SP mHiZReduceProgram;
+
+        std::vector<uint32_t> mCPUObjects;
+        // in collect order
+        std::vector<GPUObject> mGPUObjects;
+        // mGPUObjects of the frame the layout was built in, and their draw order
+        std::vector<GPUObject> mLayoutObjects;
+        std::vector<uint32_t> mLayoutOrder;
+        std::vector<RenderObject::PerObjectData> mPerObjectData;
+        Buffer::SP mPerObjectBuffer;
+        CullPass mFramePass;
+
+        // scene objects are culled against the per object buffer of RenderPipeline, indexed by dense index. Dense
+        // indices left to RenderPipeline::drawScene, in its order
+        std::vector<uint32_t> mSceneCPUObjects;
+        std::vector<SceneMaterial> mSceneMaterials;
+        // mSceneSortCount the scene batches were built from
+        uint32_t mSceneLayoutSortCount = UINT32_MAX;
+        CullPass mScenePass;
+
+        std::vector<uint32_t> mZeroCounts;
+        size_t mGPUObjectCount = 0;
+
+        bool mOcclusionCulling = true;
+        // depth of last frame and its max reduction chain, raw GL textures owned here
+        uint32_t mDepthTexture = 0;
+        uint32_t mDepthPyramid = 0;
+        int mPyramidWidth = 0;
+        int mPyramidHeight = 0;
+        int mPyramidLevels = 0;
+        bool mPyramidValid = false;
+        Eigen::Matrix4f mPyramidViewProj;
+    };
+}
@@ -0,0 +1,210 @@
+#include "GeometryPool.h"
+#include <algorithm>
+#include "RenderManager.h"
+#include "GL/glew.h"
+#include "InternalFunctions.h"
+
+namespace Graphics
+{
+    bool FreeListAllocator::Allocate(size_t count, size_t &offset)
+    {
+        for (auto iter = mFreeBlocks.begin(); iter != mFreeBlocks.end(); ++iter)
+        {
+            if (iter->second < count)
+                continue;
+
+            offset = iter->first;
+            size_t remain = iter->second - count;
+            mFreeBlocks.erase(iter);
+            if (remain > 0)
+                mFreeBlocks.insert(std::make_pair(offset + count, remain));
+            mUsed += count;
+            return true;
+        }
+        return false;
+    }
+
+    void FreeListAllocator::Free(size_t offset, size_t count)
+    {
+        if (count == 0)
+            return;
+
+        mUsed -= count;
+        auto iter = mFreeBlocks.insert(std::make_pair(offset, count)).first;
+
+        // merge with next block
+        auto next = std::next(iter);
+        if (next != mFreeBlocks.end() && iter->first + iter->second == next->first)
+        {
+            iter->second += next->second;
+            mFreeBlocks.erase(next);
+        }
+
+        // merge with previous block
+        if (iter != mFreeBlocks.begin())
+        {
+            auto prev = std::prev(iter);
+            if (prev->first + prev->second == iter->first)
+            {
+                prev->second += iter->second;
+                mFreeBlocks.erase(iter);
+            }
+        }
+    }
+
+    void FreeListAllocator::Grow(size_t newCapacity)
+    {
+        if (newCapacity <= mCapacity)
+            return;
+
+        size_t oldCapacity = mCapacity;
+        mCapacity = newCapacity;
+        // Free() counts the range as used, balance it first.
+        mUsed += newCapacity - oldCapacity;
+        Free(oldCapacity, newCapacity - oldCapacity);
+    }
+
+    size_t GeometryPool::GetVertexStride(uint32_t layoutFlag)
+    {
+        size_t stride = 0;
+        for (int flag = 1; flag < LayoutName_Max; flag <<= 1)
+        {
+            if (layoutFlag & flag)
+                stride += sizeof(float) * 3;
+        }
+        return stride;
+    }
+
+    GeometryPool::GeometryPool(uint32_t layoutFlag)
+        : mLayoutFlag(layoutFlag), mVertexStride(GetVertexStride(layoutFlag))
+    {
+        auto rm = RenderManager::Instance();
+        mVertexBuffer = rm->AllocBuffer(BufferType_VertexBuffer);
+        mVertexBuffer->BufferData(nullptr, InitialVertexCapacity * mVertexStride, BufferUsage_StaticDraw);
+        mVertexAllocator.Grow(InitialVertexCapacity);
+
+        mIndexBuffer = rm->AllocBuffer(BufferType_IndexBuffer);
+        mIndexBuffer->BufferData(nullptr, InitialIndexCapacity * sizeof(uint32_t), BufferUsage_StaticDraw);
+        mIndexAllocator.Grow(InitialIndexCapacity);
+
+        glGenVertexArrays(1, &mVAOHandle);
+        SetupVAO();
+    }
+
+    GeometryPool::~GeometryPool()
+    {
+        RenderManager::Instance()->ReleaseVertexArray(mVAOHandle);
+    }
+
+    void GeometryPool::SetupVAO()
+    {
+        auto rm = RenderManager::Instance();
+        rm->BindVertexArray(mVAOHandle);
+
+        mVertexBuffer->Bind();
+        mIndexBuffer->Bind();
+
+        int count = 0;
+        for (int i = 0, flag = 1; flag < LayoutName_Max; i++, flag <<= 1)
+        {
+            if (mLayoutFlag & flag)
+            {
+                glEnableVertexAttribArray(i);
+                glVertexAttribPointer(i, 3, GL_FLOAT, GL_FALSE, (GLsizei)mVertexStride, (void *)(count * mAttributeStride));
+                ++count;
+            }
+        }
+
+        rm->SetupObjectIndexAttribute();
+        rm->BindVertexArray(0);
+        glCheckError();
+    }
+
+    bool GeometryPool::Allocate(size_t vertexCount, size_t indexCount, Allocation &out)
+    {
+        if (vertexCount == 0)
+            return false;
+
+        if (!mVertexAllocator.Allocate(vertexCount, out.vertexOffset))
+        {
+            // growing by the requested count guarantees a big enough block at the end
+            GrowVertexBuffer(mVertexAllocator.Capacity() + vertexCount);
+            if (!mVertexAllocator.Allocate(vertexCount, out.vertexOffset))
+                return false;
+        }
+        out.vertexCount = vertexCount;
+
+        out.indexOffset = 0;
+        out.indexCount = indexCount;
+        if (indexCount > 0 && !mIndexAllocator.Allocate(indexCount, out.indexOffset))
+        {
+            GrowIndexBuffer(mIndexAllocator.Capacity() + indexCount);
+            if (!mIndexAllocator.Allocate(indexCount, out.indexOffset))
+            {
+                mVertexAllocator.Free(out.vertexOffset, out.vertexCount);
+                out.vertexCount = 0;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void GeometryPool::Free(Allocation &allocation)
+    {
+        if (!allocation.IsValid())
+            return;
+
+        mVertexAllocator.Free(allocation.vertexOffset, allocation.vertexCount);
+        mIndexAllocator.Free(allocation.indexOffset, allocation.indexCount);
+        allocation = Allocation();
+    }
+
+    void GeometryPool::UploadVertices(const Allocation &allocation, const void *data)
+    {
+        mVertexBuffer->BufferSubData((void *)data, allocation.vertexOffset * mVertexStride, allocation.vertexCount * mVertexStride);
+    }
+
+    void GeometryPool::UploadIndices(const Allocation &allocation, const uint32_t *indices)
+    {
+        if (allocation.indexCount == 0)
+            return;
+        mIndexBuffer->BufferSubData((void *)indices, allocation.indexOffset * sizeof(uint32_t), allocation.indexCount * sizeof(uint32_t));
+    }
+
+    void GeometryPool::Bind()
+    {
+        RenderManager::Instance()->BindVertexArray(mVAOHandle);
+    }
+
+    Buffer::SP GeometryPool::GrowBuffer(Buffer::SP buffer, BufferType type, size_t oldSize, size_t newSize)
+    {
+        auto newBuffer = RenderManager::Instance()->AllocBuffer(type);
+        newBuffer->BufferData(nullptr, newSize, BufferUsage_StaticDraw);
+
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer->GetBufferHandle());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer->GetBufferHandle());
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glCheckError();
+        return newBuffer;
+    }
+
+    void GeometryPool::GrowVertexBuffer(size_t minCapacity)
+    {
+        size_t oldCapacity = mVertexAllocator.Capacity();
+        size_t newCapacity = std::max(oldCapacity * 2, minCapacity);
+        mVertexBuffer = GrowBuffer(mVertexBuffer, BufferType_VertexBuffer, oldCapacity * mVertexStride, newCapacity * mVertexStride);
+        mVertexAllocator.Grow(newCapacity);
+        SetupVAO();
+    }
+
+    void GeometryPool::GrowIndexBuffer(size_t minCapacity)
+    {
+        size_t oldCapacity = mIndexAllocator.Capacity();
+        size_t newCapacity = std::max(oldCapacity * 2, minCapacity);
+        mIndexBuffer = GrowBuffer(mIndexBuffer, BufferType_IndexBuffer, oldCapacity * sizeof(uint32_t), newCapacity * sizeof(uint32_t));
+        mIndexAllocator.Grow(newCapacity);
+        SetupVAO();
+    }
+}
@@ -0,0 +1,96 @@
+/**
+ * @file GeometryPool.h
+ * @author wangyudong
+ * @brief Large shared vertex/index buffers that static meshes of the same vertex layout are suballocated from.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <memory>
+#include <map>
+#include "Buffer.h"
+#include "Constants.h"
+
+namespace Graphics
+{
+    // First-fit free list over a range of elements, adjacent free blocks are merged on free.
+    class FreeListAllocator
+    {
+    public:
+        FreeListAllocator(size_t capacity = 0) { Grow(capacity); }
+
+        // returns false if no free block is big enough
+        bool Allocate(size_t count, size_t &offset);
+        void Free(size_t offset, size_t count);
+        // append [capacity, newCapacity) as free space
+        void Grow(size_t newCapacity);
+
+        inline size_t Capacity() const { return mCapacity; }
+        inline size_t UsedCount() const { return mUsed; }
+
+    private:
+        std::map<size_t, size_t> mFreeBlocks; // offset -> count
+        size_t mCapacity = 0;
+        size_t mUsed = 0;
+    };
+
+    /**
+     * @brief One vertex buffer, one index buffer and one VAO shared by all meshes with the same layout flag.
+     * Meshes keep offsets into the pool and draw with base vertex / first index, so consecutive draws don't rebind VAO.
+     * Buffers grow by copying on GPU, the VAO is updated in place so allocations stay valid.
+     */
+    class GeometryPool
+    {
+    public:
+        typedef std::shared_ptr<GeometryPool> SP;
+
+        struct Allocation
+        {
+            size_t vertexOffset = 0;
+            size_t vertexCount = 0;
+            size_t indexOffset = 0;
+            size_t indexCount = 0;
+
+            bool IsValid() const { return vertexCount > 0; }
+        };
+
+        GeometryPool(uint32_t layoutFlag);
+        ~GeometryPool();
+
+        bool Allocate(size_t vertexCount, size_t indexCount, Allocation &out);
+        void Free(Allocation &allocation);
+
+        void UploadVertices(const Allocation &allocation, const void *data);
+        void UploadIndices(const Allocation &allocation, const uint32_t *indices);
+
+        void Bind();
+
+        inline uint32_t GetLayoutFlag() const { return mLayoutFlag; }
+        inline size_t GetVertexStride() const { return mVertexStride; }
+        inline uint32_t GetVAOHandle() const { return mVAOHandle; }
+
+        static size_t GetVertexStride(uint32_t layoutFlag);
+
+    private:
+        void GrowVertexBuffer(size_t minCapacity);
+        void GrowIndexBuffer(size_t minCapacity);
+        Buffer::SP GrowBuffer(Buffer::SP buffer, BufferType type, size_t oldSize, size_t newSize);
+        void SetupVAO();
+
+        uint32_t mLayoutFlag;
+        size_t mVertexStride;
+
+        FreeListAllocator mVertexAllocator;
+        FreeListAllocator mIndexAllocator;
+
+        Buffer::SP mVertexBuffer;
+        Buffer::SP mIndexBuffer;
+        uint32_t mVAOHandle = INVALID_ID;
+
+        static const size_t InitialVertexCapacity = 16 * 1024;
+        static const size_t InitialIndexCapacity = 48 * 1024;
+        const size_t mAttributeStride = sizeof(float) * 3;
+    };
+}
@@ -0,0 +1,126 @@
+/**
+ * @file HandlePool.h
+ * @author wangyudong
+ * @brief Typed contiguous pools addressed by 32 bit generational handles.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "Constants.h"
+
+namespace Graphics
+{
+    /**
+     * @brief Low 20 bits index a pool slot, high 12 bits are the generation of the slot when the handle was made.
+     * Tag is the type the handle refers to, so handles of different pools do not convert to each other.
+     */
+    template <typename Tag>
+    struct PoolHandle
+    {
+        static const uint32_t IndexBits = 20;
+        static const uint32_t IndexMask = (1u << IndexBits) - 1;
+        static const uint32_t GenerationMask = (1u << (32 - IndexBits)) - 1;
+        // the last index is never used, so no live handle equals INVALID_ID
+        static const uint32_t MaxCount = IndexMask;
+
+        uint32_t value = INVALID_ID;
+
+        inline uint32_t Index() const { return value & IndexMask; }
+        inline uint32_t Generation() const { return value >> IndexBits; }
+        inline bool IsValid() const { return value != INVALID_ID; }
+        inline bool operator==(const PoolHandle &other) const { return value == other.value; }
+        inline bool operator!=(const PoolHandle &other) const { return value != other.value; }
+
+        static inline PoolHandle Make(uint32_t index, uint32_t generation)
+        {
+            PoolHandle handle;
+            handle.value = (index & IndexMask) | ((generation & GenerationMask) << IndexBits);
+            return handle;
+        }
+    };
+
+    /**
+     * @brief Items live in one array indexed by handle, freed slots are reused and their generation increases, so a
+     * handle to a removed item is rejected until the generation wraps around (4096 reuses of the slot). Lookups are an
+     * index and a compare, no hashing and no reference counting.
+     */
+    template <typename T, typename Tag>
+    class HandlePool
+    {
+    public:
+        typedef PoolHandle<Tag> Handle;
+
+        // invalid handle when the pool is full
+        Handle Add(const T &item)
+        {
+            uint32_t index;
+            if (!mFreeSlots.empty())
+            {
+                index = mFreeSlots.back();
+                mFreeSlots.pop_back();
+                mItems[index] = item;
+            }
+            else
+            {
+                if (mItems.size() >= Handle::MaxCount)
+                    return Handle();
+                index = (uint32_t)mItems.size();
+                mItems.push_back(item);
+                mGenerations.push_back(0);
+                mLive.push_back(0);
+            }
+            mLive[index] = 1;
+            ++mCount;
+            return Handle::Make(index, mGenerations[index]);
+        }
+
+        // false if handle is stale
+        bool Remove(Handle handle)
+        {
+            if (!IsValid(handle))
+                return false;
+            auto index = handle.Index();
+            // drops whatever the item owns
+            mItems[index] = T();
+            mLive[index] = 0;
+            mGenerations[index] = (mGenerations[index] + 1) & Handle::GenerationMask;
+            mFreeSlots.push_back(index);
+            --mCount;
+            return true;
+        }
+
+        inline bool IsValid(Handle handle) const
+        {
+            auto index = handle.Index();
+            return index < mItems.size() && mLive[index] && mGenerations[index] == handle.Generation();
+        }
+
+        // nullptr if handle is stale, pointers are invalidated by Add
+        inline T *Get(Handle handle) { return IsValid(handle) ? &mItems[handle.Index()] : nullptr; }
+        inline const T *Get(Handle handle) const { return IsValid(handle) ? &mItems[handle.Index()] : nullptr; }
+
+        inline size_t GetCount() const { return mCount; }
+
+        // every live item in slot order
+        template <typename F>
+        void ForEach(F func) const
+        {
+            for (size_t i = 0; i < mItems.size(); ++i)
+            {
+                if (mLive[i])
+                    func(mItems[i]);
+            }
+        }
+
+    private:
+        std::vector<T> mItems;
+        std::vector<uint16_t> mGenerations;
+        std::vector<uint8_t> mLive;
+        std::vector<uint32_t> mFreeSlots;
+        size_t mCount = 0;
+    };
+}
@@ -0,0 +1,189 @@
+#include "HotReload.h"
+#include <algorithm>
+#include <filesystem>
+#include "TinySLParser.h"
+#include "ShaderUtil.h"
+#include "ShaderVariants.h"
+#include "TextureStreamer.h"
+#include "TextureResidency.h"
+
+namespace Graphics
+{
+    HotReload *HotReload::mInstance = nullptr;
+
+    HotReload *HotReload::Instance()
+    {
+        if (mInstance == nullptr)
+            mInstance = new HotReload();
+        return mInstance;
+    }
+
+    std::string HotReload::normalize(const std::string &path)
+    {
+        std::error_code error;
+        auto absolute = std::filesystem::absolute(path, error);
+        if (error)
+            absolute = path;
+        return absolute.lexically_normal().generic_string();
+    }
+
+    void HotReload::SetWatchCallback(WatchCallback callback)
+    {
+        mWatchCallback = callback;
+        if (!mWatchCallback)
+            return;
+        for (auto &pair : mWatchedFiles)
+            mWatchCallback(pair.second);
+    }
+
+    void HotReload::watch(const std::string &path)
+    {
+        auto normalized = normalize(path);
+        if (mWatchedFiles.count(normalized))
+            return;
+        mWatchedFiles[normalized] = path;
+        if (mWatchCallback)
+            mWatchCallback(path);
+    }
+
+    HotReload::ShaderEntry &HotReload::addShaderEntry(const std::vector<std::string> &sourceFiles)
+    {
+        auto key = normalize(sourceFiles.front());
+        auto &entry = mShaders[key];
+        entry.sourceFiles = sourceFiles;
+        for (auto &file : sourceFiles)
+        {
+            mShaderDependents[normalize(file)].insert(key);
+            watch(file);
+        }
+        return entry;
+    }
+
+    void HotReload::AddProgram(ShaderProgram::SP program, const std::vector<std::string> &sourceFiles, const std::string &defines)
+    {
+        if (sourceFiles.empty())
+            return;
+        addShaderEntry(sourceFiles).programs.push_back({program, defines});
+    }
+
+    void HotReload::AddVariants(std::shared_ptr<ShaderVariants> variants)
+    {
+        auto &sourceFiles = variants->GetSourceFiles();
+        if (sourceFiles.empty())
+            return;
+        addShaderEntry(sourceFiles).variants.push_back(variants);
+    }
+
+    void HotReload::AddTexture(Texture::SP texture, const std::string &path)
+    {
+        auto &textures = mTextures[normalize(path)];
+        for (auto &weak : textures)
+        {
+            if (weak.lock() == texture)
+                return;
+        }
+        textures.push_back(texture);
+        watch(path);
+    }
+
+    void HotReload::OnFileChanged(const std::string &path)
+    {
+        auto normalized = normalize(path);
+
+        auto dependents = mShaderDependents.find(normalized);
+        if (dependents != mShaderDependents.end())
+        {
+            // reloading may add includes to the set, iterate a copy
+            auto tinyslFiles = dependents->second;
+            for (auto &file : tinyslFiles)
+                reloadShader(file);
+        }
+
+        auto textures = mTextures.find(normalized);
+        if (textures != mTextures.end())
+        {
+            auto &list = textures->second;
+            list.erase(std::remove_if(list.begin(), list.end(), [](const std::weak_ptr<Texture> &weak) { return weak.expired(); }),
+                       list.end());
+            for (auto &weak : list)
+            {
+                auto texture = weak.lock();
+                if (!reloadTexture(texture, path))
+                    mPendingTextures.emplace_back(texture, path);
+            }
+        }
+    }
+
+    void HotReload::Update()
+    {
+        if (mPendingTextures.empty())
+            return;
+
+        auto pending = std::move(mPendingTextures);
+        mPendingTextures.clear();
+        for (auto &pair : pending)
+        {
+            auto texture = pair.first.lock();
+            if (texture != nullptr && !reloadTexture(texture, pair.second))
+                mPendingTextures.push_back(pair);
+        }
+    }
+
+    void HotReload::reloadShader(const std::string &tinyslFile)
+    {
+        auto &entry = mShaders[tinyslFile];
+        entry.programs.erase(std::remove_if(entry.programs.begin(), entry.programs.end(),
+                                            [](const ProgramEntry &program) { return program.program.expired(); }),
+                             entry.programs.end());
+        entry.variants.erase(std::remove_if(entry.variants.begin(), entry.variants.end(),
+                                            [](const std::weak_ptr<ShaderVariants> &variants) { return variants.expired(); }),
+                             entry.variants.end());
+        if (entry.programs.empty() && entry.variants.empty())
+            return;
+
+        TinySLProgram parsed;
+        if (!TinySLParser::Parse(entry.sourceFiles.front(), parsed))
+        {
+            GFX_LOG_ERROR_FMT("Reload %s failed, old programs are kept", entry.sourceFiles.front().c_str());
+            return;
+        }
+
+        // includes may have been added or removed
+        for (auto &file : entry.sourceFiles)
+            mShaderDependents[normalize(file)].erase(tinyslFile);
+        entry.sourceFiles = parsed.sourceFiles;
+        for (auto &file : entry.sourceFiles)
+        {
+            mShaderDependents[normalize(file)].insert(tinyslFile);
+            watch(file);
+        }
+
+        ShaderUtil::PrependVersionString(parsed);
+        // variants not built yet are created from the new sources
+        for (auto &weak : entry.variants)
+            weak.lock()->SetSources(parsed);
+
+        int rebuilt = 0;
+        for (auto &programEntry : entry.programs)
+        {
+            auto program = programEntry.program.lock();
+            if (program->Rebuild(ShaderVariants::CreateProgram(parsed, programEntry.defines)))
+                ++rebuilt;
+        }
+        GFX_LOG_OK_FMT("Reloaded %s, %d of %d programs rebuilt", entry.sourceFiles.front().c_str(), rebuilt,
+                       (int)entry.programs.size());
+    }
+
+    bool HotReload::reloadTexture(Texture::SP texture, const std::string &path)
+    {
+        // a second stream into a texture still loading would race the first one, a restore in flight would put levels
+        // of the old image back on top of the new one
+        if (texture->GetStatus() == TextureStatus_Loading || TextureResidency::Instance()->IsRestoring(texture.get()))
+            return false;
+
+        TextureStreamer::Instance()->Load(texture, path);
+        TextureResidency::Instance()->SourceChanged(texture.get());
+        GFX_LOG_OK_FMT("Reloading texture %s", path.c_str());
+        return true;
+    }
+}
@@ -0,0 +1,93 @@
+/**
+ * @file HotReload.h
+ * @author wangyudong
+ * @brief Maps source files to the TinySL programs and streamed textures built from them, and rebuilds those
+ * affected by a changed file in place.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "ShaderProgram.h"
+#include "Texture.h"
+
+namespace Graphics
+{
+    class ShaderVariants;
+
+    /**
+     * @brief Variants register their programs together with the TinySL file and every file it includes, TextureStreamer
+     * registers the textures it loads. Watching files is left to the application: the watch callback is called once for
+     * every file registered, and the application reports changes back through OnFileChanged.
+     *
+     * A changed TinySL file (or include) is parsed again and only programs built from it are rebuilt. They keep their
+     * ShaderProgram objects, materials see the new generation and read the layout again. A program that fails to
+     * compile keeps running the old code. ShaderVariants of the file take the new sources too, so variants requested
+     * for the first time after a reload are built from them. A changed image is streamed into the same Texture object.
+     * References are weak, released programs and textures are forgotten on the next change.
+     */
+    class HotReload
+    {
+    public:
+        typedef std::function<void(const std::string &path)> WatchCallback;
+
+        static HotReload *Instance();
+
+        // files registered before are reported at once
+        void SetWatchCallback(WatchCallback callback);
+
+        // sourceFiles start with the TinySL file, defines are injected after the version line like ShaderVariants does
+        void AddProgram(ShaderProgram::SP program, const std::vector<std::string> &sourceFiles, const std::string &defines);
+        // sources of variants are replaced when their files change, registered by ShaderUtil::LoadVariantsFromTinySL
+        void AddVariants(std::shared_ptr<ShaderVariants> variants);
+        void AddTexture(Texture::SP texture, const std::string &path);
+
+        void OnFileChanged(const std::string &path);
+        // retry textures that were still streaming when their file changed, call once per frame
+        void Update();
+
+    private:
+        HotReload() {}
+        ~HotReload() {}
+
+        struct ProgramEntry
+        {
+            std::weak_ptr<ShaderProgram> program;
+            std::string defines;
+        };
+
+        // one per TinySL file
+        struct ShaderEntry
+        {
+            std::vector<std::string> sourceFiles;
+            std::vector<ProgramEntry> programs;
+            std::vector<std::weak_ptr<ShaderVariants>> variants;
+        };
+
+        static std::string normalize(const std::string &path);
+        void watch(const std::string &path);
+        ShaderEntry &addShaderEntry(const std::vector<std::string> &sourceFiles);
+        void reloadShader(const std::string &tinyslFile);
+        bool reloadTexture(Texture::SP texture, const std::string &path);
+
+        static HotReload *mInstance;
+
+        WatchCallback mWatchCallback;
+        // normalized path -> path as registered, every file reported to the watch callback
+        std::unordered_map<std::string, std::string> mWatchedFiles;
+        // keyed by normalized TinySL file
+        std::unordered_map<std::string, ShaderEntry> mShaders;
+        // normalized source file -> TinySL files including it
+        std::unordered_map<std::string, std::unordered_set<std::string>> mShaderDependents;
+        // normalized image file -> textures streamed from it
+        std::unordered_map<std::string, std::vector<std::weak_ptr<Texture>>> mTextures;
+        std::vector<std::pair<std::weak_ptr<Texture>, std::string>> mPendingTextures;
+    };
+}
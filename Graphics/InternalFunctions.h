@@ -8,7 +8,8 @@
 namespace Graphics
 {
     static uint32_t BufferUsage2Native[BufferUsage_Max] = {GL_STATIC_DRAW, GL_DYNAMIC_DRAW, GL_STREAM_DRAW};
-    static uint32_t BufferType2Native[BufferType_Max] = {GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER, GL_ATOMIC_COUNTER_BUFFER};
+    static uint32_t BufferType2Native[BufferType_Max] = {GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER, GL_ATOMIC_COUNTER_BUFFER, GL_PIXEL_UNPACK_BUFFER,
+                                                         GL_DRAW_INDIRECT_BUFFER, GL_DISPATCH_INDIRECT_BUFFER, GL_PARAMETER_BUFFER_ARB};
     static uint32_t DrawType2Native[DrawType_Max] = {GL_TRIANGLES, GL_TRIANGLE_STRIP, GL_LINES, GL_LINE_STRIP};
     static uint32_t DepthStencilFunc2Native[DepthStencilFunc_Max] = {GL_ALWAYS, GL_NEVER, GL_LESS, GL_GREATER, GL_EQUAL, GL_NOTEQUAL, GL_LEQUAL, GL_GEQUAL};
     static uint32_t StencilOp2Native[StencilOp_Max] = {GL_KEEP, GL_ZERO, GL_REPLACE, GL_INCR, GL_INCR_WRAP, GL_DECR, GL_DECR_WRAP, GL_INVERT};
@@ -19,6 +20,9 @@ namespace Graphics
     static uint32_t CullFace2Native[CullFace_Max] = {GL_FRONT, GL_BACK, GL_FRONT_AND_BACK};
     static uint32_t Filter2Native[TextureFilter_Max] = {GL_LINEAR, GL_NEAREST, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR_MIPMAP_NEAREST, GL_NEAREST_MIPMAP_NEAREST, GL_NEAREST_MIPMAP_LINEAR};
     static uint32_t WrapMode2Native[TextureWrapMode_Max] = {GL_CLAMP_TO_EDGE, GL_CLAMP_TO_BORDER, GL_REPEAT, GL_MIRRORED_REPEAT};
+    static uint32_t TextureType2Native[TextureType_Max] = {GL_TEXTURE_2D, GL_TEXTURE_3D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY};
+
+    static uint32_t ImageAccess2Native[ImageAccess_Max] = {GL_READ_ONLY, GL_WRITE_ONLY, GL_READ_WRITE};
 
     inline uint32_t GetNativeBufferType(BufferType t)
     {
@@ -30,6 +34,88 @@ namespace Graphics
         return BufferUsage2Native[usage];
     }
 
+    inline uint32_t GetNativeStorageFlags(uint32_t flags)
+    {
+        uint32_t native = 0;
+        if (flags & BufferAccessFlag_Read)
+            native |= GL_MAP_READ_BIT;
+        if (flags & BufferAccessFlag_Write)
+            native |= GL_MAP_WRITE_BIT;
+        if (flags & BufferAccessFlag_Persistent)
+            native |= GL_MAP_PERSISTENT_BIT;
+        if (flags & BufferAccessFlag_Coherent)
+            native |= GL_MAP_COHERENT_BIT;
+        if (flags & BufferAccessFlag_DynamicStorage)
+            native |= GL_DYNAMIC_STORAGE_BIT;
+        return native;
+    }
+
+    inline uint32_t GetNativeMapFlags(uint32_t flags)
+    {
+        uint32_t native = 0;
+        if (flags & BufferAccessFlag_Read)
+            native |= GL_MAP_READ_BIT;
+        if (flags & BufferAccessFlag_Write)
+            native |= GL_MAP_WRITE_BIT;
+        if (flags & BufferAccessFlag_Persistent)
+            native |= GL_MAP_PERSISTENT_BIT;
+        if (flags & BufferAccessFlag_Coherent)
+            native |= GL_MAP_COHERENT_BIT;
+        if (flags & BufferAccessFlag_InvalidateRange)
+            native |= GL_MAP_INVALIDATE_RANGE_BIT;
+        if (flags & BufferAccessFlag_Unsynchronized)
+            native |= GL_MAP_UNSYNCHRONIZED_BIT;
+        return native;
+    }
+
+    inline uint32_t GetNativeImageAccess(ImageAccess access)
+    {
+        return ImageAccess2Native[access];
+    }
+
+    inline uint32_t GetNativeBarrierFlags(uint32_t flags)
+    {
+        if ((flags & BarrierFlag_All) == BarrierFlag_All)
+            return GL_ALL_BARRIER_BITS;
+
+        uint32_t native = 0;
+        if (flags & BarrierFlag_VertexAttribArray)
+            native |= GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT;
+        if (flags & BarrierFlag_ElementArray)
+            native |= GL_ELEMENT_ARRAY_BARRIER_BIT;
+        if (flags & BarrierFlag_Uniform)
+            native |= GL_UNIFORM_BARRIER_BIT;
+        if (flags & BarrierFlag_TextureFetch)
+            native |= GL_TEXTURE_FETCH_BARRIER_BIT;
+        if (flags & BarrierFlag_ShaderImageAccess)
+            native |= GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+        if (flags & BarrierFlag_Command)
+            native |= GL_COMMAND_BARRIER_BIT;
+        if (flags & BarrierFlag_BufferUpdate)
+            native |= GL_BUFFER_UPDATE_BARRIER_BIT;
+        if (flags & BarrierFlag_TextureUpdate)
+            native |= GL_TEXTURE_UPDATE_BARRIER_BIT;
+        if (flags & BarrierFlag_ShaderStorage)
+            native |= GL_SHADER_STORAGE_BARRIER_BIT;
+        if (flags & BarrierFlag_AtomicCounter)
+            native |= GL_ATOMIC_COUNTER_BARRIER_BIT;
+        return native;
+    }
+
+    // sized format for image load / store, 0 if the format can't be bound as an image
+    inline uint32_t GetNativeImageFormat(TextureFormat format)
+    {
+        switch (format)
+        {
+        case TextureFormat_R8G8B8A8:
+            return GL_RGBA8;
+        case TextureFormat_R8G8:
+            return GL_RG8;
+        default:
+            return 0;
+        }
+    }
+
     inline uint32_t GetNativeDrawType(DrawType usage)
     {
         return DrawType2Native[usage];
@@ -70,6 +156,11 @@ namespace Graphics
         return Filter2Native[filter];
     }
 
+    inline uint32_t GetNativeTextureType(TextureType type)
+    {
+        return TextureType2Native[type];
+    }
+
     inline void GetNativeTypeAndFormat(TextureFormat format, uint32_t *nativeType, uint32_t *nativeFormat, int *channel)
     {
         switch (format)
@@ -89,9 +180,42 @@ namespace Graphics
             *nativeType = GL_UNSIGNED_BYTE;
             *channel = 2;
             break;
+        // compressed formats: native format is the internal format, channel is of the source data
+        case TextureFormat_BC1:
+            *nativeFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            *nativeType = 0;
+            *channel = 3;
+            break;
+        case TextureFormat_BC4:
+            *nativeFormat = GL_COMPRESSED_RED_RGTC1;
+            *nativeType = 0;
+            *channel = 1;
+            break;
+        case TextureFormat_BC5:
+            *nativeFormat = GL_COMPRESSED_RG_RGTC2;
+            *nativeType = 0;
+            *channel = 2;
+            break;
+        case TextureFormat_BC7:
+            *nativeFormat = GL_COMPRESSED_RGBA_BPTC_UNORM;
+            *nativeType = 0;
+            *channel = 4;
+            break;
+        case TextureFormat_ETC2_RGB8:
+            *nativeFormat = GL_COMPRESSED_RGB8_ETC2;
+            *nativeType = 0;
+            *channel = 3;
+            break;
+        case TextureFormat_ETC2_RGBA8:
+            *nativeFormat = GL_COMPRESSED_RGBA8_ETC2_EAC;
+            *nativeType = 0;
+            *channel = 4;
+            break;
         default:
             GFX_LOG_ERROR("Unsupported format!!");
             *channel = 0;
+            *nativeType = 0;
+            *nativeFormat = 0;
             break;
         }
     }
@@ -120,6 +244,8 @@ namespace Graphics
             return ProgramDataType_Sampler3D;
         case GL_SAMPLER_CUBE:
             return ProgramDataType_SamplerCube;
+        case GL_SAMPLER_2D_ARRAY:
+            return ProgramDataType_Sampler2DArray;
         case GL_SAMPLER_1D_SHADOW:
             return ProgramDataType_Sampler1DShadow;
         case GL_SAMPLER_2D_SHADOW:
@@ -129,6 +255,25 @@ namespace Graphics
         return ProgramDataType_None;
     }
 
+    // texture target a sampler type reads
+    inline uint32_t GetNativeSamplerTarget(ProgramDataType type)
+    {
+        switch (type)
+        {
+        case ProgramDataType_Sampler1D:
+        case ProgramDataType_Sampler1DShadow:
+            return GL_TEXTURE_1D;
+        case ProgramDataType_Sampler3D:
+            return GL_TEXTURE_3D;
+        case ProgramDataType_SamplerCube:
+            return GL_TEXTURE_CUBE_MAP;
+        case ProgramDataType_Sampler2DArray:
+            return GL_TEXTURE_2D_ARRAY;
+        default:
+            return GL_TEXTURE_2D;
+        }
+    }
+
 #ifdef NDEBUG
 #define glCheckError()
 #else
@@ -0,0 +1,286 @@
+#include "KTX2.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Graphics
+{
+    namespace
+    {
+        const uint8_t KTX2Identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+        const size_t LevelAlignment = 16;
+
+        struct KTX2Header
+        {
+            uint8_t identifier[12];
+            uint32_t vkFormat;
+            uint32_t typeSize;
+            uint32_t pixelWidth;
+            uint32_t pixelHeight;
+            uint32_t pixelDepth;
+            uint32_t layerCount;
+            uint32_t faceCount;
+            uint32_t levelCount;
+            uint32_t supercompressionScheme;
+
+            uint32_t dfdByteOffset;
+            uint32_t dfdByteLength;
+            uint32_t kvdByteOffset;
+            uint32_t kvdByteLength;
+            uint64_t sgdByteOffset;
+            uint64_t sgdByteLength;
+        };
+        static_assert(sizeof(KTX2Header) == 80, "KTX2 header must be 80 bytes");
+
+        struct KTX2LevelIndex
+        {
+            uint64_t byteOffset;
+            uint64_t byteLength;
+            uint64_t uncompressedByteLength;
+        };
+
+        inline size_t Align(size_t v, size_t alignment)
+        {
+            return (v + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    uint32_t KTX2File::ToVkFormat(TextureFormat format)
+    {
+        switch (format)
+        {
+        case TextureFormat_R8G8B8A8:
+            return 37;  // VK_FORMAT_R8G8B8A8_UNORM
+        case TextureFormat_R8G8B8:
+            return 23;  // VK_FORMAT_R8G8B8_UNORM
+        case TextureFormat_R8G8:
+            return 16;  // VK_FORMAT_R8G8_UNORM
+        case TextureFormat_BC1:
+            return 131; // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+        case TextureFormat_BC4:
+            return 139; // VK_FORMAT_BC4_UNORM_BLOCK
+        case TextureFormat_BC5:
+            return 141; // VK_FORMAT_BC5_UNORM_BLOCK
+        case TextureFormat_BC7:
+            return 145; // VK_FORMAT_BC7_UNORM_BLOCK
+        case TextureFormat_ETC2_RGB8:
+            return 147; // VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK
+        case TextureFormat_ETC2_RGBA8:
+            return 151; // VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK
+        default:
+            return 0;
+        }
+    }
+
+    TextureFormat KTX2File::FromVkFormat(uint32_t vkFormat)
+    {
+        for (int format = 0; format < TextureFormat_Max; ++format)
+        {
+            if (ToVkFormat((TextureFormat)format) == vkFormat)
+                return (TextureFormat)format;
+        }
+        return TextureFormat_Max;
+    }
+
+    bool KTX2File::Write(const char *path, const CompressedImage &image)
+    {
+        uint32_t vkFormat = ToVkFormat(image.format);
+        if (vkFormat == 0 || image.levels.empty())
+        {
+            GFX_LOG_ERROR_FMT("Can not write ktx2 of format %d", (int)image.format);
+            return false;
+        }
+
+        KTX2Header header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.identifier, KTX2Identifier, sizeof(KTX2Identifier));
+        header.vkFormat = vkFormat;
+        header.typeSize = 1;
+        header.pixelWidth = image.levels[0].width;
+        header.pixelHeight = image.levels[0].height;
+        header.faceCount = 1;
+        header.levelCount = (uint32_t)image.levels.size();
+
+        // level index lists level 0 first, while data stores the smallest level first
+        std::vector<KTX2LevelIndex> index(image.levels.size());
+        size_t offset = sizeof(KTX2Header) + sizeof(KTX2LevelIndex) * index.size();
+        for (size_t i = image.levels.size(); i-- > 0;)
+        {
+            offset = Align(offset, LevelAlignment);
+            index[i].byteOffset = offset;
+            index[i].byteLength = image.levels[i].data.size();
+            index[i].uncompressedByteLength = image.levels[i].data.size();
+            offset += image.levels[i].data.size();
+        }
+
+        FILE *file = fopen(path, "wb");
+        if (file == nullptr)
+        {
+            GFX_LOG_ERROR_FMT("Open %s for writing failed!", path);
+            return false;
+        }
+
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(index.data(), sizeof(KTX2LevelIndex), index.size(), file);
+        const uint8_t zeros[LevelAlignment] = {};
+        size_t written = sizeof(KTX2Header) + sizeof(KTX2LevelIndex) * index.size();
+        for (size_t i = image.levels.size(); i-- > 0;)
+        {
+            fwrite(zeros, 1, index[i].byteOffset - written, file);
+            fwrite(image.levels[i].data.data(), 1, image.levels[i].data.size(), file);
+            written = index[i].byteOffset + index[i].byteLength;
+        }
+
+        bool ok = ferror(file) == 0;
+        fclose(file);
+        return ok;
+    }
+
+    bool KTX2File::Open(const char *path)
+    {
+        Close();
+
+#ifndef _WIN32
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0)
+        {
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0)
+            {
+                void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping != MAP_FAILED)
+                {
+                    mData = (const uint8_t *)mapping;
+                    mSize = st.st_size;
+                    mMapped = true;
+                }
+            }
+            close(fd);
+        }
+#else
+        FILE *file = fopen(path, "rb");
+        if (file != nullptr)
+        {
+            fseek(file, 0, SEEK_END);
+            mFileData.resize(ftell(file));
+            fseek(file, 0, SEEK_SET);
+            if (fread(mFileData.data(), 1, mFileData.size(), file) == mFileData.size())
+            {
+                mData = mFileData.data();
+                mSize = mFileData.size();
+            }
+            fclose(file);
+        }
+#endif
+
+        if (mData == nullptr)
+        {
+            GFX_LOG_ERROR_FMT("Open ktx2 %s failed!", path);
+            return false;
+        }
+
+        if (!Parse(path))
+        {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    bool KTX2File::Parse(const char *path)
+    {
+        KTX2Header header;
+        if (mSize < sizeof(header))
+        {
+            GFX_LOG_ERROR_FMT("%s is too small to be ktx2!", path);
+            return false;
+        }
+        memcpy(&header, mData, sizeof(header));
+
+        if (memcmp(header.identifier, KTX2Identifier, sizeof(KTX2Identifier)) != 0)
+        {
+            GFX_LOG_ERROR_FMT("%s is not a ktx2 file!", path);
+            return false;
+        }
+
+        if (header.pixelDepth > 1 || header.layerCount > 1 || header.faceCount != 1 || header.supercompressionScheme != 0)
+        {
+            GFX_LOG_ERROR_FMT("%s: only uncompressed single 2d images are supported!", path);
+            return false;
+        }
+
+        mFormat = FromVkFormat(header.vkFormat);
+        if (mFormat == TextureFormat_Max)
+        {
+            GFX_LOG_ERROR_FMT("%s: unsupported vkFormat %u", path, header.vkFormat);
+            return false;
+        }
+
+        if (header.pixelWidth == 0 || header.pixelHeight == 0 || header.pixelWidth > INT32_MAX || header.pixelHeight > INT32_MAX)
+        {
+            GFX_LOG_ERROR_FMT("%s: invalid image size %ux%u", path, header.pixelWidth, header.pixelHeight);
+            return false;
+        }
+        mWidth = (int)header.pixelWidth;
+        mHeight = (int)header.pixelHeight;
+        // a full chain ends at 1x1, more levels would shift the size by 32 bits or more
+        size_t levelCount = header.levelCount == 0 ? 1 : header.levelCount;
+        size_t maxLevelCount = 1;
+        while ((std::max(mWidth, mHeight) >> maxLevelCount) > 0)
+            ++maxLevelCount;
+        if (levelCount > maxLevelCount)
+        {
+            GFX_LOG_ERROR_FMT("%s: %zu levels, a %dx%d image has at most %zu", path, levelCount, mWidth, mHeight, maxLevelCount);
+            return false;
+        }
+        if (sizeof(header) + levelCount * sizeof(KTX2LevelIndex) > mSize)
+        {
+            GFX_LOG_ERROR_FMT("%s: truncated level index", path);
+            return false;
+        }
+
+        mLevels.resize(levelCount);
+        for (size_t i = 0; i < levelCount; ++i)
+        {
+            KTX2LevelIndex index;
+            memcpy(&index, mData + sizeof(header) + i * sizeof(KTX2LevelIndex), sizeof(index));
+
+            auto &level = mLevels[i];
+            level.width = mWidth >> i > 0 ? mWidth >> i : 1;
+            level.height = mHeight >> i > 0 ? mHeight >> i : 1;
+            // offsets come from the file, the sum could wrap around
+            if (index.byteOffset > mSize || index.byteLength > mSize - index.byteOffset ||
+                index.byteLength < TextureCompressor::GetLevelSize(mFormat, level.width, level.height))
+            {
+                GFX_LOG_ERROR_FMT("%s: level %zu out of file range", path, i);
+                return false;
+            }
+            level.data = mData + index.byteOffset;
+            level.size = index.byteLength;
+        }
+        return true;
+    }
+
+    void KTX2File::Close()
+    {
+#ifndef _WIN32
+        if (mMapped)
+            munmap((void *)mData, mSize);
+#endif
+        mMapped = false;
+        mData = nullptr;
+        mSize = 0;
+        std::vector<uint8_t>().swap(mFileData);
+        mLevels.clear();
+        mFormat = TextureFormat_Max;
+        mWidth = mHeight = 0;
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * @file KTX2.h
+ * @author wangyudong
+ * @brief Minimal KTX2 container for cooked textures: one 2d image with its mip chain, no supercompression.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "Constants.h"
+#include "TextureCompressor.h"
+
+namespace Graphics
+{
+    /**
+     * @brief Header, level index and level data follow the KTX2 layout (levels stored smallest first, 16 bytes aligned).
+     * Data format descriptor and key/value data are not written, vkFormat alone tells the format.
+     * The file is memory mapped on read, level data points into the mapping and is valid until Close().
+     */
+    class KTX2File
+    {
+    public:
+        struct Level
+        {
+            int width;
+            int height;
+            const uint8_t *data;
+            size_t size;
+        };
+
+        KTX2File() {}
+        ~KTX2File() { Close(); }
+        KTX2File(const KTX2File &) = delete;
+        KTX2File &operator=(const KTX2File &) = delete;
+
+        bool Open(const char *path);
+        void Close();
+
+        inline TextureFormat GetFormat() const { return mFormat; }
+        inline int GetWidth() const { return mWidth; }
+        inline int GetHeight() const { return mHeight; }
+        inline size_t GetLevelCount() const { return mLevels.size(); }
+        inline const Level &GetLevel(size_t level) const { return mLevels[level]; }
+
+        static bool Write(const char *path, const CompressedImage &image);
+
+        static uint32_t ToVkFormat(TextureFormat format);
+        // TextureFormat_Max if not supported
+        static TextureFormat FromVkFormat(uint32_t vkFormat);
+
+    private:
+        bool Parse(const char *path);
+
+        const uint8_t *mData = nullptr;
+        size_t mSize = 0;
+        bool mMapped = false;
+        std::vector<uint8_t> mFileData; // used where mmap is not available
+
+        TextureFormat mFormat = TextureFormat_Max;
+        int mWidth = 0;
+        int mHeight = 0;
+        std::vector<Level> mLevels;
+    };
+}
@@ -1,15 +1,96 @@
 #include "Material.h"
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
 #include "RenderManager.h"
+#include "TextureCache.h"
+#include "TextureResidency.h"
 #include "GL/glew.h"
+#include "InternalFunctions.h"
 
 namespace Graphics
 {
     Material::Material(ShaderProgram::SP shader)
     {
-        mMaterialUniformBuffer = RenderManager::Instance()->AllocBuffer(BufferType_UniformBuffer);
         mShader = shader;
+        mPoolHandle = RenderManager::Instance()->RegisterMaterial(this);
+        // does not wait when the driver compiles in parallel, layout is read on first use then
+        ensureLayout();
+    }
+
+    // bytes of out of block uniform values, samplers have no storage
+    static uint32_t UniformDataSize(ProgramDataType type)
+    {
+        switch (type)
+        {
+        case ProgramDataType_Float:
+        case ProgramDataType_Int:
+            return 4;
+        case ProgramDataType_Vec2:
+            return 8;
+        case ProgramDataType_Vec3:
+            return 12;
+        case ProgramDataType_Vec4:
+            return 16;
+        case ProgramDataType_Mat4:
+            return 64;
+        default:
+            return 0;
+        }
+    }
+
+    bool Material::ensureLayout()
+    {
+        if (mLayoutReady)
+        {
+            if (mShaderGeneration == mShader->GetGeneration())
+                return true;
+            releaseLayout();
+        }
+        if (!mShader->IsReady())
+            return false;
+
+        initLayout();
+        mLayoutReady = true;
+        mShaderGeneration = mShader->GetGeneration();
+
+        for (auto &pair : mPendingValues)
+        {
+            // values carried over a reload may span padding or a type the new layout does not have
+            auto size = pair.second.size();
+            if (pair.first < mSlots.size())
+            {
+                auto &slot = mSlots[pair.first];
+                if (slot.kind == PropertyKind_Block || slot.kind == PropertyKind_Uniform)
+                    size = std::min<size_t>(size, slot.size);
+            }
+            setValueBytes(pair.first, pair.second.data(), size);
+        }
+        mPendingValues.clear();
+
+        auto table = PropertyTable::Instance();
+        for (PropertyID id = 0; id < mTextureBinds.size(); ++id)
+        {
+            if (mTextureBinds[id] != nullptr && (id >= mSlots.size() || mSlots[id].kind != PropertyKind_Texture))
+            {
+                GFX_LOG_ERROR_FMT("Set a undefined texture: %s", table->GetName(id).c_str());
+                mTextureBinds[id] = nullptr;
+            }
+        }
+        return true;
+    }
+
+    void Material::initLayout()
+    {
         auto propertyLayout = mShader->GetPropertyLayout();
         // propertyLayout->PrintLayoutInfos();
+        auto table = PropertyTable::Instance();
+        auto slotOf = [this](PropertyID id) -> PropertySlot &
+        {
+            if (id >= mSlots.size())
+                mSlots.resize(id + 1);
+            return mSlots[id];
+        };
 
         // only recognize PerMaterial UBO currently, support arbitary UBO later.
         for (size_t i = 0; i < propertyLayout->uniformBlockInfos.size(); ++i)
@@ -18,86 +99,277 @@ namespace Graphics
             if (blockInfo.blockName.compare(PerMaterialUBOName) == 0)
             {
                 mPerMaterialBufferSize = blockInfo.blockSize;
-                mPerMaterialBuffer = malloc(mPerMaterialBufferSize);
+                mPerMaterialBuffer = calloc(1, mPerMaterialBufferSize);
+                mBlockAllocation = MaterialBufferPool::Instance()->Allocate((uint32_t)mPerMaterialBufferSize);
 
                 for (size_t j = 0; j < blockInfo.uniformNames.size(); ++j)
                 {
-                    mPerMaterialBlockOffset.insert(std::make_pair(blockInfo.uniformNames[j], blockInfo.uniformOffset[j]));
+                    auto &slot = slotOf(table->GetID(blockInfo.uniformNames[j]));
+                    slot.kind = PropertyKind_Block;
+                    slot.offset = (uint32_t)blockInfo.uniformOffset[j];
+                    // block members have no size in the layout, each one spans to the next offset
+                    size_t end = mPerMaterialBufferSize;
+                    for (auto offset : blockInfo.uniformOffset)
+                    {
+                        if (offset > slot.offset && offset < end)
+                            end = offset;
+                    }
+                    slot.size = (uint32_t)(end - slot.offset);
                 }
                 break;
             }
         }
 
-        // out of block uniforms
+        // out of block uniforms, all values live in one arena
+        uint32_t arenaSize = 0;
         for (size_t i = 0; i < propertyLayout->uniformInfos.size(); ++i)
         {
             auto &info = propertyLayout->uniformInfos[i];
-            mUniformCaches.insert(std::make_pair(info.name, UniformCache(info.type, info.location)));
+            auto id = table->GetID(info.name);
+            auto &slot = slotOf(id);
+            slot.type = info.type;
+            slot.location = info.location;
+            if (info.type >= ProgramDataType_SamplerStart && info.type <= ProgramDataType_SamplerEnd)
+            {
+                slot.kind = PropertyKind_Texture;
+                continue;
+            }
+
+            slot.kind = PropertyKind_Uniform;
+            slot.offset = arenaSize;
+            slot.size = UniformDataSize(info.type);
+            arenaSize += slot.size;
+            mUniformIDs.push_back(id);
         }
+        mUniformArena.assign(arenaSize, 0);
     }
 
-    Material::~Material()
+    void Material::releaseLayout()
     {
+        // block members have no size in the layout, each one spans to the next offset
+        std::vector<std::pair<uint32_t, PropertyID>> blockMembers;
+        for (PropertyID id = 0; id < mSlots.size(); ++id)
+        {
+            if (mSlots[id].kind == PropertyKind_Block)
+                blockMembers.emplace_back(mSlots[id].offset, id);
+        }
+        std::sort(blockMembers.begin(), blockMembers.end());
+
+        mPendingValues.clear();
+        auto block = (const char *)mPerMaterialBuffer;
+        for (size_t i = 0; i < blockMembers.size(); ++i)
+        {
+            size_t begin = blockMembers[i].first;
+            size_t end = i + 1 < blockMembers.size() ? blockMembers[i + 1].first : mPerMaterialBufferSize;
+            mPendingValues.emplace_back(blockMembers[i].second, std::vector<char>(block + begin, block + end));
+        }
+        for (auto id : mUniformIDs)
+        {
+            auto &slot = mSlots[id];
+            if (slot.assigned)
+                mPendingValues.emplace_back(id, std::vector<char>(&mUniformArena[slot.offset], &mUniformArena[slot.offset] + slot.size));
+        }
+
+        MaterialBufferPool::Instance()->Free(mBlockAllocation);
         free(mPerMaterialBuffer);
-        for(auto p : mUniformCaches)
+        mPerMaterialBuffer = nullptr;
+        mPerMaterialBufferSize = 0;
+        mSlots.clear();
+        mUniformArena.clear();
+        mUniformIDs.clear();
+
+        mLayoutReady = false;
+        mTextureUnitsDirty = true;
+        mDirty = true;
+    }
+
+    void Material::setValueBytes(PropertyID id, const void *value, size_t size)
+    {
+        if (!mLayoutReady)
         {
-            free(p.second.data);
+            // latest value wins, a value animated while compiling does not pile up
+            auto bytes = (const char *)value;
+            for (auto &pending : mPendingValues)
+            {
+                if (pending.first == id)
+                {
+                    pending.second.assign(bytes, bytes + size);
+                    return;
+                }
+            }
+            mPendingValues.emplace_back(id, std::vector<char>(bytes, bytes + size));
+            return;
         }
+
+        if (id < mSlots.size())
+        {
+            auto &slot = mSlots[id];
+            if (slot.kind == PropertyKind_Block)
+            {
+                assert(size <= slot.size && size + slot.offset <= mPerMaterialBufferSize);
+                if (size > slot.size || size + slot.offset > mPerMaterialBufferSize)
+                {
+                    GFX_LOG_ERROR_FMT("Value of %zu bytes is larger than uniform %s (%u bytes)", size,
+                                      PropertyTable::Instance()->GetName(id).c_str(), slot.size);
+                    return;
+                }
+                memcpy((char *)mPerMaterialBuffer + slot.offset, value, size);
+                mDirty = true;
+                return;
+            }
+            if (slot.kind == PropertyKind_Uniform)
+            {
+                // out of uniform block
+                assert(size <= slot.size);
+                if (size > slot.size)
+                {
+                    GFX_LOG_ERROR_FMT("Value of %zu bytes is larger than uniform %s (%u bytes)", size,
+                                      PropertyTable::Instance()->GetName(id).c_str(), slot.size);
+                    return;
+                }
+                memcpy(&mUniformArena[slot.offset], value, size);
+                slot.assigned = true;
+                mDirty = true;
+                return;
+            }
+        }
+        GFX_LOG_ERROR_FMT("Set a undefined uniform: %s", PropertyTable::Instance()->GetName(id).c_str());
+    }
+
+    void Material::SetTexture(PropertyID id, Texture::CSP tex)
+    {
+        if (mLayoutReady && (id >= mSlots.size() || mSlots[id].kind != PropertyKind_Texture))
+        {
+            GFX_LOG_ERROR_FMT("Set a undefined texture: %s", PropertyTable::Instance()->GetName(id).c_str());
+            return;
+        }
+
+        if (id >= mTextureBinds.size())
+            mTextureBinds.resize(id + 1);
+        mTextureBinds[id] = tex;
+        mTextureUnitsDirty = true;
+        mDirty = true;
+    }
+
+    Material::~Material()
+    {
+        RenderManager::Instance()->UnregisterMaterial(this);
+        MaterialBufferPool::Instance()->Free(mBlockAllocation);
+        free(mPerMaterialBuffer);
     }
 
     void Material::Prepare()
     {
-        // upload UBO
-        if (!mDirty)
+        // layout is checked even when clean, a hot reloaded shader needs it read again
+        if (!ensureLayout() || !mDirty)
             return;
-        mMaterialUniformBuffer->BufferData(mPerMaterialBuffer, mPerMaterialBufferSize, BufferUsage_StaticDraw);
+        if (mBlockAllocation.IsValid())
+            MaterialBufferPool::Instance()->Write(mBlockAllocation, mPerMaterialBuffer);
 
         mShader->UseProgram();
-        for (auto &c : mUniformCaches)
+        for (auto id : mUniformIDs)
         {
-            if (c.second.data == nullptr)
+            auto &slot = mSlots[id];
+            if (!slot.assigned)
                 continue;
 
-            switch (c.second.type)
+            auto data = &mUniformArena[slot.offset];
+            switch (slot.type)
             {
             case ProgramDataType_Float:
-                glUniform1fv(c.second.location, 1, reinterpret_cast<GLfloat *>(&c.second.data));
+                glUniform1fv(slot.location, 1, (GLfloat *)data);
                 break;
             case ProgramDataType_Int:
-                glUniform1iv(c.second.location, 1, reinterpret_cast<GLint *>(&c.second.data));
+                glUniform1iv(slot.location, 1, (GLint *)data);
                 break;
             case ProgramDataType_Vec2:
-                glUniform2fv(c.second.location, 1, (GLfloat *)c.second.data);
+                glUniform2fv(slot.location, 1, (GLfloat *)data);
                 break;
             case ProgramDataType_Vec3:
-                glUniform3fv(c.second.location, 1, (GLfloat *)c.second.data);
+                glUniform3fv(slot.location, 1, (GLfloat *)data);
                 break;
             case ProgramDataType_Vec4:
-                glUniform4fv(c.second.location, 1, (GLfloat *)c.second.data);
+                glUniform4fv(slot.location, 1, (GLfloat *)data);
                 break;
             case ProgramDataType_Mat4:
-                glUniformMatrix4fv(c.second.location, 1, GL_FALSE, (GLfloat *)c.second.data);
+                glUniformMatrix4fv(slot.location, 1, GL_FALSE, (GLfloat *)data);
                 break;
             }
         }
         mDirty = false;
     }
 
-    void Material::Use()
+    bool Material::Use()
     {
+        // layout is resolved by Prepare only, so a block is never bound before the pool uploaded it
+        if (!mLayoutReady)
+        {
+            auto fallback = RenderManager::Instance()->GetFallbackProgram();
+            if (fallback == nullptr)
+                return false;
+            fallback->UseProgram();
+            return true;
+        }
+
         mShader->UseProgram();
-        RenderManager::Instance()->BindBufferBase(mMaterialUniformBuffer, PerMaterialUBOBindPoint);
+        if (mBlockAllocation.IsValid())
+            MaterialBufferPool::Instance()->Bind(mBlockAllocation);
 
-        auto samplerInfos = mShader->GetSamplerInfos();
-        for (int texUnit = 0; texUnit < samplerInfos.size(); ++texUnit)
+        auto residency = TextureResidency::Instance();
+        if (mTextureUnitsDirty)
+            resolveTextureUnits();
+
+        // handles are gathered every time, streamed textures switch from placeholders when resident
+        size_t unitCount = mUnitTextures.size();
+        for (size_t unit = 0; unit < unitCount; ++unit)
         {
-            auto iter = mTextureBinds.find(samplerInfos[texUnit].name);
-            if (iter != mTextureBinds.end())
-            {
-                glActiveTexture(texUnit + GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, iter->second);
-            }
+            auto &tex = mUnitTextures[unit];
+            mUnitHandles[unit] = tex == nullptr ? 0 : tex->GetBindHandle();
+            mUnitSamplers[unit] = tex == nullptr ? 0 : tex->GetSamplerHandle();
+            if (tex != nullptr)
+                residency->MarkUsed(*tex);
+        }
+
+        if (unitCount == 0)
+            return true;
+
+        if (RenderManager::Instance()->GetSystemInfo().multiBind)
+        {
+            glBindTextures(0, (GLsizei)unitCount, mUnitHandles.data());
+            glBindSamplers(0, (GLsizei)unitCount, mUnitSamplers.data());
+            return true;
         }
+
+        // units without texture are cleared like glBindTextures does, not left with the last material's texture
+        auto &samplerInfos = mShader->GetSamplerInfos();
+        for (size_t unit = 0; unit < unitCount; ++unit)
+        {
+            auto &tex = mUnitTextures[unit];
+            glActiveTexture(GL_TEXTURE0 + (GLenum)unit);
+            if (tex != nullptr)
+                glBindTexture(GetNativeTextureType(tex->GetType()), mUnitHandles[unit]);
+            else
+                glBindTexture(unit < samplerInfos.size() ? GetNativeSamplerTarget(samplerInfos[unit].type) : GL_TEXTURE_2D, 0);
+            glBindSampler((GLuint)unit, mUnitSamplers[unit]);
+        }
+        return true;
+    }
+
+    void Material::resolveTextureUnits()
+    {
+        // shader assigns units in the order of its sorted sampler list
+        auto &samplerInfos = mShader->GetSamplerInfos();
+        mUnitTextures.assign(samplerInfos.size(), nullptr);
+        auto table = PropertyTable::Instance();
+        for (size_t unit = 0; unit < samplerInfos.size(); ++unit)
+        {
+            auto id = table->GetID(samplerInfos[unit].name);
+            if (id < mTextureBinds.size())
+                mUnitTextures[unit] = mTextureBinds[id];
+        }
+        mUnitHandles.resize(mUnitTextures.size());
+        mUnitSamplers.resize(mUnitTextures.size());
+        mTextureUnitsDirty = false;
     }
 
     void Material::SetStates()
@@ -112,14 +384,68 @@ namespace Graphics
         SetAOScale(1);
     }
 
+    BasicPBRMaterial::BasicPBRMaterial(ShaderVariants::SP variants, uint32_t keywordMask)
+        : BasicPBRMaterial(variants->GetVariant(keywordMask))
+    {
+        mVariants = variants;
+        mKeywordMask = keywordMask;
+    }
+
     BasicPBRMaterial::~BasicPBRMaterial()
     {
     }
 
+    void BasicPBRMaterial::SetRoughnessScale(float scale)
+    {
+        static const PropertyID id = PropertyTable::Instance()->GetID(GFX_PROPERTY("roughnessScale"));
+        SetValue(id, scale);
+    }
+
+    void BasicPBRMaterial::SetMetallicScale(float scale)
+    {
+        static const PropertyID id = PropertyTable::Instance()->GetID(GFX_PROPERTY("metallicScale"));
+        SetValue(id, scale);
+    }
+
+    void BasicPBRMaterial::SetAOScale(float scale)
+    {
+        static const PropertyID id = PropertyTable::Instance()->GetID(GFX_PROPERTY("aoScale"));
+        SetValue(id, scale);
+    }
+
+    bool BasicPBRMaterial::isMapCompiled(int mapIdx) const
+    {
+        const char *mapKeywords[5] = {nullptr, "METALLIC_MAP", "ROUGHNESS_MAP", "AO_MAP", "NORMAL_MAP"};
+        if (mVariants == nullptr || mapKeywords[mapIdx] == nullptr)
+            return true;
+        return (mVariants->GetKeywordBit(mapKeywords[mapIdx]) & mKeywordMask) != 0;
+    }
+
     void BasicPBRMaterial::LoadTextures(const char *texPaths[5], TextureFormat formats[5])
     {
         const char *texNames[5] = {"albedoTex","metallicTex", "roughnessTex", "aoTex", "normalTex"};
         for (int i = 0; i < 5; ++i)
+        {
+            // shader uses a constant instead, same as a white texture
+            if (!isMapCompiled(i))
+                continue;
+
+            if (texPaths[i] == nullptr)
+            {
+                mTextures[i] = Texture::GetWhiteTexture();
+            }
+            else
+            {
+                mTextures[i] = TextureCache::Instance()->Load(texPaths[i], formats[i]);
+            }
+            SetTexture(texNames[i], mTextures[i]);
+        }
+    }
+
+    void BasicPBRMaterial::LoadTexturesORM(const char *texPaths[3], TextureFormat formats[3])
+    {
+        const char *texNames[3] = {"albedoTex", "ormTex", "normalTex"};
+        for (int i = 0; i < 3; ++i)
         {
             if (texPaths[i] == nullptr)
             {
@@ -127,13 +453,25 @@ namespace Graphics
             }
             else
             {
-                auto tex = RenderManager::Instance()->AllocTexture(TextureType_2D, formats[i], true);
-                tex->SetFilter(TextureFilter_LinearMipmapLinear, TextureFilter_Linear);
-                tex->SetWrapMode(TextureWrapMode_Repeat, TextureWrapMode_Repeat);
-                tex->LoadFromFile(texPaths[i]);
-                mTextures[i] = tex;
+                mTextures[i] = TextureCache::Instance()->Load(texPaths[i], formats[i]);
             }
             SetTexture(texNames[i], mTextures[i]);
         }
     }
+
+    void BasicPBRMaterial::SetTextureSet(TextureSet::SP set)
+    {
+        const char *texNames[5] = {"albedoTex","metallicTex", "roughnessTex", "aoTex", "normalTex"};
+        if (set->GetMapCount() != 5)
+        {
+            GFX_LOG_ERROR("basic pbr texture set should have 5 maps!");
+            return;
+        }
+
+        for (int i = 0; i < 5; ++i)
+        {
+            mTextures[i] = set->GetTexture(i);
+            SetTexture(texNames[i], mTextures[i]);
+        }
+    }
 }
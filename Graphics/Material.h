@@ -15,11 +15,18 @@
 #include <unordered_map>
 #include "Eigen/Core"
 #include "ShaderProgram.h"
+#include "ShaderVariants.h"
+#include "PropertyID.h"
 #include "Buffer.h"
+#include "MaterialBufferPool.h"
 #include "Texture.h"
+#include "TextureSet.h"
 
 namespace Graphics
 {
+    class Material;
+    typedef PoolHandle<Material> MaterialHandle;
+
     class Material
     {
     public:
@@ -28,94 +35,105 @@ namespace Graphics
         Material(ShaderProgram::SP shader);
         ~Material();
 
+        // slot in the material pool of RenderManager, registered for the material's lifetime
+        inline MaterialHandle GetPoolHandle() const { return mPoolHandle; }
+
         // Values set here are cached in main memory. When material is used for drawing, things will be uploaded
         // to GPU memroy if UBO or uniforms are dirty. There are 2 types material uniform data:
         //  1. Enclosed in uniform buffer block (recommended) will be uploaded as UBO.
         //  2. Out of uniform block, needs upload saperately.
+        // Values set before the shader is built are kept and written once its layout is known.
+        // Setting by PropertyID is a memcpy, names are interned first (GFX_PROPERTY hashes literals at compile time).
         template<typename T>
-        void SetValue(const std::string &name, const T &value)
+        void SetValue(PropertyID id, const T &value)
+        {
+            setValueBytes(id, &value, sizeof(T));
+        }
+
+        template<typename T>
+        void SetValue(const PropertyName &name, const T &value)
         {
-            auto iter = mPerMaterialBlockOffset.find(name);
-            if (iter != mPerMaterialBlockOffset.end())
-            {
-
-                assert(sizeof(T) + iter->second <= mPerMaterialBufferSize);
-                *reinterpret_cast<T *>((char*)mPerMaterialBuffer + iter->second) = value;
-                mDirty = true;
-            }
-            else
-            {
-                // out of uniform block
-                auto iterUniform = mUniformCaches.find(name);
-                if (iterUniform == mUniformCaches.end())
-                {
-                    GFX_LOG_ERROR_FMT("Set a undefined uniform: %s", name.c_str());
-                    return;
-                }
-
-                if (sizeof(T) <= sizeof(void *))
-                {
-                    *reinterpret_cast<T *>(&iterUniform->second.data) = value;
-                }
-                else
-                {
-                    iterUniform->second.data = malloc(sizeof(T));
-                    *reinterpret_cast<T *>(iterUniform->second.data) = value;
-                }
-                mDirty = true;
-            }
+            setValueBytes(PropertyTable::Instance()->GetID(name), &value, sizeof(T));
         }
 
-        void SetTexture(const std::string &name, Texture::CSP tex)
+        template<typename T>
+        void SetValue(const std::string &name, const T &value)
         {
-            auto iter = mUniformCaches.find(name);
-            if (iter == mUniformCaches.end())
-            {
-                GFX_LOG_ERROR_FMT("Set a undefined texture: %s", name.c_str());
-                return;
-            }
-
-            mTextureBinds.insert(std::make_pair(name, tex->GetHandle()));
-            mDirty = true;
+            setValueBytes(PropertyTable::Instance()->GetID(name), &value, sizeof(T));
         }
 
+        void SetTexture(PropertyID id, Texture::CSP tex);
+        void SetTexture(const PropertyName &name, Texture::CSP tex) { SetTexture(PropertyTable::Instance()->GetID(name), tex); }
+        void SetTexture(const std::string &name, Texture::CSP tex) { SetTexture(PropertyTable::Instance()->GetID(name), tex); }
+
         int GetPriority() { return mPriority; }
+        inline ShaderProgram::SP GetShader() const { return mShader; }
+        // index of PerMaterial block in the SSBO view of the pool, INVALID_ID without block or before layout is known
+        inline uint32_t GetMaterialSlot() const { return mBlockAllocation.slot; }
         
-        // upload per material uniform data
+        // copy per material block to the pool (uploaded by its Flush) and upload out of block uniforms
         void Prepare();
-        // bind uniform buffer and shader program.
-        void Use();
+        // bind uniform buffer, shader program, textures and their sampler objects.
+        // The fallback program of RenderManager is bound while shader is compiling, false if there is none.
+        bool Use();
         // set states of shader program
         void SetStates();
 
     protected:
-
+        void setValueBytes(PropertyID id, const void *value, size_t size);
+        // read uniform layout once shader is ready, false while it is still compiling
+        bool ensureLayout();
+        void initLayout();
+        // shader was hot reloaded, current values become pending ones and the layout is read again
+        void releaseLayout();
+
+        bool mLayoutReady = false;
+        uint32_t mShaderGeneration = 0;
+        std::vector<std::pair<PropertyID, std::vector<char>>> mPendingValues;
+
+        MaterialHandle mPoolHandle;
         // lower is higher
         int mPriority = 0;
         bool mDirty = true;
         ShaderProgram::SP mShader;
-        Buffer::SP mMaterialUniformBuffer;
-
+        // PerMaterial block lives in a slot of MaterialBufferPool, this is its cpu copy
+        MaterialBufferPool::Allocation mBlockAllocation;
         void* mPerMaterialBuffer = nullptr;
         size_t mPerMaterialBufferSize = 0;
 
-        // cache out of block uniforms
-        struct UniformCache
+        enum PropertyKind : uint8_t
         {
-            UniformCache(ProgramDataType type, int loc)
-            {
-                this->type = type;
-                this->location = loc;
-                this->data = nullptr;
-            }
-            ProgramDataType type;
-            int location;
-            void* data;
+            PropertyKind_None = 0,
+            PropertyKind_Block,     // offset into PerMaterial block
+            PropertyKind_Uniform,   // offset into uniform arena
+            PropertyKind_Texture,
         };
 
-        std::unordered_map<std::string, UniformCache> mUniformCaches;
-        std::unordered_map<std::string, int> mPerMaterialBlockOffset;
-        std::unordered_map<std::string, uint32_t> mTextureBinds;
+        struct PropertySlot
+        {
+            PropertyKind kind = PropertyKind_None;
+            ProgramDataType type = ProgramDataType_None;
+            bool assigned = false;  // out of block uniforms are uploaded only once set
+            int location = -1;
+            uint32_t offset = 0;
+            uint32_t size = 0;
+        };
+
+        // indexed by PropertyID, sized by the largest ID the shader uses
+        std::vector<PropertySlot> mSlots;
+        // out of block uniform values, sized from reflected layout when it is read
+        std::vector<char> mUniformArena;
+        std::vector<PropertyID> mUniformIDs;
+        // indexed by PropertyID, may be set before layout is known
+        std::vector<Texture::CSP> mTextureBinds;
+
+        // textures resolved to units once, indexed by texture unit, nullptr if the sampler has no texture
+        void resolveTextureUnits();
+        bool mTextureUnitsDirty = true;
+        std::vector<Texture::CSP> mUnitTextures;
+        // scratch for multi-bind, sized when resolved so binding does not allocate
+        std::vector<uint32_t> mUnitHandles;
+        std::vector<uint32_t> mUnitSamplers;
     };
 
     class BasicPBRMaterial: public Material
@@ -123,16 +141,31 @@ namespace Graphics
     public:
         typedef std::shared_ptr<BasicPBRMaterial> SP;
         BasicPBRMaterial(ShaderProgram::SP shader);
+        // variant of basic_pbr selected by keywords, maps whose keyword is off are compiled out and not loaded
+        BasicPBRMaterial(ShaderVariants::SP variants, uint32_t keywordMask);
         ~BasicPBRMaterial();
 
-        void SetRoughnessScale(float scale) { SetValue("roughnessScale", scale); }
-        void SetMetallicScale(float scale) { SetValue("metallicScale", scale); }
-        void SetAOScale(float scale) { SetValue("aoScale", scale); }
+        void SetRoughnessScale(float scale);
+        void SetMetallicScale(float scale);
+        void SetAOScale(float scale);
 
         // "albedoTex","metallicTex", "roughnessTex", "aoTex", "normalTex
+        // Textures are streamed asynchronously, placeholders are bound until they are resident.
+        // They come from TextureCache, materials sharing a map share one texture.
         void LoadTextures(const char *texPaths[5], TextureFormat formats[5]);
+        // Use with basic_pbr_array shader, maps are bound as arrays and each draw selects its layer,
+        // so every material in the set can be drawn with this one material.
+        void SetTextureSet(TextureSet::SP set);
+        // Use with basic_pbr_orm shader: "albedoTex", "ormTex", "normalTex", ao, roughness and metallic packed
+        // in one texture (see ChannelPacker), streamed like LoadTextures.
+        void LoadTexturesORM(const char *texPaths[3], TextureFormat formats[3]);
 
     private:
+        // false if the map of LoadTextures order is compiled out of the variant
+        bool isMapCompiled(int mapIdx) const;
+
         Texture::CSP mTextures[5];
+        ShaderVariants::SP mVariants;
+        uint32_t mKeywordMask = 0;
     };
 }
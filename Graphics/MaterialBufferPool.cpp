@@ -0,0 +1,135 @@
+#include "MaterialBufferPool.h"
+#include <string.h>
+#include <algorithm>
+#include "GL/glew.h"
+#include "RenderManager.h"
+
+namespace Graphics
+{
+    MaterialBufferPool *MaterialBufferPool::mInstance = nullptr;
+
+    MaterialBufferPool *MaterialBufferPool::Instance()
+    {
+        if (mInstance == nullptr)
+            mInstance = new MaterialBufferPool();
+        return mInstance;
+    }
+
+    int MaterialBufferPool::FindPool(uint32_t blockSize) const
+    {
+        for (size_t i = 0; i < mPools.size(); ++i)
+        {
+            if (mPools[i].blockSize == blockSize)
+                return (int)i;
+        }
+        return -1;
+    }
+
+    uint32_t MaterialBufferPool::GetStride(uint32_t blockSize) const
+    {
+        uint32_t alignment = (uint32_t)RenderManager::Instance()->GetSystemInfo().uniformBufferOffsetAlignment;
+        if (alignment == 0)
+            alignment = 256;
+        return (blockSize + alignment - 1) / alignment * alignment;
+    }
+
+    MaterialBufferPool::Allocation MaterialBufferPool::Allocate(uint32_t blockSize)
+    {
+        Allocation allocation;
+        if (blockSize == 0)
+            return allocation;
+
+        int poolIdx = FindPool(blockSize);
+        if (poolIdx < 0)
+        {
+            Pool pool;
+            pool.blockSize = blockSize;
+            pool.stride = GetStride(blockSize);
+            pool.buffer = RenderManager::Instance()->AllocBuffer(BufferType_UniformBuffer);
+            poolIdx = (int)mPools.size();
+            mPools.push_back(pool);
+        }
+
+        auto &pool = mPools[poolIdx];
+        allocation.pool = (uint32_t)poolIdx;
+        if (!pool.freeSlots.empty())
+        {
+            allocation.slot = pool.freeSlots.back();
+            pool.freeSlots.pop_back();
+        }
+        else
+        {
+            allocation.slot = pool.slotCount++;
+            pool.shadow.resize((size_t)pool.slotCount * pool.stride);
+        }
+        return allocation;
+    }
+
+    void MaterialBufferPool::Free(Allocation &allocation)
+    {
+        if (!allocation.IsValid())
+            return;
+        mPools[allocation.pool].freeSlots.push_back(allocation.slot);
+        allocation = Allocation();
+    }
+
+    void MaterialBufferPool::Write(const Allocation &allocation, const void *data)
+    {
+        auto &pool = mPools[allocation.pool];
+        memcpy(&pool.shadow[(size_t)allocation.slot * pool.stride], data, pool.blockSize);
+        pool.dirtyBegin = std::min(pool.dirtyBegin, allocation.slot);
+        pool.dirtyEnd = std::max(pool.dirtyEnd, allocation.slot + 1);
+    }
+
+    void MaterialBufferPool::Flush()
+    {
+        for (auto &pool : mPools)
+        {
+            if (pool.bufferSlots < pool.slotCount)
+            {
+                // grow by half so materials created over time do not respecify every frame
+                pool.bufferSlots = std::max((size_t)pool.slotCount, pool.bufferSlots + pool.bufferSlots / 2);
+                pool.shadow.resize(pool.bufferSlots * pool.stride);
+                pool.buffer->BufferData(pool.shadow.data(), pool.shadow.size(), BufferUsage_DynamicDraw);
+                mUploadedBytes += pool.shadow.size();
+            }
+            else if (pool.dirtyBegin < pool.dirtyEnd)
+            {
+                // one ranged write of the span, clean slots in between are cheaper to resend than extra calls
+                size_t offset = (size_t)pool.dirtyBegin * pool.stride;
+                size_t size = (size_t)(pool.dirtyEnd - pool.dirtyBegin - 1) * pool.stride + pool.blockSize;
+                pool.buffer->BufferSubData(&pool.shadow[offset], offset, size);
+                mUploadedBytes += size;
+            }
+            pool.dirtyBegin = UINT32_MAX;
+            pool.dirtyEnd = 0;
+        }
+    }
+
+    void MaterialBufferPool::Bind(const Allocation &allocation)
+    {
+        auto &pool = mPools[allocation.pool];
+        RenderManager::Instance()->BindBufferRange(pool.buffer, PerMaterialUBOBindPoint, allocation.slot * pool.stride, pool.blockSize);
+    }
+
+    bool MaterialBufferPool::BindStorage(uint32_t blockSize)
+    {
+        int poolIdx = FindPool(blockSize);
+        if (poolIdx < 0 || !RenderManager::Instance()->GetSystemInfo().shaderStorageBuffer)
+            return false;
+        // same buffer object, bound to the storage target instead
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PerMaterialSSBOBindPoint, mPools[poolIdx].buffer->GetBufferHandle());
+        return true;
+    }
+
+    void MaterialBufferPool::PrintReport() const
+    {
+        GFX_LOG_OK("Material buffer pool:");
+        for (auto &pool : mPools)
+        {
+            GFX_LOG_OK_FMT("    block %u bytes, stride %u: %u slots (%d free), buffer %zu bytes", pool.blockSize, pool.stride,
+                           pool.slotCount, (int)pool.freeSlots.size(), pool.bufferSlots * pool.stride);
+        }
+        GFX_LOG_OK_FMT("    uploaded %zu bytes", mUploadedBytes);
+    }
+}
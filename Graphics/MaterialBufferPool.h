@@ -0,0 +1,76 @@
+/**
+ * @file MaterialBufferPool.h
+ * @author wangyudong
+ * @brief PerMaterial uniform blocks suballocated from shared buffers, dirty blocks are uploaded in one ranged write per frame.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "Buffer.h"
+
+namespace Graphics
+{
+    /**
+     * @brief Blocks of the same size share one buffer, each takes a slot with stride aligned to UNIFORM_BUFFER_OFFSET_ALIGNMENT,
+     * so a material binds its block with BindBufferRange and the whole buffer is an array of blocks indexed by slot.
+     * Writes go to a cpu shadow, Flush uploads the dirty slot range of every buffer once (RenderPipeline::Submit calls it
+     * after materials are prepared). A buffer that has to grow is specified again with its whole shadow.
+     */
+    class MaterialBufferPool
+    {
+    public:
+        struct Allocation
+        {
+            uint32_t pool = INVALID_ID;
+            uint32_t slot = INVALID_ID;     // index into the array of blocks, material id of SSBO access
+            inline bool IsValid() const { return pool != INVALID_ID; }
+        };
+
+        static MaterialBufferPool *Instance();
+
+        Allocation Allocate(uint32_t blockSize);
+        void Free(Allocation &allocation);
+
+        // copies the block, uploaded at next Flush
+        void Write(const Allocation &allocation, const void *data);
+        void Flush();
+
+        // block of allocation as PerMaterial UBO
+        void Bind(const Allocation &allocation);
+        // all blocks of the size as SSBO at PerMaterialSSBOBindPoint, false without SSBO support.
+        // Shaders index it by slot, their struct must be padded to GetStride bytes.
+        bool BindStorage(uint32_t blockSize);
+        uint32_t GetStride(uint32_t blockSize) const;
+
+        size_t GetUploadedBytes() const { return mUploadedBytes; }
+        void PrintReport() const;
+
+    private:
+        MaterialBufferPool() {}
+        ~MaterialBufferPool() {}
+
+        struct Pool
+        {
+            uint32_t blockSize;
+            uint32_t stride;
+            Buffer::SP buffer;
+            size_t bufferSlots = 0;             // slots the gpu buffer has room for
+            std::vector<char> shadow;
+            std::vector<uint32_t> freeSlots;
+            uint32_t slotCount = 0;
+            uint32_t dirtyBegin = UINT32_MAX;   // dirty slot range [dirtyBegin, dirtyEnd)
+            uint32_t dirtyEnd = 0;
+        };
+
+        int FindPool(uint32_t blockSize) const;
+
+        static MaterialBufferPool *mInstance;
+
+        std::vector<Pool> mPools;
+        size_t mUploadedBytes = 0;
+    };
+}
@@ -0,0 +1,219 @@
+#include "MipGenerator.h"
+#include <math.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define MIP_USE_SSE
+#endif
+
+namespace Graphics
+{
+    namespace
+    {
+        // one rgba float pixel, unused channels are 0
+#ifdef MIP_USE_SSE
+        typedef __m128 Pixel4;
+        inline Pixel4 Zero4() { return _mm_setzero_ps(); }
+        inline Pixel4 Splat4(float v) { return _mm_set1_ps(v); }
+        inline Pixel4 Add4(Pixel4 a, Pixel4 b) { return _mm_add_ps(a, b); }
+        inline Pixel4 Mul4(Pixel4 a, Pixel4 b) { return _mm_mul_ps(a, b); }
+        inline Pixel4 MulAdd4(Pixel4 acc, Pixel4 a, Pixel4 w) { return _mm_add_ps(acc, _mm_mul_ps(a, w)); }
+        inline void Store4(float *dst, Pixel4 p) { _mm_storeu_ps(dst, p); }
+        inline Pixel4 Load4(const float *src) { return _mm_loadu_ps(src); }
+#else
+        struct Pixel4
+        {
+            float v[4];
+        };
+        inline Pixel4 Zero4() { return {{0, 0, 0, 0}}; }
+        inline Pixel4 Splat4(float v) { return {{v, v, v, v}}; }
+        inline Pixel4 Add4(Pixel4 a, Pixel4 b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+        inline Pixel4 Mul4(Pixel4 a, Pixel4 b) { return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}}; }
+        inline Pixel4 MulAdd4(Pixel4 acc, Pixel4 a, Pixel4 w) { return Add4(acc, Mul4(a, w)); }
+        inline void Store4(float *dst, Pixel4 p) { std::copy(p.v, p.v + 4, dst); }
+        inline Pixel4 Load4(const float *src) { return {{src[0], src[1], src[2], src[3]}}; }
+#endif
+
+        inline float SrgbToLinear(float c)
+        {
+            return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+
+        inline float LinearToSrgb(float c)
+        {
+            return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.f / 2.4f) - 0.055f;
+        }
+
+        // float image, 4 floats per pixel
+        struct FloatImage
+        {
+            int width = 0;
+            int height = 0;
+            std::vector<float> data;
+
+            float *At(int x, int y) { return data.data() + ((size_t)y * width + x) * 4; }
+        };
+
+        void ToFloat(const uint8_t *pixels, int width, int height, int channel, bool srgb, FloatImage &out)
+        {
+            float lut[256];
+            for (int i = 0; i < 256; ++i)
+                lut[i] = srgb ? SrgbToLinear(i / 255.f) : i / 255.f;
+
+            out.width = width;
+            out.height = height;
+            out.data.assign((size_t)width * height * 4, 0.f);
+            int colorChannel = std::min(channel, 3);
+            for (size_t i = 0; i < (size_t)width * height; ++i)
+            {
+                for (int c = 0; c < channel; ++c)
+                    out.data[i * 4 + c] = c < colorChannel ? lut[pixels[i * channel + c]] : pixels[i * channel + c] / 255.f;
+            }
+        }
+
+        void ToBytes(const FloatImage &image, int channel, bool srgb, std::vector<uint8_t> &out)
+        {
+            out.resize((size_t)image.width * image.height * channel);
+            int colorChannel = std::min(channel, 3);
+            for (size_t i = 0; i < (size_t)image.width * image.height; ++i)
+            {
+                for (int c = 0; c < channel; ++c)
+                {
+                    // kaiser lobes may overshoot
+                    float v = std::min(1.f, std::max(0.f, image.data[i * 4 + c]));
+                    if (srgb && c < colorChannel)
+                        v = LinearToSrgb(v);
+                    out[i * channel + c] = (uint8_t)(v * 255.f + 0.5f);
+                }
+            }
+        }
+
+        void DownsampleBox(FloatImage &src, FloatImage &dst)
+        {
+            dst.width = std::max(1, src.width / 2);
+            dst.height = std::max(1, src.height / 2);
+            dst.data.resize((size_t)dst.width * dst.height * 4);
+
+            const Pixel4 quarter = Splat4(0.25f);
+            for (int y = 0; y < dst.height; ++y)
+            {
+                int y0 = std::min(y * 2, src.height - 1), y1 = std::min(y * 2 + 1, src.height - 1);
+                for (int x = 0; x < dst.width; ++x)
+                {
+                    int x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+                    Pixel4 sum = Add4(Add4(Load4(src.At(x0, y0)), Load4(src.At(x1, y0))), Add4(Load4(src.At(x0, y1)), Load4(src.At(x1, y1))));
+                    Store4(dst.At(x, y), Mul4(sum, quarter));
+                }
+            }
+        }
+
+        double BesselI0(double x)
+        {
+            // power series, converges fast for the small arguments used here
+            double sum = 1, term = 1;
+            for (int k = 1; k < 32; ++k)
+            {
+                term *= (x / (2 * k)) * (x / (2 * k));
+                sum += term;
+            }
+            return sum;
+        }
+
+        // A 2x reduction puts every destination texel center between source texels 2x and 2x+1,
+        // so one set of weights serves all texels, tap k reads source texel 2x + k.
+        void KaiserWeights(float weights[MipGenerator::KaiserRadius * 2])
+        {
+            const int radius = MipGenerator::KaiserRadius;
+            double sum = 0;
+            double w[radius * 2];
+            for (int i = 0; i < radius * 2; ++i)
+            {
+                double d = (i - radius + 1) - 0.5; // distance to destination center in source texels
+                double x = d / 2;                  // in destination texels
+                double sinc = x == 0 ? 1 : sin(PI * x) / (PI * x);
+                double r = d / radius;
+                double window = BesselI0(MipGenerator::KaiserAlpha * sqrt(std::max(0.0, 1 - r * r))) / BesselI0(MipGenerator::KaiserAlpha);
+                w[i] = sinc * window;
+                sum += w[i];
+            }
+            for (int i = 0; i < radius * 2; ++i)
+                weights[i] = (float)(w[i] / sum);
+        }
+
+        // separable, horizontal pass into temp then vertical, edges are clamped
+        void DownsampleKaiser(FloatImage &src, FloatImage &dst)
+        {
+            const int radius = MipGenerator::KaiserRadius;
+            float weights[radius * 2];
+            KaiserWeights(weights);
+            Pixel4 w4[radius * 2];
+            for (int i = 0; i < radius * 2; ++i)
+                w4[i] = Splat4(weights[i]);
+
+            FloatImage temp;
+            temp.width = std::max(1, src.width / 2);
+            temp.height = src.height;
+            temp.data.resize((size_t)temp.width * temp.height * 4);
+            for (int y = 0; y < temp.height; ++y)
+            {
+                for (int x = 0; x < temp.width; ++x)
+                {
+                    Pixel4 acc = Zero4();
+                    for (int k = 0; k < radius * 2; ++k)
+                    {
+                        int sx = std::min(std::max(x * 2 + k - radius + 1, 0), src.width - 1);
+                        acc = MulAdd4(acc, Load4(src.At(sx, y)), w4[k]);
+                    }
+                    Store4(temp.At(x, y), acc);
+                }
+            }
+
+            dst.width = temp.width;
+            dst.height = std::max(1, src.height / 2);
+            dst.data.resize((size_t)dst.width * dst.height * 4);
+            for (int y = 0; y < dst.height; ++y)
+            {
+                for (int x = 0; x < dst.width; ++x)
+                {
+                    Pixel4 acc = Zero4();
+                    for (int k = 0; k < radius * 2; ++k)
+                    {
+                        int sy = std::min(std::max(y * 2 + k - radius + 1, 0), temp.height - 1);
+                        acc = MulAdd4(acc, Load4(temp.At(x, sy)), w4[k]);
+                    }
+                    Store4(dst.At(x, y), acc);
+                }
+            }
+        }
+    }
+
+    void MipGenerator::Generate(const uint8_t *pixels, int width, int height, int channel, MipFilter filter, bool srgb,
+                                std::vector<CompressedImage::Level> &levels)
+    {
+        levels.clear();
+
+        CompressedImage::Level level0;
+        level0.width = width;
+        level0.height = height;
+        level0.data.assign(pixels, pixels + (size_t)width * height * channel);
+        levels.push_back(std::move(level0));
+
+        FloatImage current, next;
+        ToFloat(pixels, width, height, channel, srgb, current);
+        while (current.width > 1 || current.height > 1)
+        {
+            if (filter == MipFilter_Kaiser)
+                DownsampleKaiser(current, next);
+            else
+                DownsampleBox(current, next);
+            std::swap(current, next);
+
+            CompressedImage::Level level;
+            level.width = current.width;
+            level.height = current.height;
+            ToBytes(current, channel, srgb, level.data);
+            levels.push_back(std::move(level));
+        }
+    }
+}
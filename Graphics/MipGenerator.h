@@ -0,0 +1,38 @@
+/**
+ * @file MipGenerator.h
+ * @author wangyudong
+ * @brief CPU mip chain generation with box or Kaiser filter, optionally filtering sRGB color in linear space. No GL dependency.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "TextureCompressor.h"
+
+namespace Graphics
+{
+    enum MipFilter
+    {
+        MipFilter_Box = 0,  // 2x2 average, cheap
+        MipFilter_Kaiser,   // Kaiser windowed sinc, sharper mips with less aliasing
+        MipFilter_Max
+    };
+
+    class MipGenerator
+    {
+    public:
+        /**
+         * @brief Build levels down to 1x1, levels[0] is a copy of source. Pixels keep their channel count.
+         * With srgb the first 3 channels are decoded to linear before filtering and encoded back after, alpha stays linear.
+         * Filtering is done on float4 pixels, each level is filtered from the unquantized previous one.
+         */
+        static void Generate(const uint8_t *pixels, int width, int height, int channel, MipFilter filter, bool srgb,
+                             std::vector<CompressedImage::Level> &levels);
+
+        static const int KaiserRadius = 3;  // taps on each side in source texels
+        static constexpr float KaiserAlpha = 4.f;
+    };
+}
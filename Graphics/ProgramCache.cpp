@@ -0,0 +1,190 @@
+#include "ProgramCache.h"
+#include <stdio.h>
+#include <filesystem>
+#include "GL/glew.h"
+#include "RenderManager.h"
+
+namespace Graphics
+{
+    namespace
+    {
+        const uint32_t ProgramCacheMagic = 0x42505354; // "TSPB"
+        const uint32_t ProgramCacheVersion = 1;
+
+        struct ProgramCacheHeader
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint64_t key;
+            uint32_t binaryFormat;
+            uint32_t binarySize;
+        };
+
+        // FNV-1a 64
+        uint64_t HashBytes(uint64_t hash, const void *data, size_t size)
+        {
+            auto bytes = (const uint8_t *)data;
+            for (size_t i = 0; i < size; ++i)
+            {
+                hash ^= bytes[i];
+                hash *= 0x100000001b3ull;
+            }
+            return hash;
+        }
+
+        std::string GetGLString(GLenum name)
+        {
+            auto str = (const char *)glGetString(name);
+            return str == nullptr ? "" : str;
+        }
+    }
+
+    ProgramCache *ProgramCache::mInstance = nullptr;
+
+    ProgramCache *ProgramCache::Instance()
+    {
+        if (mInstance == nullptr)
+            mInstance = new ProgramCache();
+        return mInstance;
+    }
+
+    ProgramCache::ProgramCache()
+    {
+        mDriverString = GetGLString(GL_VENDOR) + "|" + GetGLString(GL_RENDERER) + "|" + GetGLString(GL_VERSION);
+    }
+
+    void ProgramCache::SetDirectory(const std::string &dir)
+    {
+        mDirectory = dir;
+        if (!mDirectory.empty() && mDirectory.back() != '/' && mDirectory.back() != '\\')
+            mDirectory += '/';
+    }
+
+    bool ProgramCache::IsEnabled() const
+    {
+        return !mDirectory.empty() && RenderManager::Instance()->GetSystemInfo().programBinaryFormats > 0;
+    }
+
+    uint64_t ProgramCache::MakeKey(const std::vector<std::string> &stageSources) const
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        hash = HashBytes(hash, mDriverString.data(), mDriverString.size());
+        for (auto &src : stageSources)
+        {
+            // length goes first, so moving code between stages changes the key
+            uint64_t size = src.size();
+            hash = HashBytes(hash, &size, sizeof(size));
+            hash = HashBytes(hash, src.data(), src.size());
+        }
+        return hash == 0 ? 1 : hash;
+    }
+
+    std::string ProgramCache::MakePath(uint64_t key) const
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+        return mDirectory + name;
+    }
+
+    bool ProgramCache::Load(uint32_t programHandle, uint64_t key)
+    {
+        if (!IsEnabled())
+            return false;
+
+        auto path = MakePath(key);
+        FILE *file = fopen(path.c_str(), "rb");
+        if (file == nullptr)
+        {
+            ++mStats.misses;
+            return false;
+        }
+
+        ProgramCacheHeader header;
+        std::vector<char> binary;
+        bool valid = fread(&header, sizeof(header), 1, file) == 1 && header.magic == ProgramCacheMagic &&
+                     header.version == ProgramCacheVersion && header.key == key && header.binarySize > 0;
+        if (valid)
+        {
+            binary.resize(header.binarySize);
+            valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+        }
+        fclose(file);
+
+        GLint success = GL_FALSE;
+        if (valid)
+        {
+            glProgramBinary(programHandle, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+            glGetProgramiv(programHandle, GL_LINK_STATUS, &success);
+        }
+
+        if (!success)
+        {
+            // stale or truncated, it is rebuilt from source and saved again
+            GFX_LOG_ERROR_FMT("Program binary rejected, rebuild from source: %s", path.c_str());
+            remove(path.c_str());
+            ++mStats.rejected;
+            return false;
+        }
+
+        ++mStats.hits;
+        return true;
+    }
+
+    void ProgramCache::Save(uint32_t programHandle, uint64_t key)
+    {
+        if (!IsEnabled())
+            return;
+
+        GLint size = 0;
+        glGetProgramiv(programHandle, GL_PROGRAM_BINARY_LENGTH, &size);
+        if (size <= 0)
+            return;
+
+        ProgramCacheHeader header;
+        header.magic = ProgramCacheMagic;
+        header.version = ProgramCacheVersion;
+        header.key = key;
+        std::vector<char> binary(size);
+        GLsizei length = 0;
+        GLenum format = 0;
+        glGetProgramBinary(programHandle, size, &length, &format, binary.data());
+        if (length <= 0)
+            return;
+        header.binaryFormat = format;
+        header.binarySize = (uint32_t)length;
+
+        std::error_code error;
+        std::filesystem::create_directories(mDirectory, error);
+
+        // written aside and renamed, a crash while saving never leaves a truncated blob under the key
+        auto path = MakePath(key);
+        auto tmpPath = path + ".tmp";
+        FILE *file = fopen(tmpPath.c_str(), "wb");
+        if (file == nullptr)
+        {
+            GFX_LOG_ERROR_FMT("Can't write program binary: %s", tmpPath.c_str());
+            return;
+        }
+        bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                       fwrite(binary.data(), 1, header.binarySize, file) == header.binarySize;
+        fclose(file);
+
+        std::filesystem::rename(tmpPath, path, error);
+        if (!written || error)
+        {
+            GFX_LOG_ERROR_FMT("Can't write program binary: %s", path.c_str());
+            remove(tmpPath.c_str());
+        }
+    }
+
+    void ProgramCache::PrintStats() const
+    {
+        if (!IsEnabled())
+        {
+            GFX_LOG_OK("Program cache disabled");
+            return;
+        }
+        GFX_LOG_OK_FMT("Program cache \"%s\": %zu hits, %zu misses, %zu rejected", mDirectory.c_str(), mStats.hits,
+                       mStats.misses, mStats.rejected);
+    }
+}
@@ -0,0 +1,64 @@
+/**
+ * @file ProgramCache.h
+ * @author wangyudong
+ * @brief On disk cache of linked program binaries, programs built from the same sources on the same driver skip compile and link.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace Graphics
+{
+    /**
+     * @brief Keys hash the final stage sources together with vendor, renderer and version strings of the driver,
+     * so a driver update makes new keys instead of loading blobs it can not read. A blob the driver still rejects
+     * (glProgramBinary fails to link) is deleted and the program is compiled from source again.
+     * Binaries are saved as <directory>/<key>.bin, the directory is created on first save.
+     */
+    class ProgramCache
+    {
+    public:
+        struct Stats
+        {
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t rejected = 0;    // blobs the driver refused
+        };
+
+        static ProgramCache *Instance();
+
+        // "ShaderCache/" under working directory by default, empty string disables caching
+        void SetDirectory(const std::string &dir);
+        inline const std::string &GetDirectory() const { return mDirectory; }
+        // false if caching is disabled or driver has no binary formats
+        bool IsEnabled() const;
+
+        // 0 is never returned, ShaderProgram treats key 0 as uncached
+        uint64_t MakeKey(const std::vector<std::string> &stageSources) const;
+
+        // try to load cached binary of key into program, true if program is linked after
+        bool Load(uint32_t programHandle, uint64_t key);
+        // program must be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+        void Save(uint32_t programHandle, uint64_t key);
+
+        inline const Stats &GetStats() const { return mStats; }
+        void PrintStats() const;
+
+    private:
+        ProgramCache();
+        ~ProgramCache() {}
+
+        std::string MakePath(uint64_t key) const;
+
+        static ProgramCache *mInstance;
+
+        std::string mDirectory = "ShaderCache/";
+        std::string mDriverString;
+        Stats mStats;
+    };
+}
@@ -0,0 +1,65 @@
+#include "PropertyID.h"
+#include <string.h>
+#include "Constants.h"
+
+namespace Graphics
+{
+    PropertyTable *PropertyTable::mInstance = nullptr;
+
+    PropertyTable *PropertyTable::Instance()
+    {
+        if (mInstance == nullptr)
+            mInstance = new PropertyTable();
+        return mInstance;
+    }
+
+    PropertyID PropertyTable::intern(uint64_t hash, const char *name, size_t length)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto iter = mIDs.find(hash);
+        if (iter != mIDs.end())
+        {
+            // 64 bit collisions are not expected, but a silent one would alias two properties
+            auto &known = mNames[iter->second];
+            if (known.size() != length || known.compare(0, length, name, length) != 0)
+            {
+                GFX_LOG_ERROR_FMT("Property name hash collision: %s and %s", known.c_str(), std::string(name, length).c_str());
+            }
+            return iter->second;
+        }
+
+        auto id = (PropertyID)mNames.size();
+        mNames.emplace_back(name, length);
+        mIDs.insert(std::make_pair(hash, id));
+        return id;
+    }
+
+    PropertyID PropertyTable::GetID(const std::string &name)
+    {
+        return intern(HashPropertyName(name.data(), name.size()), name.data(), name.size());
+    }
+
+    PropertyID PropertyTable::GetID(const PropertyName &name)
+    {
+        return intern(name.hash, name.name, strlen(name.name));
+    }
+
+    PropertyID PropertyTable::FindID(const std::string &name)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto iter = mIDs.find(HashPropertyName(name.data(), name.size()));
+        return iter == mIDs.end() ? InvalidPropertyID : iter->second;
+    }
+
+    const std::string &PropertyTable::GetName(PropertyID id)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mNames[id];
+    }
+
+    size_t PropertyTable::GetCount()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mNames.size();
+    }
+}
@@ -0,0 +1,76 @@
+/**
+ * @file PropertyID.h
+ * @author wangyudong
+ * @brief Material property names interned to small dense integers, so per-material lookups are array indexing.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <deque>
+
+namespace Graphics
+{
+    typedef uint32_t PropertyID;
+    const PropertyID InvalidPropertyID = 0xFFFFFFFF;
+
+    // FNV-1a 64, constexpr so literal names are hashed at compile time
+    constexpr uint64_t HashPropertyName(const char *name, size_t length)
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < length; ++i)
+        {
+            hash ^= (uint8_t)name[i];
+            hash *= 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    struct PropertyName
+    {
+        const char *name;
+        uint64_t hash;
+    };
+
+// name literal with its hash folded at compile time, e.g. GFX_PROPERTY("mainColor")
+#define GFX_PROPERTY(literal) \
+    ::Graphics::PropertyName{literal, std::integral_constant<uint64_t, ::Graphics::HashPropertyName(literal, sizeof(literal) - 1)>::value}
+
+    /**
+     * @brief IDs are assigned in first use order and never released, so they stay small and index flat arrays.
+     * Interning is guarded by a mutex, cache IDs of names used every frame instead of looking them up again.
+     */
+    class PropertyTable
+    {
+    public:
+        static PropertyTable *Instance();
+
+        PropertyID GetID(const std::string &name);
+        // no string hashing, hash comes from GFX_PROPERTY
+        PropertyID GetID(const PropertyName &name);
+        // InvalidPropertyID if never interned, does not add it
+        PropertyID FindID(const std::string &name);
+
+        const std::string &GetName(PropertyID id);
+        size_t GetCount();
+
+    private:
+        PropertyTable() {}
+        ~PropertyTable() {}
+
+        PropertyID intern(uint64_t hash, const char *name, size_t length);
+
+        static PropertyTable *mInstance;
+
+        std::mutex mMutex;
+        std::unordered_map<uint64_t, PropertyID> mIDs;
+        // deque keeps names in place, GetName references stay valid
+        std::deque<std::string> mNames;
+    };
+}
@@ -1,6 +1,8 @@
 #include "RenderManager.h"
 #include "GL/glew.h"
 #include "InternalFunctions.h"
+#include "TextureStreamer.h"
+#include "TextureResidency.h"
 
 namespace Graphics
 {
@@ -20,7 +22,9 @@ namespace Graphics
         GLuint bufferHandle;
         glGenBuffers(1, &bufferHandle);
 
-        return std::make_shared<Buffer>(bufferHandle, type);
+        auto buffer = std::make_shared<Buffer>(bufferHandle, type);
+        buffer->SetPoolHandle(mBuffers.Add(buffer.get()));
+        return buffer;
     }
 
     Texture::SP RenderManager::AllocTexture(TextureType type, TextureFormat format, bool generateMipmap)
@@ -28,13 +32,18 @@ namespace Graphics
         GLuint texHandle;
         glGenTextures(1, &texHandle);
 
-        return std::make_shared<Texture>(texHandle, type, format, generateMipmap);
+        auto tex = std::make_shared<Texture>(texHandle, type, format, generateMipmap);
+        tex->SetPoolHandle(mTextures.Add(tex.get()));
+        TextureResidency::Instance()->Register(tex);
+        return tex;
     }
 
     ShaderProgram::SP RenderManager::AllocShaderProgram()
     {
         GLuint programHandle = glCreateProgram();
-        return std::make_shared<ShaderProgram>(programHandle);
+        auto program = std::make_shared<ShaderProgram>(programHandle);
+        program->SetPoolHandle(mShaderPrograms.Add(program.get()));
+        return program;
     }
 
     void RenderManager::ReleaseTexture(Texture *tex)
@@ -44,6 +53,8 @@ namespace Graphics
         auto handle = tex->GetHandle();
         glDeleteTextures(1, &handle);
         tex->Reset();
+        mTextures.Remove(tex->GetPoolHandle());
+        TextureResidency::Instance()->Unregister(tex);
     }
 
     void RenderManager::ReleaseBuffer(Buffer *buffer)
@@ -54,6 +65,7 @@ namespace Graphics
         auto handle = buffer->GetBufferHandle();
         glDeleteBuffers(1, &handle);
         buffer->Reset();
+        mBuffers.Remove(buffer->GetPoolHandle());
     }
 
     void RenderManager::ReleaseShaderProgram(ShaderProgram *shaderProgram)
@@ -62,6 +74,67 @@ namespace Graphics
             return;
         glDeleteProgram(shaderProgram->GetProgramHandle());
         shaderProgram->Reset();
+        mShaderPrograms.Remove(shaderProgram->GetPoolHandle());
+    }
+
+    void RenderManager::BuildShaderProgramsAsync()
+    {
+        mShaderPrograms.ForEach([](ShaderProgram *program) { program->BuildAsync(); });
+    }
+
+    void RenderManager::SetFallbackProgram(ShaderProgram::SP program)
+    {
+        // it must be usable right away
+        if (program != nullptr && !program->BuildProgram())
+        {
+            GFX_LOG_ERROR("Fallback program failed to build!");
+            return;
+        }
+        mFallbackProgram = program;
+    }
+
+    uint32_t RenderManager::GetSampler(const SamplerState &state)
+    {
+        auto iter = mSamplers.find(state.Key());
+        if (iter != mSamplers.end())
+            return iter->second;
+
+        GLuint sampler;
+        glGenSamplers(1, &sampler);
+        glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GetNativeFilter(state.minFilter));
+        glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GetNativeFilter(state.magFilter));
+        glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GetNativeWrapMode(state.wrapS));
+        glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GetNativeWrapMode(state.wrapT));
+        mSamplers.insert(std::make_pair(state.Key(), (uint32_t)sampler));
+        return sampler;
+    }
+
+    GeometryPool::SP RenderManager::GetGeometryPool(uint32_t layoutFlag)
+    {
+        auto iter = mGeometryPools.find(layoutFlag);
+        if (iter != mGeometryPools.end())
+            return iter->second;
+
+        auto pool = std::make_shared<GeometryPool>(layoutFlag);
+        mGeometryPools.insert(std::make_pair(layoutFlag, pool));
+        return pool;
+    }
+
+    void RenderManager::BindVertexArray(uint32_t handle)
+    {
+        if (handle == mCurrentVAO)
+            return;
+        glBindVertexArray(handle);
+        mCurrentVAO = handle;
+    }
+
+    void RenderManager::ReleaseVertexArray(uint32_t handle)
+    {
+        if (handle == INVALID_ID)
+            return;
+        if (handle == mCurrentVAO)
+            BindVertexArray(0);
+        glDeleteVertexArrays(1, &handle);
     }
 
     void RenderManager::BindBufferRange(Buffer::SP buffer, uint32_t bindPoint, uint32_t offset, uint32_t size)
@@ -76,15 +149,173 @@ namespace Graphics
         glCheckError();
     }
 
+    void RenderManager::BindStorageBuffer(Buffer::SP buffer, uint32_t bindPoint, uint32_t offset, uint32_t size)
+    {
+        if (offset == 0 && size == 0)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bindPoint, buffer->GetBufferHandle());
+        else
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, bindPoint, buffer->GetBufferHandle(), offset,
+                              size == 0 ? buffer->GetSize() - offset : size);
+        glCheckError();
+    }
+
+    void RenderManager::BindImageTexture(Texture::SP tex, uint32_t unit, ImageAccess access, int level, bool layered)
+    {
+        auto format = GetNativeImageFormat(tex->GetFormat());
+        if (format == 0)
+        {
+            GFX_LOG_ERROR_FMT("Texture format %d can't be bound as image", (int)tex->GetFormat());
+            return;
+        }
+        glBindImageTexture(unit, tex->GetHandle(), level, layered ? GL_TRUE : GL_FALSE, 0, GetNativeImageAccess(access), format);
+        glCheckError();
+    }
+
+    void RenderManager::Dispatch(ShaderProgram::SP program, uint32_t groupsX, uint32_t groupsY, uint32_t groupsZ)
+    {
+        if (!program->IsCompute())
+        {
+            GFX_LOG_ERROR("Dispatch needs a compute program!");
+            return;
+        }
+        program->UseProgram();
+        glDispatchCompute(groupsX, groupsY, groupsZ);
+        glCheckError();
+    }
+
+    void RenderManager::DispatchIndirect(ShaderProgram::SP program, Buffer::SP buffer, uint32_t offset)
+    {
+        if (!program->IsCompute())
+        {
+            GFX_LOG_ERROR("Dispatch needs a compute program!");
+            return;
+        }
+        program->UseProgram();
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, buffer->GetBufferHandle());
+        glDispatchComputeIndirect((GLintptr)offset);
+        glCheckError();
+    }
+
+    void RenderManager::Barrier(uint32_t flags)
+    {
+        glMemoryBarrier(GetNativeBarrierFlags(flags));
+    }
+
     void RenderManager::DrawArrays(DrawType type, uint32_t first, uint32_t count)
     {
         glDrawArrays(GetNativeDrawType(type), first, count);
         glCheckError();
     }
 
-    void RenderManager::DrawElements(DrawType type, uint32_t count)
+    void RenderManager::DrawElements(DrawType type, uint32_t count, uint32_t firstIndex, int32_t baseVertex)
+    {
+        auto indexOffset = (void *)(firstIndex * sizeof(uint32_t));
+        if (baseVertex == 0)
+            glDrawElements(GetNativeDrawType(type), count, GL_UNSIGNED_INT, indexOffset);
+        else
+            glDrawElementsBaseVertex(GetNativeDrawType(type), count, GL_UNSIGNED_INT, indexOffset, baseVertex);
+        glCheckError();
+    }
+
+    void RenderManager::DrawObject(VertexDataSource *source, uint32_t objectIndex)
     {
-        glDrawElements(GetNativeDrawType(type), count, GL_UNSIGNED_INT, 0);
+        if (!mSystemInfo.baseInstance)
+            glVertexAttribI1ui(ObjectIndexAttribLocation, objectIndex);
+
+        if (source->HasIndex())
+        {
+            auto indexOffset = (void *)(source->FirstIndex() * sizeof(uint32_t));
+            if (mSystemInfo.baseInstance)
+                glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, (GLsizei)source->IndexCount(), GL_UNSIGNED_INT, indexOffset, 1,
+                                                              (GLint)source->BaseVertex(), objectIndex);
+            else
+                glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)source->IndexCount(), GL_UNSIGNED_INT, indexOffset, (GLint)source->BaseVertex());
+        }
+        else
+        {
+            if (mSystemInfo.baseInstance)
+                glDrawArraysInstancedBaseInstance(GL_TRIANGLES, (GLint)source->BaseVertex(), (GLsizei)source->VertexCount(), 1, objectIndex);
+            else
+                glDrawArrays(GL_TRIANGLES, (GLint)source->BaseVertex(), (GLsizei)source->VertexCount());
+        }
+        glCheckError();
+    }
+
+    void RenderManager::DrawObjectInstances(VertexDataSource *source, uint32_t firstObject, uint32_t count)
+    {
+        if (!mSystemInfo.baseInstance)
+        {
+            for (uint32_t i = 0; i < count; ++i)
+                DrawObject(source, firstObject + i);
+            return;
+        }
+
+        // the instanced attribute reads objectIndex firstObject + gl_InstanceID
+        if (source->HasIndex())
+        {
+            auto indexOffset = (void *)(source->FirstIndex() * sizeof(uint32_t));
+            glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, (GLsizei)source->IndexCount(), GL_UNSIGNED_INT, indexOffset, (GLsizei)count,
+                                                          (GLint)source->BaseVertex(), firstObject);
+        }
+        else
+        {
+            glDrawArraysInstancedBaseInstance(GL_TRIANGLES, (GLint)source->BaseVertex(), (GLsizei)source->VertexCount(), (GLsizei)count, firstObject);
+        }
+        glCheckError();
+    }
+
+    void RenderManager::SetupObjectIndexAttribute()
+    {
+        // without base instance the attribute array stays disabled and reads the constant value
+        if (!mSystemInfo.baseInstance)
+            return;
+
+        ReserveObjectIndices(1024);
+        mObjectIndexBuffer->Bind();
+        glEnableVertexAttribArray(ObjectIndexAttribLocation);
+        glVertexAttribIPointer(ObjectIndexAttribLocation, 1, GL_UNSIGNED_INT, 0, (void *)0);
+        glVertexAttribDivisor(ObjectIndexAttribLocation, 1);
+        glCheckError();
+    }
+
+    void RenderManager::ReserveObjectIndices(uint32_t count)
+    {
+        if (!mSystemInfo.baseInstance || count <= mObjectIndexCount)
+            return;
+
+        if (mObjectIndexBuffer == nullptr)
+            mObjectIndexBuffer = AllocBuffer(BufferType_VertexBuffer);
+        std::vector<uint32_t> indices(std::max(count, mObjectIndexCount * 2));
+        for (size_t i = 0; i < indices.size(); ++i)
+            indices[i] = (uint32_t)i;
+        // same buffer name, attributes of existing VAOs see the new storage
+        mObjectIndexBuffer->BufferData(indices.data(), indices.size() * sizeof(uint32_t), BufferUsage_StaticDraw);
+        mObjectIndexCount = (uint32_t)indices.size();
+    }
+
+    void RenderManager::MultiDrawElements(DrawType type, const uint32_t *counts, const uint32_t *firstIndices, const int32_t *baseVertices, uint32_t drawCount)
+    {
+        mMultiDrawOffsets.resize(drawCount);
+        for (uint32_t i = 0; i < drawCount; ++i)
+        {
+            mMultiDrawOffsets[i] = (const void *)(firstIndices[i] * sizeof(uint32_t));
+        }
+        glMultiDrawElementsBaseVertex(GetNativeDrawType(type), (const GLsizei *)counts, GL_UNSIGNED_INT, mMultiDrawOffsets.data(), drawCount, (const GLint *)baseVertices);
+        glCheckError();
+    }
+
+    void RenderManager::MultiDrawElementsIndirectCount(DrawType type, Buffer::SP commands, size_t commandOffset, Buffer::SP countBuffer,
+                                                       size_t countOffset, uint32_t maxDrawCount)
+    {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commands->GetBufferHandle());
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, countBuffer->GetBufferHandle());
+        // same entry point, core since 4.6
+        if (GLEW_VERSION_4_6)
+            glMultiDrawElementsIndirectCount(GetNativeDrawType(type), GL_UNSIGNED_INT, (const void *)commandOffset, (GLintptr)countOffset,
+                                             (GLsizei)maxDrawCount, 0);
+        else
+            glMultiDrawElementsIndirectCountARB(GetNativeDrawType(type), GL_UNSIGNED_INT, (const void *)commandOffset, (GLintptr)countOffset,
+                                                (GLsizei)maxDrawCount, 0);
         glCheckError();
     }
 
@@ -145,8 +376,82 @@ namespace Graphics
         glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &info.uniformBufferOffsetAlignment);
         glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &info.maxTextureImageUnits);
         glGetIntegerv(GL_MAX_VERTEX_TEXTURE_IMAGE_UNITS, &info.maxVertexTextureImageUnits);
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &info.maxArrayTextureLayers);
+        info.programBinaryFormats = 0;
+        if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &info.programBinaryFormats);
+        info.bufferStorage = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+        info.multiBind = GLEW_VERSION_4_4 || GLEW_ARB_multi_bind;
+        info.parallelShaderCompile = GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+        info.shaderStorageBuffer = GLEW_VERSION_4_3 || GLEW_ARB_shader_storage_buffer_object;
+        info.computeShader = GLEW_VERSION_4_3 || GLEW_ARB_compute_shader;
+        info.multiDrawIndirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+        info.indirectParameters = GLEW_VERSION_4_6 || GLEW_ARB_indirect_parameters;
+        info.baseInstance = GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+        info.shaderImageLoadStore = GLEW_VERSION_4_2 || GLEW_ARB_shader_image_load_store;
+        // let the driver pick its thread count
+        if (GLEW_KHR_parallel_shader_compile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        else if (GLEW_ARB_parallel_shader_compile)
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        info.textureCompressionS3TC = GLEW_EXT_texture_compression_s3tc;
+        info.textureCompressionBPTC = GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+        info.textureCompressionETC2 = GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility;
 
         info.printInfo();
+        mSystemInfo = info;
+    }
+
+    bool RenderManager::IsFormatSupported(TextureFormat format) const
+    {
+        switch (format)
+        {
+        case TextureFormat_BC1:
+            return mSystemInfo.textureCompressionS3TC;
+        case TextureFormat_BC7:
+            return mSystemInfo.textureCompressionBPTC;
+        case TextureFormat_ETC2_RGB8:
+        case TextureFormat_ETC2_RGBA8:
+            return mSystemInfo.textureCompressionETC2;
+        default:
+            // RGTC (BC4, BC5) is core since 3.0
+            return true;
+        }
+    }
+
+    size_t RenderManager::GetRetainedBytes() const
+    {
+        size_t bytes = 0;
+        mBuffers.ForEach([&bytes](Buffer *buffer) { bytes += buffer->GetRetainedBytes(); });
+        mTextures.ForEach([&bytes](Texture *tex) { bytes += tex->GetRetainedBytes(); });
+        mMeshes.ForEach([&bytes](StaticMesh *mesh) { bytes += mesh->GetRetainedBytes(); });
+        return bytes;
+    }
+
+    void RenderManager::PrintMemoryReport() const
+    {
+        static const char *policyNames[RetentionPolicy_Max] = {"discard", "keepSource", "keepForReadback"};
+        size_t bufferBytes = 0, textureBytes = 0, meshBytes = 0;
+
+        GFX_LOG_OK("Retained cpu memory report:");
+        mBuffers.ForEach([&](Buffer *buffer)
+        {
+            GFX_LOG_OK_FMT("    buffer %u (%s): %zu bytes", buffer->GetBufferHandle(), policyNames[buffer->GetRetentionPolicy()], buffer->GetRetainedBytes());
+            bufferBytes += buffer->GetRetainedBytes();
+        });
+        mTextures.ForEach([&](Texture *tex)
+        {
+            GFX_LOG_OK_FMT("    texture %u %dx%d (%s): %zu bytes", tex->GetHandle(), tex->GetWidth(), tex->GetHeight(), policyNames[tex->GetRetentionPolicy()], tex->GetRetainedBytes());
+            textureBytes += tex->GetRetainedBytes();
+        });
+        mMeshes.ForEach([&](StaticMesh *mesh)
+        {
+            GFX_LOG_OK_FMT("    mesh %08x (%s): %zu bytes", mesh->GetPoolHandle().value, policyNames[mesh->GetRetentionPolicy()], mesh->GetRetainedBytes());
+            meshBytes += mesh->GetRetainedBytes();
+        });
+        GFX_LOG_OK_FMT("    total: buffers %zu, textures %zu, meshes %zu, all %zu bytes", bufferBytes, textureBytes, meshBytes, bufferBytes + textureBytes + meshBytes);
+        TextureResidency::Instance()->PrintReport();
+        MaterialBufferPool::Instance()->PrintReport();
     }
 
     void RenderManager::ClearColor(Eigen::Vector4f c)
@@ -154,6 +459,15 @@ namespace Graphics
         glClearColor(c[0], c[1], c[2], c[3]);
     }
 
+    void RenderManager::EndFrame()
+    {
+        // textures finished in this update are bound by this frame's draws
+        TextureStreamer::Instance()->Update();
+        mPipeline->Submit();
+        // textures bound by this frame are known now
+        TextureResidency::Instance()->Update();
+    }
+
     void RenderManager::EnableWireFrame(bool enabled)
     {
         if (enabled)
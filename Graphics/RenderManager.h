@@ -9,6 +9,7 @@
 #pragma once
 
 #include <queue>
+#include <unordered_map>
 #include "Texture.h"
 #include "RenderTexture.h"
 #include "Buffer.h"
@@ -16,6 +17,7 @@
 #include "RenderPass.h"
 #include "Material.h"
 #include "StaticMesh.h"
+#include "GeometryPool.h"
 #include "RenderPipeline.h"
 
 namespace Graphics
@@ -36,18 +38,85 @@ namespace Graphics
         void ReleaseTexture(Texture *tex);
         void ReleaseShaderProgram(ShaderProgram *shaderProgram);
 
+        // submit every living program not built yet, call once programs are loaded so the driver compiles them together
+        void BuildShaderProgramsAsync();
+        // drawn with by materials whose program is still compiling, their draws are skipped if there is none
+        void SetFallbackProgram(ShaderProgram::SP program);
+        inline ShaderProgram::SP GetFallbackProgram() { return mFallbackProgram; }
+
+        // static meshes and materials are not allocated here, they register themselves for their lifetime.
+        MeshHandle RegisterMesh(StaticMesh *mesh) { return mMeshes.Add(mesh); }
+        void UnregisterMesh(StaticMesh *mesh) { mMeshes.Remove(mesh->GetPoolHandle()); }
+        MaterialHandle RegisterMaterial(Material *material) { return mMaterials.Add(material); }
+        void UnregisterMaterial(Material *material) { mMaterials.Remove(material->GetPoolHandle()); }
+
+        // Handles name objects without owning them, nullptr once the object is destroyed.
+        inline Buffer *GetBuffer(BufferHandle handle) const { return lookup(mBuffers, handle); }
+        inline Texture *GetTexture(TextureHandle handle) const { return lookup(mTextures, handle); }
+        inline ShaderProgram *GetShaderProgram(ProgramHandle handle) const { return lookup(mShaderPrograms, handle); }
+        inline Material *GetMaterial(MaterialHandle handle) const { return lookup(mMaterials, handle); }
+        inline StaticMesh *GetMesh(MeshHandle handle) const { return lookup(mMeshes, handle); }
+
         void SetCurrentRenderTexture(RenderTexture::SP rt) {}
         RenderTexture::SP GetCurrentRenderTexture() { return mRenderTexture; }
 
+        // shared by all static meshes with the same layout flag
+        GeometryPool::SP GetGeometryPool(uint32_t layoutFlag);
+
+        // VAO binding is cached, all VAO binds should go through here.
+        void BindVertexArray(uint32_t handle);
+        void ReleaseVertexArray(uint32_t handle);
+
+        // sampler objects are shared by state and live as long as the manager
+        uint32_t GetSampler(const SamplerState &state);
+
         void BindBufferRange(Buffer::SP buffer, uint32_t bindPoint, uint32_t offset, uint32_t size);
         void BindBufferBase(Buffer::SP buffer, uint32_t bindPoint);
+        // any buffer can be read or written by shaders as a storage buffer, size 0 binds from offset to the end
+        void BindStorageBuffer(Buffer::SP buffer, uint32_t bindPoint, uint32_t offset = 0, uint32_t size = 0);
+        // level of texture for image load / store, layered binds every layer of arrays, 3D and cube textures
+        void BindImageTexture(Texture::SP tex, uint32_t unit, ImageAccess access, int level = 0, bool layered = true);
+
+        /****************** compute functions ***********************/
+
+        // program must be a compute program, counts are work groups not invocations
+        void Dispatch(ShaderProgram::SP program, uint32_t groupsX, uint32_t groupsY = 1, uint32_t groupsZ = 1);
+        // group counts are 3 uint32 at offset of buffer, written by an earlier pass
+        void DispatchIndirect(ShaderProgram::SP program, Buffer::SP buffer, uint32_t offset = 0);
+        // flags are combination of BarrierFlag, describe how the written data is read next
+        void Barrier(uint32_t flags);
 
         /****************** draw functions ***********************/
 
         void DrawArrays(DrawType type, uint32_t first, uint32_t count);
-        void DrawElements(DrawType type, uint32_t count);
-
-        inline void DrawMesh(StaticMesh::SP mesh, Material::SP material, const Eigen::Matrix4f &modelMat) { mPipeline->CollectMesh(mesh, material, modelMat); }
+        // 32 bit indices, firstIndex and baseVertex are used for suballocated vertex data.
+        void DrawElements(DrawType type, uint32_t count, uint32_t firstIndex = 0, int32_t baseVertex = 0);
+        // one object of the per object array, objectIndex reaches shaders through the objectIndex attribute: as base
+        // instance when supported, otherwise as a constant attribute value set before the draw
+        void DrawObject(VertexDataSource *source, uint32_t objectIndex);
+        // count objects from firstObject, in one instanced draw when base instance is supported
+        void DrawObjectInstances(VertexDataSource *source, uint32_t firstObject, uint32_t count);
+        // called by vertex sources while their VAO is bound, so base instance selects the object index
+        void SetupObjectIndexAttribute();
+        // object indices below count can be drawn with DrawObject, call before drawing
+        void ReserveObjectIndices(uint32_t count);
+        // several draws from the same VAO in one call
+        void MultiDrawElements(DrawType type, const uint32_t *counts, const uint32_t *firstIndices, const int32_t *baseVertices, uint32_t drawCount);
+        // commands are DrawElementsIndirectCommand (5 uint32) from commandOffset, how many of at most maxDrawCount
+        // are drawn is the uint32 at countOffset of countBuffer, both usually written by a compute pass
+        void MultiDrawElementsIndirectCount(DrawType type, Buffer::SP commands, size_t commandOffset, Buffer::SP countBuffer,
+                                            size_t countOffset, uint32_t maxDrawCount);
+
+        // the pipeline keeps mesh and material alive until EndFrame
+        inline void DrawMesh(const VertexDataSource::SP &mesh, const Material::SP &material, const Eigen::Matrix4f &modelMat) { mPipeline->CollectMesh(mesh, material, modelMat); }
+        // material samples texture set arrays, layer picks the material maps
+        inline void DrawMesh(const VertexDataSource::SP &mesh, const Material::SP &material, const Eigen::Matrix4f &modelMat, const TextureSetSlice &slice) { mPipeline->CollectMesh(mesh, material, modelMat, slice.layer); }
+        // Nothing is reference counted, the caller owns mesh and material and keeps them until EndFrame. Stale handles
+        // are dropped with an error.
+        inline void DrawMesh(MeshHandle mesh, MaterialHandle material, const Eigen::Matrix4f &modelMat, int textureLayer = 0) { mPipeline->CollectMesh(GetMesh(mesh), GetMaterial(material), modelMat, textureLayer); }
+        // streams are read in EndFrame, see RenderPipeline::CollectInstances
+        inline void DrawInstances(const VertexDataSource::SP &mesh, const Material::SP &material, const Eigen::Matrix4f &parent, const TransformSoA &transforms,
+                                  uint32_t count, int textureLayer = 0) { mPipeline->CollectInstances(mesh, material, parent, transforms, count, textureLayer); }
         inline void AddRenderPass(RenderPass::SP pass) { mPipeline->AddRenderPass(pass); }
 
         /****************** other functions ***********************/
@@ -65,30 +134,88 @@ namespace Graphics
 
         void EnableWireFrame(bool enabled);
         void CollectLight(const Light &light) { mPipeline->CollectLight(light); }
-        void EndFrame() { mPipeline->Submit(); }
+        void SetScene(RenderScene::SP scene) { mPipeline->SetScene(scene); }
+        // uploads streamed textures, submits collected draws, then keeps textures under budget
+        void EndFrame();
+        bool Pick(const Ray &ray, PickResult &result) { return mPipeline->Pick(ray, result); }
 
         struct GraphicsInfo
         {
             int uniformBufferOffsetAlignment;
             int maxTextureImageUnits;
             int maxVertexTextureImageUnits;
+            int maxArrayTextureLayers;
+            int programBinaryFormats;   // 0 if driver can't save program binaries
+            bool bufferStorage;     // GL 4.4 or ARB_buffer_storage
+            bool multiBind;         // GL 4.4 or ARB_multi_bind
+            bool parallelShaderCompile; // KHR or ARB_parallel_shader_compile
+            bool shaderStorageBuffer;   // GL 4.3 or ARB_shader_storage_buffer_object
+            bool computeShader;         // GL 4.3 or ARB_compute_shader
+            bool multiDrawIndirect;     // GL 4.3 or ARB_multi_draw_indirect
+            bool indirectParameters;    // GL 4.6 or ARB_indirect_parameters, draw count from a buffer
+            bool baseInstance;          // GL 4.2 or ARB_base_instance
+            bool shaderImageLoadStore;  // GL 4.2 or ARB_shader_image_load_store
+            bool textureCompressionS3TC;    // BC1
+            bool textureCompressionBPTC;    // BC7, GL 4.2
+            bool textureCompressionETC2;    // GL 4.3 or ARB_ES3_compatibility
 
             void printInfo()
             {
                 GFX_LOG_OK_FMT("Graphics Info:\n    UNIFORM_BUFFER_OFFSET_ALIGNMENT: %d", uniformBufferOffsetAlignment);
                 GFX_LOG_OK_FMT("    MAX_TEXTURE_IMAGE_UNITS: %d", maxTextureImageUnits);
                 GFX_LOG_OK_FMT("    MAX_VERTEX_TEXTURE_IMAGE_UNITS: %d", maxVertexTextureImageUnits);
+                GFX_LOG_OK_FMT("    MAX_ARRAY_TEXTURE_LAYERS: %d", maxArrayTextureLayers);
+                GFX_LOG_OK_FMT("    NUM_PROGRAM_BINARY_FORMATS: %d", programBinaryFormats);
+                GFX_LOG_OK_FMT("    BUFFER_STORAGE: %s", bufferStorage ? "yes" : "no");
+                GFX_LOG_OK_FMT("    MULTI_BIND: %s", multiBind ? "yes" : "no");
+                GFX_LOG_OK_FMT("    PARALLEL_SHADER_COMPILE: %s", parallelShaderCompile ? "yes" : "no");
+                GFX_LOG_OK_FMT("    SHADER_STORAGE_BUFFER: %s", shaderStorageBuffer ? "yes" : "no");
+                GFX_LOG_OK_FMT("    COMPUTE_SHADER: %s", computeShader ? "yes" : "no");
+                GFX_LOG_OK_FMT("    MULTI_DRAW_INDIRECT: %s, INDIRECT_PARAMETERS: %s", multiDrawIndirect ? "yes" : "no",
+                               indirectParameters ? "yes" : "no");
+                GFX_LOG_OK_FMT("    BASE_INSTANCE: %s", baseInstance ? "yes" : "no");
+                GFX_LOG_OK_FMT("    SHADER_IMAGE_LOAD_STORE: %s", shaderImageLoadStore ? "yes" : "no");
+                GFX_LOG_OK_FMT("    TEXTURE_COMPRESSION: S3TC %s, BPTC %s, ETC2 %s", textureCompressionS3TC ? "yes" : "no",
+                               textureCompressionBPTC ? "yes" : "no", textureCompressionETC2 ? "yes" : "no");
             }
         };
         const GraphicsInfo &GetSystemInfo() { return mSystemInfo; }
+        bool IsFormatSupported(TextureFormat format) const;
+
+        // cpu side memory retained by living buffers, textures and static meshes.
+        size_t GetRetainedBytes() const;
+        void PrintMemoryReport() const;
         
     private:
         RenderManager();
         ~RenderManager() {}
 
+        template <typename T>
+        static inline T *lookup(const HandlePool<T *, T> &pool, PoolHandle<T> handle)
+        {
+            auto item = pool.Get(handle);
+            return item == nullptr ? nullptr : *item;
+        }
+
         static RenderManager *mInstance;
         RenderPipeline::SP mPipeline;
         RenderTexture::SP mRenderTexture;
         GraphicsInfo mSystemInfo;
+
+        // every living object of each kind, its slot is its handle
+        HandlePool<Buffer *, Buffer> mBuffers;
+        HandlePool<Texture *, Texture> mTextures;
+        HandlePool<ShaderProgram *, ShaderProgram> mShaderPrograms;
+        HandlePool<Material *, Material> mMaterials;
+        HandlePool<StaticMesh *, StaticMesh> mMeshes;
+        ShaderProgram::SP mFallbackProgram;
+
+        std::unordered_map<uint32_t, GeometryPool::SP> mGeometryPools;
+        std::unordered_map<uint32_t, uint32_t> mSamplers;
+        uint32_t mCurrentVAO = 0;
+        std::vector<const void *> mMultiDrawOffsets;
+        // 0, 1, 2 ... instanced by the objectIndex attribute of every VAO, grows in place so VAOs keep it
+        Buffer::SP mObjectIndexBuffer;
+        uint32_t mObjectIndexCount = 0;
     };
 }
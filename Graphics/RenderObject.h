@@ -20,21 +20,26 @@ namespace Graphics
     {
 
     public:
-        RenderObject(VertexDataSource::SP vertexSource, Material::SP material, const Eigen::Matrix4f &modelMatrix)
-            : vertexSource(vertexSource), material(material) { objectData.modelMat = modelMatrix; }
+        // the pipeline collecting it keeps vertex source and material alive until the frame is submitted
+        RenderObject(VertexDataSource *vertexSource, Material *material, const Eigen::Matrix4f &modelMatrix, int textureLayer = 0)
+            : vertexSource(vertexSource), material(material)
+        {
+            objectData.modelMat = modelMatrix;
+            objectData.textureLayer = textureLayer;
+        }
         ~RenderObject() {}
 
-        // Uniform buffer offset alignment is 256, more per object data in the future
+        // element of the per object array, std430 and std140 layouts of PerObjectData in common.tinysl.
+        // View dependent matrices are derived from Globals by shaders.
         struct PerObjectData
         {
             Eigen::Matrix4f modelMat;
-            Eigen::Matrix4f modelViewMat;
-            Eigen::Matrix4f mvpMat;
-            Eigen::Matrix4f padding2;
+            int textureLayer;   // layer of texture set arrays bound by material
+            int padding[3] = {0, 0, 0};
         };
 
-        VertexDataSource::SP vertexSource;
-        Material::SP material;
+        VertexDataSource *vertexSource;
+        Material *material;
         PerObjectData objectData;
 
         const static size_t PerObjectDataSize = sizeof(PerObjectData);
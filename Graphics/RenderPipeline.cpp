@@ -1,4 +1,5 @@
 #include "RenderPipeline.h"
+#include <algorithm>
 #include "RenderManager.h"
 #include "InternalFunctions.h"
 
@@ -7,6 +8,7 @@ namespace Graphics
     RenderPipeline::RenderPipeline()
     {
         mGlobalUniformBuffer = RenderManager::Instance()->AllocBuffer(BufferType_UniformBuffer);
+        mSceneObjectBuffer = RenderManager::Instance()->AllocBuffer(BufferType_UniformBuffer);
     }
 
     RenderPipeline::~RenderPipeline()
@@ -19,61 +21,452 @@ namespace Graphics
         mRenderPasses.push_back(renderPass);
     }
 
-    void RenderPipeline::CollectMesh(StaticMesh::SP mesh, Material::SP material, const Eigen::Matrix4f &modelMat)
+    void RenderPipeline::CollectMesh(const VertexDataSource::SP &mesh, const Material::SP &material, const Eigen::Matrix4f &modelMat,
+                                     int textureLayer)
     {
-        mRenderObjects.push_back(RenderObject(mesh, material, modelMat));
+        // consecutive draws of the same mesh or material take one reference
+        if (mFrameMeshOwners.empty() || mFrameMeshOwners.back() != mesh)
+            mFrameMeshOwners.push_back(mesh);
+        if (mFrameMaterialOwners.empty() || mFrameMaterialOwners.back() != material)
+            mFrameMaterialOwners.push_back(material);
+        CollectMesh(mesh.get(), material.get(), modelMat, textureLayer);
+    }
+
+    void RenderPipeline::CollectMesh(VertexDataSource *mesh, Material *material, const Eigen::Matrix4f &modelMat, int textureLayer)
+    {
+        if (mesh == nullptr || material == nullptr)
+        {
+            GFX_LOG_ERROR("Collected mesh or material is null or destroyed!");
+            return;
+        }
+        mRenderObjects.push_back(RenderObject(mesh, material, modelMat, textureLayer));
+    }
+
+    void RenderPipeline::CollectInstances(const VertexDataSource::SP &mesh, const Material::SP &material, const Eigen::Matrix4f &parent,
+                                          const TransformSoA &transforms, uint32_t count, int textureLayer)
+    {
+        if (count == 0)
+            return;
+        InstanceBatch batch;
+        batch.mesh = mesh;
+        batch.material = material;
+        batch.parent = parent;
+        batch.transforms = transforms;
+        batch.count = count;
+        batch.textureLayer = textureLayer;
+        batch.first = 0;
+        mInstanceBatches.push_back(batch);
+    }
+
+    void RenderPipeline::SetScene(RenderScene::SP scene)
+    {
+        mScene = scene;
+        mSceneDrawOrder.clear();
+        mSceneSortedVAOs.clear();
+        mSceneMeshVAOs.clear();
+        mSceneDrawVersion = UINT64_MAX;
+        mSceneUploadAll = true;
     }
 
     void RenderPipeline::Submit()
+    {
+        uploadGlobals();
+        prepareObjects();
+
+        mDrawObjects.resize(mRenderObjects.size());
+        for (size_t i = 0; i < mDrawObjects.size(); ++i)
+            mDrawObjects[i] = (uint32_t)i;
+        drawObjects(mDrawObjects);
+        drawInstances();
+        prepareScene();
+        drawScene();
+
+        finishFrame();
+    }
+
+    void RenderPipeline::uploadGlobals()
     {
         // calculate frequently used Matrix.
         mGlobalData.vpMat = mGlobalData.projMat * mGlobalData.viewMat;
 
-        mGlobalUniformBuffer->BufferData(&mGlobalData, sizeof(GlobalUniformData), BufferUsage_StaticDraw);
-        auto rm = RenderManager::Instance();
-        auto perObjectUbo = rm->AllocBuffer(BufferType_UniformBuffer);
+        // scene lights follow collected ones, beyond maxLightCount they are dropped
+        if (mScene != nullptr)
+        {
+            for (auto &light : mScene->GetLights())
+            {
+                if (mGlobalData.lightCount >= maxLightCount)
+                    break;
+                mGlobalData.lightData[mGlobalData.lightCount++] = light;
+            }
+        }
 
-        // currently per-object data only contains transform
-        size_t perObjectBufferSize = RenderObject::PerObjectDataSize * mRenderObjects.size();
-        auto perObjectBuffer = malloc(perObjectBufferSize);
+        mGlobalUniformBuffer->BufferData(&mGlobalData, sizeof(GlobalUniformData), BufferUsage_StaticDraw);
+        RenderManager::Instance()->BindBufferBase(mGlobalUniformBuffer, GlobalUBOBindPoint);
+    }
 
-        auto writePtr = perObjectBuffer;
-        // prepare and collect per-object data
-        for (size_t i = 0; i < mRenderObjects.size(); ++i)
+    void RenderPipeline::prepareObjects()
+    {
+        for (auto &ro : mRenderObjects)
         {
-            auto &ro = mRenderObjects[i];
             ro.vertexSource->Prepare();
             ro.material->Prepare();
-            ro.objectData.mvpMat = mGlobalData.vpMat * ro.objectData.modelMat;
-            ro.objectData.modelViewMat = mGlobalData.viewMat * ro.objectData.modelMat;
-            memcpy(writePtr, &ro.objectData, RenderObject::PerObjectDataSize);
-            writePtr = (void *)((char *)writePtr + RenderObject::PerObjectDataSize);
         }
+        for (auto &batch : mInstanceBatches)
+        {
+            batch.mesh->Prepare();
+            batch.material->Prepare();
+        }
+        if (mScene != nullptr)
+        {
+            // once per mesh and material however many objects share them
+            for (auto mesh : mScene->GetMeshes())
+                mesh->Prepare();
+            for (auto material : mScene->GetMaterials())
+                material->Prepare();
+        }
+        // blocks of materials prepared above, in one ranged write per pool
+        MaterialBufferPool::Instance()->Flush();
+    }
+
+    bool RenderPipeline::reserveObjectBuffer(Buffer::SP buffer, size_t &capacity, size_t count)
+    {
+        if (count <= capacity)
+            return false;
+        capacity = std::max(count, capacity * 2);
+        capacity = (capacity + PerObjectChunkSize - 1) / PerObjectChunkSize * PerObjectChunkSize;
+        buffer->BufferData(nullptr, capacity * RenderObject::PerObjectDataSize, BufferUsage_DynamicDraw);
+        return true;
+    }
+
+    void RenderPipeline::bindObjectBuffer(Buffer::SP buffer)
+    {
+        auto rm = RenderManager::Instance();
+        if (rm->GetSystemInfo().shaderStorageBuffer)
+            rm->BindStorageBuffer(buffer, PerObjectSSBOBindPoint);
+    }
+
+    void RenderPipeline::bindObjectChunk(Buffer::SP buffer, uint32_t objectIndex, uint32_t &boundChunk)
+    {
+        auto rm = RenderManager::Instance();
+        uint32_t chunk = objectIndex / PerObjectChunkSize;
+        if (rm->GetSystemInfo().shaderStorageBuffer || chunk == boundChunk)
+            return;
+        // a chunk is 15360 bytes, a multiple of every power of two offset alignment up to 1024
+        const uint32_t chunkBytes = PerObjectChunkSize * RenderObject::PerObjectDataSize;
+        rm->BindBufferRange(buffer, PerObjectUBOBindPoint, chunk * chunkBytes, chunkBytes);
+        boundChunk = chunk;
+    }
+
+    void RenderPipeline::drawObjects(const std::vector<uint32_t> &objects)
+    {
+        if (objects.empty())
+            return;
+
+        // Draw objects sharing material and VAO together, so that they are bound only once.
+        mDrawOrder.resize(objects.size());
+        for (size_t slot = 0; slot < mDrawOrder.size(); ++slot)
+            mDrawOrder[slot] = (uint32_t)slot;
+
+        std::sort(mDrawOrder.begin(), mDrawOrder.end(), [this, &objects](uint32_t a, uint32_t b)
+        {
+            auto &roA = mRenderObjects[objects[a]];
+            auto &roB = mRenderObjects[objects[b]];
+            if (roA.material != roB.material)
+                return roA.material < roB.material;
+            return roA.vertexSource->VertexArrayHandle() < roB.vertexSource->VertexArrayHandle();
+        });
+
+        // per object data in draw order, so the chunks of the uniform buffer fallback are bound in sequence
+        size_t count = objects.size();
+        mFrameObjectData.resize(count);
+        for (size_t i = 0; i < count; ++i)
+            mFrameObjectData[i] = mRenderObjects[objects[mDrawOrder[i]]].objectData;
+
+        auto rm = RenderManager::Instance();
+        if (mFrameObjectBuffer == nullptr)
+            mFrameObjectBuffer = rm->AllocBuffer(BufferType_UniformBuffer);
+        reserveObjectBuffer(mFrameObjectBuffer, mFrameObjectCapacity, count);
+        mFrameObjectBuffer->BufferSubData(mFrameObjectData.data(), 0, count * RenderObject::PerObjectDataSize);
+        bindObjectBuffer(mFrameObjectBuffer);
+        rm->ReserveObjectIndices((uint32_t)count);
 
-        perObjectUbo->BufferData(perObjectBuffer, perObjectBufferSize, BufferUsage_StaticDraw);
-        rm->BindBufferBase(mGlobalUniformBuffer, GlobalUBOBindPoint);
-        
         // draw render objects
-        for (size_t i = 0; i < mRenderObjects.size(); ++i)
+        Material *lastMaterial = nullptr;
+        bool materialUsable = false;
+        uint32_t boundChunk = INVALID_ID;
+        for (uint32_t i = 0; i < (uint32_t)count; ++i)
         {
-            auto &ro = mRenderObjects[i];
+            auto &ro = mRenderObjects[objects[mDrawOrder[i]]];
+            if (ro.material != lastMaterial)
+            {
+                // false while its shader compiles and there is no fallback program
+                materialUsable = ro.material->Use();
+                ro.material->SetStates();
+                lastMaterial = ro.material;
+            }
+            if (!materialUsable)
+                continue;
             ro.vertexSource->Bind();
-            ro.material->Use();
-            ro.material->SetStates();
-            rm->BindBufferRange(perObjectUbo, PerObjectUBOBindPoint, (uint32_t)(i * RenderObject::PerObjectDataSize), RenderObject::PerObjectDataSize);
+            bindObjectChunk(mFrameObjectBuffer, i, boundChunk);
+            rm->DrawObject(ro.vertexSource, i);
+        }
+    }
+
+    void RenderPipeline::drawInstances()
+    {
+        if (mInstanceBatches.empty())
+            return;
+
+        static_assert(RenderObject::PerObjectDataSize == TransformKernels::RecordSize, "kernels write PerObjectData records");
+        size_t total = 0;
+        for (auto &batch : mInstanceBatches)
+        {
+            batch.first = (uint32_t)total;
+            total += batch.count;
+        }
+
+        auto rm = RenderManager::Instance();
+        if (mInstanceObjectBuffer == nullptr)
+            mInstanceObjectBuffer = rm->AllocBuffer(BufferType_UniformBuffer);
+        reserveObjectBuffer(mInstanceObjectBuffer, mInstanceCapacity, total);
+
+        // last frame's contents are discarded, the driver can hand out fresh memory instead of waiting for its draws
+        size_t bytes = total * RenderObject::PerObjectDataSize;
+        auto dst = (uint8_t *)mInstanceObjectBuffer->MapRange(0, bytes, BufferAccessFlag_Write | BufferAccessFlag_InvalidateRange);
+        bool mapped = dst != nullptr;
+        if (!mapped)
+        {
+            mInstanceStaging.resize(bytes);
+            dst = mInstanceStaging.data();
+        }
+        for (auto &batch : mInstanceBatches)
+        {
+            TransformKernels::ComposeParallel(batch.parent, batch.transforms, batch.count, batch.textureLayer,
+                                              dst + batch.first * RenderObject::PerObjectDataSize);
+        }
+        if (mapped)
+            mInstanceObjectBuffer->Unmap();
+        else
+            mInstanceObjectBuffer->BufferSubData(dst, 0, bytes);
+
+        bindObjectBuffer(mInstanceObjectBuffer);
+        rm->ReserveObjectIndices((uint32_t)total);
+
+        // without storage buffers a batch can span chunks of the uniform buffer, its objects are drawn one by one
+        bool wholeBatches = rm->GetSystemInfo().shaderStorageBuffer;
+        uint32_t boundChunk = INVALID_ID;
+        for (auto &batch : mInstanceBatches)
+        {
+            if (!batch.material->Use())
+                continue;
+            batch.material->SetStates();
+            batch.mesh->Bind();
+            if (wholeBatches)
+            {
+                rm->DrawObjectInstances(batch.mesh.get(), batch.first, batch.count);
+                continue;
+            }
+            for (uint32_t i = batch.first; i < batch.first + batch.count; ++i)
+            {
+                bindObjectChunk(mInstanceObjectBuffer, i, boundChunk);
+                rm->DrawObject(batch.mesh.get(), i);
+            }
+        }
+    }
+
+    void RenderPipeline::uploadSceneObjects()
+    {
+        size_t count = mScene->GetObjectCount();
+        if (reserveObjectBuffer(mSceneObjectBuffer, mSceneBufferCapacity, count))
+            mSceneUploadAll = true;
+
+        if (mSceneUploadAll)
+        {
+            if (count > 0)
+                mSceneObjectBuffer->BufferSubData((void *)mScene->GetObjectDataArray(), 0, count * RenderObject::PerObjectDataSize);
+        }
+        else
+        {
+            // adjacent dirty objects go in one write
+            mSceneDirty = mScene->GetDirtyObjects();
+            std::sort(mSceneDirty.begin(), mSceneDirty.end());
+            for (size_t begin = 0; begin < mSceneDirty.size();)
+            {
+                size_t end = begin + 1;
+                while (end < mSceneDirty.size() && mSceneDirty[end] == mSceneDirty[end - 1] + 1)
+                    ++end;
+                auto first = mSceneDirty[begin];
+                mSceneObjectBuffer->BufferSubData((void *)(mScene->GetObjectDataArray() + first), first * RenderObject::PerObjectDataSize,
+                                                  (end - begin) * RenderObject::PerObjectDataSize);
+                begin = end;
+            }
+        }
+        mScene->ClearDirtyObjects();
+        mSceneUploadAll = false;
+    }
+
+    void RenderPipeline::prepareScene()
+    {
+        if (mScene == nullptr)
+            return;
+
+        uploadSceneObjects();
+        uint32_t count = (uint32_t)mScene->GetObjectCount();
+
+        // order of last frame is kept until objects, their meshes or materials change, the mesh list only changes along
+        // with the draw version
+        auto &meshes = mScene->GetMeshes();
+        bool sortNeeded = mScene->GetDrawVersion() != mSceneDrawVersion || mSceneMeshVAOs.size() != meshes.size();
+        for (size_t i = 0; i < meshes.size() && !sortNeeded; ++i)
+            sortNeeded = meshes[i]->VertexArrayHandle() != mSceneMeshVAOs[i];
+
+        if (!sortNeeded)
+            return;
+
+        mSceneMeshVAOs.resize(meshes.size());
+        for (size_t i = 0; i < meshes.size(); ++i)
+            mSceneMeshVAOs[i] = meshes[i]->VertexArrayHandle();
+        mSceneSortedVAOs.resize(count);
+        mSceneDrawOrder.resize(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            mSceneSortedVAOs[i] = mScene->GetMesh(i)->VertexArrayHandle();
+            mSceneDrawOrder[i] = i;
+        }
+        std::sort(mSceneDrawOrder.begin(), mSceneDrawOrder.end(), [this](uint32_t a, uint32_t b)
+        {
+            auto materialA = mScene->GetMaterial(a);
+            auto materialB = mScene->GetMaterial(b);
+            if (materialA != materialB)
+                return materialA < materialB;
+            return mSceneSortedVAOs[a] < mSceneSortedVAOs[b];
+        });
+        mSceneDrawVersion = mScene->GetDrawVersion();
+        ++mSceneSortCount;
+    }
+
+    void RenderPipeline::drawScene(const std::vector<uint32_t> *objects)
+    {
+        if (mScene == nullptr)
+            return;
+        if (objects == nullptr)
+            objects = &mSceneDrawOrder;
+        uint32_t count = (uint32_t)mScene->GetObjectCount();
+        if (count == 0 || objects->empty())
+            return;
+
+        auto rm = RenderManager::Instance();
+        bindObjectBuffer(mSceneObjectBuffer);
+        rm->ReserveObjectIndices(count);
 
-            if (ro.vertexSource->HasIndex())
-                rm->DrawElements(DrawType_Triangles, ro.vertexSource->IndexCount());
-            else
-                rm->DrawArrays(DrawType_Triangles, 0, ro.vertexSource->VertexCount());
+        Material *lastMaterial = nullptr;
+        bool materialUsable = false;
+        uint32_t boundChunk = INVALID_ID;
+        for (auto index : *objects)
+        {
+            auto material = mScene->GetMaterial(index);
+            if (material != lastMaterial)
+            {
+                materialUsable = material->Use();
+                material->SetStates();
+                lastMaterial = material;
+            }
+            if (!materialUsable)
+                continue;
+
+            auto source = mScene->GetMesh(index);
+            source->Bind();
+            bindObjectChunk(mSceneObjectBuffer, index, boundChunk);
+            rm->DrawObject(source, index);
         }
+    }
 
+    void RenderPipeline::finishFrame()
+    {
+        if (mPickingEnabled)
+            keepPickObjects();
         clear();
     }
 
+    void RenderPipeline::EnablePicking(bool enabled)
+    {
+        mPickingEnabled = enabled;
+        if (!enabled)
+        {
+            mPickObjects.clear();
+            mPickScene.Clear();
+            mPickSceneDirty = false;
+        }
+    }
+
+    void RenderPipeline::keepPickObjects()
+    {
+        mPickObjects.clear();
+        // handles only, objects destroyed before picking are skipped then
+        for (auto &ro : mRenderObjects)
+        {
+            auto mesh = dynamic_cast<StaticMesh *>(ro.vertexSource);
+            if (mesh == nullptr || !mesh->IsPickable())
+                continue;
+            mPickObjects.push_back({mesh->GetPoolHandle(), ro.material->GetPoolHandle(), ro.objectData.modelMat, RenderScene::Handle()});
+        }
+        // scene objects are appended when picking, not every frame
+        mPickSceneDirty = true;
+    }
+
+    void RenderPipeline::keepPickSceneObjects()
+    {
+        if (mScene == nullptr)
+            return;
+        for (uint32_t i = 0; i < (uint32_t)mScene->GetObjectCount(); ++i)
+        {
+            auto mesh = dynamic_cast<StaticMesh *>(mScene->GetMesh(i));
+            if (mesh == nullptr || !mesh->IsPickable())
+                continue;
+            mPickObjects.push_back({mesh->GetPoolHandle(), mScene->GetMaterial(i)->GetPoolHandle(), mScene->GetObjectData(i).modelMat,
+                                    mScene->GetObjectHandle(i)});
+        }
+    }
+
+    bool RenderPipeline::Pick(const Ray &ray, PickResult &result)
+    {
+        // top level is rebuilt lazily, only when picking after scene changed
+        if (mPickSceneDirty)
+        {
+            keepPickSceneObjects();
+            auto rm = RenderManager::Instance();
+            std::vector<SceneBVH::Instance> instances(mPickObjects.size());
+            for (size_t i = 0; i < mPickObjects.size(); ++i)
+            {
+                // destroyed meshes have no bvh and are left out
+                auto mesh = rm->GetMesh(mPickObjects[i].mesh);
+                instances[i].bvh = mesh == nullptr ? nullptr : mesh->GetBVH();
+                instances[i].modelMat = mPickObjects[i].modelMat;
+            }
+            mPickScene.Build(instances);
+            mPickSceneDirty = false;
+        }
+
+        RayHit hit;
+        if (!mPickScene.Intersect(ray, hit))
+            return false;
+
+        auto &object = mPickObjects[hit.instance];
+        result.mesh = object.mesh;
+        result.material = object.material;
+        result.objectIndex = hit.instance;
+        result.sceneObject = object.sceneObject;
+        result.hit = hit;
+        result.worldPosition = ray.origin + ray.direction * hit.t;
+        return true;
+    }
+
     void RenderPipeline::clear()
     {
         mRenderObjects.clear();
+        mFrameMeshOwners.clear();
+        mFrameMaterialOwners.clear();
+        mInstanceBatches.clear();
         mGlobalData.lightCount = 0;
     }
 
@@ -14,17 +14,22 @@
 #include "RenderPass.h"
 #include "StaticMesh.h"
 #include "RenderObject.h"
+#include "RenderScene.h"
+#include "BVH.h"
+#include "TransformKernels.h"
 
 namespace Graphics
 {
-    struct Light
-    {
-        Eigen::Vector3f lightPos;
-        int lightType; // 0 directional, 1 point light, 2 spot light
-        Eigen::Vector3f lightColor;
-        float intensity = 1.f;
+    class RenderManager;
 
-        // parameters for different light types
+    struct PickResult
+    {
+        MeshHandle mesh;                   // resolved by RenderManager::GetMesh, nullptr if destroyed since
+        MaterialHandle material;
+        uint32_t objectIndex = INVALID_ID; // order in last frame, collected objects first then scene objects
+        RenderScene::Handle sceneObject;   // valid when the picked object belongs to the scene
+        RayHit hit;                        // triangle and barycentrics in mesh space, t along the query ray
+        Eigen::Vector3f worldPosition;
     };
 
     class RenderPipeline
@@ -41,14 +46,29 @@ namespace Graphics
 
         // passes should be added only once.
         virtual void AddRenderPass(RenderPass::SP pass);
-        // meshes should be collected each frame.
-        virtual void CollectMesh(StaticMesh::SP mesh, Material::SP material, const Eigen::Matrix4f &modelMat);
+        // meshes should be collected each frame. textureLayer selects the layer when material samples texture arrays.
+        // Mesh and material are kept alive until Submit.
+        void CollectMesh(const VertexDataSource::SP &mesh, const Material::SP &material, const Eigen::Matrix4f &modelMat, int textureLayer = 0);
+        // the caller keeps mesh and material alive until Submit, no reference is taken. nullptr ones are dropped.
+        virtual void CollectMesh(VertexDataSource *mesh, Material *material, const Eigen::Matrix4f &modelMat, int textureLayer = 0);
+        // count copies of a mesh, copy i placed at parent * T(i) * R(i) * S(i). The streams are read in Submit and must
+        // be kept until then. Instances are drawn after collected objects and are not kept for picking.
+        virtual void CollectInstances(const VertexDataSource::SP &mesh, const Material::SP &material, const Eigen::Matrix4f &parent,
+                                      const TransformSoA &transforms, uint32_t count, int textureLayer = 0);
         virtual void CollectLight(const Light& lightInfo);
         virtual void Submit();
 
+        // retained objects and lights drawn every frame with the collected ones, nullptr to draw collected ones only
+        void SetScene(RenderScene::SP scene);
+        inline RenderScene::SP GetScene() const { return mScene; }
+
+        // Static meshes submitted in last frame are kept for CPU ray picking, no GPU readback involved.
+        void EnablePicking(bool enabled);
+        bool Pick(const Ray &ray, PickResult &result);
+
         static const int maxLightCount = 16;
 
-    private:
+    protected:
         struct GlobalUniformData
         {
             Eigen::Matrix4f viewMat;
@@ -59,12 +79,93 @@ namespace Graphics
             int lightCount = 0;
         };
 
+        // steps of Submit, derived pipelines draw part of the objects their own way
+        void uploadGlobals();
+        // prepare vertex data and materials of every collected object
+        void prepareObjects();
+        // draw some of collected objects, their per object data is written in draw order and indexed by position
+        void drawObjects(const std::vector<uint32_t> &objects);
+        // per object data of instances is composed by the batch kernels straight into the mapped instance buffer
+        void drawInstances();
+        // upload per object data of dirty scene objects and sort the scene again if objects, their meshes or materials
+        // changed since last frame
+        void prepareScene();
+        // scene objects by dense index in the given order, every object in the order of prepareScene when nullptr.
+        // Per object data is indexed by dense index
+        void drawScene(const std::vector<uint32_t> *objects = nullptr);
+        // keep objects for picking and clear collected ones
+        void finishFrame();
+
         void clear();
+        void keepPickObjects();
+        // scene objects follow collected ones in mPickObjects
+        void keepPickSceneObjects();
+
+        struct InstanceBatch
+        {
+            VertexDataSource::SP mesh;
+            Material::SP material;
+            Eigen::Matrix4f parent;
+            TransformSoA transforms;
+            uint32_t count;
+            int textureLayer;
+            uint32_t first;         // in the instance buffer
+        };
+
+        struct PickObject
+        {
+            MeshHandle mesh;
+            MaterialHandle material;
+            Eigen::Matrix4f modelMat;
+            RenderScene::Handle sceneObject;
+        };
+
+        void uploadSceneObjects();
+        // capacity is kept in whole chunks so every chunk range can be bound, true if the buffer was reallocated
+        static bool reserveObjectBuffer(Buffer::SP buffer, size_t &capacity, size_t count);
+        // storage buffer binding for the draws that follow
+        static void bindObjectBuffer(Buffer::SP buffer);
+        // without storage buffers shaders see one chunk of the array, bound when objectIndex leaves the bound one
+        static void bindObjectChunk(Buffer::SP buffer, uint32_t objectIndex, uint32_t &boundChunk);
 
         std::vector<RenderPass::SP> mRenderPasses;
         std::vector<RenderObject> mRenderObjects;
+        // references taken by CollectMesh with shared pointers, dropped after Submit
+        std::vector<VertexDataSource::SP> mFrameMeshOwners;
+        std::vector<Material::SP> mFrameMaterialOwners;
+        std::vector<uint32_t> mDrawObjects;
+        std::vector<uint32_t> mDrawOrder;
+        std::vector<RenderObject::PerObjectData> mFrameObjectData;
+        Buffer::SP mFrameObjectBuffer;
+        size_t mFrameObjectCapacity = 0;
         Buffer::SP mGlobalUniformBuffer;
 
+        std::vector<InstanceBatch> mInstanceBatches;
+        Buffer::SP mInstanceObjectBuffer;
+        size_t mInstanceCapacity = 0;
+        // written instead of the mapping when mapping fails
+        std::vector<uint8_t> mInstanceStaging;
+
         GlobalUniformData mGlobalData;
+
+        RenderScene::SP mScene;
+        // mirrors per object array of the scene
+        Buffer::SP mSceneObjectBuffer;
+        size_t mSceneBufferCapacity = 0;
+        std::vector<uint32_t> mSceneDrawOrder;
+        std::vector<uint32_t> mSceneDirty;
+        // VAO of each object when sorted, a mesh uploaded later changes it
+        std::vector<uint32_t> mSceneSortedVAOs;
+        // VAO of each mesh of RenderScene::GetMeshes when sorted, checked every frame instead of every object
+        std::vector<uint32_t> mSceneMeshVAOs;
+        uint64_t mSceneDrawVersion = UINT64_MAX;
+        // increases every time mSceneDrawOrder is sorted
+        uint32_t mSceneSortCount = 0;
+        bool mSceneUploadAll = true;
+
+        bool mPickingEnabled = true;
+        bool mPickSceneDirty = false;
+        std::vector<PickObject> mPickObjects;
+        SceneBVH mPickScene;
     };
 }
\ No newline at end of file
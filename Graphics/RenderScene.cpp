@@ -0,0 +1,248 @@
+#include "RenderScene.h"
+
+namespace Graphics
+{
+    RenderScene::Handle RenderScene::allocSlot(std::vector<Slot> &slots, uint32_t &freeSlot, uint32_t index)
+    {
+        Handle handle;
+        if (freeSlot != INVALID_ID)
+        {
+            handle.slot = freeSlot;
+            freeSlot = slots[freeSlot].index;
+        }
+        else
+        {
+            handle.slot = (uint32_t)slots.size();
+            slots.push_back({INVALID_ID, 0});
+        }
+        slots[handle.slot].index = index;
+        handle.generation = slots[handle.slot].generation;
+        return handle;
+    }
+
+    void RenderScene::freeSlot(std::vector<Slot> &slots, uint32_t &freeSlot, uint32_t slot)
+    {
+        // handles to the old generation become stale
+        ++slots[slot].generation;
+        slots[slot].index = freeSlot;
+        freeSlot = slot;
+    }
+
+    uint32_t RenderScene::findIndex(const std::vector<Slot> &slots, Handle handle)
+    {
+        if (handle.slot >= slots.size() || slots[handle.slot].generation != handle.generation)
+            return INVALID_ID;
+        return slots[handle.slot].index;
+    }
+
+    template <typename T>
+    void RenderScene::addUse(std::vector<T *> &list, std::unordered_map<T *, UseCount> &uses, T *item)
+    {
+        auto result = uses.emplace(item, UseCount{(uint32_t)list.size(), 0});
+        if (result.second)
+            list.push_back(item);
+        ++result.first->second.count;
+    }
+
+    template <typename T>
+    void RenderScene::releaseUse(std::vector<T *> &list, std::unordered_map<T *, UseCount> &uses, T *item)
+    {
+        auto use = uses.find(item);
+        if (use == uses.end() || --use->second.count > 0)
+            return;
+        // the last one fills the hole
+        auto index = use->second.index;
+        list[index] = list.back();
+        uses[list[index]].index = index;
+        list.pop_back();
+        uses.erase(use);
+    }
+
+    RenderScene::Handle RenderScene::AddObject(VertexDataSource::SP mesh, Material::SP material, const Eigen::Matrix4f &modelMat,
+                                               int textureLayer)
+    {
+        auto index = (uint32_t)mObjectData.size();
+        auto handle = allocSlot(mObjectSlots, mFreeObjectSlot, index);
+
+        RenderObject::PerObjectData data;
+        data.modelMat = modelMat;
+        data.textureLayer = textureLayer;
+        mObjectData.push_back(data);
+        mDrawItems.push_back({mesh.get(), material.get()});
+        mObjectOwners.push_back({mesh, material, handle.slot});
+        mDirtyFlags.push_back(0);
+        addUse(mMeshes, mMeshUses, mesh.get());
+        addUse(mMaterials, mMaterialUses, material.get());
+
+        markDirty(index);
+        ++mDrawVersion;
+        return handle;
+    }
+
+    bool RenderScene::RemoveObject(Handle handle)
+    {
+        auto index = findObject(handle);
+        if (index == INVALID_ID)
+            return false;
+
+        releaseUse(mMeshes, mMeshUses, mDrawItems[index].mesh);
+        releaseUse(mMaterials, mMaterialUses, mDrawItems[index].material);
+
+        // the last object fills the hole
+        auto last = (uint32_t)mObjectData.size() - 1;
+        if (index != last)
+        {
+            mObjectData[index] = mObjectData[last];
+            mDrawItems[index] = mDrawItems[last];
+            mObjectOwners[index] = std::move(mObjectOwners[last]);
+            mObjectSlots[mObjectOwners[index].slot].index = index;
+            markDirty(index);
+        }
+        mObjectData.pop_back();
+        mDrawItems.pop_back();
+        mObjectOwners.pop_back();
+        freeSlot(mObjectSlots, mFreeObjectSlot, handle.slot);
+
+        // entries past the end are dropped, the pipeline shrinks its copy to the object count
+        if (mDirtyFlags[last])
+        {
+            for (size_t i = 0; i < mDirtyObjects.size(); ++i)
+            {
+                if (mDirtyObjects[i] == last)
+                {
+                    mDirtyObjects[i] = mDirtyObjects.back();
+                    mDirtyObjects.pop_back();
+                    break;
+                }
+            }
+        }
+        mDirtyFlags.pop_back();
+
+        ++mDrawVersion;
+        return true;
+    }
+
+    bool RenderScene::SetTransform(Handle handle, const Eigen::Matrix4f &modelMat)
+    {
+        auto index = findObject(handle);
+        if (index == INVALID_ID)
+            return false;
+        mObjectData[index].modelMat = modelMat;
+        markDirty(index);
+        return true;
+    }
+
+    bool RenderScene::SetTextureLayer(Handle handle, int textureLayer)
+    {
+        auto index = findObject(handle);
+        if (index == INVALID_ID)
+            return false;
+        mObjectData[index].textureLayer = textureLayer;
+        markDirty(index);
+        return true;
+    }
+
+    bool RenderScene::SetMesh(Handle handle, VertexDataSource::SP mesh)
+    {
+        auto index = findObject(handle);
+        if (index == INVALID_ID)
+            return false;
+        addUse(mMeshes, mMeshUses, mesh.get());
+        releaseUse(mMeshes, mMeshUses, mDrawItems[index].mesh);
+        mDrawItems[index].mesh = mesh.get();
+        mObjectOwners[index].mesh = mesh;
+        ++mDrawVersion;
+        return true;
+    }
+
+    bool RenderScene::SetMaterial(Handle handle, Material::SP material)
+    {
+        auto index = findObject(handle);
+        if (index == INVALID_ID)
+            return false;
+        addUse(mMaterials, mMaterialUses, material.get());
+        releaseUse(mMaterials, mMaterialUses, mDrawItems[index].material);
+        mDrawItems[index].material = material.get();
+        mObjectOwners[index].material = material;
+        ++mDrawVersion;
+        return true;
+    }
+
+    RenderScene::Handle RenderScene::GetObjectHandle(uint32_t index) const
+    {
+        Handle handle;
+        handle.slot = mObjectOwners[index].slot;
+        handle.generation = mObjectSlots[handle.slot].generation;
+        return handle;
+    }
+
+    RenderScene::Handle RenderScene::AddLight(const Light &light)
+    {
+        auto handle = allocSlot(mLightSlots, mFreeLightSlot, (uint32_t)mLights.size());
+        mLights.push_back(light);
+        mLightSlotOfIndex.push_back(handle.slot);
+        return handle;
+    }
+
+    bool RenderScene::RemoveLight(Handle handle)
+    {
+        auto index = findIndex(mLightSlots, handle);
+        if (index == INVALID_ID)
+            return false;
+
+        auto last = (uint32_t)mLights.size() - 1;
+        mLights[index] = mLights[last];
+        mLightSlotOfIndex[index] = mLightSlotOfIndex[last];
+        mLightSlots[mLightSlotOfIndex[index]].index = index;
+        mLights.pop_back();
+        mLightSlotOfIndex.pop_back();
+        freeSlot(mLightSlots, mFreeLightSlot, handle.slot);
+        return true;
+    }
+
+    bool RenderScene::SetLight(Handle handle, const Light &light)
+    {
+        auto index = findIndex(mLightSlots, handle);
+        if (index == INVALID_ID)
+            return false;
+        mLights[index] = light;
+        return true;
+    }
+
+    void RenderScene::Clear()
+    {
+        // slots are kept so that old handles stay stale
+        for (auto &owner : mObjectOwners)
+            freeSlot(mObjectSlots, mFreeObjectSlot, owner.slot);
+        for (auto slot : mLightSlotOfIndex)
+            freeSlot(mLightSlots, mFreeLightSlot, slot);
+
+        mObjectData.clear();
+        mDrawItems.clear();
+        mObjectOwners.clear();
+        mMeshes.clear();
+        mMeshUses.clear();
+        mMaterials.clear();
+        mMaterialUses.clear();
+        mDirtyObjects.clear();
+        mDirtyFlags.clear();
+        mLights.clear();
+        mLightSlotOfIndex.clear();
+        ++mDrawVersion;
+    }
+
+    void RenderScene::markDirty(uint32_t index)
+    {
+        if (mDirtyFlags[index])
+            return;
+        mDirtyFlags[index] = 1;
+        mDirtyObjects.push_back(index);
+    }
+
+    void RenderScene::ClearDirtyObjects()
+    {
+        for (auto index : mDirtyObjects)
+            mDirtyFlags[index] = 0;
+        mDirtyObjects.clear();
+    }
+}
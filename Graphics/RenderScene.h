@@ -0,0 +1,155 @@
+/**
+ * @file RenderScene.h
+ * @author wangyudong
+ * @brief Retained objects and lights drawn by a pipeline every frame until removed, addressed by generational handles.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "Constants.h"
+#include "RenderObject.h"
+
+namespace Graphics
+{
+    struct Light
+    {
+        Eigen::Vector3f lightPos;
+        int lightType; // 0 directional, 1 point light, 2 spot light
+        Eigen::Vector3f lightColor;
+        float intensity = 1.f;
+
+        // parameters for different light types
+    };
+
+    /**
+     * @brief Objects are stored densely and removed by moving the last one into the hole, so a handle goes through a
+     * slot table to find its object. A slot's generation increases on removal, stale handles are rejected.
+     *
+     * Data read every frame (per object data, mesh and material pointers) is kept apart from what only add and remove
+     * need (owning pointers, back references to slots). Changes are recorded instead of applied to GPU data: objects
+     * whose per object data changed are listed in the dirty set, and the draw version increases when an object is added
+     * or removed or changes mesh or material. A pipeline uploads only dirty objects and sorts again only when the draw
+     * version it sorted for is outdated. Meshes and materials used by objects are also listed once each, so work per
+     * mesh or material (preparing, checking for reallocated vertex arrays) does not grow with the object count.
+     *
+     * Set to a pipeline with RenderPipeline::SetScene, objects collected each frame are drawn along with it.
+     */
+    class RenderScene
+    {
+    public:
+        typedef std::shared_ptr<RenderScene> SP;
+
+        struct Handle
+        {
+            uint32_t slot = INVALID_ID;
+            uint32_t generation = 0;
+
+            inline bool IsValid() const { return slot != INVALID_ID; }
+            inline bool operator==(const Handle &other) const { return slot == other.slot && generation == other.generation; }
+        };
+
+        // mesh and material are kept alive by the scene until the object is removed
+        Handle AddObject(VertexDataSource::SP mesh, Material::SP material, const Eigen::Matrix4f &modelMat, int textureLayer = 0);
+        // false if handle is stale
+        bool RemoveObject(Handle handle);
+        bool SetTransform(Handle handle, const Eigen::Matrix4f &modelMat);
+        bool SetTextureLayer(Handle handle, int textureLayer);
+        bool SetMesh(Handle handle, VertexDataSource::SP mesh);
+        bool SetMaterial(Handle handle, Material::SP material);
+        inline bool IsValid(Handle handle) const { return findObject(handle) != INVALID_ID; }
+
+        Handle AddLight(const Light &light);
+        bool RemoveLight(Handle handle);
+        bool SetLight(Handle handle, const Light &light);
+
+        void Clear();
+
+        // dense arrays for pipelines, an index is only valid until the next removal
+        inline size_t GetObjectCount() const { return mObjectData.size(); }
+        inline const RenderObject::PerObjectData &GetObjectData(uint32_t index) const { return mObjectData[index]; }
+        // GetObjectCount() elements, uploaded as is
+        inline const RenderObject::PerObjectData *GetObjectDataArray() const { return mObjectData.data(); }
+        inline VertexDataSource *GetMesh(uint32_t index) const { return mDrawItems[index].mesh; }
+        inline Material *GetMaterial(uint32_t index) const { return mDrawItems[index].material; }
+        inline const VertexDataSource::SP &GetMeshSP(uint32_t index) const { return mObjectOwners[index].mesh; }
+        inline const Material::SP &GetMaterialSP(uint32_t index) const { return mObjectOwners[index].material; }
+        Handle GetObjectHandle(uint32_t index) const;
+        // meshes and materials of objects, each listed once, in no particular order. They change with the draw version
+        inline const std::vector<VertexDataSource *> &GetMeshes() const { return mMeshes; }
+        inline const std::vector<Material *> &GetMaterials() const { return mMaterials; }
+        inline const std::vector<Light> &GetLights() const { return mLights; }
+
+        // dense indices of objects whose per object data changed since ClearDirtyObjects, each listed once
+        inline const std::vector<uint32_t> &GetDirtyObjects() const { return mDirtyObjects; }
+        void ClearDirtyObjects();
+        // changes whenever sorted draw order of objects may change
+        inline uint64_t GetDrawVersion() const { return mDrawVersion; }
+
+    private:
+        struct Slot
+        {
+            uint32_t index;         // dense index when live, next free slot otherwise
+            uint32_t generation;
+        };
+
+        // hot, read every frame
+        struct DrawItem
+        {
+            VertexDataSource *mesh;
+            Material *material;
+        };
+
+        // cold, used on add and remove
+        struct ObjectOwner
+        {
+            VertexDataSource::SP mesh;
+            Material::SP material;
+            uint32_t slot;
+        };
+
+        // position in the unique list and number of objects using it
+        struct UseCount
+        {
+            uint32_t index;
+            uint32_t count;
+        };
+
+        template <typename T>
+        static void addUse(std::vector<T *> &list, std::unordered_map<T *, UseCount> &uses, T *item);
+        template <typename T>
+        static void releaseUse(std::vector<T *> &list, std::unordered_map<T *, UseCount> &uses, T *item);
+
+        // slot table shared by objects and lights
+        static Handle allocSlot(std::vector<Slot> &slots, uint32_t &freeSlot, uint32_t index);
+        static void freeSlot(std::vector<Slot> &slots, uint32_t &freeSlot, uint32_t slot);
+        static uint32_t findIndex(const std::vector<Slot> &slots, Handle handle);
+        inline uint32_t findObject(Handle handle) const { return findIndex(mObjectSlots, handle); }
+
+        void markDirty(uint32_t index);
+
+        std::vector<RenderObject::PerObjectData> mObjectData;
+        std::vector<DrawItem> mDrawItems;
+        std::vector<ObjectOwner> mObjectOwners;
+        std::vector<Slot> mObjectSlots;
+        uint32_t mFreeObjectSlot = INVALID_ID;
+
+        std::vector<VertexDataSource *> mMeshes;
+        std::unordered_map<VertexDataSource *, UseCount> mMeshUses;
+        std::vector<Material *> mMaterials;
+        std::unordered_map<Material *, UseCount> mMaterialUses;
+
+        std::vector<uint32_t> mDirtyObjects;
+        std::vector<uint8_t> mDirtyFlags;
+        uint64_t mDrawVersion = 0;
+
+        std::vector<Light> mLights;
+        std::vector<uint32_t> mLightSlotOfIndex;
+        std::vector<Slot> mLightSlots;
+        uint32_t mFreeLightSlot = INVALID_ID;
+    };
+}
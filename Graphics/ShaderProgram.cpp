@@ -6,6 +6,7 @@
 #include "Constants.h"
 #include "InternalFunctions.h"
 #include "RenderManager.h"
+#include "ProgramCache.h"
 
 namespace Graphics
 {
@@ -23,73 +24,155 @@ namespace Graphics
         mStageFlag |= ShaderFlag_Fragment;
     }
 
-    bool ShaderProgram::BuildProgram()
+    void ShaderProgram::SetComputeShaderSource(const char *src)
     {
-        if (mHaveBuilt)
-            return true;
+        mStageHandles.computeHandle = glCreateShader(GL_COMPUTE_SHADER);
+        glShaderSource(mStageHandles.computeHandle, 1, &src, nullptr);
+        mStageFlag |= ShaderFlag_Compute;
+        mCompute = true;
+    }
 
+    void ShaderProgram::submitStages()
+    {
+        // no status queries here, they would wait for the driver
         for (int i = 0, flag = 1; flag < ShaderFlag_Max; i++, flag <<= 1)
         {
             if (mStageFlag & flag)
             {
                 glCompileShader(mStageHandles.handles[i]);
-                GLint success;
-                glGetShaderiv(mStageHandles.handles[i], GL_COMPILE_STATUS, &success);
-                if (!success)
-                {
-                    char infoLog[512];
-                    glGetShaderInfoLog(mStageHandles.handles[i], 512, NULL, infoLog);
-                    GFX_LOG_ERROR(infoLog);
-                    return false;
-                }
                 glAttachShader(mProgramHandle, mStageHandles.handles[i]);
             }
         }
+
+        if (mCacheKey != 0)
+            glProgramParameteri(mProgramHandle, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         glLinkProgram(mProgramHandle);
+    }
 
+    bool ShaderProgram::checkLinkStatus()
+    {
         GLint success;
         glGetProgramiv(mProgramHandle, GL_LINK_STATUS, &success);
-        if (!success)
+        if (success)
+            return true;
+
+        // a failed compile fails the link, report the stage errors first
+        for (int i = 0, flag = 1; flag < ShaderFlag_Max; i++, flag <<= 1)
         {
-            char infoLog[512];
-            glGetProgramInfoLog(mProgramHandle, 512, NULL, infoLog);
-            GFX_LOG_ERROR(infoLog);
-            return false;
+            if ((mStageFlag & flag) == 0)
+                continue;
+            glGetShaderiv(mStageHandles.handles[i], GL_COMPILE_STATUS, &success);
+            if (!success)
+            {
+                char infoLog[512];
+                glGetShaderInfoLog(mStageHandles.handles[i], 512, NULL, infoLog);
+                GFX_LOG_ERROR(infoLog);
+            }
         }
 
+        char infoLog[512];
+        glGetProgramInfoLog(mProgramHandle, 512, NULL, infoLog);
+        GFX_LOG_ERROR(infoLog);
+        return false;
+    }
+
+    void ShaderProgram::deleteStageShaders()
+    {
         for (int i = 0, flag = 1; flag < ShaderFlag_Max; i++, flag <<= 1)
         {
             if (mStageFlag & flag)
             {
-                glDetachShader(mProgramHandle, mStageHandles.handles[i]);
+                if (!mLoadedFromCache)
+                    glDetachShader(mProgramHandle, mStageHandles.handles[i]);
                 glDeleteShader(mStageHandles.handles[i]);
+                mStageHandles.handles[i] = INVALID_ID;
             }
         }
+        mStageFlag = ShaderFlag_None;
+    }
 
-        mGlobalUniformBlockIdx = glGetUniformBlockIndex(mProgramHandle, GlobalUBOName);
-        if (mGlobalUniformBlockIdx == GL_INVALID_INDEX)
+    void ShaderProgram::BuildAsync()
+    {
+        if (mBuildState != BuildState_None)
+            return;
+
+        // stage shaders are not compiled at all when the linked binary is cached
+        mLoadedFromCache = mCacheKey != 0 && ProgramCache::Instance()->Load(mProgramHandle, mCacheKey);
+        if (!mLoadedFromCache)
+            submitStages();
+        mBuildState = BuildState_Compiling;
+    }
+
+    bool ShaderProgram::IsReady()
+    {
+        if (mBuildState == BuildState_None)
+            BuildAsync();
+
+        if (mBuildState == BuildState_Compiling)
         {
-            GFX_LOG_ERROR("Can't find gloabl uniform block!");
+            // without parallel compile the driver is waited for here, as BuildProgram does
+            if (RenderManager::Instance()->GetSystemInfo().parallelShaderCompile)
+            {
+                GLint done = GL_FALSE;
+                glGetProgramiv(mProgramHandle, GL_COMPLETION_STATUS_KHR, &done);
+                if (!done)
+                    return false;
+            }
+            finishBuild();
         }
+        return mBuildState == BuildState_Ready;
+    }
 
-        mPerMaterialUniformBlockIdx = glGetUniformBlockIndex(mProgramHandle, PerMaterialUBOName);
-        if (mPerMaterialUniformBlockIdx == GL_INVALID_INDEX)
+    bool ShaderProgram::BuildProgram()
+    {
+        BuildAsync();
+        if (mBuildState == BuildState_Compiling)
+            finishBuild();
+        return mBuildState == BuildState_Ready;
+    }
+
+    void ShaderProgram::finishBuild()
+    {
+        if (!mLoadedFromCache && !checkLinkStatus())
         {
-            GFX_LOG_ERROR("Can't find per material uniform block!");
+            deleteStageShaders();
+            mBuildState = BuildState_Failed;
+            return;
         }
+        if (!mLoadedFromCache && mCacheKey != 0)
+            ProgramCache::Instance()->Save(mProgramHandle, mCacheKey);
+        deleteStageShaders();
+
+        // Set uniform block index binding, UBOs will be bound to the same point when drawing.
+        // Compute programs use whichever blocks they need, storage blocks take layout(binding = N) in GLSL.
+        mUsesPerObjectBuffer = RenderManager::Instance()->GetSystemInfo().shaderStorageBuffer &&
+                               glGetProgramResourceIndex(mProgramHandle, GL_SHADER_STORAGE_BLOCK, PerObjectSSBOName) != GL_INVALID_INDEX;
+        auto bindBlock = [this](const char *name, uint32_t bindPoint, bool required) -> uint32_t
+        {
+            uint32_t index = glGetUniformBlockIndex(mProgramHandle, name);
+            if (index != GL_INVALID_INDEX)
+            {
+                glUniformBlockBinding(mProgramHandle, index, bindPoint);
+            }
+            else if (required)
+            {
+                GFX_LOG_ERROR_FMT("Can't find %s uniform block!", name);
+            }
+            return index;
+        };
+        mGlobalUniformBlockIdx = bindBlock(GlobalUBOName, GlobalUBOBindPoint, !mCompute);
+        mPerMaterialUniformBlockIdx = bindBlock(PerMaterialUBOName, PerMaterialUBOBindPoint, !mCompute);
+        mPerObjectUniformBlockIdx = bindBlock(PerObjectUBOName, PerObjectUBOBindPoint, !mCompute && !mUsesPerObjectBuffer);
 
-        mPerObjectUniformBlockIdx = glGetUniformBlockIndex(mProgramHandle, PerObjectUBOName);
-        if (mPerObjectUniformBlockIdx == GL_INVALID_INDEX)
+        if (mCompute)
         {
-            GFX_LOG_ERROR("Can't find per object uniform block!");
+            GLint size[3];
+            glGetProgramiv(mProgramHandle, GL_COMPUTE_WORK_GROUP_SIZE, size);
+            for (int i = 0; i < 3; ++i)
+                mWorkGroupSize[i] = (uint32_t)size[i];
         }
 
-        // Set uniform block index binding, UBOs will be bound to the same point when drawing.
-        glUniformBlockBinding(mProgramHandle, mGlobalUniformBlockIdx, GlobalUBOBindPoint);
-        glUniformBlockBinding(mProgramHandle, mPerMaterialUniformBlockIdx, PerMaterialUBOBindPoint);
-        glUniformBlockBinding(mProgramHandle, mPerObjectUniformBlockIdx, PerObjectUBOBindPoint);
-        
-        mHaveBuilt = true;
+        mBuildState = BuildState_Ready;
 
         auto property = GetPropertyLayout();
         // property->PrintLayoutInfos();
@@ -116,7 +199,50 @@ namespace Graphics
             glUniform1i(mSamplerInfos[i].location, i);
         }
         glUseProgram(0);
+    }
+
+    bool ShaderProgram::Rebuild(ShaderProgram::SP source)
+    {
+        // nothing was built from the old code yet, take the sources over
+        if (mBuildState == BuildState_None)
+        {
+            for (int i = 0, flag = 1; flag < ShaderFlag_Max; i++, flag <<= 1)
+            {
+                if (mStageFlag & flag)
+                    glDeleteShader(mStageHandles.handles[i]);
+            }
+            mStageHandles = source->mStageHandles;
+            mStageFlag = source->mStageFlag;
+            mCompute = source->mCompute;
+            mCacheKey = source->mCacheKey;
+            mStates = source->mStates;
+            source->mStageFlag = ShaderFlag_None;
+            return true;
+        }
+
+        // a build in flight is finished first, so its stage shaders are released
+        if (mBuildState == BuildState_Compiling)
+            finishBuild();
+
+        // built aside, so a typo never leaves the program without code
+        if (!source->BuildProgram())
+            return false;
 
+        // source takes the old handle and deletes it when released
+        std::swap(mProgramHandle, source->mProgramHandle);
+        mGlobalUniformBlockIdx = source->mGlobalUniformBlockIdx;
+        mPerMaterialUniformBlockIdx = source->mPerMaterialUniformBlockIdx;
+        mPerObjectUniformBlockIdx = source->mPerObjectUniformBlockIdx;
+        std::copy(source->mWorkGroupSize, source->mWorkGroupSize + 3, mWorkGroupSize);
+        mSamplerInfos = source->mSamplerInfos;
+        mPropertyLayout = nullptr;
+        mLoadedFromCache = source->mLoadedFromCache;
+        mCompute = source->mCompute;
+        mUsesPerObjectBuffer = source->mUsesPerObjectBuffer;
+        mCacheKey = source->mCacheKey;
+        mStates = source->mStates;
+        mBuildState = BuildState_Ready;
+        ++mGeneration;
         return true;
     }
 
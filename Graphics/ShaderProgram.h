@@ -2,7 +2,7 @@
  * @file ShaderProgram.h
  * @author wangyudong
  * @brief ShaderProgram is assembled by a variety of shader stages,
- * including vertex, geometry, tesselation, fragment shaders ( compute and ray tracing shaders later ).
+ * including vertex, geometry, tesselation, fragment shaders, or a single compute shader ( ray tracing shaders later ).
  * @version 0.1
  * @date 2022-06-07
  */
@@ -13,10 +13,13 @@
 #include <vector>
 #include <string>
 #include "Constants.h"
+#include "HandlePool.h"
 
 namespace Graphics
 {
     class ShaderProgram;
+    typedef PoolHandle<ShaderProgram> ProgramHandle;
+
     struct ShaderProgramPropertyLayout
     {
         typedef std::shared_ptr<ShaderProgramPropertyLayout> SP;
@@ -105,28 +108,69 @@ namespace Graphics
 
         inline uint32_t GetProgramHandle() const { return mProgramHandle; }
         inline void Reset() { mProgramHandle = 0; }
+        // slot in the program pool of RenderManager, valid from AllocShaderProgram until destruction
+        inline ProgramHandle GetPoolHandle() const { return mPoolHandle; }
+        inline void SetPoolHandle(ProgramHandle handle) { mPoolHandle = handle; }
         
         void SetVertexShaderSource(const char* src);
         void SetFragmentShaderSource(const char *src);
+        // a compute program has no other stage, it is run by RenderManager::Dispatch
+        void SetComputeShaderSource(const char *src);
+        inline bool IsCompute() const { return mCompute; }
+        // local_size of the compute shader, known once built
+        inline const uint32_t *GetWorkGroupSize() const { return mWorkGroupSize; }
+        // reads per object data from the PerObjects storage buffer instead of the PerObject block, known once built
+        inline bool UsesPerObjectBuffer() const { return mUsesPerObjectBuffer; }
+        // key from ProgramCache::MakeKey, build loads the cached binary if there is one and saves it otherwise
+        void SetCacheKey(uint64_t key) { mCacheKey = key; }
 
         ShaderProgramPropertyLayout::SP GetPropertyLayout();
 
+        // blocks until compile and link are done, false if they failed
         bool BuildProgram();
+        // submit compile and link and return, the driver works on it in background threads
+        // when GL_KHR_parallel_shader_compile is supported
+        void BuildAsync();
+        // never waits for the driver when parallel compile is supported, the build is finished once it is done
+        bool IsReady();
+        inline bool IsFailed() const { return mBuildState == BuildState_Failed; }
         void UseProgram();
+
+        // take over the code, states and cache key of a program not built yet, blocks until it is linked.
+        // On failure the old code is kept and false is returned, on success the handle changes and generation increases,
+        // so users read the layout again.
+        bool Rebuild(ShaderProgram::SP source);
+        inline uint32_t GetGeneration() const { return mGeneration; }
         
         void SetStates(const RenderStates &states) { mStates = states;}
         const RenderStates &GetStates() { return mStates; }
 
         const std::vector<ShaderProgramPropertyLayout::UniformInfo> &GetSamplerInfos() { return mSamplerInfos; }
     private:
+        enum BuildState
+        {
+            BuildState_None,
+            BuildState_Compiling,
+            BuildState_Ready,
+            BuildState_Failed,
+        };
+
+        void submitStages();
+        bool checkLinkStatus();
+        void deleteStageShaders();
+        // query block indices and sampler uniforms once linked
+        void finishBuild();
 
         uint32_t mProgramHandle = -1;
+        ProgramHandle mPoolHandle;
+        uint64_t mCacheKey = 0;
+        uint32_t mGeneration = 0;
 
         struct ShaderStageHandles
         {
             union
             {
-                uint32_t handles[5];
+                uint32_t handles[6];
                 struct
                 {
                     uint32_t vertexHandle;
@@ -134,17 +178,22 @@ namespace Graphics
                     uint32_t tessControlHandle;
                     uint32_t tessEvalHandle;
                     uint32_t fragmentHandle;
+                    uint32_t computeHandle;
                 };
             };
         };
 
-        ShaderStageHandles mStageHandles = {INVALID_ID, INVALID_ID, INVALID_ID, INVALID_ID, INVALID_ID};
+        ShaderStageHandles mStageHandles = {INVALID_ID, INVALID_ID, INVALID_ID, INVALID_ID, INVALID_ID, INVALID_ID};
         uint32_t mStageFlag = ShaderFlag_None;
-        bool mHaveBuilt = false;
+        BuildState mBuildState = BuildState_None;
+        bool mLoadedFromCache = false;
+        bool mCompute = false;
+        bool mUsesPerObjectBuffer = false;
 
         uint32_t mGlobalUniformBlockIdx = INVALID_ID;
         uint32_t mPerMaterialUniformBlockIdx = INVALID_ID;
         uint32_t mPerObjectUniformBlockIdx = INVALID_ID;
+        uint32_t mWorkGroupSize[3] = {0, 0, 0};
         ShaderProgramPropertyLayout::SP mPropertyLayout = nullptr;
         std::vector<ShaderProgramPropertyLayout::UniformInfo> mSamplerInfos;
         RenderStates mStates;
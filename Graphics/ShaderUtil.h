@@ -26,6 +26,27 @@
 
     There is a special section "Share", code in share section is inserted to every other section of current file.
 
+    A file with a "Compute" section is a compute program: Compute (with Share in front) is its only stage, Vertex and
+    Fragment are ignored. It gets the compute version string (GL 4.3) and is run by RenderManager::Dispatch, storage
+    buffers and images are bound with layout(binding = N) in GLSL.
+
+    Compute
+    {
+        layout(local_size_x = 64) in;
+        layout(std430, binding = 0) buffer Data { float values[]; };
+        void main() { values[gl_GlobalInvocationID.x] *= 2.0; }
+    }
+
+    Section "Keywords" lists names separated by white space, at most 32. Every combination of them is a variant,
+    compiled with "#define NAME" after the version line for each enabled keyword, so shader code switches features
+    with #ifdef and the driver folds disabled paths away. Keywords of included files are merged.
+
+    Keywords
+    {
+        NORMAL_MAP
+        LIGHT_COUNT_4
+    }
+
     Another special section is "States", it describte the pipeline states when using current shader, like
     Depth test on/off, Blend function and so on. States section in included file is ignored.
 
@@ -57,6 +78,8 @@
 
 #include "string"
 #include "ShaderProgram.h"
+#include "ShaderVariants.h"
+#include "TinySLParser.h"
 
 namespace Graphics
 {
@@ -64,9 +87,21 @@ namespace Graphics
     {
     public:
         static ShaderProgram::SP LoadProgramFromRaw(const std::string &vertFile, const std::string &fragFile);
+        // variant with no keyword enabled
         static ShaderProgram::SP LoadProgramFromTinySL(const std::string &vertFile);
+        // variants are compiled on request, see ShaderVariants. A .tslb bundle built by tinyslc is loaded
+        // without parsing, so is a bundle of the same name in bundle directory unless its sources are newer.
+        static ShaderVariants::SP LoadVariantsFromTinySL(const std::string &tinyslFile);
 
-        // defaut is #version 460 core
+        // defaut is #version 410 core
         static void SetTinySLVersionString(const std::string &version);
+        // used for programs with a Compute section, default is #version 430 core
+        static void SetTinySLComputeVersionString(const std::string &version);
+        // stage sources of a parsed file or bundle get the version line of their kind
+        static void PrependVersionString(TinySLProgram &program);
+        // linked TinySL programs are cached here as binaries, empty string disables the cache
+        static void SetProgramCacheDirectory(const std::string &dir);
+        // where tinyslc bundles are looked up first, empty (default) always parses sources
+        static void SetShaderBundleDirectory(const std::string &dir);
     };
 }
\ No newline at end of file
@@ -0,0 +1,118 @@
+#include "ShaderVariants.h"
+#include "RenderManager.h"
+#include "ProgramCache.h"
+#include "HotReload.h"
+
+namespace Graphics
+{
+    ShaderVariants::ShaderVariants(const std::string &name, const TinySLProgram &program) : mName(name), mProgram(program)
+    {
+        auto &keywords = mProgram.keywords;
+        if (keywords.size() > MaxKeywords)
+        {
+            GFX_LOG_ERROR_FMT("%s declares %d keywords, only first %d are used", mName.c_str(), (int)keywords.size(), MaxKeywords);
+            keywords.resize(MaxKeywords);
+        }
+    }
+
+    void ShaderVariants::SetSources(const TinySLProgram &program)
+    {
+        auto keywords = std::move(mProgram.keywords);
+        mProgram = program;
+        if (mProgram.keywords.size() > MaxKeywords)
+            mProgram.keywords.resize(MaxKeywords);
+        if (mProgram.keywords != keywords)
+        {
+            GFX_LOG_ERROR_FMT("Keywords of %s changed, they take effect after restart", mName.c_str());
+        }
+        mProgram.keywords = std::move(keywords);
+    }
+
+    uint32_t ShaderVariants::GetKeywordBit(const std::string &keyword) const
+    {
+        auto &keywords = mProgram.keywords;
+        for (size_t i = 0; i < keywords.size(); ++i)
+        {
+            if (keywords[i] == keyword)
+                return 1u << i;
+        }
+        return 0;
+    }
+
+    uint32_t ShaderVariants::GetKeywordMask(const std::vector<std::string> &keywords) const
+    {
+        uint32_t mask = 0;
+        for (auto &keyword : keywords)
+        {
+            auto bit = GetKeywordBit(keyword);
+            if (bit == 0)
+            {
+                GFX_LOG_ERROR_FMT("Undefined keyword %s in %s", keyword.c_str(), mName.c_str());
+            }
+            mask |= bit;
+        }
+        return mask;
+    }
+
+    std::string ShaderVariants::InjectDefines(const std::string &source, const std::string &defines)
+    {
+        if (source.empty())
+            return source;
+
+        // #version must stay the first line
+        auto lineEnd = source.find('\n');
+        if (lineEnd == std::string::npos)
+            return source + "\n" + defines;
+
+        std::string result;
+        result.reserve(source.size() + defines.size());
+        result.append(source, 0, lineEnd + 1);
+        result.append(defines);
+        result.append(source, lineEnd + 1, std::string::npos);
+        return result;
+    }
+
+    ShaderProgram::SP ShaderVariants::CreateProgram(const TinySLProgram &program, const std::string &defines)
+    {
+        auto shader = RenderManager::Instance()->AllocShaderProgram();
+        if (!program.computeSource.empty())
+        {
+            auto computeSource = InjectDefines(program.computeSource, defines);
+            shader->SetComputeShaderSource(computeSource.c_str());
+            shader->SetCacheKey(ProgramCache::Instance()->MakeKey({computeSource}));
+            return shader;
+        }
+
+        auto vertexSource = InjectDefines(program.vertexSource, defines);
+        auto fragmentSource = InjectDefines(program.fragmentSource, defines);
+        shader->SetVertexShaderSource(vertexSource.c_str());
+        shader->SetFragmentShaderSource(fragmentSource.c_str());
+        shader->SetStates(program.states);
+        shader->SetCacheKey(ProgramCache::Instance()->MakeKey({vertexSource, fragmentSource}));
+        return shader;
+    }
+
+    ShaderProgram::SP ShaderVariants::GetVariant(uint32_t keywordMask)
+    {
+        // bits of undeclared keywords would only make duplicated variants
+        auto &keywords = mProgram.keywords;
+        if (keywords.size() < MaxKeywords)
+            keywordMask &= (1u << keywords.size()) - 1;
+
+        auto iter = mVariants.find(keywordMask);
+        if (iter != mVariants.end())
+            return iter->second;
+
+        std::string defines;
+        for (size_t i = 0; i < keywords.size(); ++i)
+        {
+            if (keywordMask & (1u << i))
+                defines += "#define " + keywords[i] + "\n";
+        }
+
+        auto program = CreateProgram(mProgram, defines);
+        mVariants[keywordMask] = program;
+        HotReload::Instance()->AddProgram(program, mProgram.sourceFiles, defines);
+        return program;
+    }
+}
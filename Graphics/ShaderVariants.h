@@ -0,0 +1,63 @@
+/**
+ * @file ShaderVariants.h
+ * @author wangyudong
+ * @brief Keyword permutations of one TinySL program, each variant is compiled with the enabled keywords defined.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "ShaderProgram.h"
+#include "TinySLParser.h"
+
+namespace Graphics
+{
+    /**
+     * @brief Keywords come from the Keywords section of TinySL, keyword i is bit i of a variant mask.
+     * A variant is created on first request and injects "#define KEYWORD" after the version line of every stage,
+     * its program is built lazily like any other (or by RenderManager::BuildShaderProgramsAsync).
+     * Variants of a compute TinySL file are compute programs.
+     */
+    class ShaderVariants
+    {
+    public:
+        typedef std::shared_ptr<ShaderVariants> SP;
+
+        static const int MaxKeywords = 32;
+
+        // stage sources of program start with the version line, variants are registered to HotReload with its source files
+        ShaderVariants(const std::string &name, const TinySLProgram &program);
+
+        inline const std::vector<std::string> &GetKeywords() const { return mProgram.keywords; }
+        // 0 if keyword is not declared
+        uint32_t GetKeywordBit(const std::string &keyword) const;
+        // unknown keywords are reported and ignored
+        uint32_t GetKeywordMask(const std::vector<std::string> &keywords) const;
+
+        ShaderProgram::SP GetVariant(uint32_t keywordMask);
+        inline ShaderProgram::SP GetVariant(const std::vector<std::string> &keywords) { return GetVariant(GetKeywordMask(keywords)); }
+        inline size_t GetVariantCount() const { return mVariants.size(); }
+        inline const std::vector<std::string> &GetSourceFiles() const { return mProgram.sourceFiles; }
+
+        // sources, states and files of a reloaded program, built variants are rebuilt by HotReload. Keywords are kept,
+        // masks handed out before would select other defines otherwise
+        void SetSources(const TinySLProgram &program);
+
+        // program of the stages with defines injected, not built. Also used by HotReload to rebuild variants.
+        static ShaderProgram::SP CreateProgram(const TinySLProgram &program, const std::string &defines);
+
+    private:
+        // defines go right after the first (#version) line
+        static std::string InjectDefines(const std::string &source, const std::string &defines);
+
+
+        std::string mName;
+        TinySLProgram mProgram;
+        std::unordered_map<uint32_t, ShaderProgram::SP> mVariants;
+    };
+}
@@ -1,11 +1,15 @@
 #include "StaticMesh.h"
 #include "RenderManager.h"
-#include "GL/glew.h"
 #include <iostream>
 #include "Eigen/LU"
 
 namespace Graphics
 {
+    StaticMesh::StaticMesh()
+    {
+        mPoolHandle = RenderManager::Instance()->RegisterMesh(this);
+    }
+
     void StaticMesh::Prepare()
     {
         if (!mDirty)
@@ -13,8 +17,6 @@ namespace Graphics
 
         CalculateTBN();
         // TODO: dirty mark and only upload changed data.
-        if (mVertexBuffer == nullptr)
-            mVertexBuffer = RenderManager::Instance()->AllocBuffer(BufferType_VertexBuffer);
 
         // Assemble vertex buffer according to layout flags
         int totalStride = 0;
@@ -50,37 +52,92 @@ namespace Graphics
             }
         }
 
-        mVertexBuffer->BufferData(mPreparedBuffer, mPreparedBufferSize, BufferUsage_StaticDraw);
-
-        if (mHasIndex)
+        // Suballocate from the pool of current layout, keep last allocation if sizes are unchanged.
+        size_t indexCount = mHasIndex ? mIndices.size() : 0;
+        if (mPool != nullptr && (mPool->GetLayoutFlag() != mLayoutFlag || mAllocation.vertexCount != mPositions.size() || mAllocation.indexCount != indexCount))
         {
-            if (mIndexBuffer == nullptr)
-                mIndexBuffer = RenderManager::Instance()->AllocBuffer(BufferType_IndexBuffer);
-            mIndexBuffer->BufferData(mIndices.data(), mIndices.size() * sizeof(uint32_t), BufferUsage_StaticDraw);
+            mPool->Free(mAllocation);
+            mPool = nullptr;
         }
 
-        // Set VAO
-        if (mVAOHandle == INVALID_ID)
-            glGenVertexArrays(1, &mVAOHandle);
-        glBindVertexArray(mVAOHandle);
+        if (mPool == nullptr)
+        {
+            mPool = RenderManager::Instance()->GetGeometryPool(mLayoutFlag);
+            if (!mPool->Allocate(mPositions.size(), indexCount, mAllocation))
+            {
+                GFX_LOG_ERROR("Allocate static mesh from geometry pool failed!");
+                mPool = nullptr;
+                return;
+            }
+        }
 
-        mVertexBuffer->Bind();
+        mPool->UploadVertices(mAllocation, mPreparedBuffer);
         if (mHasIndex)
-            mIndexBuffer->Bind();
+            mPool->UploadIndices(mAllocation, mIndices.data());
 
-        int count = 0;
-        for (int i = 0, flag = 1; flag < LayoutName_Max; i++, flag <<= 1)
+        mBaseVertex = mAllocation.vertexOffset;
+        mFirstIndex = mAllocation.indexOffset;
+        mDirty = false;
+
+        mBounds.setEmpty();
+        for (auto &position : mPositions)
+            mBounds.extend(position);
+
+        ReleaseCpuData();
+    }
+
+    void StaticMesh::ReleaseCpuData()
+    {
+        if (mRetentionPolicy != RetentionPolicy_KeepForReadback)
         {
-            if (mLayoutFlag & flag)
+            free(mPreparedBuffer);
+            mPreparedBuffer = nullptr;
+            mPreparedBufferSize = 0;
+        }
+
+        if (mRetentionPolicy == RetentionPolicy_Discard)
+        {
+            // positions are about to be dropped, last chance to build picking data.
+            if (mPickable)
+                GetBVH();
+
+            std::vector<Eigen::Vector3f>().swap(mPositions);
+            std::vector<Eigen::Vector3f>().swap(mNormals);
+            std::vector<Eigen::Vector3f>().swap(mTangents);
+            std::vector<Eigen::Vector3f>().swap(mBiTangents);
+            for (int i = 0; i < 3; ++i)
             {
-                glEnableVertexAttribArray(i);
-                glVertexAttribPointer(i, 3, GL_FLOAT, GL_FALSE, totalStride, (void*)(count * mAttributeStride));
-                ++count;
+                std::vector<Eigen::Vector3f>().swap(mUvs[i]);
+                std::vector<Eigen::Vector3f>().swap(mColors[i]);
             }
+            std::vector<uint32_t>().swap(mIndices);
+            // attributes are gone, a new layout is built from the next Set* calls.
+            mLayoutFlag = LayoutName_None;
         }
+    }
 
-        glBindVertexArray(0);
-        mDirty = false;
+    size_t StaticMesh::GetRetainedBytes() const
+    {
+        size_t bytes = mPreparedBuffer == nullptr ? 0 : mPreparedBufferSize;
+        const std::vector<Eigen::Vector3f> *attribs[] = {&mPositions, &mNormals, &mUvs[0], &mUvs[1], &mUvs[2], &mColors[0], &mColors[1], &mColors[2], &mTangents, &mBiTangents};
+        for (auto attrib : attribs)
+        {
+            bytes += attrib->capacity() * sizeof(Eigen::Vector3f);
+        }
+        bytes += mIndices.capacity() * sizeof(uint32_t);
+        if (mBVH != nullptr)
+            bytes += mBVH->GetMemoryBytes();
+        return bytes;
+    }
+
+    MeshBVH::SP StaticMesh::GetBVH()
+    {
+        if (mBVH == nullptr && !mPositions.empty())
+        {
+            mBVH = std::make_shared<MeshBVH>();
+            mBVH->Build(mPositions, mHasIndex ? mIndices : std::vector<uint32_t>());
+        }
+        return mBVH;
     }
 
     void StaticMesh::CalculateTBN()
@@ -88,6 +145,9 @@ namespace Graphics
         // triangles must not share vertex, and should contain nromal and uv attribs
         if ((mLayoutFlag & LayoutName_Normal) && (mLayoutFlag & LayoutName_UV0))
         {
+            // prepared again, don't append to tangents of last time
+            mTangents.clear();
+            mBiTangents.clear();
             for (int idx = 0; idx < mVertexCount; idx += 3)
             {
                 auto &a = mPositions[idx];
@@ -135,12 +195,15 @@ namespace Graphics
 
     void StaticMesh::Bind()
     {
-        glBindVertexArray(mVAOHandle);
+        if (mPool != nullptr)
+            mPool->Bind();
     }
 
     StaticMesh::~StaticMesh()
     {
+        RenderManager::Instance()->UnregisterMesh(this);
         free(mPreparedBuffer);
-        glDeleteVertexArrays(1, &mVAOHandle);
+        if (mPool != nullptr)
+            mPool->Free(mAllocation);
     }
 }
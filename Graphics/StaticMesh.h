@@ -11,12 +11,17 @@
 #include <memory>
 #include <Eigen/Core>
 #include <vector>
-#include "Buffer.h"
 #include "Constants.h"
+#include "HandlePool.h"
+#include "GeometryPool.h"
+#include "BVH.h"
 #include "VertexDataSource.h"
 
 namespace Graphics
 {
+    class StaticMesh;
+    typedef PoolHandle<StaticMesh> MeshHandle;
+
     /**
      * @brief Represent a static mesh with fixed vertex attribute layout:
      * location 0 position, 1 normal, 2 uv0, 3 uv1, 4 uv2, 5 color0, 6 color1, 7 color2, (TODO: 8 Tangent, 9 BiTangent)
@@ -26,15 +31,19 @@ namespace Graphics
     public:
         typedef std::shared_ptr<StaticMesh> SP;
 
-        StaticMesh() {}
+        StaticMesh();
         ~StaticMesh();
 
+        // slot in the mesh pool of RenderManager, registered for the mesh's lifetime
+        inline MeshHandle GetPoolHandle() const { return mPoolHandle; }
+
         void SetPositions(const std::vector<Eigen::Vector3f>& positions)
         {
             mPositions = positions;
             mLayoutFlag |= LayoutName_Position;
             mVertexCount = mPositions.size();
             mDirty = true;
+            mBVH = nullptr;
         }
 
         void SetPositions(std::vector<Eigen::Vector3f> &&positions)
@@ -43,6 +52,7 @@ namespace Graphics
             mLayoutFlag |= LayoutName_Position;
             mVertexCount = mPositions.size();
             mDirty = true;
+            mBVH = nullptr;
         }
 
         void SetNormals(const std::vector<Eigen::Vector3f> &normals)
@@ -100,6 +110,7 @@ namespace Graphics
             mIndices = indices;
             mHasIndex = true;
             mDirty = true;
+            mBVH = nullptr;
             mIndexCount = mIndices.size();
         }
 
@@ -108,16 +119,38 @@ namespace Graphics
             mIndices.swap(indices);
             mHasIndex = true;
             mDirty = true;
+            mBVH = nullptr;
             mIndexCount = mIndices.size();
         }
 
         void Prepare() override;
         void Bind() override;
 
+        // Meshes keep their source attributes by default so they can be modified and prepared again.
+        // With Discard, every attribute is dropped after upload and the mesh must be fully re-specified before next change.
+        // KeepForReadback additionally keeps the assembled vertex buffer.
+        void SetRetentionPolicy(RetentionPolicy policy) { mRetentionPolicy = policy; }
+        RetentionPolicy GetRetentionPolicy() const { return mRetentionPolicy; }
+        size_t GetRetainedBytes() const;
+
+        GeometryPool::SP GetGeometryPool() const { return mPool; }
+        // object space bounds of positions, updated by Prepare and kept when cpu data is released
+        const Eigen::AlignedBox3f &GetBounds() const { return mBounds; }
+        uint32_t VertexArrayHandle() override { return mPool == nullptr ? 0 : mPool->GetVAOHandle(); }
+
+        // Triangle hierarchy for ray picking, built on first request from positions.
+        // Meshes with Discard policy build it before dropping positions if pickable, otherwise they return nullptr.
+        MeshBVH::SP GetBVH();
+        void SetPickable(bool pickable) { mPickable = pickable; }
+        bool IsPickable() const { return mPickable; }
+
     private:
         void CalculateTBN();
+        void ReleaseCpuData();
         
+        MeshHandle mPoolHandle;
         uint32_t mLayoutFlag = LayoutName_None;
+        RetentionPolicy mRetentionPolicy = RetentionPolicy_KeepSource;
 
         std::vector<Eigen::Vector3f> mPositions;
         std::vector<Eigen::Vector3f> mNormals;
@@ -128,11 +161,14 @@ namespace Graphics
 
         std::vector<uint32_t> mIndices;
 
-        Buffer::SP mVertexBuffer = nullptr;
-        Buffer::SP mIndexBuffer = nullptr;
-        uint32_t mVAOHandle = INVALID_ID;
+        // vertex and index data live in a pool shared by meshes of the same layout
+        GeometryPool::SP mPool = nullptr;
+        GeometryPool::Allocation mAllocation;
 
         bool mDirty = true;
+        bool mPickable = true;
+        MeshBVH::SP mBVH = nullptr;
+        Eigen::AlignedBox3f mBounds;
         void* mPreparedBuffer = nullptr;
         size_t mPreparedBufferSize = 0;
 
@@ -1,30 +1,39 @@
 #include "Texture.h"
 #include "string.h"
+#include <algorithm>
 #include "GL/glew.h"
 #include "InternalFunctions.h"
 #include "stb/stb_image.h"
 #include "RenderManager.h"
+#include "KTX2.h"
 
 namespace Graphics
 {
-    // currently only 2d, others supported lately
+    // image data functions are 2d only except the layer ones, others supported lately
     void Texture::SetWrapMode(TextureWrapMode S, TextureWrapMode T)
     {
-        glBindTexture(GL_TEXTURE_2D, mHandle);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GetNativeWrapMode(S));
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GetNativeWrapMode(T));
+        mSamplerState.wrapS = S;
+        mSamplerState.wrapT = T;
+        mSamplerHandle = 0;
     }
 
     void Texture::SetFilter(TextureFilter min, TextureFilter mag)
     {
-        glBindTexture(GL_TEXTURE_2D, mHandle);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GetNativeFilter(min));
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GetNativeFilter(mag));
+        mSamplerState.minFilter = min;
+        mSamplerState.magFilter = mag;
+        mSamplerHandle = 0;
+    }
+
+    uint32_t Texture::GetSamplerHandle() const
+    {
+        if (mSamplerHandle == 0)
+            mSamplerHandle = RenderManager::Instance()->GetSampler(mSamplerState);
+        return mSamplerHandle;
     }
 
     void Texture::BindTexture()
     {
-        glBindTexture(GL_TEXTURE_2D, mHandle);
+        glBindTexture(GetNativeTextureType(mType), mHandle);
     }
 
     bool Texture::TexData(int width, int height, int nchannel, void *data, int level)
@@ -40,31 +49,326 @@ namespace Graphics
             return false;
         }
 
-        auto dataSize = nchannel *width *height;
-        mData = malloc(dataSize);
-        memcpy(mData, data, dataSize);
+        free(mData);
+        mData = nullptr;
+        mDataSize = 0;
+        if (mRetentionPolicy == RetentionPolicy_KeepForReadback && data != nullptr)
+        {
+            mDataSize = nchannel * width * height;
+            mData = malloc(mDataSize);
+            memcpy(mData, data, mDataSize);
+        }
+        mWidth = width;
+        mHeight = height;
+
+        if (TextureCompressor::IsCompressed(mFormat))
+        {
+            CompressedImage image;
+            if (!TextureCompressor::Compress(mFormat, (const uint8_t *)data, width, height, mGenerateMipmap, image))
+                return false;
+            return SetCompressedImage(image);
+        }
 
         glBindTexture(GL_TEXTURE_2D, mHandle);
         glTexImage2D(GL_TEXTURE_2D, 0, nativeFormat, width, height, 0, nativeFormat, nativeType, data);
 
         if (mGenerateMipmap)
             glGenerateMipmap(GL_TEXTURE_2D);
+        mLevelCount = mGenerateMipmap ? FullLevelCount() : 1;
+        SetBaseLevel(0);
 
+        mStatus = TextureStatus_Resident;
         return true;
     }
 
+    bool Texture::CompressedTexData(int width, int height, const void *data, size_t size, int level)
+    {
+        if (!RenderManager::Instance()->IsFormatSupported(mFormat))
+        {
+            GFX_LOG_ERROR_FMT("Compressed texture format %d is not supported!", (int)mFormat);
+            return false;
+        }
+
+        uint32_t nativeType;
+        uint32_t nativeFormat;
+        int formatChannel;
+        GetNativeTypeAndFormat(mFormat, &nativeType, &nativeFormat, &formatChannel);
+
+        if (level == 0)
+        {
+            mWidth = width;
+            mHeight = height;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, mHandle);
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, nativeFormat, width, height, 0, (GLsizei)size, data);
+        glCheckError();
+        return true;
+    }
+
+    bool Texture::SetCompressedImage(const CompressedImage &image)
+    {
+        if (image.format != mFormat || image.levels.empty())
+        {
+            GFX_LOG_ERROR("compressed image not match texture format!");
+            return false;
+        }
+
+        for (size_t i = 0; i < image.levels.size(); ++i)
+        {
+            auto &level = image.levels[i];
+            if (!CompressedTexData(level.width, level.height, level.data.data(), level.data.size(), (int)i))
+                return false;
+        }
+
+        glBindTexture(GL_TEXTURE_2D, mHandle);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+        mLevelCount = (int)image.levels.size();
+        SetBaseLevel(0);
+        mStatus = TextureStatus_Resident;
+        return true;
+    }
+
+    uint32_t Texture::GetBindHandle() const
+    {
+        switch (mStatus)
+        {
+        case TextureStatus_Loading:
+            return GetWhiteTexture()->GetHandle();
+        case TextureStatus_Failed:
+            return GetMagentaTexture()->GetHandle();
+        default:
+            return mHandle;
+        }
+    }
+
     void Texture::LoadFromFile(const char *filePath)
     {
         int w, h, nchannel;
-        unsigned char *data = stbi_load(filePath, &w, &h, &nchannel, 0);
+        // compressed formats are encoded from a fixed channel count, let stbi convert
+        int desiredChannel = TextureCompressor::IsCompressed(mFormat) ? TextureCompressor::GetSourceChannel(mFormat) : 0;
+        unsigned char *data = stbi_load(filePath, &w, &h, &nchannel, desiredChannel);
+        if (desiredChannel != 0)
+            nchannel = desiredChannel;
 
         if (data == nullptr)
+        {
             GFX_LOG_ERROR_FMT("load image %s failed!", filePath);
+            return;
+        }
 
         if (!TexData(w, h, nchannel, data, 0))
         {
             GFX_LOG_ERROR_FMT("set image data failed! %s", filePath);
         }
+        mSourcePath = filePath;
+        stbi_image_free(data);
+    }
+
+    bool Texture::LoadFromKTX2(const char *filePath)
+    {
+        KTX2File file;
+        if (!file.Open(filePath))
+            return false;
+
+        if (file.GetFormat() != mFormat)
+        {
+            GFX_LOG_ERROR_FMT("%s is texture format %d, not %d the texture was allocated with, the file format is used", filePath,
+                              (int)file.GetFormat(), (int)mFormat);
+        }
+        mFormat = file.GetFormat();
+        mWidth = file.GetWidth();
+        mHeight = file.GetHeight();
+        free(mData);
+        mData = nullptr;
+        mDataSize = 0;
+
+        bool compressed = TextureCompressor::IsCompressed(mFormat);
+        uint32_t nativeType;
+        uint32_t nativeFormat;
+        int formatChannel;
+        GetNativeTypeAndFormat(mFormat, &nativeType, &nativeFormat, &formatChannel);
+
+        glBindTexture(GL_TEXTURE_2D, mHandle);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (size_t i = 0; i < file.GetLevelCount(); ++i)
+        {
+            auto &level = file.GetLevel(i);
+            if (compressed)
+            {
+                if (!CompressedTexData(level.width, level.height, level.data, level.size, (int)i))
+                {
+                    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                    GFX_LOG_ERROR_FMT("upload %s failed!", filePath);
+                    return false;
+                }
+            }
+            else
+            {
+                glTexImage2D(GL_TEXTURE_2D, (GLint)i, nativeFormat, level.width, level.height, 0, nativeFormat, nativeType, level.data);
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        glBindTexture(GL_TEXTURE_2D, mHandle);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)file.GetLevelCount() - 1);
+        mLevelCount = (int)file.GetLevelCount();
+        SetBaseLevel(0);
+        mSourcePath = filePath;
+
+        if (mRetentionPolicy == RetentionPolicy_KeepForReadback && !compressed)
+        {
+            mDataSize = file.GetLevel(0).size;
+            mData = malloc(mDataSize);
+            memcpy(mData, file.GetLevel(0).data, mDataSize);
+        }
+
+        mStatus = TextureStatus_Resident;
+        return true;
+    }
+
+    bool Texture::AllocLayers(int width, int height, int layerCount)
+    {
+        if (mType != TextureType_2DArray)
+        {
+            GFX_LOG_ERROR("layers can only be allocated for 2d array texture!");
+            return false;
+        }
+
+        if (TextureCompressor::IsCompressed(mFormat) && !RenderManager::Instance()->IsFormatSupported(mFormat))
+        {
+            GFX_LOG_ERROR_FMT("Compressed texture format %d is not supported!", (int)mFormat);
+            return false;
+        }
+
+        uint32_t nativeType;
+        uint32_t nativeFormat;
+        int formatChannel;
+        GetNativeTypeAndFormat(mFormat, &nativeType, &nativeFormat, &formatChannel);
+
+        mWidth = width;
+        mHeight = height;
+        mLayerCount = layerCount;
+        mLevelCount = mGenerateMipmap ? FullLevelCount() : 1;
+
+        glBindTexture(GL_TEXTURE_2D_ARRAY, mHandle);
+        for (int level = 0; level < mLevelCount; ++level)
+        {
+            int w = std::max(1, width >> level);
+            int h = std::max(1, height >> level);
+            if (TextureCompressor::IsCompressed(mFormat))
+            {
+                auto size = TextureCompressor::GetLevelSize(mFormat, w, h) * layerCount;
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, nativeFormat, w, h, layerCount, 0, (GLsizei)size, nullptr);
+            }
+            else
+            {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, nativeFormat, w, h, layerCount, 0, nativeFormat, nativeType, nullptr);
+            }
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, mLevelCount - 1);
+        glCheckError();
+
+        mStatus = TextureStatus_Resident;
+        return true;
+    }
+
+    bool Texture::SetLayerImage(int layer, const CompressedImage &image)
+    {
+        if (mType != TextureType_2DArray || layer < 0 || layer >= mLayerCount)
+        {
+            GFX_LOG_ERROR_FMT("invalid texture layer %d!", layer);
+            return false;
+        }
+
+        if (image.format != mFormat || image.levels.empty() || image.levels[0].width != mWidth || image.levels[0].height != mHeight)
+        {
+            GFX_LOG_ERROR("layer image not match texture array!");
+            return false;
+        }
+
+        uint32_t nativeType;
+        uint32_t nativeFormat;
+        int formatChannel;
+        GetNativeTypeAndFormat(mFormat, &nativeType, &nativeFormat, &formatChannel);
+
+        // levels not provided by image stay undefined, so image should carry the full chain if mipmaps are used
+        int levelCount = std::min((int)image.levels.size(), mLevelCount);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, mHandle);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int i = 0; i < levelCount; ++i)
+        {
+            auto &level = image.levels[i];
+            if (TextureCompressor::IsCompressed(mFormat))
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, level.width, level.height, 1, nativeFormat,
+                                          (GLsizei)level.data.size(), level.data.data());
+            else
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, i, 0, 0, layer, level.width, level.height, 1, nativeFormat, nativeType,
+                                level.data.data());
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glCheckError();
+        return true;
+    }
+
+    size_t Texture::GetLevelBytes(int level) const
+    {
+        int w = std::max(1, mWidth >> level);
+        int h = std::max(1, mHeight >> level);
+        return TextureCompressor::GetLevelSize(mFormat, w, h) * std::max(1, mLayerCount);
+    }
+
+    size_t Texture::GetResidentBytes() const
+    {
+        size_t bytes = 0;
+        for (int level = mBaseLevel; level < mLevelCount; ++level)
+            bytes += GetLevelBytes(level);
+        return bytes;
+    }
+
+    void Texture::ReleaseTopLevels(int baseLevel)
+    {
+        if (mType != TextureType_2D || baseLevel <= mBaseLevel || baseLevel >= mLevelCount)
+            return;
+
+        uint32_t nativeType;
+        uint32_t nativeFormat;
+        int formatChannel;
+        GetNativeTypeAndFormat(mFormat, &nativeType, &nativeFormat, &formatChannel);
+
+        // levels below base do not take part in completeness, redefining them as empty frees their storage
+        glBindTexture(GL_TEXTURE_2D, mHandle);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, baseLevel);
+        for (int level = mBaseLevel; level < baseLevel; ++level)
+        {
+            if (TextureCompressor::IsCompressed(mFormat))
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, nativeFormat, 0, 0, 0, 0, nullptr);
+            else
+                glTexImage2D(GL_TEXTURE_2D, level, nativeFormat, 0, 0, 0, nativeFormat, nativeType, nullptr);
+        }
+        glCheckError();
+        mBaseLevel = baseLevel;
+    }
+
+    void Texture::SetBaseLevel(int baseLevel)
+    {
+        if (mBaseLevel == baseLevel)
+            return;
+        auto target = GetNativeTextureType(mType);
+        glBindTexture(target, mHandle);
+        glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, baseLevel);
+        mBaseLevel = baseLevel;
+    }
+
+    void Texture::SetRetentionPolicy(RetentionPolicy policy)
+    {
+        mRetentionPolicy = policy;
+        if (policy != RetentionPolicy_KeepForReadback)
+        {
+            free(mData);
+            mData = nullptr;
+            mDataSize = 0;
+        }
     }
 
     Texture::SP Texture::mWhiteTexture = nullptr;
@@ -9,10 +9,27 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include "Constants.h"
+#include "TextureCompressor.h"
+#include "HandlePool.h"
 
 namespace Graphics
 {
+    // filtering and wrapping, textures sharing the same state share one GL sampler object
+    struct SamplerState
+    {
+        TextureFilter minFilter = TextureFilter_Linear;
+        TextureFilter magFilter = TextureFilter_Linear;
+        TextureWrapMode wrapS = TextureWrapMode_Repeat;
+        TextureWrapMode wrapT = TextureWrapMode_Repeat;
+
+        inline uint32_t Key() const { return minFilter | magFilter << 8 | wrapS << 16 | wrapT << 24; }
+    };
+
+    class Texture;
+    typedef PoolHandle<Texture> TextureHandle;
+
     class Texture
     {
     public:
@@ -20,29 +37,107 @@ namespace Graphics
         typedef std::shared_ptr<const Texture> CSP;
 
         Texture(uint32_t handle, TextureType type, TextureFormat format, bool generateMipmap):
-            mHandle(handle), mType(type), mFormat(format), mGenerateMipmap(generateMipmap){}
+            mHandle(handle), mType(type), mFormat(format), mGenerateMipmap(generateMipmap)
+        {
+            mSamplerState.minFilter = generateMipmap ? TextureFilter_LinearMipmapLinear : TextureFilter_Linear;
+        }
         ~Texture();
 
+        // Only recorded, they take effect through the sampler object bound along with the texture by Material::Use.
         void SetWrapMode(TextureWrapMode S, TextureWrapMode T);
         void SetFilter(TextureFilter min, TextureFilter mag);
+        inline const SamplerState &GetSamplerState() const { return mSamplerState; }
+        // shared sampler object of current state
+        uint32_t GetSamplerHandle() const;
 
+        // Data of compressed formats is encoded on cpu first (with full mip chain if mipmap is requested).
         bool TexData(int width, int height, int nchannel, void *data, int level);
+        // pre-compressed blocks of one level, size in bytes
+        bool CompressedTexData(int width, int height, const void *data, size_t size, int level);
+        // upload every level, mipmaps are not generated on GPU for compressed images
+        bool SetCompressedImage(const CompressedImage &image);
         void LoadFromFile(const char *filePath);
+
+        // 2d array only: allocate every layer of the mip chain, layers are filled separately afterwards.
+        bool AllocLayers(int width, int height, int layerCount);
+        // 2d array only: one layer with its mip chain, image must match array size and format
+        bool SetLayerImage(int layer, const CompressedImage &image);
+        inline int GetLayerCount() const { return mLayerCount; }
+
+        // mip levels of the image, base level is the largest one resident on GPU (see TextureResidency)
+        inline int GetLevelCount() const { return mLevelCount; }
+        inline int GetBaseLevel() const { return mBaseLevel; }
+        size_t GetLevelBytes(int level) const;
+        // estimated GPU memory of levels from base level on, all layers included
+        size_t GetResidentBytes() const;
+        // Raise base level and release storage of levels above it, they can be streamed back from source path.
+        void ReleaseTopLevels(int baseLevel);
+        // file the image came from, empty if set from memory
+        inline const std::string &GetSourcePath() const { return mSourcePath; }
+        // cooked by texcook, texture format is taken from the file and every stored level is uploaded as is
+        bool LoadFromKTX2(const char *filePath);
         void BindTexture();
 
         inline uint32_t GetHandle() const { return mHandle; }
         inline void Reset() { mHandle = 0; }
+        // slot in the texture pool of RenderManager, valid from AllocTexture until destruction
+        inline TextureHandle GetPoolHandle() const { return mPoolHandle; }
+        inline void SetPoolHandle(TextureHandle handle) { mPoolHandle = handle; }
+
+        // Textures discard their cpu copy by default, KeepForReadback keeps mip 0 image data.
+        // KeepSource has nothing to keep for a texture and behaves like Discard.
+        void SetRetentionPolicy(RetentionPolicy policy);
+        inline RetentionPolicy GetRetentionPolicy() const { return mRetentionPolicy; }
+        // cpu copy of mip 0, nullptr if not retained
+        inline const void *GetData() const { return mData; }
+        inline size_t GetRetainedBytes() const { return mData == nullptr ? 0 : mDataSize; }
+
+        inline int GetWidth() const { return mWidth; }
+        inline int GetHeight() const { return mHeight; }
+        inline TextureFormat GetFormat() const { return mFormat; }
+        inline TextureType GetType() const { return mType; }
+
+        // Textures streamed by TextureStreamer are not usable until resident,
+        // bind handle falls back to white placeholder while loading and magenta one on failure.
+        inline TextureStatus GetStatus() const { return mStatus; }
+        inline bool IsResident() const { return mStatus == TextureStatus_Resident; }
+        uint32_t GetBindHandle() const;
 
         static Texture::CSP GetWhiteTexture();
         static Texture::CSP GetBlackTexture();
         static Texture::CSP GetMagentaTexture();
 
     private:
+        friend class TextureStreamer;
+        friend class TextureResidency;
+
+        void SetBaseLevel(int baseLevel);
+        inline int FullLevelCount() const
+        {
+            int count = 1;
+            while ((mWidth >> count) > 0 || (mHeight >> count) > 0)
+                ++count;
+            return count;
+        }
+
         uint32_t mHandle;
+        TextureHandle mPoolHandle;
         TextureType mType;
         TextureFormat mFormat;
+        RetentionPolicy mRetentionPolicy = RetentionPolicy_Discard;
         void *mData = nullptr;
+        size_t mDataSize = 0;
+        int mWidth = 0;
+        int mHeight = 0;
+        int mLayerCount = 0;
+        int mLevelCount = 0;
+        int mBaseLevel = 0;
         bool mGenerateMipmap;
+        std::string mSourcePath;
+        SamplerState mSamplerState;
+        mutable uint32_t mSamplerHandle = 0;    // resolved lazily, reset when state changes
+        mutable uint64_t mLastUsedFrame = 0;   // written by TextureResidency::MarkUsed
+        TextureStatus mStatus = TextureStatus_Resident;
 
         static Texture::SP mWhiteTexture;
         static Texture::SP mBlackTexture;
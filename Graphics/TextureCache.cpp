@@ -0,0 +1,118 @@
+#include "TextureCache.h"
+#include <algorithm>
+#include "RenderManager.h"
+#include "TextureStreamer.h"
+
+namespace Graphics
+{
+    TextureCache *TextureCache::mInstance = nullptr;
+
+    TextureCache *TextureCache::Instance()
+    {
+        if (mInstance == nullptr)
+            mInstance = new TextureCache();
+        return mInstance;
+    }
+
+    std::string TextureCache::MakeKey(const std::string &path, TextureFormat format, bool generateMipmap)
+    {
+        std::string key = path;
+        // windows separators should not make a second entry of the same file
+        for (auto &c : key)
+        {
+            if (c == '\\')
+                c = '/';
+        }
+        key += '|';
+        key += std::to_string((int)format);
+        key += generateMipmap ? "|m" : "|n";
+        return key;
+    }
+
+    Texture::SP TextureCache::Load(const std::string &path, TextureFormat format, bool generateMipmap)
+    {
+        auto key = MakeKey(path, format, generateMipmap);
+        std::lock_guard<std::mutex> lock(mMutex);
+        // released textures leave their entries behind, they are dropped amortized over new entries
+        if (mEntries.size() >= mPurgeCount && mEntries.count(key) == 0)
+        {
+            purgeLocked();
+            mPurgeCount = std::max<size_t>(64, mEntries.size() * 2);
+        }
+        auto &entry = mEntries[key];
+        auto tex = entry.texture.lock();
+        if (tex != nullptr)
+        {
+            ++entry.hits;
+            ++mHits;
+            return tex;
+        }
+
+        ++mMisses;
+        entry.hits = 0;
+        tex = RenderManager::Instance()->AllocTexture(TextureType_2D, format, generateMipmap);
+        tex->SetFilter(generateMipmap ? TextureFilter_LinearMipmapLinear : TextureFilter_Linear, TextureFilter_Linear);
+        tex->SetWrapMode(TextureWrapMode_Repeat, TextureWrapMode_Repeat);
+        TextureStreamer::Instance()->Load(tex, path);
+        entry.texture = tex;
+        return tex;
+    }
+
+    Texture::SP TextureCache::Find(const std::string &path, TextureFormat format, bool generateMipmap)
+    {
+        auto key = MakeKey(path, format, generateMipmap);
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto iter = mEntries.find(key);
+        if (iter == mEntries.end())
+            return nullptr;
+        auto tex = iter->second.texture.lock();
+        if (tex == nullptr)
+            mEntries.erase(iter);
+        return tex;
+    }
+
+    TextureCache::Stats TextureCache::GetStats()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        Stats stats;
+        stats.hits = mHits;
+        stats.misses = mMisses;
+        for (auto &pair : mEntries)
+        {
+            auto tex = pair.second.texture.lock();
+            if (tex == nullptr)
+                continue;
+            ++stats.liveTextures;
+            // full chain, what every hit would have uploaded again
+            size_t bytes = 0;
+            for (int level = 0; level < tex->GetLevelCount(); ++level)
+                bytes += tex->GetLevelBytes(level);
+            stats.savedBytes += bytes * pair.second.hits;
+        }
+        return stats;
+    }
+
+    void TextureCache::PrintStats()
+    {
+        auto stats = GetStats();
+        GFX_LOG_OK_FMT("Texture cache: %zu hits, %zu misses, %zu living textures, about %zu bytes of uploads saved",
+                       stats.hits, stats.misses, stats.liveTextures, stats.savedBytes);
+    }
+
+    void TextureCache::Purge()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        purgeLocked();
+    }
+
+    void TextureCache::purgeLocked()
+    {
+        for (auto iter = mEntries.begin(); iter != mEntries.end();)
+        {
+            if (iter->second.texture.expired())
+                iter = mEntries.erase(iter);
+            else
+                ++iter;
+        }
+    }
+}
@@ -0,0 +1,69 @@
+/**
+ * @file TextureCache.h
+ * @author wangyudong
+ * @brief Path keyed texture registry, the same image file requested with the same format is decoded and uploaded once.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "Texture.h"
+
+namespace Graphics
+{
+    /**
+     * @brief Entries hold weak references, a texture is released once nothing else uses it and a later request loads it again.
+     * Bookkeeping is guarded by a mutex, so concurrent requests of one key share a texture. A miss allocates the texture
+     * through RenderManager, which needs the GL context, so Load must run on render thread while Find can run anywhere.
+     */
+    class TextureCache
+    {
+    public:
+        struct Stats
+        {
+            size_t hits = 0;
+            size_t misses = 0;
+            size_t liveTextures = 0;
+            size_t savedBytes = 0;  // estimated GPU bytes of uploads avoided by hits on living textures
+        };
+
+        static TextureCache *Instance();
+
+        // streamed by TextureStreamer on a miss, with linear (mipmap) filter and repeat wrap mode
+        Texture::SP Load(const std::string &path, TextureFormat format, bool generateMipmap = true);
+        // nullptr if not cached or released
+        Texture::SP Find(const std::string &path, TextureFormat format, bool generateMipmap = true);
+
+        Stats GetStats();
+        void PrintStats();
+        // drop entries of released textures, also done by Load when the entries doubled since the last purge
+        void Purge();
+
+    private:
+        TextureCache() {}
+        ~TextureCache() {}
+
+        struct Entry
+        {
+            std::weak_ptr<Texture> texture;
+            size_t hits = 0;
+        };
+
+        static std::string MakeKey(const std::string &path, TextureFormat format, bool generateMipmap);
+        // caller holds mMutex
+        void purgeLocked();
+
+        static TextureCache *mInstance;
+
+        std::mutex mMutex;
+        std::unordered_map<std::string, Entry> mEntries;
+        size_t mHits = 0;
+        size_t mMisses = 0;
+        // entry count Load purges at
+        size_t mPurgeCount = 64;
+    };
+}
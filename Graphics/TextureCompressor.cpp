@@ -0,0 +1,440 @@
+#include "TextureCompressor.h"
+#include <string.h>
+#include <algorithm>
+#include <future>
+#include "ThreadPool.h"
+#include "MipGenerator.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define COMPRESSOR_USE_SSE
+#endif
+
+namespace Graphics
+{
+    namespace
+    {
+        // 4x4 block fetched as rgba8, missing channels are 0 (alpha 255), edges are clamped.
+        void FetchBlock(const uint8_t *pixels, int width, int height, int channel, int blockX, int blockY, uint8_t block[64])
+        {
+            for (int y = 0; y < 4; ++y)
+            {
+                int py = std::min(blockY * 4 + y, height - 1);
+                for (int x = 0; x < 4; ++x)
+                {
+                    int px = std::min(blockX * 4 + x, width - 1);
+                    const uint8_t *src = pixels + ((size_t)py * width + px) * channel;
+                    uint8_t *dst = block + (y * 4 + x) * 4;
+                    dst[0] = src[0];
+                    dst[1] = channel > 1 ? src[1] : 0;
+                    dst[2] = channel > 2 ? src[2] : 0;
+                    dst[3] = channel > 3 ? src[3] : 255;
+                }
+            }
+        }
+
+        // per channel min and max over 16 rgba8 pixels
+        inline void BlockMinMax(const uint8_t block[64], uint8_t minColor[4], uint8_t maxColor[4])
+        {
+#ifdef COMPRESSOR_USE_SSE
+            __m128i p0 = _mm_loadu_si128((const __m128i *)block);
+            __m128i p1 = _mm_loadu_si128((const __m128i *)(block + 16));
+            __m128i p2 = _mm_loadu_si128((const __m128i *)(block + 32));
+            __m128i p3 = _mm_loadu_si128((const __m128i *)(block + 48));
+
+            // each 32 bit lane is one pixel, reduce across lanes
+            __m128i lo = _mm_min_epu8(_mm_min_epu8(p0, p1), _mm_min_epu8(p2, p3));
+            __m128i hi = _mm_max_epu8(_mm_max_epu8(p0, p1), _mm_max_epu8(p2, p3));
+            lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(1, 0, 3, 2)));
+            hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(1, 0, 3, 2)));
+            lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+            hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+
+            int minBits = _mm_cvtsi128_si32(lo);
+            int maxBits = _mm_cvtsi128_si32(hi);
+            memcpy(minColor, &minBits, 4);
+            memcpy(maxColor, &maxBits, 4);
+#else
+            for (int c = 0; c < 4; ++c)
+            {
+                minColor[c] = 255;
+                maxColor[c] = 0;
+            }
+            for (int i = 0; i < 16; ++i)
+            {
+                for (int c = 0; c < 4; ++c)
+                {
+                    minColor[c] = std::min(minColor[c], block[i * 4 + c]);
+                    maxColor[c] = std::max(maxColor[c], block[i * 4 + c]);
+                }
+            }
+#endif
+        }
+
+        inline uint16_t PackRGB565(const uint8_t *c)
+        {
+            return (uint16_t)(((c[0] & 0xF8) << 8) | ((c[1] & 0xFC) << 3) | (c[2] >> 3));
+        }
+
+        inline void UnpackRGB565(uint16_t v, int *c)
+        {
+            int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+            c[0] = (r << 3) | (r >> 2);
+            c[1] = (g << 2) | (g >> 4);
+            c[2] = (b << 3) | (b >> 2);
+        }
+
+        void EncodeBC1(const uint8_t block[64], uint8_t *out)
+        {
+            uint8_t minColor[4], maxColor[4];
+            BlockMinMax(block, minColor, maxColor);
+
+            // inset bounding box by 1/16 to reduce error of the extremes
+            for (int c = 0; c < 3; ++c)
+            {
+                int inset = (maxColor[c] - minColor[c]) >> 4;
+                minColor[c] = (uint8_t)std::min(255, minColor[c] + inset);
+                maxColor[c] = (uint8_t)std::max(0, maxColor[c] - inset);
+            }
+
+            uint16_t c0 = PackRGB565(maxColor);
+            uint16_t c1 = PackRGB565(minColor);
+            uint32_t indices = 0;
+            if (c0 < c1)
+                std::swap(c0, c1);
+
+            // equal endpoints leave all indices 0
+            if (c0 != c1)
+            {
+                int palette[4][3];
+                UnpackRGB565(c0, palette[0]);
+                UnpackRGB565(c1, palette[1]);
+                for (int c = 0; c < 3; ++c)
+                {
+                    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+                }
+
+                for (int i = 0; i < 16; ++i)
+                {
+                    int best = 0, bestError = INT32_MAX;
+                    for (int p = 0; p < 4; ++p)
+                    {
+                        int dr = block[i * 4] - palette[p][0];
+                        int dg = block[i * 4 + 1] - palette[p][1];
+                        int db = block[i * 4 + 2] - palette[p][2];
+                        int error = dr * dr + dg * dg + db * db;
+                        if (error < bestError)
+                        {
+                            bestError = error;
+                            best = p;
+                        }
+                    }
+                    indices |= (uint32_t)best << (i * 2);
+                }
+            }
+
+            memcpy(out, &c0, 2);
+            memcpy(out + 2, &c1, 2);
+            memcpy(out + 4, &indices, 4);
+        }
+
+        // single channel block, 8 interpolated values between max and min
+        void EncodeBC4(const uint8_t block[64], int channel, uint8_t minValue, uint8_t maxValue, uint8_t *out)
+        {
+            uint64_t bits = 0;
+            int range = maxValue - minValue;
+            if (range > 0)
+            {
+                for (int i = 0; i < 16; ++i)
+                {
+                    // k is the weight of max in sevenths, palette index 0 is max, 1 is min, 2-7 are in between
+                    int k = ((block[i * 4 + channel] - minValue) * 7 + range / 2) / range;
+                    uint64_t index = k == 7 ? 0 : (k == 0 ? 1 : 8 - k);
+                    bits |= index << (i * 3);
+                }
+            }
+
+            out[0] = maxValue;
+            out[1] = minValue;
+            for (int i = 0; i < 6; ++i)
+                out[2 + i] = (uint8_t)(bits >> (i * 8));
+        }
+
+        // 128 bit little endian bit stream
+        struct BlockWriter
+        {
+            uint64_t bits[2] = {0, 0};
+            int position = 0;
+
+            void Write(uint32_t value, int count)
+            {
+                for (int i = 0; i < count; ++i, ++position)
+                    bits[position >> 6] |= (uint64_t)((value >> i) & 1) << (position & 63);
+            }
+        };
+
+        // choose 7 bit value and shared p-bit of one endpoint, 8 bit endpoint is (value << 1) | p
+        void QuantizeBC7Endpoint(const uint8_t color[4], uint8_t quantized[4], int &pbit)
+        {
+            int bestError = INT32_MAX;
+            for (int p = 0; p < 2; ++p)
+            {
+                int error = 0;
+                uint8_t q[4];
+                for (int c = 0; c < 4; ++c)
+                {
+                    int v = std::min(127, std::max(0, (color[c] - p + 1) >> 1));
+                    q[c] = (uint8_t)v;
+                    int d = ((v << 1) | p) - color[c];
+                    error += d * d;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    pbit = p;
+                    memcpy(quantized, q, 4);
+                }
+            }
+        }
+
+        // mode 6 only: one subset, rgba 7.7.7.7 endpoints with p-bits and 4 bit indices
+        void EncodeBC7(const uint8_t block[64], uint8_t *out)
+        {
+            static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+            uint8_t minColor[4], maxColor[4];
+            BlockMinMax(block, minColor, maxColor);
+
+            uint8_t q0[4], q1[4];
+            int p0 = 0, p1 = 0;
+            QuantizeBC7Endpoint(minColor, q0, p0);
+            QuantizeBC7Endpoint(maxColor, q1, p1);
+
+            int e0[4], e1[4];
+            for (int c = 0; c < 4; ++c)
+            {
+                e0[c] = (q0[c] << 1) | p0;
+                e1[c] = (q1[c] << 1) | p1;
+            }
+
+            int palette[16][4];
+            for (int w = 0; w < 16; ++w)
+            {
+                for (int c = 0; c < 4; ++c)
+                    palette[w][c] = ((64 - weights[w]) * e0[c] + weights[w] * e1[c] + 32) >> 6;
+            }
+
+            int indices[16];
+            for (int i = 0; i < 16; ++i)
+            {
+                int best = 0, bestError = INT32_MAX;
+                for (int w = 0; w < 16; ++w)
+                {
+                    int error = 0;
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        int d = block[i * 4 + c] - palette[w][c];
+                        error += d * d;
+                    }
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        best = w;
+                    }
+                }
+                indices[i] = best;
+            }
+
+            // anchor index has an implicit 0 msb, swap endpoints to make it so
+            if (indices[0] >= 8)
+            {
+                std::swap(q0, q1);
+                std::swap(p0, p1);
+                for (int i = 0; i < 16; ++i)
+                    indices[i] = 15 - indices[i];
+            }
+
+            BlockWriter writer;
+            writer.Write(1 << 6, 7); // mode 6
+            for (int c = 0; c < 4; ++c)
+            {
+                writer.Write(q0[c], 7);
+                writer.Write(q1[c], 7);
+            }
+            writer.Write(p0, 1);
+            writer.Write(p1, 1);
+            writer.Write(indices[0], 3);
+            for (int i = 1; i < 16; ++i)
+                writer.Write(indices[i], 4);
+
+            memcpy(out, writer.bits, 16);
+        }
+
+        void EncodeBlock(TextureFormat format, const uint8_t block[64], uint8_t *out)
+        {
+            switch (format)
+            {
+            case TextureFormat_BC1:
+                EncodeBC1(block, out);
+                break;
+            case TextureFormat_BC4:
+            case TextureFormat_BC5:
+            {
+                uint8_t minColor[4], maxColor[4];
+                BlockMinMax(block, minColor, maxColor);
+                EncodeBC4(block, 0, minColor[0], maxColor[0], out);
+                if (format == TextureFormat_BC5)
+                    EncodeBC4(block, 1, minColor[1], maxColor[1], out + 8);
+                break;
+            }
+            case TextureFormat_BC7:
+                EncodeBC7(block, out);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    bool TextureCompressor::IsCompressed(TextureFormat format)
+    {
+        return GetBlockBytes(format) > 0;
+    }
+
+    int TextureCompressor::GetBlockBytes(TextureFormat format)
+    {
+        switch (format)
+        {
+        case TextureFormat_BC1:
+        case TextureFormat_BC4:
+        case TextureFormat_ETC2_RGB8:
+            return 8;
+        case TextureFormat_BC5:
+        case TextureFormat_BC7:
+        case TextureFormat_ETC2_RGBA8:
+            return 16;
+        default:
+            return 0;
+        }
+    }
+
+    int TextureCompressor::GetSourceChannel(TextureFormat format)
+    {
+        switch (format)
+        {
+        case TextureFormat_R8G8B8A8:
+        case TextureFormat_BC7:
+        case TextureFormat_ETC2_RGBA8:
+            return 4;
+        case TextureFormat_R8G8B8:
+        case TextureFormat_BC1:
+        case TextureFormat_ETC2_RGB8:
+            return 3;
+        case TextureFormat_R8G8:
+        case TextureFormat_BC5:
+            return 2;
+        case TextureFormat_BC4:
+            return 1;
+        default:
+            return 0;
+        }
+    }
+
+    size_t TextureCompressor::GetLevelSize(TextureFormat format, int width, int height)
+    {
+        int blockBytes = GetBlockBytes(format);
+        if (blockBytes == 0)
+            return (size_t)width * height * GetSourceChannel(format);
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+    }
+
+    bool TextureCompressor::CanEncode(TextureFormat format)
+    {
+        return format == TextureFormat_BC1 || format == TextureFormat_BC4 || format == TextureFormat_BC5 || format == TextureFormat_BC7;
+    }
+
+    void TextureCompressor::EncodeBlockRows(TextureFormat format, const uint8_t *pixels, int width, int height,
+                                            int firstBlockRow, int lastBlockRow, uint8_t *out)
+    {
+        int channel = GetSourceChannel(format);
+        int blockBytes = GetBlockBytes(format);
+        int blocksX = (width + 3) / 4;
+
+        uint8_t block[64];
+        for (int by = firstBlockRow; by < lastBlockRow; ++by)
+        {
+            uint8_t *rowOut = out + (size_t)by * blocksX * blockBytes;
+            for (int bx = 0; bx < blocksX; ++bx)
+            {
+                FetchBlock(pixels, width, height, channel, bx, by, block);
+                EncodeBlock(format, block, rowOut + bx * blockBytes);
+            }
+        }
+    }
+
+    bool TextureCompressor::Compress(TextureFormat format, const uint8_t *pixels, int width, int height, bool generateMips,
+                                     CompressedImage &out, bool parallel)
+    {
+        std::vector<CompressedImage::Level> levels;
+        if (generateMips)
+        {
+            MipGenerator::Generate(pixels, width, height, GetSourceChannel(format), MipFilter_Box, false, levels);
+        }
+        else
+        {
+            CompressedImage::Level level;
+            level.width = width;
+            level.height = height;
+            level.data.assign(pixels, pixels + (size_t)width * height * GetSourceChannel(format));
+            levels.push_back(std::move(level));
+        }
+        return CompressLevels(format, levels, out, parallel);
+    }
+
+    bool TextureCompressor::CompressLevels(TextureFormat format, const std::vector<CompressedImage::Level> &levels,
+                                           CompressedImage &out, bool parallel)
+    {
+        if (!CanEncode(format))
+        {
+            GFX_LOG_ERROR_FMT("Texture format %d can not be encoded!", (int)format);
+            return false;
+        }
+
+        out.format = format;
+        out.levels.clear();
+
+        auto pool = ThreadPool::Instance();
+        for (auto &source : levels)
+        {
+            CompressedImage::Level level;
+            level.width = source.width;
+            level.height = source.height;
+            level.data.resize(GetLevelSize(format, source.width, source.height));
+
+            int blockRows = (source.height + 3) / 4;
+            int jobCount = parallel ? std::min(blockRows, (int)pool->GetThreadCount() * 4) : 1;
+            const uint8_t *src = source.data.data();
+            uint8_t *dst = level.data.data();
+            int w = source.width, h = source.height;
+            if (jobCount <= 1)
+            {
+                EncodeBlockRows(format, src, w, h, 0, blockRows, dst);
+            }
+            else
+            {
+                std::vector<std::future<void>> jobs;
+                for (int j = 0; j < jobCount; ++j)
+                {
+                    int first = blockRows * j / jobCount;
+                    int last = blockRows * (j + 1) / jobCount;
+                    jobs.push_back(pool->Async([=]() { EncodeBlockRows(format, src, w, h, first, last, dst); }));
+                }
+                for (auto &job : jobs)
+                    job.wait();
+            }
+            out.levels.push_back(std::move(level));
+        }
+        return true;
+    }
+}
@@ -0,0 +1,58 @@
+/**
+ * @file TextureCompressor.h
+ * @author wangyudong
+ * @brief CPU block compression encoder (BC1, BC4, BC5, BC7) and block format helpers, no GL dependency.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "Constants.h"
+
+namespace Graphics
+{
+    // A full mip chain of one image, level 0 first. Data is tightly packed rows of pixels or 4x4 blocks.
+    struct CompressedImage
+    {
+        struct Level
+        {
+            int width;
+            int height;
+            std::vector<uint8_t> data;
+        };
+
+        TextureFormat format = TextureFormat_R8G8B8A8;
+        std::vector<Level> levels;
+    };
+
+    class TextureCompressor
+    {
+    public:
+        static bool IsCompressed(TextureFormat format);
+        // bytes per 4x4 block, 0 for uncompressed formats
+        static int GetBlockBytes(TextureFormat format);
+        // channel count of uncompressed source data the format is encoded from
+        static int GetSourceChannel(TextureFormat format);
+        static size_t GetLevelSize(TextureFormat format, int width, int height);
+        // ETC2 can be uploaded but not encoded
+        static bool CanEncode(TextureFormat format);
+
+        /**
+         * @brief Encode pixels with GetSourceChannel(format) channels into a block compressed image.
+         * With generateMips the whole chain down to 1x1 is built by box filtering before encoding.
+         * parallel splits block rows over ThreadPool::Instance(), must be false when called from a pool job.
+         */
+        static bool Compress(TextureFormat format, const uint8_t *pixels, int width, int height, bool generateMips,
+                             CompressedImage &out, bool parallel = true);
+        // encode prepared uncompressed levels (e.g. from MipGenerator) one by one
+        static bool CompressLevels(TextureFormat format, const std::vector<CompressedImage::Level> &levels,
+                                   CompressedImage &out, bool parallel = true);
+
+        // single level encoding, rows of blocks [firstBlockRow, lastBlockRow)
+        static void EncodeBlockRows(TextureFormat format, const uint8_t *pixels, int width, int height,
+                                    int firstBlockRow, int lastBlockRow, uint8_t *out);
+    };
+}
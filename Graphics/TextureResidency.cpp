@@ -0,0 +1,178 @@
+#include "TextureResidency.h"
+#include <algorithm>
+#include <vector>
+#include "TextureStreamer.h"
+
+namespace Graphics
+{
+    TextureResidency *TextureResidency::mInstance = nullptr;
+
+    TextureResidency *TextureResidency::Instance()
+    {
+        if (mInstance == nullptr)
+            mInstance = new TextureResidency();
+        return mInstance;
+    }
+
+    void TextureResidency::Register(Texture::SP texture)
+    {
+        mTextures[texture.get()] = texture;
+    }
+
+    void TextureResidency::Unregister(Texture *texture)
+    {
+        mTextures.erase(texture);
+        mRestoring.erase(texture);
+        mRestoreFailed.erase(texture);
+    }
+
+    void TextureResidency::SourceChanged(Texture *texture)
+    {
+        mRestoreFailed.erase(texture);
+    }
+
+    bool TextureResidency::IsEvictable(const Texture &texture) const
+    {
+        return texture.GetType() == TextureType_2D && texture.IsResident() && !texture.GetSourcePath().empty();
+    }
+
+    int TextureResidency::MaxBaseLevel(const Texture &texture) const
+    {
+        int level = 0;
+        while (level + 1 < texture.GetLevelCount() &&
+               std::max(texture.GetWidth() >> level, texture.GetHeight() >> level) > mMinResidentSize)
+            ++level;
+        return level;
+    }
+
+    void TextureResidency::Update()
+    {
+        // restores in flight count as resident already, so they are not over committed
+        mResidentBytes = 0;
+        for (auto &pair : mTextures)
+        {
+            auto tex = pair.first;
+            mResidentBytes += tex->GetResidentBytes();
+            if (mRestoring.count(tex) > 0)
+            {
+                for (int level = 0; level < tex->GetBaseLevel(); ++level)
+                    mResidentBytes += tex->GetLevelBytes(level);
+            }
+        }
+
+        size_t lowWatermark = mBudget == SIZE_MAX ? SIZE_MAX : (size_t)(mBudget * mLowWatermark);
+        if (mResidentBytes > mBudget)
+        {
+            Evict(lowWatermark);
+        }
+        else
+        {
+            mOverBudgetReported = false;
+            Restore(lowWatermark);
+        }
+
+        ++mFrame;
+    }
+
+    void TextureResidency::Evict(size_t target)
+    {
+        std::vector<Texture *> candidates;
+        for (auto &pair : mTextures)
+        {
+            auto tex = pair.first;
+            if (IsEvictable(*tex) && mRestoring.count(tex) == 0 && tex->GetBaseLevel() < MaxBaseLevel(*tex))
+                candidates.push_back(tex);
+        }
+
+        // least recently used first, textures bound this frame are the last resort
+        std::sort(candidates.begin(), candidates.end(), [](Texture *a, Texture *b)
+        {
+            if (a->mLastUsedFrame != b->mLastUsedFrame)
+                return a->mLastUsedFrame < b->mLastUsedFrame;
+            return a->GetResidentBytes() > b->GetResidentBytes();
+        });
+
+        for (auto tex : candidates)
+        {
+            if (mResidentBytes <= target)
+                break;
+
+            int maxBase = MaxBaseLevel(*tex);
+            int base = tex->GetBaseLevel();
+            while (base < maxBase && mResidentBytes > target)
+                mResidentBytes -= tex->GetLevelBytes(base++);
+            tex->ReleaseTopLevels(base);
+        }
+
+        // reported once until memory fits again, not every frame
+        bool overBudget = mResidentBytes > mBudget;
+        if (overBudget && !mOverBudgetReported)
+            GFX_LOG_ERROR_FMT("Texture memory %zu bytes is over budget %zu bytes, nothing more to evict", mResidentBytes, mBudget);
+        mOverBudgetReported = overBudget;
+    }
+
+    void TextureResidency::Restore(size_t target)
+    {
+        auto streamer = TextureStreamer::Instance();
+        for (auto &pair : mTextures)
+        {
+            auto tex = pair.first;
+            if (tex->GetBaseLevel() == 0 || tex->mLastUsedFrame != mFrame || mRestoring.count(tex) > 0)
+                continue;
+            auto failed = mRestoreFailed.find(tex);
+            if (failed != mRestoreFailed.end())
+            {
+                if (failed->second == tex->GetSourcePath())
+                    continue;
+                mRestoreFailed.erase(failed);
+            }
+
+            size_t bytes = 0;
+            for (int level = 0; level < tex->GetBaseLevel(); ++level)
+                bytes += tex->GetLevelBytes(level);
+            if (mResidentBytes + bytes > target)
+                continue;
+
+            auto sp = pair.second.lock();
+            if (sp == nullptr)
+                continue;
+            auto restored = [this](Texture::SP texture, bool success)
+            {
+                mRestoring.erase(texture.get());
+                if (!success)
+                {
+                    // reported once, the texture keeps its lower levels until the source changes
+                    GFX_LOG_ERROR_FMT("Restore of texture %s failed, not retried until the source changes", texture->GetSourcePath().c_str());
+                    mRestoreFailed[texture.get()] = texture->GetSourcePath();
+                }
+            };
+            if (streamer->Restore(sp, restored))
+            {
+                mRestoring.insert(tex);
+                mResidentBytes += bytes;
+            }
+        }
+    }
+
+    void TextureResidency::PrintReport() const
+    {
+        GFX_LOG_OK("Texture residency report:");
+        for (auto &pair : mTextures)
+        {
+            auto tex = pair.first;
+            if (tex->GetBaseLevel() == 0)
+                continue;
+            GFX_LOG_OK_FMT("    texture %u %dx%d: base level %d of %d, last used frame %llu%s", tex->GetHandle(), tex->GetWidth(), tex->GetHeight(),
+                           tex->GetBaseLevel(), tex->GetLevelCount(), (unsigned long long)tex->mLastUsedFrame,
+                           mRestoring.count(tex) > 0 ? ", restoring" : "");
+        }
+        if (mBudget == SIZE_MAX)
+        {
+            GFX_LOG_OK_FMT("    resident %zu bytes, no budget", mResidentBytes);
+        }
+        else
+        {
+            GFX_LOG_OK_FMT("    resident %zu bytes, budget %zu bytes", mResidentBytes, mBudget);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+/**
+ * @file TextureResidency.h
+ * @author wangyudong
+ * @brief Keep estimated texture memory under a budget by releasing top mips of least recently used textures,
+ * and streaming them back when they are used again and the budget allows.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <string>
+#include "Texture.h"
+
+namespace Graphics
+{
+    /**
+     * @brief Every texture allocated by RenderManager is tracked, Material::Use reports the frame it is bound in.
+     * Eviction starts when resident bytes exceed the budget and stops at the low watermark, restores only happen while
+     * the result stays under the low watermark, so a texture does not bounce between evicted and restored.
+     * Only 2d textures with a source path (streamed, loaded from file or ktx2) are evicted.
+     */
+    class TextureResidency
+    {
+    public:
+        static TextureResidency *Instance();
+
+        void Register(Texture::SP texture);
+        void Unregister(Texture *texture);
+        // the source of texture changed (hot reload), a failed restore is tried again
+        void SourceChanged(Texture *texture);
+
+        inline void MarkUsed(const Texture &texture) const { texture.mLastUsedFrame = mFrame; }
+        // a restore of released levels is streaming into texture
+        inline bool IsRestoring(Texture *texture) const { return mRestoring.count(texture) > 0; }
+
+        // called once per frame after draws are submitted (RenderManager::EndFrame does it)
+        void Update();
+
+        // unlimited by default
+        void SetBudget(size_t bytes) { mBudget = bytes; }
+        inline size_t GetBudget() const { return mBudget; }
+        // fraction of budget eviction goes down to
+        void SetLowWatermark(float ratio) { mLowWatermark = ratio; }
+        // levels whose larger side is not above this are never released
+        void SetMinResidentSize(int size) { mMinResidentSize = size; }
+
+        inline size_t GetResidentBytes() const { return mResidentBytes; }
+        inline uint64_t GetFrame() const { return mFrame; }
+        void PrintReport() const;
+
+    private:
+        TextureResidency() {}
+        ~TextureResidency() {}
+
+        bool IsEvictable(const Texture &texture) const;
+        // lowest base level allowed by min resident size
+        int MaxBaseLevel(const Texture &texture) const;
+        void Evict(size_t target);
+        void Restore(size_t target);
+
+        static TextureResidency *mInstance;
+
+        std::unordered_map<Texture *, std::weak_ptr<Texture>> mTextures;
+        std::unordered_set<Texture *> mRestoring;
+        // source path of textures whose restore failed, not retried until the source changes
+        std::unordered_map<Texture *, std::string> mRestoreFailed;
+        size_t mBudget = SIZE_MAX;
+        float mLowWatermark = 0.9f;
+        int mMinResidentSize = 64;
+        size_t mResidentBytes = 0;
+        bool mOverBudgetReported = false;
+        uint64_t mFrame = 1;
+    };
+}
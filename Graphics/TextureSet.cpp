@@ -0,0 +1,175 @@
+#include "TextureSet.h"
+#include <algorithm>
+#include <future>
+#include "stb/stb_image.h"
+#include "RenderManager.h"
+#include "ThreadPool.h"
+#include "MipGenerator.h"
+
+namespace Graphics
+{
+    TextureSet::TextureSet(int width, int height, const std::vector<TextureFormat> &formats, int layerCount)
+        : mWidth(width), mHeight(height), mLayerCount(layerCount), mFormats(formats)
+    {
+        for (auto format : formats)
+        {
+            auto tex = RenderManager::Instance()->AllocTexture(TextureType_2DArray, format, true);
+            tex->SetFilter(TextureFilter_LinearMipmapLinear, TextureFilter_Linear);
+            tex->SetWrapMode(TextureWrapMode_Repeat, TextureWrapMode_Repeat);
+            tex->AllocLayers(width, height, layerCount);
+            mTextures.push_back(tex);
+        }
+    }
+
+    bool TextureSet::Match(int width, int height, const std::vector<TextureFormat> &formats) const
+    {
+        return mWidth == width && mHeight == height && mFormats == formats;
+    }
+
+    int TextureSet::AllocLayer()
+    {
+        if (IsFull())
+            return -1;
+        return mUsedLayers++;
+    }
+
+    bool TextureSet::SetLayer(int layer, size_t map, const CompressedImage &image)
+    {
+        if (map >= mTextures.size() || layer >= mUsedLayers)
+        {
+            GFX_LOG_ERROR_FMT("invalid texture set map %zu layer %d", map, layer);
+            return false;
+        }
+        return mTextures[map]->SetLayerImage(layer, image);
+    }
+
+    TextureSetManager *TextureSetManager::mInstance = nullptr;
+
+    TextureSetManager *TextureSetManager::Instance()
+    {
+        if (mInstance == nullptr)
+            mInstance = new TextureSetManager();
+        return mInstance;
+    }
+
+    namespace
+    {
+        // mip chain in the target format, block compressed formats are encoded serially since this runs in a pool job
+        bool BuildImage(TextureFormat format, const uint8_t *pixels, int width, int height, CompressedImage &image)
+        {
+            if (TextureCompressor::IsCompressed(format))
+                return TextureCompressor::Compress(format, pixels, width, height, true, image, false);
+
+            image.format = format;
+            MipGenerator::Generate(pixels, width, height, TextureCompressor::GetSourceChannel(format), MipFilter_Box, false, image.levels);
+            return true;
+        }
+    }
+
+    bool TextureSetManager::Load(const char *const *paths, const TextureFormat *formats, size_t mapCount, TextureSetSlice &slice)
+    {
+        auto rm = RenderManager::Instance();
+        for (size_t i = 0; i < mapCount; ++i)
+        {
+            if (TextureCompressor::IsCompressed(formats[i]) && (!TextureCompressor::CanEncode(formats[i]) || !rm->IsFormatSupported(formats[i])))
+            {
+                GFX_LOG_ERROR_FMT("Texture format %d can not be used in texture set!", (int)formats[i]);
+                return false;
+            }
+        }
+
+        struct MapImage
+        {
+            int width = 0;
+            int height = 0;
+            CompressedImage image;
+        };
+        std::vector<MapImage> images(mapCount);
+        std::vector<std::future<bool>> jobs;
+        for (size_t i = 0; i < mapCount; ++i)
+        {
+            if (paths[i] == nullptr)
+                continue;
+
+            MapImage *mapImage = &images[i];
+            const char *path = paths[i];
+            TextureFormat format = formats[i];
+            jobs.push_back(ThreadPool::Instance()->Async([mapImage, path, format]()
+            {
+                int nchannel;
+                auto pixels = stbi_load(path, &mapImage->width, &mapImage->height, &nchannel, TextureCompressor::GetSourceChannel(format));
+                if (pixels == nullptr)
+                {
+                    GFX_LOG_ERROR_FMT("load image %s failed!", path);
+                    return false;
+                }
+                bool ok = BuildImage(format, pixels, mapImage->width, mapImage->height, mapImage->image);
+                stbi_image_free(pixels);
+                return ok;
+            }));
+        }
+
+        bool ok = true;
+        for (auto &job : jobs)
+            ok = job.get() && ok;
+        if (!ok || jobs.empty())
+            return false;
+
+        int width = 0, height = 0;
+        for (size_t i = 0; i < mapCount; ++i)
+        {
+            if (paths[i] == nullptr)
+                continue;
+            if (width == 0)
+            {
+                width = images[i].width;
+                height = images[i].height;
+            }
+            else if (images[i].width != width || images[i].height != height)
+            {
+                GFX_LOG_ERROR_FMT("texture set maps must have the same size, %s is %dx%d, expect %dx%d",
+                                  paths[i], images[i].width, images[i].height, width, height);
+                return false;
+            }
+        }
+
+        // missing maps are white
+        for (size_t i = 0; i < mapCount; ++i)
+        {
+            if (paths[i] != nullptr)
+                continue;
+            std::vector<uint8_t> white((size_t)width * height * TextureCompressor::GetSourceChannel(formats[i]), 255);
+            if (!BuildImage(formats[i], white.data(), width, height, images[i].image))
+                return false;
+        }
+
+        std::vector<TextureFormat> formatList(formats, formats + mapCount);
+        TextureSet::SP set;
+        for (auto &s : mSets)
+        {
+            if (!s->IsFull() && s->Match(width, height, formatList))
+            {
+                set = s;
+                break;
+            }
+        }
+
+        if (set == nullptr)
+        {
+            int layerCount = std::max(1, std::min(mLayersPerSet, rm->GetSystemInfo().maxArrayTextureLayers));
+            set = std::make_shared<TextureSet>(width, height, formatList, layerCount);
+            mSets.push_back(set);
+        }
+
+        int layer = set->AllocLayer();
+        for (size_t i = 0; i < mapCount; ++i)
+        {
+            if (!set->SetLayer(layer, i, images[i].image))
+                return false;
+        }
+
+        slice.set = set;
+        slice.layer = layer;
+        return true;
+    }
+}
@@ -0,0 +1,86 @@
+/**
+ * @file TextureSet.h
+ * @author wangyudong
+ * @brief Pack material maps of the same size and format into 2d texture array layers, so materials differ only by a layer index.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "Texture.h"
+
+namespace Graphics
+{
+    /**
+     * @brief One 2d array texture per material map (e.g. albedo, metallic, roughness, ao, normal), all maps of a
+     * material live in the same layer of every array. Layer count is fixed when created.
+     */
+    class TextureSet
+    {
+    public:
+        typedef std::shared_ptr<TextureSet> SP;
+
+        TextureSet(int width, int height, const std::vector<TextureFormat> &formats, int layerCount);
+
+        bool Match(int width, int height, const std::vector<TextureFormat> &formats) const;
+        inline bool IsFull() const { return mUsedLayers >= mLayerCount; }
+        // -1 if full
+        int AllocLayer();
+        // image is in the format of the map, with full mip chain
+        bool SetLayer(int layer, size_t map, const CompressedImage &image);
+
+        inline size_t GetMapCount() const { return mTextures.size(); }
+        inline Texture::SP GetTexture(size_t map) const { return mTextures[map]; }
+        inline TextureFormat GetFormat(size_t map) const { return mFormats[map]; }
+        inline int GetWidth() const { return mWidth; }
+        inline int GetHeight() const { return mHeight; }
+        inline int GetLayerCount() const { return mLayerCount; }
+        inline int GetUsedLayers() const { return mUsedLayers; }
+
+    private:
+        int mWidth;
+        int mHeight;
+        int mLayerCount;
+        int mUsedLayers = 0;
+        std::vector<TextureFormat> mFormats;
+        std::vector<Texture::SP> mTextures;
+    };
+
+    // where a material's maps are, layer goes to per-draw data
+    struct TextureSetSlice
+    {
+        TextureSet::SP set;
+        int layer = -1;
+
+        inline bool IsValid() const { return set != nullptr && layer >= 0; }
+    };
+
+    class TextureSetManager
+    {
+    public:
+        static TextureSetManager *Instance();
+
+        /**
+         * @brief Load maps of one material into a layer of a matching set, a new set is created when none has free layers.
+         * Images are decoded (and block compressed) on ThreadPool in parallel, this call blocks until they are uploaded.
+         * All maps must have the same size, nullptr path fills the map with white.
+         */
+        bool Load(const char *const *paths, const TextureFormat *formats, size_t mapCount, TextureSetSlice &slice);
+
+        // layers of sets created later, clamped to GL_MAX_ARRAY_TEXTURE_LAYERS
+        void SetLayersPerSet(int layerCount) { mLayersPerSet = layerCount; }
+        inline const std::vector<TextureSet::SP> &GetSets() const { return mSets; }
+        void Clear() { mSets.clear(); }
+
+    private:
+        TextureSetManager() {}
+        ~TextureSetManager() {}
+
+        static TextureSetManager *mInstance;
+        int mLayersPerSet = 16;
+        std::vector<TextureSet::SP> mSets;
+    };
+}
@@ -0,0 +1,384 @@
+#include "TextureStreamer.h"
+#include <algorithm>
+#include <thread>
+#include "string.h"
+#include "GL/glew.h"
+#include "InternalFunctions.h"
+#include "stb/stb_image.h"
+#include "RenderManager.h"
+#include "ThreadPool.h"
+#include "TextureCompressor.h"
+#include "MipGenerator.h"
+#include "KTX2.h"
+#include "HotReload.h"
+
+namespace Graphics
+{
+    TextureStreamer *TextureStreamer::mInstance = nullptr;
+
+    TextureStreamer *TextureStreamer::Instance()
+    {
+        if (mInstance == nullptr)
+            mInstance = new TextureStreamer();
+        return mInstance;
+    }
+
+    std::shared_future<bool> TextureStreamer::Load(Texture::SP texture, const std::string &path, Callback callback)
+    {
+        auto request = std::make_shared<Request>();
+        request->texture = texture;
+        request->path = path;
+        request->callback = callback;
+        auto future = request->promise.get_future().share();
+
+        uint32_t nativeType, nativeFormat;
+        GetNativeTypeAndFormat(texture->mFormat, &nativeType, &nativeFormat, &request->channel);
+        request->compressedFormat = TextureCompressor::IsCompressed(texture->mFormat);
+        texture->mStatus = TextureStatus_Loading;
+        texture->mSourcePath = path;
+        HotReload::Instance()->AddTexture(texture, path);
+
+        if (request->compressedFormat && (!TextureCompressor::CanEncode(texture->mFormat) || !RenderManager::Instance()->IsFormatSupported(texture->mFormat)))
+        {
+            GFX_LOG_ERROR_FMT("Texture format %d can not be streamed from %s", (int)texture->mFormat, path.c_str());
+            request->channel = 0;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++mPendingCount;
+            // unsupported format fails on next update without decoding
+            if (request->channel == 0)
+            {
+                request->failed = true;
+                mDecoded.push_back(request);
+                return future;
+            }
+        }
+
+        ThreadPool::Instance()->Submit([this, request]()
+        {
+            int nchannel;
+            request->pixels = stbi_load(request->path.c_str(), &request->width, &request->height, &nchannel, request->channel);
+            if (request->pixels == nullptr)
+            {
+                GFX_LOG_ERROR_FMT("load image %s failed!", request->path.c_str());
+                request->failed = true;
+            }
+            else if (request->compressedFormat)
+            {
+                // already on a pool thread, encode serially
+                request->failed = !TextureCompressor::Compress(request->texture->mFormat, request->pixels, request->width, request->height,
+                                                               request->texture->mGenerateMipmap, request->compressed, false);
+            }
+
+            std::lock_guard<std::mutex> lock(mMutex);
+            mDecoded.push_back(request);
+        });
+        return future;
+    }
+
+    bool TextureStreamer::Restore(Texture::SP texture, Callback callback)
+    {
+        if (texture->mBaseLevel == 0 || texture->mSourcePath.empty() || !texture->IsResident())
+            return false;
+
+        auto request = std::make_shared<Request>();
+        request->texture = texture;
+        request->path = texture->mSourcePath;
+        request->callback = callback;
+        request->restore = true;
+        request->restoreLevels = texture->mBaseLevel;
+        request->compressedFormat = TextureCompressor::IsCompressed(texture->mFormat);
+        uint32_t nativeType, nativeFormat;
+        GetNativeTypeAndFormat(texture->mFormat, &nativeType, &nativeFormat, &request->channel);
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            ++mPendingCount;
+        }
+
+        ThreadPool::Instance()->Submit([this, request]()
+        {
+            DecodeRestore(*request);
+            std::lock_guard<std::mutex> lock(mMutex);
+            mDecoded.push_back(request);
+        });
+        return true;
+    }
+
+    void TextureStreamer::DecodeRestore(Request &request)
+    {
+        auto tex = request.texture;
+        auto &levels = request.compressed.levels;
+        request.compressed.format = tex->mFormat;
+
+        // cooked files already hold the chain
+        auto &path = request.path;
+        if (path.size() > 5 && path.compare(path.size() - 5, 5, ".ktx2") == 0)
+        {
+            KTX2File file;
+            if (!file.Open(path.c_str()) || file.GetFormat() != tex->mFormat || file.GetWidth() != tex->mWidth ||
+                file.GetHeight() != tex->mHeight || (int)file.GetLevelCount() < request.restoreLevels)
+            {
+                request.failed = true;
+                return;
+            }
+
+            levels.resize(request.restoreLevels);
+            for (int i = 0; i < request.restoreLevels; ++i)
+            {
+                auto &level = file.GetLevel(i);
+                levels[i].width = level.width;
+                levels[i].height = level.height;
+                levels[i].data.assign(level.data, level.data + level.size);
+            }
+            return;
+        }
+
+        int nchannel;
+        request.pixels = stbi_load(path.c_str(), &request.width, &request.height, &nchannel, request.channel);
+        if (request.pixels == nullptr || request.width != tex->mWidth || request.height != tex->mHeight)
+        {
+            GFX_LOG_ERROR_FMT("restore %s failed!", path.c_str());
+            request.failed = true;
+            return;
+        }
+
+        // levels are rebuilt on cpu, already on a pool thread so encoding is serial
+        if (request.compressedFormat)
+            request.failed = !TextureCompressor::Compress(tex->mFormat, request.pixels, request.width, request.height, true, request.compressed, false);
+        else
+            MipGenerator::Generate(request.pixels, request.width, request.height, request.channel, MipFilter_Box, false, levels);
+
+        if ((int)levels.size() < request.restoreLevels)
+            request.failed = true;
+        else
+            levels.resize(request.restoreLevels);
+        stbi_image_free(request.pixels);
+        request.pixels = nullptr;
+    }
+
+    void TextureStreamer::Update()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            while (!mDecoded.empty())
+            {
+                mUploads.push_back(mDecoded.front());
+                mDecoded.pop_front();
+            }
+        }
+
+        if (mUploads.empty())
+            return;
+
+        // plan row slices of this frame, textures are uploaded top to bottom in arrival order
+        mSlices.clear();
+        size_t totalBytes = 0;
+        for (auto &request : mUploads)
+        {
+            if (request->failed)
+                continue;
+            if (totalBytes >= mUploadBudget)
+                break;
+
+            auto tex = request->texture;
+            if (request->UploadByLevel())
+            {
+                // levels are allocated and filled by one call, at least one level per frame
+                auto &levels = request->compressed.levels;
+                while (request->uploadedLevels < levels.size())
+                {
+                    size_t size = levels[request->uploadedLevels].data.size();
+                    if (totalBytes > 0 && totalBytes + size > mUploadBudget)
+                        break;
+                    mSlices.push_back({request.get(), 0, 0, (int)request->uploadedLevels, totalBytes});
+                    request->uploadedLevels++;
+                    totalBytes += size;
+                }
+                continue;
+            }
+
+            uint32_t nativeType, nativeFormat;
+            int channel;
+            GetNativeTypeAndFormat(tex->mFormat, &nativeType, &nativeFormat, &channel);
+            if (!request->storageAllocated)
+            {
+                // unpack buffer is not bound here, storage is allocated without data
+                glBindTexture(GL_TEXTURE_2D, tex->mHandle);
+                glTexImage2D(GL_TEXTURE_2D, 0, nativeFormat, request->width, request->height, 0, nativeFormat, nativeType, nullptr);
+                tex->mWidth = request->width;
+                tex->mHeight = request->height;
+                request->storageAllocated = true;
+            }
+
+            size_t rowBytes = (size_t)request->width * request->channel;
+            size_t affordableRows = (mUploadBudget - totalBytes) / rowBytes;
+            if (affordableRows == 0)
+            {
+                if (!mSlices.empty())
+                    break;
+                affordableRows = 1;
+            }
+
+            int rows = (int)std::min((size_t)(request->height - request->uploadedRows), affordableRows);
+            mSlices.push_back({request.get(), request->uploadedRows, rows, 0, totalBytes});
+            request->uploadedRows += rows;
+            totalBytes += rows * rowBytes;
+        }
+
+        if (!mSlices.empty())
+        {
+            if (mUnpackBuffer == nullptr)
+                mUnpackBuffer = RenderManager::Instance()->AllocBuffer(BufferType_PixelUnpackBuffer);
+
+            // orphan storage of last frame, GPU may still be reading from it
+            mUnpackBuffer->BufferData(nullptr, totalBytes, BufferUsage_StreamDraw);
+            char *dst = (char *)mUnpackBuffer->MapRange(0, totalBytes, BufferAccessFlag_Write | BufferAccessFlag_InvalidateRange);
+            if (dst != nullptr)
+            {
+                for (auto &slice : mSlices)
+                {
+                    if (slice.request->UploadByLevel())
+                    {
+                        auto &level = slice.request->compressed.levels[slice.level];
+                        memcpy(dst + slice.offset, level.data.data(), level.data.size());
+                        continue;
+                    }
+
+                    size_t rowBytes = (size_t)slice.request->width * slice.request->channel;
+                    memcpy(dst + slice.offset, slice.request->pixels + slice.firstRow * rowBytes, slice.rowCount * rowBytes);
+                }
+                mUnpackBuffer->Unmap();
+
+                mUnpackBuffer->Bind();
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                for (auto &slice : mSlices)
+                {
+                    uint32_t nativeType, nativeFormat;
+                    int channel;
+                    GetNativeTypeAndFormat(slice.request->texture->mFormat, &nativeType, &nativeFormat, &channel);
+                    glBindTexture(GL_TEXTURE_2D, slice.request->texture->mHandle);
+                    if (slice.request->UploadByLevel())
+                    {
+                        auto &level = slice.request->compressed.levels[slice.level];
+                        if (slice.request->compressedFormat)
+                            glCompressedTexImage2D(GL_TEXTURE_2D, slice.level, nativeFormat, level.width, level.height, 0,
+                                                   (GLsizei)level.data.size(), (void *)slice.offset);
+                        else
+                            glTexImage2D(GL_TEXTURE_2D, slice.level, nativeFormat, level.width, level.height, 0,
+                                         nativeFormat, nativeType, (void *)slice.offset);
+                        continue;
+                    }
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, slice.firstRow, slice.request->width, slice.rowCount,
+                                    nativeFormat, nativeType, (void *)slice.offset);
+                }
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                glCheckError();
+            }
+        }
+
+        for (auto iter = mUploads.begin(); iter != mUploads.end();)
+        {
+            auto request = *iter;
+            if (request->failed)
+            {
+                Finish(request, false);
+                iter = mUploads.erase(iter);
+            }
+            else if (IsUploaded(*request))
+            {
+                Finish(request, true);
+                iter = mUploads.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
+    }
+
+    bool TextureStreamer::IsUploaded(const Request &request) const
+    {
+        if (request.UploadByLevel())
+            return request.uploadedLevels == request.compressed.levels.size();
+        return request.uploadedRows == request.height;
+    }
+
+    void TextureStreamer::Finish(std::shared_ptr<Request> request, bool success)
+    {
+        auto tex = request->texture;
+        if (request->restore)
+        {
+            // a failed restore leaves the texture usable at its current base level
+            if (success)
+                tex->SetBaseLevel(0);
+            CompressedImage().levels.swap(request->compressed.levels);
+        }
+        else if (success)
+        {
+            tex->SetBaseLevel(0);
+            glBindTexture(GL_TEXTURE_2D, tex->mHandle);
+            if (request->compressedFormat)
+            {
+                auto &levels = request->compressed.levels;
+                tex->mWidth = levels[0].width;
+                tex->mHeight = levels[0].height;
+                tex->mLevelCount = (int)levels.size();
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+                CompressedImage().levels.swap(levels);
+            }
+            else
+            {
+                if (tex->mGenerateMipmap)
+                    glGenerateMipmap(GL_TEXTURE_2D);
+                tex->mLevelCount = tex->mGenerateMipmap ? tex->FullLevelCount() : 1;
+            }
+
+            if (tex->mRetentionPolicy == RetentionPolicy_KeepForReadback)
+            {
+                free(tex->mData);
+                tex->mDataSize = (size_t)request->width * request->height * request->channel;
+                tex->mData = malloc(tex->mDataSize);
+                memcpy(tex->mData, request->pixels, tex->mDataSize);
+            }
+            tex->mStatus = TextureStatus_Resident;
+        }
+        else
+        {
+            tex->mStatus = TextureStatus_Failed;
+        }
+
+        stbi_image_free(request->pixels);
+        request->pixels = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            --mPendingCount;
+        }
+
+        request->promise.set_value(success);
+        if (request->callback)
+            request->callback(tex, success);
+    }
+
+    void TextureStreamer::Flush()
+    {
+        size_t budget = mUploadBudget;
+        mUploadBudget = SIZE_MAX;
+        while (GetPendingCount() > 0)
+        {
+            Update();
+            std::this_thread::yield();
+        }
+        mUploadBudget = budget;
+    }
+
+    size_t TextureStreamer::GetPendingCount()
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        return mPendingCount;
+    }
+}
@@ -0,0 +1,115 @@
+/**
+ * @file TextureStreamer.h
+ * @author wangyudong
+ * @brief Load textures in background: images are decoded on worker threads and uploaded through pixel unpack buffers
+ * in small slices every frame, so neither decoding nor uploading blocks the render thread.
+ * Block compressed formats are also encoded on the worker, and uploaded one mip level per slice.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Buffer.h"
+#include "Texture.h"
+
+namespace Graphics
+{
+    /**
+     * @brief A texture passed to Load() is in TextureStatus_Loading until its last row is uploaded, materials bind
+     * the white placeholder meanwhile and the magenta one if loading fails.
+     * Update() must be called once per frame on render thread (RenderManager::EndFrame does it).
+     */
+    class TextureStreamer
+    {
+    public:
+        // called on render thread once the texture is resident or failed
+        typedef std::function<void(Texture::SP texture, bool success)> Callback;
+
+        static TextureStreamer *Instance();
+
+        // Decode is forced to the channel count of texture format. The future becomes true when resident, false on failure.
+        std::shared_future<bool> Load(Texture::SP texture, const std::string &path, Callback callback = nullptr);
+
+        /**
+         * @brief Stream back levels released by Texture::ReleaseTopLevels from the texture source path.
+         * The texture stays bound at its current base level meanwhile, base level drops to 0 once all are uploaded.
+         * Returns false if there is nothing to restore or no source to restore from.
+         */
+        bool Restore(Texture::SP texture, Callback callback = nullptr);
+
+        // upload decoded images within the per-frame budget
+        void Update();
+        // block until every pending texture is resident or failed, for loading screens and tools
+        void Flush();
+
+        // at least one row is uploaded per frame whatever the budget is
+        void SetUploadBudget(size_t bytesPerFrame) { mUploadBudget = bytesPerFrame; }
+        inline size_t GetUploadBudget() const { return mUploadBudget; }
+        size_t GetPendingCount();
+
+    private:
+        TextureStreamer() {}
+        ~TextureStreamer() {}
+
+        struct Request
+        {
+            Texture::SP texture;
+            std::string path;
+            Callback callback;
+            std::promise<bool> promise;
+
+            int channel = 0;
+            int width = 0;
+            int height = 0;
+            unsigned char *pixels = nullptr;
+            bool storageAllocated = false;
+            int uploadedRows = 0;
+
+            bool compressedFormat = false;
+            CompressedImage compressed;
+            size_t uploadedLevels = 0;
+
+            // restores upload released levels of a resident texture, whatever the format is
+            bool restore = false;
+            int restoreLevels = 0;
+
+            bool failed = false;
+
+            inline bool UploadByLevel() const { return compressedFormat || restore; }
+        };
+
+        // rows of an uncompressed level 0, or a whole level of compressed and restored images
+        struct Slice
+        {
+            Request *request;
+            int firstRow;
+            int rowCount;
+            int level;
+            size_t offset;
+        };
+
+        bool IsUploaded(const Request &request) const;
+        static void DecodeRestore(Request &request);
+
+        void Finish(std::shared_ptr<Request> request, bool success);
+
+        static TextureStreamer *mInstance;
+
+        std::mutex mMutex;
+        size_t mPendingCount = 0;
+        std::deque<std::shared_ptr<Request>> mDecoded;  // filled by workers
+        std::deque<std::shared_ptr<Request>> mUploads;  // render thread only
+        std::vector<Slice> mSlices;
+
+        Buffer::SP mUnpackBuffer;
+        size_t mUploadBudget = 4 * 1024 * 1024;
+    };
+}
@@ -0,0 +1,82 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+namespace Graphics
+{
+    ThreadPool *ThreadPool::mInstance = nullptr;
+
+    ThreadPool *ThreadPool::Instance()
+    {
+        if (mInstance == nullptr)
+            mInstance = new ThreadPool();
+        return mInstance;
+    }
+
+    ThreadPool::ThreadPool(size_t threadCount)
+    {
+        if (threadCount == 0)
+        {
+            unsigned int cores = std::thread::hardware_concurrency();
+            threadCount = std::max(1u, cores > 1 ? cores - 1 : 1u);
+        }
+
+        for (size_t i = 0; i < threadCount; ++i)
+            mWorkers.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mJobCondition.notify_all();
+
+        for (auto &worker : mWorkers)
+            worker.join();
+    }
+
+    void ThreadPool::Submit(Job job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mJobs.push_back(std::move(job));
+        }
+        mJobCondition.notify_one();
+    }
+
+    void ThreadPool::WaitIdle()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mIdleCondition.wait(lock, [this]() { return mJobs.empty() && mRunningJobs == 0; });
+    }
+
+    void ThreadPool::WorkerLoop()
+    {
+        while (true)
+        {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mJobCondition.wait(lock, [this]() { return mStopping || !mJobs.empty(); });
+
+                // remaining jobs are dropped on shutdown
+                if (mStopping)
+                    return;
+
+                job = std::move(mJobs.front());
+                mJobs.pop_front();
+                ++mRunningJobs;
+            }
+
+            job();
+
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                --mRunningJobs;
+                if (mJobs.empty() && mRunningJobs == 0)
+                    mIdleCondition.notify_all();
+            }
+        }
+    }
+}
@@ -0,0 +1,65 @@
+/**
+ * @file ThreadPool.h
+ * @author wangyudong
+ * @brief Fixed size worker threads for cpu jobs (image decoding, encoding, batch transforms ...), no GL calls are allowed in jobs.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+namespace Graphics
+{
+    class ThreadPool
+    {
+    public:
+        typedef std::function<void()> Job;
+
+        // 0 means hardware concurrency - 1, leaving one core for render thread, at least 1 worker.
+        explicit ThreadPool(size_t threadCount = 0);
+        ~ThreadPool();
+
+        void Submit(Job job);
+
+        // job with a result, the future is ready when the job has run
+        template <typename F>
+        auto Async(F func) -> std::future<decltype(func())>
+        {
+            typedef decltype(func()) R;
+            auto task = std::make_shared<std::packaged_task<R()>>(std::move(func));
+            auto future = task->get_future();
+            Submit([task]() { (*task)(); });
+            return future;
+        }
+
+        // block until queue is empty and no job is running
+        void WaitIdle();
+
+        inline size_t GetThreadCount() const { return mWorkers.size(); }
+
+        // shared pool used by graphics modules
+        static ThreadPool *Instance();
+
+    private:
+        void WorkerLoop();
+
+        std::vector<std::thread> mWorkers;
+        std::deque<Job> mJobs;
+        std::mutex mMutex;
+        std::condition_variable mJobCondition;
+        std::condition_variable mIdleCondition;
+        size_t mRunningJobs = 0;
+        bool mStopping = false;
+
+        static ThreadPool *mInstance;
+    };
+}
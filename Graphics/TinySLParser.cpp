@@ -0,0 +1,673 @@
+#include "TinySLParser.h"
+#include <stdio.h>
+#include <string.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include "Constants.h"
+
+namespace Graphics
+{
+    bool TinySLParser::ReadFile(const std::string &path, std::string &content)
+    {
+        FILE *file = fopen(path.c_str(), "rb");
+        if (file == nullptr)
+            return false;
+
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        content.resize(size > 0 ? (size_t)size : 0);
+        size_t read = content.empty() ? 0 : fread(&content[0], 1, content.size(), file);
+        fclose(file);
+        content.resize(read);
+        return true;
+    }
+
+    static void GetParentDirectoryFromFilePath(const std::string &path, std::string &outDir)
+    {
+        auto idx = path.find_last_of('/');
+        if (idx != std::string::npos)
+        {
+            outDir = path.substr(0, idx + 1);
+        }
+    }
+
+    static const char *sectionEnum2String[] = { "Vertex", "Geometry", "TesselationControl", "TesselationEval", "Fragment", "Share", "States", "Keywords", "Compute" };
+    enum SLSectionName
+    {
+        SLSection_Vertex = 0,
+        SLSection_Geometry,
+        SLSection_TesselationControl,
+        SLSection_TesselationEval,
+        SLSection_Fragment,
+        SLSection_Share,
+        SLSection_States,
+        SLSection_Keywords,
+        SLSection_Compute,
+        SLSection_Max,
+    };
+
+    static const std::unordered_map<std::string, SLSectionName> sectionName2Enum = {
+        {sectionEnum2String[0], SLSection_Vertex},
+        {sectionEnum2String[1], SLSection_Geometry},
+        {sectionEnum2String[2], SLSection_TesselationControl},
+        {sectionEnum2String[3], SLSection_TesselationEval},
+        {sectionEnum2String[4], SLSection_Fragment},
+        {sectionEnum2String[5], SLSection_Share},
+        {sectionEnum2String[6], SLSection_States},
+        {sectionEnum2String[7], SLSection_Keywords},
+        {sectionEnum2String[8], SLSection_Compute},
+    };
+
+    enum TokenType
+    {
+        TokenType_None,
+        TokenType_Include,
+        TokenType_Quote,
+        TokenType_LeftBrace,
+        TokenType_RightBrace,
+        TokenType_Name,
+    };
+
+    class TinyLexer
+    {
+    public:
+        TinyLexer(const char *src) { mSrc = src; }
+
+        const char *CurrentPtr() { return mSrc; }
+
+        TokenType GetNextToken(const char **tokenStart)
+        {
+            while(*mSrc != '\0')
+            {
+                char c = *mSrc;
+                // skip white space
+                if (c == '\"')
+                {
+                    *tokenStart = mSrc;
+                    mSrc += 1;
+                    return TokenType_Quote;
+                }
+                else if (c == '{')
+                {
+                    *tokenStart = mSrc;
+                    mSrc += 1;
+                    return TokenType_LeftBrace;
+                }
+                else if (c == '}')
+                {
+                    *tokenStart = mSrc;
+                    mSrc += 1;
+                    return TokenType_RightBrace;
+                }
+                else if (c == '#')
+                {
+                    if (strncmp(mSrc, "#include", 8) == 0)
+                    {
+                        mSrc += 8;
+                        // get file path enclosed within quote
+                        while (*mSrc != '\"')
+                        {
+                            if (*mSrc == '\0' || *mSrc == '\n')
+                            {
+                                return TokenType_None;
+                            }
+                            ++mSrc;
+                        }
+                        
+                        *tokenStart = ++mSrc;
+
+                        while (*mSrc != '\"')
+                        {
+                            if (*mSrc == '\0' || *mSrc == '\n')
+                            {
+                                return TokenType_None;
+                            }
+                            ++mSrc;
+                        }
+                        return TokenType_Include;
+                    }
+                    else
+                        ++mSrc;
+                }
+                else if (isalpha(c) || isdigit(c) || c == '_')
+                {
+                    *tokenStart = mSrc;
+                    while (isalpha(*mSrc) || isdigit(*mSrc) || *mSrc == '_')
+                    {
+                        ++mSrc;
+                    }
+                    return TokenType_Name;
+                }
+                else
+                {
+                    ++mSrc;
+                }
+            }
+
+            *tokenStart = nullptr;
+            return TokenType_None;
+        }
+
+    private:
+        const char *mSrc;
+    };
+
+    struct TinySLContent
+    {
+        std::string sectionCode[SLSection_Max];
+
+        void PrintContent()
+        {
+            for (int sectionId = 0; sectionId < SLSection_Max; ++sectionId)
+            {
+                GFX_LOG_OK_FMT("Section %s:\n%s", sectionEnum2String[sectionId], sectionCode[sectionId].c_str());
+            }
+        }
+    };
+
+    struct ParseContex
+    {
+        const char *tokenStart;
+        TokenType curToken;
+        TokenType prevToken = TokenType_None;
+        int prevLeftBraceCount = 0;
+        const char *sectionStart = nullptr;
+        std::string prevName;
+        std::string currentSectionName;
+    };
+
+    static bool ParseTinySL(const std::string &filePath, std::unordered_set<std::string> &includedFiles,
+                            std::vector<std::string> &sourceFiles, std::vector<TinySLContent> &allSLContents)
+    {
+        std::string source;
+        if (!TinySLParser::ReadFile(filePath, source) || source.empty())
+        {
+            GFX_LOG_ERROR_FMT("Can't open file: \"%s\"", filePath.c_str());
+            return false;
+        }
+        includedFiles.insert(filePath);
+        sourceFiles.push_back(filePath);
+
+        std::string currentDir;
+        GetParentDirectoryFromFilePath(filePath, currentDir);
+
+        TinyLexer lexer(source.c_str());
+        ParseContex ctx;
+        TinySLContent currentContent;
+
+        while ((ctx.curToken = lexer.GetNextToken(&ctx.tokenStart)) != TokenType_None)
+        {
+            switch (ctx.curToken)
+            {
+            case TokenType_Include:
+                {
+                    // every file is included once, a second include of it is skipped
+                    std::string includeFile = currentDir + std::string(ctx.tokenStart, lexer.CurrentPtr());
+                    if (includedFiles.find(includeFile) == includedFiles.end())
+                    {
+                        if (!ParseTinySL(includeFile, includedFiles, sourceFiles, allSLContents))
+                            return false;
+                    }
+                }
+                break;
+            case TokenType_Quote:
+                break;
+            case TokenType_LeftBrace:
+                if (ctx.prevLeftBraceCount == 0 && ctx.prevToken == TokenType_Name)
+                {
+                    // new section start
+                    ctx.sectionStart = lexer.CurrentPtr();
+                    ctx.currentSectionName = ctx.prevName;
+                    // GFX_LOG_OK_FMT("begin section: %s", ctx.currentSectionName.c_str());
+                }
+                ++ctx.prevLeftBraceCount;
+                break;
+            case TokenType_RightBrace:
+                if (ctx.prevLeftBraceCount == 1 && ctx.sectionStart != nullptr)
+                {
+                    // end of section
+                    auto iter = sectionName2Enum.find(ctx.currentSectionName);
+                    if (iter == sectionName2Enum.end())
+                    {
+                        GFX_LOG_ERROR_FMT("Unrecognized section [%s] in:%s", ctx.currentSectionName.c_str(), filePath.c_str());
+                    }
+                    else
+                    {
+                        currentContent.sectionCode[iter->second].assign(ctx.sectionStart, ctx.tokenStart);
+                        // GFX_LOG_OK_FMT("section content: %s", currentContent.sectionCode[iter->second].c_str());
+                    }
+                    
+                    ctx.sectionStart = nullptr;
+                    ctx.currentSectionName = "";
+                }
+                else if (ctx.prevLeftBraceCount == 0)
+                {
+                    GFX_LOG_ERROR_FMT("Shader brace not match in:%s", filePath.c_str());
+                    return false;
+                }
+                --ctx.prevLeftBraceCount;
+                break;
+            case TokenType_Name:
+                ctx.prevName.assign(ctx.tokenStart, lexer.CurrentPtr());
+                break;
+            }
+
+            ctx.prevToken = ctx.curToken;
+        }
+
+        allSLContents.push_back(currentContent);
+        return true;
+    }
+
+#define NEXT_NAME(name)                                                \
+    {                                                                  \
+        auto type = lexer.GetNextToken(&tokenStart);                   \
+        name.assign(tokenStart, lexer.CurrentPtr());                   \
+        if (type != TokenType_Name)                                    \
+        {                                                              \
+            GFX_LOG_ERROR_FMT("Invalid states name: %s", name.c_str()); \
+            return;                                                    \
+        }                                                              \
+    }
+
+#define ON_OFF_OPTION(name, setOption)                               \
+    if (name.compare("on") == 0)                                     \
+    {                                                                \
+        setOption = true;                                            \
+    }                                                                \
+    else if (name.compare("off") == 0)                               \
+    {                                                                \
+        setOption = false;                                           \
+    }                                                                \
+    else                                                             \
+    {                                                                \
+        GFX_LOG_ERROR_FMT("Invalid states option: %s", name.c_str()); \
+        return;                                                      \
+    }
+
+#define ENUM_OPTIONS(map, name, setOption)                               \
+    {                                                                    \
+        auto iter = map.find(name);                                      \
+        if (iter != map.end())                                           \
+        {                                                                \
+            setOption = iter->second;                                    \
+        }                                                                \
+        else                                                             \
+        {                                                                \
+            GFX_LOG_ERROR_FMT("Invalid states option: %s", name.c_str()); \
+            return;                                                      \
+        }                                                                \
+    }
+
+#define NUM_OPTIONS(name, setOption)                                         \
+    {                                                                        \
+        char *end = nullptr;                                                 \
+        setOption = strtol(name.c_str(), &end, 16);                          \
+        if (end == nullptr)                                                  \
+        {                                                                    \
+            setOption = strtol(name.c_str(), &end, 10);                      \
+            if (end == nullptr)                                              \
+            {                                                                \
+                GFX_LOG_ERROR_FMT("Invalid states option: %s", name.c_str()); \
+                return;                                                      \
+            }                                                                \
+        }                                                                    \
+    }
+
+    enum StateCommand
+    {
+        StateCommand_ZTest = 0,
+        StateCommand_ZWrite,
+        StateCommand_ZTestFunc,
+
+        StateCommand_StencilTest,
+        StateCommand_StencilMask,
+        StateCommand_StencilFunc,
+        StateCommand_StencilOp,
+
+        StateCommand_Blend,
+        StateCommand_BlendEquation,
+        StateCommand_BlendFunc,
+
+        StateCommand_Cull,
+        StateCommand_CullFace
+    };
+
+    const std::unordered_map<std::string, StateCommand> stateCommands = {
+        {"ZTest", StateCommand_ZTest},
+        {"ZWrite", StateCommand_ZWrite},
+        {"ZTestFunc", StateCommand_ZTestFunc},
+
+        {"Stencil", StateCommand_StencilTest},
+        {"StencilMask", StateCommand_StencilMask},
+        {"StencilFunc", StateCommand_StencilFunc},
+        {"StencilOp", StateCommand_StencilOp},
+
+        {"Blend", StateCommand_Blend},
+        {"BlendEquation", StateCommand_BlendEquation},
+        {"BlendFunc", StateCommand_BlendFunc},
+
+        {"Cull", StateCommand_Cull},
+        {"CullFace", StateCommand_CullFace},
+    };
+
+    const std::unordered_map<std::string, DepthStencilFunc> depthStencilFuncOptions = {
+        {"always", DepthStencilFunc_Always},
+        {"never", DepthStencilFunc_Never},
+        {"less", DepthStencilFunc_Less},
+        {"greater", DepthStencilFunc_Greater},
+        {"equal", DepthStencilFunc_Equal},
+        {"notEqual", DepthStencilFunc_NotEqual},
+        {"lEqual", DepthStencilFunc_LEqual},
+        {"gEqual", DepthStencilFunc_GEqual},
+    };
+
+    const std::unordered_map<std::string, StencilOp> stencilOpOptions = {
+        {"keep", StencilOp_Keep},
+        {"zero", StencilOp_Zero},
+        {"replace", StencilOp_Replace},
+        {"increase", StencilOp_Increase},
+        {"increaseWrap", StencilOp_IncreaseWrap},
+        {"decrease", StencilOp_Decrease},
+        {"decreaseWrap", StencilOp_DecreaseWrap},
+        {"invert", StencilOp_Invert},
+    };
+
+    const std::unordered_map<std::string, BlendFunc> blendFuncOptions = {
+        {"zero", BlendFunc_Zero},
+        {"one", BlendFunc_One},
+        {"srcColor", BlendFunc_SrcColor},
+        {"oneMinusSrcColor", BlendFunc_OneMinusSrcColor},
+        {"dstColor", BlendFunc_DestColor},
+        {"oneMinusDstColor", BlendFunc_OneMinusDestColor},
+        {"srcAlpha", BlendFunc_SrcAlpha},
+        {"oneMinusSrcAlpha", BlendFunc_OneMinusSrcAlpha},
+        {"dstAlpha", BlendFunc_DestAlpha},
+        {"oneMinusDstAlpha", BlendFunc_OneMinusDestAlpha},
+        // constant color support later.
+    };
+    const std::unordered_map<std::string, BlendEquation> blendEquationOptions = {
+        {"add", BlendEquation_Add},
+        {"subtract", BlendEquation_Subtract},
+        {"reverseSubtract", BlendEquation_ReverseSubTract},
+    };
+
+    const std::unordered_map<std::string, CullFace> cullFaceOptions = {
+        {"front", CullFace_Front},
+        {"back", CullFace_Back},
+        {"both", CullFace_FrontAndBack},
+    };
+
+    static void ParseRenderStates(const std::string &code, RenderStates &states)
+    {
+        states.Reset();
+        TinyLexer lexer(code.c_str());
+        const char *tokenStart;
+
+        std::string name;
+        while (lexer.GetNextToken(&tokenStart) == TokenType_Name)
+        {
+            name.assign(tokenStart, lexer.CurrentPtr());
+            auto iter = stateCommands.find(name);
+            if (iter != stateCommands.end())
+            {
+                NEXT_NAME(name);
+                switch (iter->second)
+                {
+                case StateCommand_ZTest:
+                    ON_OFF_OPTION(name, states.depthTestEnable);
+                    break;
+                case StateCommand_ZWrite:
+                    ON_OFF_OPTION(name, states.depthWriteEnable);
+                    break;
+                case StateCommand_ZTestFunc:
+                    ENUM_OPTIONS(depthStencilFuncOptions, name, states.depthFunc);
+                    break;
+
+                case StateCommand_StencilTest:
+                    ON_OFF_OPTION(name, states.stencilTestEnable);
+                    break;
+                case StateCommand_StencilMask:
+                    NUM_OPTIONS(name, states.stencilMask);
+                    break;
+                case StateCommand_StencilFunc:
+                    ENUM_OPTIONS(depthStencilFuncOptions, name, states.stencilFunc);
+                    NEXT_NAME(name);
+                    NUM_OPTIONS(name, states.stencilRef);
+                    NEXT_NAME(name);
+                    NUM_OPTIONS(name, states.stencilRefMask);
+                    break;
+                case StateCommand_StencilOp:
+                    ENUM_OPTIONS(stencilOpOptions, name, states.stencilFailOp);
+                    NEXT_NAME(name);
+                    ENUM_OPTIONS(stencilOpOptions, name, states.depthFailOp);
+                    NEXT_NAME(name);
+                    ENUM_OPTIONS(stencilOpOptions, name, states.depthPassOp);
+                    break;
+
+                case StateCommand_Blend:
+                    ON_OFF_OPTION(name, states.blendEnable);
+                    break;
+                case StateCommand_BlendEquation:
+                    ENUM_OPTIONS(blendEquationOptions, name, states.blendEquation);
+                    break;
+                case StateCommand_BlendFunc:
+                    ENUM_OPTIONS(blendFuncOptions, name, states.srcBlendFunc);
+                    NEXT_NAME(name);
+                    ENUM_OPTIONS(blendFuncOptions, name, states.destBlendFunc);
+                    break;
+
+                case StateCommand_Cull:
+                    ON_OFF_OPTION(name, states.cullingEnable);
+                    break;
+                case StateCommand_CullFace:
+                    ENUM_OPTIONS(cullFaceOptions, name, states.cullFace);
+                    break;
+                }
+            }
+            else
+            {
+                GFX_LOG_ERROR_FMT("Unrecognized state command: %s", name.c_str());
+            }
+        }
+    }
+
+    static void ParseKeywords(const std::string &code, const std::string &filePath, std::vector<std::string> &keywords)
+    {
+        // drop line comments, words in them are not keywords
+        std::string names;
+        size_t lineStart = 0;
+        while (lineStart < code.size())
+        {
+            size_t lineEnd = code.find('\n', lineStart);
+            if (lineEnd == std::string::npos)
+                lineEnd = code.size();
+            size_t comment = code.find("//", lineStart);
+            names.append(code, lineStart, std::min(lineEnd, comment) - lineStart);
+            names += '\n';
+            lineStart = lineEnd + 1;
+        }
+
+        TinyLexer lexer(names.c_str());
+        const char *tokenStart;
+        TokenType type;
+        while ((type = lexer.GetNextToken(&tokenStart)) != TokenType_None)
+        {
+            std::string keyword(tokenStart, lexer.CurrentPtr());
+            if (type != TokenType_Name || isdigit(keyword[0]))
+            {
+                GFX_LOG_ERROR_FMT("Invalid keyword %s in: %s", keyword.c_str(), filePath.c_str());
+                continue;
+            }
+            // included files may declare the same keyword
+            if (std::find(keywords.begin(), keywords.end(), keyword) == keywords.end())
+                keywords.push_back(keyword);
+        }
+    }
+
+    bool TinySLParser::Parse(const std::string &tinyslFile, TinySLProgram &program)
+    {
+        std::vector<TinySLContent> slContents;
+        std::unordered_set<std::string> includedFiles;
+        program.sourceFiles.clear();
+        // process sections and includes
+        if (!ParseTinySL(tinyslFile, includedFiles, program.sourceFiles, slContents) || slContents.size() == 0)
+        {
+            GFX_LOG_ERROR_FMT("Shader parse error: \"%s\"", tinyslFile.c_str());
+            return false;
+        }
+
+        // merge together, share code goes in front of each stage, States section of current file only
+        std::string share;
+        std::string keywords;
+        for (auto &content : slContents)
+        {
+            share.append(content.sectionCode[SLSection_Share]);
+            keywords.append(content.sectionCode[SLSection_Keywords]);
+        }
+
+        auto mergeStage = [&](SLSectionName section, std::string &out)
+        {
+            size_t size = share.size();
+            for (auto &content : slContents)
+                size += content.sectionCode[section].size();
+            out.clear();
+            out.reserve(size);
+            out.append(share);
+            for (auto &content : slContents)
+                out.append(content.sectionCode[section]);
+        };
+        mergeStage(SLSection_Vertex, program.vertexSource);
+        mergeStage(SLSection_Fragment, program.fragmentSource);
+
+        // a file with compute code is a compute program, graphics stages are dropped
+        bool hasCompute = false;
+        for (auto &content : slContents)
+            hasCompute |= !content.sectionCode[SLSection_Compute].empty();
+        program.computeSource.clear();
+        if (hasCompute)
+        {
+            mergeStage(SLSection_Compute, program.computeSource);
+            program.vertexSource.clear();
+            program.fragmentSource.clear();
+        }
+
+        ParseRenderStates(slContents.back().sectionCode[SLSection_States], program.states);
+        program.keywords.clear();
+        ParseKeywords(keywords, tinyslFile, program.keywords);
+        return true;
+    }
+
+    namespace
+    {
+        const char BundleMagic[4] = {'T', 'S', 'L', 'B'};
+        const uint32_t BundleVersion = 2;
+
+        void WriteU32(std::string &out, uint32_t value)
+        {
+            out.append((const char *)&value, sizeof(value));
+        }
+
+        void WriteString(std::string &out, const std::string &str)
+        {
+            WriteU32(out, (uint32_t)str.size());
+            out.append(str);
+        }
+
+        void WriteStrings(std::string &out, const std::vector<std::string> &strs)
+        {
+            WriteU32(out, (uint32_t)strs.size());
+            for (auto &str : strs)
+                WriteString(out, str);
+        }
+
+        // reads advance cursor, false once past the end
+        struct BundleReader
+        {
+            const std::string &data;
+            size_t cursor = 0;
+
+            bool Read(void *dst, size_t size)
+            {
+                if (cursor + size > data.size())
+                    return false;
+                memcpy(dst, data.data() + cursor, size);
+                cursor += size;
+                return true;
+            }
+
+            bool ReadString(std::string &str)
+            {
+                uint32_t size;
+                if (!Read(&size, sizeof(size)) || cursor + size > data.size())
+                    return false;
+                str.assign(data, cursor, size);
+                cursor += size;
+                return true;
+            }
+
+            bool ReadStrings(std::vector<std::string> &strs)
+            {
+                uint32_t count;
+                if (!Read(&count, sizeof(count)) || count > data.size())
+                    return false;
+                strs.resize(count);
+                for (auto &str : strs)
+                {
+                    if (!ReadString(str))
+                        return false;
+                }
+                return true;
+            }
+        };
+    }
+
+    bool TinySLParser::WriteBundle(const std::string &path, const TinySLProgram &program)
+    {
+        std::string out;
+        out.append(BundleMagic, sizeof(BundleMagic));
+        WriteU32(out, BundleVersion);
+        WriteU32(out, (uint32_t)sizeof(RenderStates));
+        out.append((const char *)&program.states, sizeof(RenderStates));
+        WriteStrings(out, program.keywords);
+        WriteStrings(out, program.sourceFiles);
+        WriteString(out, program.vertexSource);
+        WriteString(out, program.fragmentSource);
+        WriteString(out, program.computeSource);
+
+        FILE *file = fopen(path.c_str(), "wb");
+        if (file == nullptr)
+        {
+            GFX_LOG_ERROR_FMT("Can't write shader bundle: %s", path.c_str());
+            return false;
+        }
+        bool written = fwrite(out.data(), 1, out.size(), file) == out.size();
+        fclose(file);
+        return written;
+    }
+
+    bool TinySLParser::ReadBundle(const std::string &path, TinySLProgram &program)
+    {
+        std::string data;
+        if (!ReadFile(path, data))
+            return false;
+
+        BundleReader reader{data};
+        char magic[4];
+        uint32_t version, statesSize;
+        // states are raw bytes, a bundle from another build of RenderStates is refused
+        bool valid = reader.Read(magic, sizeof(magic)) && memcmp(magic, BundleMagic, sizeof(magic)) == 0 &&
+                     reader.Read(&version, sizeof(version)) && version == BundleVersion &&
+                     reader.Read(&statesSize, sizeof(statesSize)) && statesSize == sizeof(RenderStates) &&
+                     reader.Read(&program.states, sizeof(RenderStates)) && reader.ReadStrings(program.keywords) &&
+                     reader.ReadStrings(program.sourceFiles) && reader.ReadString(program.vertexSource) &&
+                     reader.ReadString(program.fragmentSource) && reader.ReadString(program.computeSource);
+        if (!valid)
+        {
+            GFX_LOG_ERROR_FMT("Invalid shader bundle: %s", path.c_str());
+        }
+        return valid;
+    }
+}
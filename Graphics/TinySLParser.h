@@ -0,0 +1,49 @@
+/**
+ * @file TinySLParser.h
+ * @author wangyudong
+ * @brief TinySL front end without GL: flattens includes, merges sections, parses States and Keywords,
+ * and reads / writes pre-resolved bundles. Shared by ShaderUtil at runtime and the offline tinyslc tool.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "ShaderProgram.h"
+
+namespace Graphics
+{
+    // result of a TinySL file, stage sources have Share code in front but no version line
+    struct TinySLProgram
+    {
+        std::string vertexSource;
+        std::string fragmentSource;
+        // not empty for a compute program, which has no vertex and fragment source then
+        std::string computeSource;
+        RenderStates states;
+        std::vector<std::string> keywords;
+        // the file and every file it includes, in include order
+        std::vector<std::string> sourceFiles;
+    };
+
+    class TinySLParser
+    {
+    public:
+        // whole file in one read, false if it can't be opened
+        static bool ReadFile(const std::string &path, std::string &content);
+
+        // false if the file or one of its includes can't be read or has unmatched braces
+        static bool Parse(const std::string &tinyslFile, TinySLProgram &program);
+
+        /**
+         * Bundle layout, little endian:
+         *   "TSLB", format version, sizeof(RenderStates), RenderStates bytes,
+         *   then counted strings: keywords, source files, vertex source, fragment source, compute source.
+         * Strings are a uint32 length followed by the bytes, lists a uint32 count followed by strings.
+         */
+        static bool WriteBundle(const std::string &path, const TinySLProgram &program);
+        static bool ReadBundle(const std::string &path, TinySLProgram &program);
+    };
+}
@@ -0,0 +1,94 @@
+/**
+ * @file TransformKernelLanes.h
+ * @author wangyudong
+ * @brief Lane generic body of the batch transform kernels, included by the translation unit of each instruction set.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Translation units built with extra instruction sets include nothing but this header and intrinsics. Inline
+// functions from other headers (Eigen, std) instantiated there could be picked by the linker for the whole program
+// and run wider instructions on cpus without them.
+
+namespace Graphics
+{
+    // One stream per component, element i of every stream belongs to object i. Rotations are unit quaternions.
+    struct TransformSoA
+    {
+        const float *position[3] = {nullptr, nullptr, nullptr};
+        const float *rotation[4] = {nullptr, nullptr, nullptr, nullptr}; // x y z w
+        const float *scale[3] = {nullptr, nullptr, nullptr};
+    };
+
+    // 16 floats of the matrix and 4 words of layer and padding
+    const size_t TransformRecordSize = 80;
+
+    // Objects [first, first + count) to records at dst, count is a multiple of the lane width of the path.
+    // parent is column major. Each returns false when its instruction set was not compiled in.
+    bool ComposeTransformsSSE4(const float *parent, const TransformSoA &src, size_t first, size_t count, int textureLayer, uint8_t *dst);
+    bool ComposeTransformsAVX2(const float *parent, const TransformSoA &src, size_t first, size_t count, int textureLayer, uint8_t *dst);
+    bool ComposeTransformsAVX512(const float *parent, const TransformSoA &src, size_t first, size_t count, int textureLayer, uint8_t *dst);
+    // lane widths of the paths above
+    const size_t TransformLanesSSE4 = 4;
+    const size_t TransformLanesAVX2 = 8;
+    const size_t TransformLanesAVX512 = 16;
+
+    namespace TransformLanes
+    {
+        /**
+         * V is a vector of V::Width floats with Load, Set1, Add, Sub, Mul, MulAdd (a * b + c) and
+         * Store(const typename V::Type columns[16], layer, dst), which writes V::Width records from per element vectors.
+         * Everything here is instantiated only with the V of the including translation unit.
+         */
+        template <typename V>
+        inline void Compose(const float *parent, const TransformSoA &src, size_t first, size_t count, int textureLayer, uint8_t *dst)
+        {
+            if (count == 0)
+                return;
+            typedef typename V::Type T;
+            T p[16];
+            for (int i = 0; i < 16; ++i)
+                p[i] = V::Set1(parent[i]);
+            const T one = V::Set1(1.f);
+
+            for (size_t i = first; i < first + count; i += V::Width)
+            {
+                T tx = V::Load(src.position[0] + i), ty = V::Load(src.position[1] + i), tz = V::Load(src.position[2] + i);
+                T qx = V::Load(src.rotation[0] + i), qy = V::Load(src.rotation[1] + i);
+                T qz = V::Load(src.rotation[2] + i), qw = V::Load(src.rotation[3] + i);
+                T sx = V::Load(src.scale[0] + i), sy = V::Load(src.scale[1] + i), sz = V::Load(src.scale[2] + i);
+
+                T x2 = V::Add(qx, qx), y2 = V::Add(qy, qy), z2 = V::Add(qz, qz);
+                T xx = V::Mul(qx, x2), yy = V::Mul(qy, y2), zz = V::Mul(qz, z2);
+                T xy = V::Mul(qx, y2), xz = V::Mul(qx, z2), yz = V::Mul(qy, z2);
+                T wx = V::Mul(qw, x2), wy = V::Mul(qw, y2), wz = V::Mul(qw, z2);
+
+                // local 3x3 of T * R * S, l[col][row]
+                T l[3][3];
+                l[0][0] = V::Mul(V::Sub(one, V::Add(yy, zz)), sx);
+                l[0][1] = V::Mul(V::Add(xy, wz), sx);
+                l[0][2] = V::Mul(V::Sub(xz, wy), sx);
+                l[1][0] = V::Mul(V::Sub(xy, wz), sy);
+                l[1][1] = V::Mul(V::Sub(one, V::Add(xx, zz)), sy);
+                l[1][2] = V::Mul(V::Add(yz, wx), sy);
+                l[2][0] = V::Mul(V::Add(xz, wy), sz);
+                l[2][1] = V::Mul(V::Sub(yz, wx), sz);
+                l[2][2] = V::Mul(V::Sub(one, V::Add(xx, yy)), sz);
+
+                T m[16];
+                for (int r = 0; r < 4; ++r)
+                {
+                    for (int c = 0; c < 3; ++c)
+                        m[c * 4 + r] = V::MulAdd(p[8 + r], l[c][2], V::MulAdd(p[4 + r], l[c][1], V::Mul(p[r], l[c][0])));
+                    m[12 + r] = V::MulAdd(p[8 + r], tz, V::MulAdd(p[4 + r], ty, V::MulAdd(p[r], tx, p[12 + r])));
+                }
+                V::Store(m, textureLayer, dst + (i - first) * TransformRecordSize);
+            }
+        }
+    }
+}
@@ -0,0 +1,204 @@
+#include "TransformKernels.h"
+#include <string.h>
+#include <algorithm>
+#include <future>
+#include <vector>
+#include "ThreadPool.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define TRANSFORM_KERNELS_CPUID_MSVC
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define TRANSFORM_KERNELS_CPUID_BUILTIN
+#endif
+
+namespace Graphics
+{
+    namespace
+    {
+        // one object per lane, for the remainder of the vector paths and cpus without them
+        struct LanesScalar
+        {
+            typedef float Type;
+            static const size_t Width = 1;
+
+            static inline float Load(const float *src) { return *src; }
+            static inline float Set1(float v) { return v; }
+            static inline float Add(float a, float b) { return a + b; }
+            static inline float Sub(float a, float b) { return a - b; }
+            static inline float Mul(float a, float b) { return a * b; }
+            static inline float MulAdd(float a, float b, float c) { return a * b + c; }
+
+            static inline void Store(const float m[16], int textureLayer, uint8_t *dst)
+            {
+                int32_t tail[4] = {textureLayer, 0, 0, 0};
+                memcpy(dst, m, 16 * sizeof(float));
+                memcpy(dst + 16 * sizeof(float), tail, sizeof(tail));
+            }
+        };
+
+        bool CpuSupports(TransformISA isa)
+        {
+#if defined(TRANSFORM_KERNELS_CPUID_MSVC)
+            int regs[4];
+            __cpuid(regs, 0);
+            int maxLeaf = regs[0];
+            __cpuid(regs, 1);
+            bool sse41 = (regs[2] & (1 << 19)) != 0;
+            bool fma = (regs[2] & (1 << 12)) != 0;
+            bool osxsave = (regs[2] & (1 << 27)) != 0;
+            bool avx = (regs[2] & (1 << 28)) != 0;
+            // the OS has to save the wider registers on context switches
+            unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+            bool ymmState = (xcr0 & 0x6) == 0x6;
+            bool zmmState = (xcr0 & 0xe6) == 0xe6;
+            bool avx2 = false, avx512 = false;
+            if (maxLeaf >= 7)
+            {
+                __cpuidex(regs, 7, 0);
+                avx2 = (regs[1] & (1 << 5)) != 0;
+                avx512 = (regs[1] & (1 << 16)) != 0;
+            }
+            switch (isa)
+            {
+            case TransformISA_Scalar: return true;
+            case TransformISA_SSE4: return sse41;
+            case TransformISA_AVX2: return avx && avx2 && fma && ymmState;
+            case TransformISA_AVX512: return avx512 && zmmState;
+            default: return false;
+            }
+#elif defined(TRANSFORM_KERNELS_CPUID_BUILTIN)
+            // checks OS support of the register state as well
+            __builtin_cpu_init();
+            switch (isa)
+            {
+            case TransformISA_Scalar: return true;
+            case TransformISA_SSE4: return __builtin_cpu_supports("sse4.1");
+            case TransformISA_AVX2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+            case TransformISA_AVX512: return __builtin_cpu_supports("avx512f");
+            default: return false;
+            }
+#else
+            return isa == TransformISA_Scalar;
+#endif
+        }
+
+        // a path with count 0 only reports whether it was compiled in
+        bool Built(TransformISA isa)
+        {
+            TransformSoA none;
+            switch (isa)
+            {
+            case TransformISA_Scalar: return true;
+            case TransformISA_SSE4: return ComposeTransformsSSE4(nullptr, none, 0, 0, 0, nullptr);
+            case TransformISA_AVX2: return ComposeTransformsAVX2(nullptr, none, 0, 0, 0, nullptr);
+            case TransformISA_AVX512: return ComposeTransformsAVX512(nullptr, none, 0, 0, 0, nullptr);
+            default: return false;
+            }
+        }
+
+        struct ISASupport
+        {
+            bool supported[TransformISA_Count];
+            TransformISA best = TransformISA_Scalar;
+
+            ISASupport()
+            {
+                for (int i = 0; i < TransformISA_Count; ++i)
+                {
+                    supported[i] = CpuSupports((TransformISA)i) && Built((TransformISA)i);
+                    if (supported[i])
+                        best = (TransformISA)i;
+                }
+            }
+        };
+
+        const ISASupport &GetISASupport()
+        {
+            static ISASupport support;
+            return support;
+        }
+    }
+
+    TransformISA TransformKernels::GetBestISA()
+    {
+        return GetISASupport().best;
+    }
+
+    bool TransformKernels::IsSupported(TransformISA isa)
+    {
+        return isa >= 0 && isa < TransformISA_Count && GetISASupport().supported[isa];
+    }
+
+    const char *TransformKernels::GetISAName(TransformISA isa)
+    {
+        switch (isa)
+        {
+        case TransformISA_Scalar: return "scalar";
+        case TransformISA_SSE4: return "sse4";
+        case TransformISA_AVX2: return "avx2";
+        case TransformISA_AVX512: return "avx512";
+        default: return "unknown";
+        }
+    }
+
+    void TransformKernels::Compose(const Eigen::Matrix4f &parent, const TransformSoA &src, size_t first, size_t count, int textureLayer,
+                                   void *dst, TransformISA isa)
+    {
+        if (!IsSupported(isa))
+            isa = GetBestISA();
+
+        const float *p = parent.data();
+        auto out = (uint8_t *)dst;
+        size_t lanes = 1;
+        switch (isa)
+        {
+        case TransformISA_SSE4: lanes = TransformLanesSSE4; break;
+        case TransformISA_AVX2: lanes = TransformLanesAVX2; break;
+        case TransformISA_AVX512: lanes = TransformLanesAVX512; break;
+        default: break;
+        }
+
+        // whole vectors on the instruction set path, the rest one by one
+        size_t bulk = count / lanes * lanes;
+        if (bulk > 0)
+        {
+            switch (isa)
+            {
+            case TransformISA_SSE4: ComposeTransformsSSE4(p, src, first, bulk, textureLayer, out); break;
+            case TransformISA_AVX2: ComposeTransformsAVX2(p, src, first, bulk, textureLayer, out); break;
+            case TransformISA_AVX512: ComposeTransformsAVX512(p, src, first, bulk, textureLayer, out); break;
+            default: bulk = 0; break;
+            }
+        }
+        TransformLanes::Compose<LanesScalar>(p, src, first + bulk, count - bulk, textureLayer, out + bulk * RecordSize);
+    }
+
+    void TransformKernels::ComposeParallel(const Eigen::Matrix4f &parent, const TransformSoA &src, size_t count, int textureLayer, void *dst)
+    {
+        auto pool = ThreadPool::Instance();
+        size_t jobCount = std::min(pool->GetThreadCount() + 1, count / (MinParallelCount / 2));
+        if (count < MinParallelCount || jobCount <= 1)
+        {
+            Compose(parent, src, 0, count, textureLayer, dst);
+            return;
+        }
+
+        // chunk boundaries on whole vectors of the widest path, only the last chunk has a scalar remainder
+        const size_t align = TransformLanesAVX512;
+        auto out = (uint8_t *)dst;
+        auto boundary = [&](size_t job) { return job == jobCount ? count : count * job / jobCount / align * align; };
+
+        std::vector<std::future<void>> jobs;
+        for (size_t j = 0; j + 1 < jobCount; ++j)
+        {
+            size_t begin = boundary(j), end = boundary(j + 1);
+            jobs.push_back(pool->Async([=, &parent, &src]() { Compose(parent, src, begin, end - begin, textureLayer, out + begin * RecordSize); }));
+        }
+        size_t last = boundary(jobCount - 1);
+        Compose(parent, src, last, count - last, textureLayer, out + last * RecordSize);
+        for (auto &job : jobs)
+            job.wait();
+    }
+}
@@ -0,0 +1,61 @@
+/**
+ * @file TransformKernels.h
+ * @author wangyudong
+ * @brief Batch kernels turning SoA transforms into per object records, with SSE4/AVX2/AVX-512 paths picked at runtime.
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <Eigen/Core>
+#include "TransformKernelLanes.h"
+
+namespace Graphics
+{
+    enum TransformISA
+    {
+        TransformISA_Scalar,
+        TransformISA_SSE4,
+        TransformISA_AVX2,
+        TransformISA_AVX512,
+        TransformISA_Count
+    };
+
+    /**
+     * @brief Object i of a batch is written as the record parent * T(i) * R(i) * S(i), column major, followed by
+     * textureLayer and 3 zero words, which is RenderObject::PerObjectData. Records are contiguous and written front to
+     * back in whole records, so the destination can be a write combined mapping of a GL buffer.
+     *
+     * Each instruction set path lives in its own translation unit built with that instruction set enabled, sharing the
+     * lane code of TransformKernelLanes.h, and is only called when the cpu and OS support it. Paths without the
+     * instruction set compiled in (other architectures, compilers) report themselves unavailable.
+     */
+    class TransformKernels
+    {
+    public:
+        static const size_t RecordSize = TransformRecordSize;
+
+        // best path supported by both the build and the cpu, detected once
+        static TransformISA GetBestISA();
+        static bool IsSupported(TransformISA isa);
+        static const char *GetISAName(TransformISA isa);
+
+        // objects [first, first + count) of src into dst[0, count), on the calling thread
+        static void Compose(const Eigen::Matrix4f &parent, const TransformSoA &src, size_t first, size_t count, int textureLayer,
+                            void *dst, TransformISA isa);
+        static void Compose(const Eigen::Matrix4f &parent, const TransformSoA &src, size_t first, size_t count, int textureLayer,
+                            void *dst)
+        {
+            Compose(parent, src, first, count, textureLayer, dst, GetBestISA());
+        }
+
+        // split in chunks over the shared ThreadPool, the calling thread takes the last chunk and waits for the rest.
+        // Small batches are not worth the hand off and run on the calling thread only.
+        static void ComposeParallel(const Eigen::Matrix4f &parent, const TransformSoA &src, size_t count, int textureLayer, void *dst);
+
+        // batches below this run on the calling thread
+        static const size_t MinParallelCount = 4096;
+    };
+}
@@ -0,0 +1,68 @@
+#include "TransformKernelLanes.h"
+
+// built with AVX2 and FMA enabled, see Graphics/CMakeLists.txt
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#include <immintrin.h>
+#define TRANSFORM_KERNELS_AVX2
+#endif
+
+namespace Graphics
+{
+#ifdef TRANSFORM_KERNELS_AVX2
+    namespace
+    {
+        struct LanesAVX2
+        {
+            typedef __m256 Type;
+            static const size_t Width = 8;
+
+            static inline __m256 Load(const float *src) { return _mm256_loadu_ps(src); }
+            static inline __m256 Set1(float v) { return _mm256_set1_ps(v); }
+            static inline __m256 Add(__m256 a, __m256 b) { return _mm256_add_ps(a, b); }
+            static inline __m256 Sub(__m256 a, __m256 b) { return _mm256_sub_ps(a, b); }
+            static inline __m256 Mul(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+            static inline __m256 MulAdd(__m256 a, __m256 b, __m256 c) { return _mm256_fmadd_ps(a, b, c); }
+
+            static inline void Store(const __m256 m[16], int textureLayer, uint8_t *dst)
+            {
+                // 4x4 transposes within each 128 bit half, column c of object j is in the low half of cols[c][j]
+                // and column c of object j + 4 in the high half
+                __m256 cols[4][4];
+                for (int c = 0; c < 4; ++c)
+                {
+                    __m256 t0 = _mm256_unpacklo_ps(m[c * 4], m[c * 4 + 1]);
+                    __m256 t1 = _mm256_unpackhi_ps(m[c * 4], m[c * 4 + 1]);
+                    __m256 t2 = _mm256_unpacklo_ps(m[c * 4 + 2], m[c * 4 + 3]);
+                    __m256 t3 = _mm256_unpackhi_ps(m[c * 4 + 2], m[c * 4 + 3]);
+                    cols[c][0] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+                    cols[c][1] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+                    cols[c][2] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+                    cols[c][3] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+                }
+                const __m128 tail = _mm_castsi128_ps(_mm_setr_epi32(textureLayer, 0, 0, 0));
+                for (int j = 0; j < 8; ++j)
+                {
+                    float *record = (float *)(dst + j * TransformRecordSize);
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        __m128 col = j < 4 ? _mm256_castps256_ps128(cols[c][j]) : _mm256_extractf128_ps(cols[c][j - 4], 1);
+                        _mm_storeu_ps(record + c * 4, col);
+                    }
+                    _mm_storeu_ps(record + 16, tail);
+                }
+            }
+        };
+    }
+
+    bool ComposeTransformsAVX2(const float *parent, const TransformSoA &src, size_t first, size_t count, int textureLayer, uint8_t *dst)
+    {
+        TransformLanes::Compose<LanesAVX2>(parent, src, first, count, textureLayer, dst);
+        return true;
+    }
+#else
+    bool ComposeTransformsAVX2(const float *, const TransformSoA &, size_t, size_t, int, uint8_t *)
+    {
+        return false;
+    }
+#endif
+}
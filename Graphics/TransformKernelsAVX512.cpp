@@ -0,0 +1,80 @@
+#include "TransformKernelLanes.h"
+
+// built with AVX-512F enabled, see Graphics/CMakeLists.txt
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define TRANSFORM_KERNELS_AVX512
+#endif
+
+namespace Graphics
+{
+#ifdef TRANSFORM_KERNELS_AVX512
+    namespace
+    {
+        struct LanesAVX512
+        {
+            typedef __m512 Type;
+            static const size_t Width = 16;
+
+            static inline __m512 Load(const float *src) { return _mm512_loadu_ps(src); }
+            static inline __m512 Set1(float v) { return _mm512_set1_ps(v); }
+            static inline __m512 Add(__m512 a, __m512 b) { return _mm512_add_ps(a, b); }
+            static inline __m512 Sub(__m512 a, __m512 b) { return _mm512_sub_ps(a, b); }
+            static inline __m512 Mul(__m512 a, __m512 b) { return _mm512_mul_ps(a, b); }
+            static inline __m512 MulAdd(__m512 a, __m512 b, __m512 c) { return _mm512_fmadd_ps(a, b, c); }
+
+            // zero masked forms with every lane set, the plain ones (and the cast, in gcc) pass an undefined source gcc
+            // warns about
+            static inline __m128 Quarter(__m512 v, int quarter)
+            {
+                switch (quarter)
+                {
+                case 0: return _mm512_maskz_extractf32x4_ps(0xF, v, 0);
+                case 1: return _mm512_maskz_extractf32x4_ps(0xF, v, 1);
+                case 2: return _mm512_maskz_extractf32x4_ps(0xF, v, 2);
+                default: return _mm512_maskz_extractf32x4_ps(0xF, v, 3);
+                }
+            }
+
+            static inline __m512 UnpackLo(__m512 a, __m512 b) { return _mm512_maskz_unpacklo_ps(0xFFFF, a, b); }
+            static inline __m512 UnpackHi(__m512 a, __m512 b) { return _mm512_maskz_unpackhi_ps(0xFFFF, a, b); }
+
+            static inline void Store(const __m512 m[16], int textureLayer, uint8_t *dst)
+            {
+                // 4x4 transposes within each 128 bit quarter, column c of object j + 4 * q is in quarter q of cols[c][j]
+                __m512 cols[4][4];
+                for (int c = 0; c < 4; ++c)
+                {
+                    __m512 t0 = UnpackLo(m[c * 4], m[c * 4 + 1]);
+                    __m512 t1 = UnpackHi(m[c * 4], m[c * 4 + 1]);
+                    __m512 t2 = UnpackLo(m[c * 4 + 2], m[c * 4 + 3]);
+                    __m512 t3 = UnpackHi(m[c * 4 + 2], m[c * 4 + 3]);
+                    cols[c][0] = _mm512_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+                    cols[c][1] = _mm512_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+                    cols[c][2] = _mm512_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+                    cols[c][3] = _mm512_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+                }
+                const __m128 tail = _mm_castsi128_ps(_mm_setr_epi32(textureLayer, 0, 0, 0));
+                for (int j = 0; j < 16; ++j)
+                {
+                    float *record = (float *)(dst + j * TransformRecordSize);
+                    for (int c = 0; c < 4; ++c)
+                        _mm_storeu_ps(record + c * 4, Quarter(cols[c][j & 3], j >> 2));
+                    _mm_storeu_ps(record + 16, tail);
+                }
+            }
+        };
+    }
+
+    bool ComposeTransformsAVX512(const float *parent, const TransformSoA &src, size_t first, size_t count, int textureLayer, uint8_t *dst)
+    {
+        TransformLanes::Compose<LanesAVX512>(parent, src, first, count, textureLayer, dst);
+        return true;
+    }
+#else
+    bool ComposeTransformsAVX512(const float *, const TransformSoA &, size_t, size_t, int, uint8_t *)
+    {
+        return false;
+    }
+#endif
+}
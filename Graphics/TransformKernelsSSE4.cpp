@@ -0,0 +1,64 @@
+#include "TransformKernelLanes.h"
+
+// built with SSE4.1 enabled, see Graphics/CMakeLists.txt. MSVC has no switch for it, x64 builds can always emit it.
+#if defined(__SSE4_1__) || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64)))
+#include <smmintrin.h>
+#define TRANSFORM_KERNELS_SSE4
+#endif
+
+namespace Graphics
+{
+#ifdef TRANSFORM_KERNELS_SSE4
+    namespace
+    {
+        struct LanesSSE4
+        {
+            typedef __m128 Type;
+            static const size_t Width = 4;
+
+            static inline __m128 Load(const float *src) { return _mm_loadu_ps(src); }
+            static inline __m128 Set1(float v) { return _mm_set1_ps(v); }
+            static inline __m128 Add(__m128 a, __m128 b) { return _mm_add_ps(a, b); }
+            static inline __m128 Sub(__m128 a, __m128 b) { return _mm_sub_ps(a, b); }
+            static inline __m128 Mul(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+            static inline __m128 MulAdd(__m128 a, __m128 b, __m128 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+
+            static inline void Store(const __m128 m[16], int textureLayer, uint8_t *dst)
+            {
+                // columns of 4 objects, transposed so that each record is written whole before the next one
+                __m128 cols[4][4];
+                for (int c = 0; c < 4; ++c)
+                {
+                    __m128 r0 = m[c * 4], r1 = m[c * 4 + 1], r2 = m[c * 4 + 2], r3 = m[c * 4 + 3];
+                    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+                    cols[c][0] = r0;
+                    cols[c][1] = r1;
+                    cols[c][2] = r2;
+                    cols[c][3] = r3;
+                }
+                const __m128 tail = _mm_castsi128_ps(_mm_setr_epi32(textureLayer, 0, 0, 0));
+                for (int j = 0; j < 4; ++j)
+                {
+                    float *record = (float *)(dst + j * TransformRecordSize);
+                    _mm_storeu_ps(record, cols[0][j]);
+                    _mm_storeu_ps(record + 4, cols[1][j]);
+                    _mm_storeu_ps(record + 8, cols[2][j]);
+                    _mm_storeu_ps(record + 12, cols[3][j]);
+                    _mm_storeu_ps(record + 16, tail);
+                }
+            }
+        };
+    }
+
+    bool ComposeTransformsSSE4(const float *parent, const TransformSoA &src, size_t first, size_t count, int textureLayer, uint8_t *dst)
+    {
+        TransformLanes::Compose<LanesSSE4>(parent, src, first, count, textureLayer, dst);
+        return true;
+    }
+#else
+    bool ComposeTransformsSSE4(const float *, const TransformSoA &, size_t, size_t, int, uint8_t *)
+    {
+        return false;
+    }
+#endif
+}
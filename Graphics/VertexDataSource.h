@@ -22,14 +22,21 @@ namespace Graphics
         typedef std::shared_ptr<VertexDataSource> SP;
         virtual void Prepare() = 0;
         virtual void Bind() = 0;
+        // VAO bound by Bind(), used to order draws so that sources sharing a VAO are drawn together.
+        virtual uint32_t VertexArrayHandle() { return 0; }
 
         inline size_t VertexCount() { return mVertexCount; }
         inline size_t IndexCount() { return mIndexCount; }
         inline bool HasIndex() { return mHasIndex; }
+        // where the data starts in bound buffers, non zero when vertex data is suballocated.
+        inline size_t BaseVertex() { return mBaseVertex; }
+        inline size_t FirstIndex() { return mFirstIndex; }
 
     protected:
         size_t mVertexCount = 0;
         size_t mIndexCount = 0;
+        size_t mBaseVertex = 0;
+        size_t mFirstIndex = 0;
         bool mHasIndex = false;
     };
 }
\ No newline at end of file
@@ -0,0 +1,199 @@
+/**
+ * @file texcook.cpp
+ * @author wangyudong
+ * @brief Offline texture cooker: builds a filtered mip chain, block compresses it and writes a KTX2 file,
+ * so the runtime only has to upload. usage: texcook <input> <output.ktx2> [options]
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb/stb_image_write.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "KTX2.h"
+#include "MipGenerator.h"
+#include "TextureCompressor.h"
+#include "ChannelPacker.h"
+
+using namespace Graphics;
+
+namespace
+{
+    void PrintUsage()
+    {
+        printf("usage: texcook <input> <output.ktx2> [--format rgba8|rg8|bc1|bc4|bc5|bc7] [--filter box|kaiser] [--srgb] [--no-mips] [--pack-orm <roughness> <metallic>]\n");
+        printf("  --format   output format, default rgba8\n");
+        printf("  --filter   mip filter, default kaiser\n");
+        printf("  --srgb     filter color channels in linear space\n");
+        printf("  --no-mips  only write level 0\n");
+        printf("  --pack-orm input is ao, packed with roughness and metallic maps into r, g, b\n");
+    }
+
+    bool ParseFormat(const char *name, TextureFormat &format)
+    {
+        struct { const char *name; TextureFormat format; } formats[] = {
+            {"rgba8", TextureFormat_R8G8B8A8},
+            {"rg8", TextureFormat_R8G8},
+            {"bc1", TextureFormat_BC1},
+            {"bc4", TextureFormat_BC4},
+            {"bc5", TextureFormat_BC5},
+            {"bc7", TextureFormat_BC7},
+        };
+        for (auto &f : formats)
+        {
+            if (strcmp(name, f.name) == 0)
+            {
+                format = f.format;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    int ChannelOf(TextureFormat format)
+    {
+        switch (format)
+        {
+        case TextureFormat_R8G8B8A8:
+            return 4;
+        case TextureFormat_R8G8:
+            return 2;
+        default:
+            return TextureCompressor::GetSourceChannel(format);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    const char *input = argv[1];
+    const char *output = argv[2];
+    TextureFormat format = TextureFormat_R8G8B8A8;
+    MipFilter filter = MipFilter_Kaiser;
+    bool srgb = false;
+    bool mips = true;
+    const char *roughnessPath = nullptr;
+    const char *metallicPath = nullptr;
+
+    for (int i = 3; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--format" && i + 1 < argc)
+        {
+            if (!ParseFormat(argv[++i], format))
+            {
+                printf("unknown format %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (arg == "--filter" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if (name == "box")
+                filter = MipFilter_Box;
+            else if (name == "kaiser")
+                filter = MipFilter_Kaiser;
+            else
+            {
+                printf("unknown filter %s\n", name.c_str());
+                return 1;
+            }
+        }
+        else if (arg == "--srgb")
+            srgb = true;
+        else if (arg == "--no-mips")
+            mips = false;
+        else if (arg == "--pack-orm" && i + 2 < argc)
+        {
+            roughnessPath = argv[++i];
+            metallicPath = argv[++i];
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    int channel = ChannelOf(format);
+    int width, height, sourceChannel;
+    unsigned char *pixels = nullptr;
+    std::vector<uint8_t> packed;
+    if (roughnessPath != nullptr)
+    {
+        if (channel < 3)
+        {
+            printf("ORM needs a format with at least 3 channels\n");
+            return 1;
+        }
+        if (!ChannelPacker::PackORM(input, roughnessPath, metallicPath, width, height, packed))
+            return 1;
+        // ORM is rgb, widened to rgba formats with opaque alpha
+        pixels = (unsigned char *)malloc((size_t)width * height * channel);
+        for (size_t i = 0; i < (size_t)width * height; ++i)
+        {
+            for (int c = 0; c < channel; ++c)
+                pixels[i * channel + c] = c < 3 ? packed[i * 3 + c] : 255;
+        }
+    }
+    else
+    {
+        // stbi converts to the channel count the output format is built from
+        pixels = stbi_load(input, &width, &height, &sourceChannel, channel);
+        if (pixels == nullptr)
+        {
+            printf("load %s failed: %s\n", input, stbi_failure_reason());
+            return 1;
+        }
+    }
+
+    std::vector<CompressedImage::Level> levels;
+    if (mips)
+        MipGenerator::Generate(pixels, width, height, channel, filter, srgb, levels);
+    else
+    {
+        levels.resize(1);
+        levels[0].width = width;
+        levels[0].height = height;
+        levels[0].data.assign(pixels, pixels + (size_t)width * height * channel);
+    }
+    if (roughnessPath != nullptr)
+        free(pixels);
+    else
+        stbi_image_free(pixels);
+
+    CompressedImage image;
+    if (TextureCompressor::IsCompressed(format))
+    {
+        if (!TextureCompressor::CompressLevels(format, levels, image))
+        {
+            printf("compress %s failed\n", input);
+            return 1;
+        }
+    }
+    else
+    {
+        image.format = format;
+        image.levels = std::move(levels);
+    }
+
+    if (!KTX2File::Write(output, image))
+        return 1;
+
+    size_t bytes = 0;
+    for (auto &level : image.levels)
+        bytes += level.data.size();
+    printf("%s -> %s: %dx%d, %zu levels, %zu bytes\n", input, output, width, height, image.levels.size(), bytes);
+    return 0;
+}
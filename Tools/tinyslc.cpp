@@ -0,0 +1,95 @@
+/**
+ * @file tinyslc.cpp
+ * @author wangyudong
+ * @brief Offline TinySL compiler: flattens includes, validates sections, pre-parses States and Keywords
+ * and writes one bundle per program, which ShaderUtil loads with a single read and no parsing.
+ * usage: tinyslc <input.tinysl> <output.tslb> [--print]
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#include <stdio.h>
+#include <string>
+#include "TinySLParser.h"
+
+using namespace Graphics;
+
+namespace
+{
+    void PrintUsage()
+    {
+        printf("usage: tinyslc <input.tinysl> <output.tslb> [--print]\n");
+        printf("  --print  print keywords, included files and merged stage sources\n");
+    }
+
+    void PrintProgram(const TinySLProgram &program)
+    {
+        printf("sources:\n");
+        for (auto &file : program.sourceFiles)
+            printf("    %s\n", file.c_str());
+        printf("keywords:");
+        for (auto &keyword : program.keywords)
+            printf(" %s", keyword.c_str());
+        if (!program.computeSource.empty())
+            printf("\nCompute:\n%s\n", program.computeSource.c_str());
+        else
+            printf("\nVertex:\n%s\nFragment:\n%s\n", program.vertexSource.c_str(), program.fragmentSource.c_str());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    const char *input = argv[1];
+    const char *output = argv[2];
+    bool print = false;
+    for (int i = 3; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--print")
+            print = true;
+        else
+        {
+            printf("unknown option %s\n", arg.c_str());
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    TinySLProgram program;
+    if (!TinySLParser::Parse(input, program))
+        return 1;
+
+    // a program that can't be drawn is an error here rather than at runtime
+    if (!program.computeSource.empty())
+    {
+        if (program.computeSource.find("main") == std::string::npos)
+        {
+            printf("%s: Compute section needs a main function\n", input);
+            return 1;
+        }
+    }
+    else if (program.vertexSource.find("main") == std::string::npos || program.fragmentSource.find("main") == std::string::npos)
+    {
+        printf("%s: Vertex and Fragment sections need a main function\n", input);
+        return 1;
+    }
+    if (program.keywords.size() > 32)
+    {
+        printf("%s: %d keywords, at most 32 are supported\n", input, (int)program.keywords.size());
+        return 1;
+    }
+
+    if (print)
+        PrintProgram(program);
+
+    if (!TinySLParser::WriteBundle(output, program))
+        return 1;
+    printf("%s -> %s, %d keywords, %d files\n", input, output, (int)program.keywords.size(), (int)program.sourceFiles.size());
+    return 0;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file transformbench.cpp
+ * @author wangyudong
+ * @brief Microbenchmark of the batch transform kernels against a per object Eigen loop writing the same records.
+ * usage: transformbench [object count] [repeat]
+ * @version 0.1
+ * @date 2026-10-19
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <Eigen/Geometry>
+#include "TransformKernels.h"
+
+using namespace Graphics;
+
+namespace
+{
+    struct Streams
+    {
+        std::vector<float> data[10];
+        TransformSoA soa;
+
+        explicit Streams(size_t count)
+        {
+            std::mt19937 rng(7);
+            std::uniform_real_distribution<float> position(-100.f, 100.f), unit(-1.f, 1.f), scale(0.5f, 2.f);
+            for (auto &stream : data)
+                stream.resize(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                Eigen::Quaternionf q(unit(rng), unit(rng), unit(rng), unit(rng));
+                q.normalize();
+                float values[10] = {position(rng), position(rng), position(rng), q.x(), q.y(), q.z(), q.w(), scale(rng), scale(rng), scale(rng)};
+                for (int s = 0; s < 10; ++s)
+                    data[s][i] = values[s];
+            }
+            for (int s = 0; s < 3; ++s)
+            {
+                soa.position[s] = data[s].data();
+                soa.scale[s] = data[7 + s].data();
+            }
+            for (int s = 0; s < 4; ++s)
+                soa.rotation[s] = data[3 + s].data();
+        }
+    };
+
+    // what a per object submit does: one Eigen product per object, copied into the record
+    void EigenLoop(const Eigen::Matrix4f &parent, const Streams &streams, size_t count, int textureLayer, uint8_t *dst)
+    {
+        auto &d = streams.data;
+        for (size_t i = 0; i < count; ++i)
+        {
+            Eigen::Affine3f local = Eigen::Translation3f(d[0][i], d[1][i], d[2][i]) * Eigen::Quaternionf(d[6][i], d[3][i], d[4][i], d[5][i]) *
+                                    Eigen::Scaling(d[7][i], d[8][i], d[9][i]);
+            Eigen::Matrix4f world = parent * local.matrix();
+            int32_t tail[4] = {textureLayer, 0, 0, 0};
+            memcpy(dst + i * TransformKernels::RecordSize, world.data(), sizeof(world));
+            memcpy(dst + i * TransformKernels::RecordSize + sizeof(world), tail, sizeof(tail));
+        }
+    }
+
+    template <typename F>
+    double BestMilliseconds(int repeat, F func)
+    {
+        double best = 1e30;
+        for (int r = 0; r < repeat; ++r)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            func();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        return best;
+    }
+
+    float MaxError(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b, size_t count)
+    {
+        float error = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto ma = (const float *)(a.data() + i * TransformKernels::RecordSize);
+            auto mb = (const float *)(b.data() + i * TransformKernels::RecordSize);
+            for (int e = 0; e < 16; ++e)
+                error = std::max(error, fabsf(ma[e] - mb[e]));
+            if (memcmp(ma + 16, mb + 16, 16) != 0)
+                return INFINITY;
+        }
+        return error;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t count = argc > 1 ? (size_t)atol(argv[1]) : 100000;
+    int repeat = argc > 2 ? atoi(argv[2]) : 20;
+    if (count == 0 || repeat <= 0)
+    {
+        printf("usage: transformbench [object count] [repeat]\n");
+        return 1;
+    }
+
+    Streams streams(count);
+    Eigen::Matrix4f parent = (Eigen::Translation3f(1, 2, 3) * Eigen::AngleAxisf(0.5f, Eigen::Vector3f(0, 1, 0).normalized())).matrix();
+    const int layer = 3;
+
+    std::vector<uint8_t> reference(count * TransformKernels::RecordSize);
+    std::vector<uint8_t> output(reference.size());
+
+    printf("%zu objects, best of %d runs\n", count, repeat);
+    double eigenTime = BestMilliseconds(repeat, [&]() { EigenLoop(parent, streams, count, layer, reference.data()); });
+    printf("  %-16s %9.3f ms\n", "eigen loop", eigenTime);
+
+    for (int i = 0; i < TransformISA_Count; ++i)
+    {
+        auto isa = (TransformISA)i;
+        if (!TransformKernels::IsSupported(isa))
+        {
+            printf("  %-16s unsupported\n", TransformKernels::GetISAName(isa));
+            continue;
+        }
+        memset(output.data(), 0, output.size());
+        double time = BestMilliseconds(repeat, [&]() { TransformKernels::Compose(parent, streams.soa, 0, count, layer, output.data(), isa); });
+        printf("  %-16s %9.3f ms  x%.2f  max error %g\n", TransformKernels::GetISAName(isa), time, eigenTime / time,
+               MaxError(reference, output, count));
+    }
+
+    memset(output.data(), 0, output.size());
+    double time = BestMilliseconds(repeat, [&]() { TransformKernels::ComposeParallel(parent, streams.soa, count, layer, output.data()); });
+    char name[32];
+    snprintf(name, sizeof(name), "parallel %s", TransformKernels::GetISAName(TransformKernels::GetBestISA()));
+    printf("  %-16s %9.3f ms  x%.2f  max error %g\n", name, time, eigenTime / time, MaxError(reference, output, count));
+    return 0;
+}